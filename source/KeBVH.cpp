@@ -0,0 +1,823 @@
+//
+//  KeBVH.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeBVH.h"
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/* Traversal stack that only touches the heap for unusually deep trees */
+template <class T> struct KeBVHStack
+{
+    KeBVHStack() : count(0) {}
+
+    void Push( const T& entry )
+    {
+        if( count < KE_BVH_STACK_SIZE )
+            fixed[count] = entry;
+        else
+            overflow.push_back( entry );
+        count++;
+    }
+
+    T Pop()
+    {
+        count--;
+        if( count < KE_BVH_STACK_SIZE )
+            return fixed[count];
+
+        T entry = overflow.back();
+        overflow.pop_back();
+        return entry;
+    }
+
+    bool Empty() { return count == 0; }
+
+    T                   fixed[KE_BVH_STACK_SIZE];
+    std::vector<T>      overflow;
+    int                 count;
+};
+
+/* Multi-view traversal stack entry */
+struct KeBVHViewEntry
+{
+    int         node;
+    uint32_t    partial;    /* Views the node's parent intersected */
+    uint32_t    inside;     /* Views the node's parent was entirely inside of */
+};
+
+/* Surface area heuristic for a box (half of the surface area, which is all that matters for comparisons) */
+static inline float KeBoxArea( const float* min, const float* max )
+{
+    float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+/* Surface area of the union of two nodes' boxes */
+static inline float KeUnionArea( const KeBVHNode* a, const KeBVHNode* b )
+{
+    float min[3], max[3];
+
+    for( int i = 0; i < 3; i++ )
+    {
+        min[i] = a->min[i] < b->min[i] ? a->min[i] : b->min[i];
+        max[i] = a->max[i] > b->max[i] ? a->max[i] : b->max[i];
+    }
+
+    return KeBoxArea( min, max );
+}
+
+/* Returns true if two boxes overlap */
+static inline bool KeBoxesOverlap( const float* min1, const float* max1, const float* min2, const float* max2 )
+{
+    return min1[0] <= max2[0] && max1[0] >= min2[0] &&
+           min1[1] <= max2[1] && max1[1] >= min2[1] &&
+           min1[2] <= max2[2] && max1[2] >= min2[2];
+}
+
+
+/*
+ * Name: KeBVH::KeBVH
+ * Desc: Default constructor.  Leaf boxes are grown by margin on every side.
+ */
+KeBVH::KeBVH( float margin ) : root(KE_BVH_NULL_NODE), free_list(KE_BVH_NULL_NODE), margin(margin), leaf_count(0),
+    rotations(0), reinserts(0)
+{
+}
+
+
+/*
+ * Name: KeBVH::~KeBVH
+ * Desc: Default deconstructor.
+ */
+KeBVH::~KeBVH()
+{
+}
+
+
+/*
+ * Name: KeBVH::Insert
+ * Desc: Adds an object with the given bounding box to the tree.  Returns a handle, which stays
+ *       valid until the object is removed.
+ */
+int KeBVH::Insert( const float* min, const float* max, void* user_data )
+{
+    if( !min || !max )
+    {
+        DISPDBG( KE_ERROR, "Invalid bounding box!" );
+        return KE_BVH_NULL_NODE;
+    }
+
+    int leaf = PVT_AllocateNode();
+
+    for( int i = 0; i < 3; i++ )
+    {
+        nodes[leaf].min[i] = min[i] - margin;
+        nodes[leaf].max[i] = max[i] + margin;
+    }
+    info[leaf].user_data = user_data;
+    info[leaf].height = 0;
+
+    PVT_InsertLeaf( leaf );
+    leaf_count++;
+
+    return leaf;
+}
+
+
+/*
+ * Name: KeBVH::Remove
+ * Desc: Removes an object from the tree.
+ */
+void KeBVH::Remove( int handle )
+{
+    if( handle < 0 || handle >= (int) nodes.size() || info[handle].height != 0 )
+        DISPDBG_R( KE_ERROR, "Invalid handle!" );
+
+    PVT_RemoveLeaf( handle );
+    PVT_FreeNode( handle );
+    leaf_count--;
+}
+
+
+/*
+ * Name: KeBVH::Update
+ * Desc: Updates the bounding box of an object.  Nothing changes while the new box is still
+ *       inside the fattened one; otherwise the leaf is taken out of the tree and reinserted,
+ *       and true is returned.
+ */
+bool KeBVH::Update( int handle, const float* min, const float* max )
+{
+    if( handle < 0 || handle >= (int) nodes.size() || info[handle].height != 0 )
+        DISPDBG_RB( KE_ERROR, "Invalid handle!" );
+
+    KeBVHNode* n = &nodes[handle];
+    if( n->min[0] <= min[0] && n->min[1] <= min[1] && n->min[2] <= min[2] &&
+        n->max[0] >= max[0] && n->max[1] >= max[1] && n->max[2] >= max[2] )
+        return false;
+
+    PVT_RemoveLeaf( handle );
+
+    for( int i = 0; i < 3; i++ )
+    {
+        nodes[handle].min[i] = min[i] - margin;
+        nodes[handle].max[i] = max[i] + margin;
+    }
+
+    PVT_InsertLeaf( handle );
+    reinserts++;
+
+    return true;
+}
+
+
+/*
+ * Name: KeBVH::Clear
+ * Desc: Removes every object from the tree.  All handles become invalid.
+ */
+void KeBVH::Clear()
+{
+    nodes.clear();
+    info.clear();
+    root = KE_BVH_NULL_NODE;
+    free_list = KE_BVH_NULL_NODE;
+    leaf_count = 0;
+}
+
+
+/*
+ * Name: KeBVH::QueryAABB
+ * Desc: Calls proc for every object whose fattened box overlaps the given box.
+ */
+void KeBVH::QueryAABB( const float* min, const float* max, KeBVHQueryProc proc, void* context ) const
+{
+    if( root == KE_BVH_NULL_NODE )
+        return;
+
+    KeBVHStack<int> stack;
+    stack.Push( root );
+
+    while( !stack.Empty() )
+    {
+        int index = stack.Pop();
+        const KeBVHNode* n = &nodes[index];
+
+        if( !KeBoxesOverlap( n->min, n->max, min, max ) )
+            continue;
+
+        if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            if( !proc( index, info[index].user_data, context ) )
+                return;
+        }
+        else
+        {
+            stack.Push( n->child1 );
+            stack.Push( n->child2 );
+        }
+    }
+}
+
+
+/*
+ * Name: KeBVH::QuerySphere
+ * Desc: Calls proc for every object whose fattened box overlaps the given sphere.
+ */
+void KeBVH::QuerySphere( const float* centre, float radius, KeBVHQueryProc proc, void* context ) const
+{
+    if( root == KE_BVH_NULL_NODE )
+        return;
+
+    float radius_sq = radius * radius;
+    KeBVHStack<int> stack;
+    stack.Push( root );
+
+    while( !stack.Empty() )
+    {
+        int index = stack.Pop();
+        const KeBVHNode* n = &nodes[index];
+
+        /* Squared distance from the centre to the closest point of the box */
+        float d = 0;
+        for( int i = 0; i < 3; i++ )
+        {
+            float e = centre[i] < n->min[i] ? n->min[i] - centre[i] : centre[i] > n->max[i] ? centre[i] - n->max[i] : 0.0f;
+            d += e * e;
+        }
+
+        if( d > radius_sq )
+            continue;
+
+        if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            if( !proc( index, info[index].user_data, context ) )
+                return;
+        }
+        else
+        {
+            stack.Push( n->child1 );
+            stack.Push( n->child2 );
+        }
+    }
+}
+
+
+/*
+ * Name: KeBVH::QueryFrustum
+ * Desc: Calls proc for every object whose fattened box is at least partly inside the frustum.
+ *       Subtrees outside any plane are rejected as a whole, and subtrees entirely inside the
+ *       frustum are accepted as a whole; otherwise, children are only tested against the
+ *       planes their parent intersected.
+ */
+void KeBVH::QueryFrustum( const KeFrustumPlanes* frustum, KeBVHQueryProc proc, void* context ) const
+{
+    if( root == KE_BVH_NULL_NODE )
+        return;
+
+    const float (*f)[4] = frustum->planes;
+    KeBVHStack<int> stack;
+
+    /* Stack entries are the node index and the mask of planes left to test */
+    stack.Push( ( root << 6 ) | 0x3F );
+
+    while( !stack.Empty() )
+    {
+        int entry = stack.Pop();
+        int index = entry >> 6;
+        int mask = entry & 0x3F;
+        const KeBVHNode* n = &nodes[index];
+        bool outside = false;
+
+        for( int p = 0; p < 6; p++ )
+        {
+            if( !( mask & ( 1 << p ) ) )
+                continue;
+
+            float cx = ( n->min[0] + n->max[0] ) * 0.5f, ex = ( n->max[0] - n->min[0] ) * 0.5f;
+            float cy = ( n->min[1] + n->max[1] ) * 0.5f, ey = ( n->max[1] - n->min[1] ) * 0.5f;
+            float cz = ( n->min[2] + n->max[2] ) * 0.5f, ez = ( n->max[2] - n->min[2] ) * 0.5f;
+            float d = f[p][0] * cx + f[p][1] * cy + f[p][2] * cz + f[p][3];
+            float e = fabsf( f[p][0] ) * ex + fabsf( f[p][1] ) * ey + fabsf( f[p][2] ) * ez;
+
+            if( d + e <= 0 )
+            {
+                outside = true;
+                break;
+            }
+            if( d - e > 0 )
+                mask &= ~( 1 << p );
+        }
+
+        if( outside )
+            continue;
+
+        if( mask == 0 )
+        {
+            if( !PVT_ReportSubtree( index, proc, context ) )
+                return;
+        }
+        else if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            if( !proc( index, info[index].user_data, context ) )
+                return;
+        }
+        else
+        {
+            stack.Push( ( n->child1 << 6 ) | mask );
+            stack.Push( ( n->child2 << 6 ) | mask );
+        }
+    }
+}
+
+
+/*
+ * Name: KeBVH::QueryFrusta
+ * Desc: Culls the tree against several frusta (shadow cascades, split screen views, etc.) in a
+ *       single traversal, calling proc once for every object visible in at least one of them
+ *       with a mask of the views it is visible in.  Each subtree is only tested against the
+ *       views its parent intersected, and is accepted as a whole once it is entirely inside
+ *       or outside of every view.
+ */
+void KeBVH::QueryFrusta( const KeFrustumPlanes* frusta, int view_count, KeBVHViewQueryProc proc, void* context ) const
+{
+    if( root == KE_BVH_NULL_NODE || view_count <= 0 )
+        return;
+
+    if( view_count > KE_MAX_CULL_VIEWS )
+    {
+        DISPDBG( KE_WARNING, "Only the first " << KE_MAX_CULL_VIEWS << " views are culled!" );
+        view_count = KE_MAX_CULL_VIEWS;
+    }
+
+    KeBVHStack<KeBVHViewEntry> stack;
+    KeBVHViewEntry entry;
+    entry.node = root;
+    entry.partial = view_count == 32 ? 0xFFFFFFFF : ( 1u << view_count ) - 1;
+    entry.inside = 0;
+    stack.Push( entry );
+
+    while( !stack.Empty() )
+    {
+        entry = stack.Pop();
+        const KeBVHNode* n = &nodes[entry.node];
+
+        float cx = ( n->min[0] + n->max[0] ) * 0.5f, ex = ( n->max[0] - n->min[0] ) * 0.5f;
+        float cy = ( n->min[1] + n->max[1] ) * 0.5f, ey = ( n->max[1] - n->min[1] ) * 0.5f;
+        float cz = ( n->min[2] + n->max[2] ) * 0.5f, ez = ( n->max[2] - n->min[2] ) * 0.5f;
+
+        /* Sort the views the parent intersected into outside, inside and still intersecting */
+        uint32_t partial = 0;
+        for( int v = 0; v < view_count; v++ )
+        {
+            if( !( entry.partial & ( 1u << v ) ) )
+                continue;
+
+            const float (*f)[4] = frusta[v].planes;
+            int planes_inside = 0;
+            int outside = No;
+
+            for( int p = 0; p < 6; p++ )
+            {
+                float d = f[p][0] * cx + f[p][1] * cy + f[p][2] * cz + f[p][3];
+                float e = fabsf( f[p][0] ) * ex + fabsf( f[p][1] ) * ey + fabsf( f[p][2] ) * ez;
+
+                if( d + e <= 0 )
+                {
+                    outside = Yes;
+                    break;
+                }
+                if( d - e > 0 )
+                    planes_inside++;
+            }
+
+            if( outside )
+                continue;
+            if( planes_inside == 6 )
+                entry.inside |= 1u << v;
+            else
+                partial |= 1u << v;
+        }
+
+        if( !partial && !entry.inside )
+            continue;
+
+        if( !partial )
+        {
+            if( !PVT_ReportSubtree( entry.node, entry.inside, proc, context ) )
+                return;
+        }
+        else if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            if( !proc( entry.node, info[entry.node].user_data, partial | entry.inside, context ) )
+                return;
+        }
+        else
+        {
+            KeBVHViewEntry child;
+            child.partial = partial;
+            child.inside = entry.inside;
+            child.node = n->child1;
+            stack.Push( child );
+            child.node = n->child2;
+            stack.Push( child );
+        }
+    }
+}
+
+
+/*
+ * Name: KeBVH::RayCast
+ * Desc: Calls proc for every object whose fattened box is hit by the ray within max_distance.
+ *       The direction doesn't need to be normalized; distances are in multiples of it.
+ */
+void KeBVH::RayCast( const float* origin, const float* direction, float max_distance, KeBVHRayCastProc proc, void* context ) const
+{
+    if( root == KE_BVH_NULL_NODE )
+        return;
+
+    float inv_dir[3];
+    for( int i = 0; i < 3; i++ )
+        inv_dir[i] = direction[i] != 0.0f ? 1.0f / direction[i] : ( direction[i] < 0.0f ? -FLT_MAX : FLT_MAX );
+
+    KeBVHStack<int> stack;
+    stack.Push( root );
+
+    while( !stack.Empty() )
+    {
+        int index = stack.Pop();
+        const KeBVHNode* n = &nodes[index];
+
+        /* Slab test */
+        float t_min = 0.0f, t_max = max_distance;
+        for( int i = 0; i < 3 && t_min <= t_max; i++ )
+        {
+            float t1 = ( n->min[i] - origin[i] ) * inv_dir[i];
+            float t2 = ( n->max[i] - origin[i] ) * inv_dir[i];
+            if( t1 > t2 )
+            {
+                float t = t1;
+                t1 = t2;
+                t2 = t;
+            }
+            t_min = t1 > t_min ? t1 : t_min;
+            t_max = t2 < t_max ? t2 : t_max;
+        }
+
+        if( t_min > t_max )
+            continue;
+
+        if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            float distance = proc( index, info[index].user_data, origin, direction, max_distance, context );
+            if( distance <= 0.0f )
+                return;
+            max_distance = distance < max_distance ? distance : max_distance;
+        }
+        else
+        {
+            stack.Push( n->child1 );
+            stack.Push( n->child2 );
+        }
+    }
+}
+
+
+/*
+ * Name: KeBVH::GetUserData
+ * Desc: Returns the user data an object was inserted with.
+ */
+void* KeBVH::GetUserData( int handle ) const
+{
+    if( handle < 0 || handle >= (int) nodes.size() )
+        return NULL;
+
+    return info[handle].user_data;
+}
+
+
+/*
+ * Name: KeBVH::GetFatBounds
+ * Desc: Returns the fattened bounding box of an object.
+ */
+void KeBVH::GetFatBounds( int handle, float* min, float* max ) const
+{
+    if( handle < 0 || handle >= (int) nodes.size() )
+        return;
+
+    memmove( min, nodes[handle].min, sizeof( float ) * 3 );
+    memmove( max, nodes[handle].max, sizeof( float ) * 3 );
+}
+
+
+/*
+ * Name: KeBVH::GetStats
+ * Desc: Returns the size and quality of the tree.
+ */
+void KeBVH::GetStats( KeBVHStats* stats ) const
+{
+    ZeroMemory( stats, sizeof( KeBVHStats ) );
+    stats->leaves = leaf_count;
+    stats->rotations = rotations;
+    stats->reinserts = reinserts;
+
+    if( root == KE_BVH_NULL_NODE )
+        return;
+
+    stats->height = info[root].height;
+
+    float root_area = KeBoxArea( nodes[root].min, nodes[root].max );
+    float total_area = 0;
+
+    for( size_t i = 0; i < nodes.size(); i++ )
+    {
+        if( info[i].height < 0 )
+            continue;
+
+        stats->nodes++;
+        if( info[i].height > 0 )
+            total_area += KeBoxArea( nodes[i].min, nodes[i].max );
+    }
+
+    stats->sah_cost = root_area > 0 ? total_area / root_area : 0;
+}
+
+
+/* Takes a node from the free list, or adds a new one */
+int KeBVH::PVT_AllocateNode()
+{
+    int node;
+
+    if( free_list != KE_BVH_NULL_NODE )
+    {
+        node = free_list;
+        free_list = info[node].parent;
+    }
+    else
+    {
+        node = (int) nodes.size();
+        nodes.push_back( KeBVHNode() );
+        info.push_back( KeBVHNodeInfo() );
+    }
+
+    nodes[node].child1 = KE_BVH_NULL_NODE;
+    nodes[node].child2 = KE_BVH_NULL_NODE;
+    info[node].parent = KE_BVH_NULL_NODE;
+    info[node].height = 0;
+    info[node].user_data = NULL;
+
+    return node;
+}
+
+/* Returns a node to the free list */
+void KeBVH::PVT_FreeNode( int node )
+{
+    info[node].parent = free_list;
+    info[node].height = -1;
+    free_list = node;
+}
+
+/* Links a leaf into the tree next to the sibling that adds the least surface area */
+void KeBVH::PVT_InsertLeaf( int leaf )
+{
+    if( root == KE_BVH_NULL_NODE )
+    {
+        root = leaf;
+        info[leaf].parent = KE_BVH_NULL_NODE;
+        return;
+    }
+
+    /* Walk down the tree, stopping once pairing with the current node is cheaper than the
+       least the insertion could cost further down */
+    const KeBVHNode* l = &nodes[leaf];
+    int index = root;
+
+    while( nodes[index].child1 != KE_BVH_NULL_NODE )
+    {
+        const KeBVHNode* n = &nodes[index];
+        float area = KeBoxArea( n->min, n->max );
+        float combined_area = KeUnionArea( n, l );
+
+        /* Cost of a new parent for this node and the leaf, and the cost pushed onto every node below */
+        float cost = 2.0f * combined_area;
+        float inheritance_cost = 2.0f * ( combined_area - area );
+
+        float cost1 = KeUnionArea( &nodes[n->child1], l ) + inheritance_cost;
+        if( nodes[n->child1].child1 != KE_BVH_NULL_NODE )
+            cost1 -= KeBoxArea( nodes[n->child1].min, nodes[n->child1].max );
+
+        float cost2 = KeUnionArea( &nodes[n->child2], l ) + inheritance_cost;
+        if( nodes[n->child2].child1 != KE_BVH_NULL_NODE )
+            cost2 -= KeBoxArea( nodes[n->child2].min, nodes[n->child2].max );
+
+        if( cost < cost1 && cost < cost2 )
+            break;
+
+        index = cost1 < cost2 ? n->child1 : n->child2;
+    }
+
+    /* Create a new parent for the sibling and the leaf (the allocation may move the nodes) */
+    int sibling = index;
+    int old_parent = info[sibling].parent;
+    int new_parent = PVT_AllocateNode();
+
+    info[new_parent].parent = old_parent;
+    nodes[new_parent].child1 = sibling;
+    nodes[new_parent].child2 = leaf;
+    info[sibling].parent = new_parent;
+    info[leaf].parent = new_parent;
+
+    if( old_parent == KE_BVH_NULL_NODE )
+        root = new_parent;
+    else if( nodes[old_parent].child1 == sibling )
+        nodes[old_parent].child1 = new_parent;
+    else
+        nodes[old_parent].child2 = new_parent;
+
+    PVT_Refit( new_parent );
+}
+
+/* Unlinks a leaf from the tree (the leaf itself is kept) */
+void KeBVH::PVT_RemoveLeaf( int leaf )
+{
+    if( leaf == root )
+    {
+        root = KE_BVH_NULL_NODE;
+        return;
+    }
+
+    int parent = info[leaf].parent;
+    int grand_parent = info[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    /* The sibling takes the parent's place */
+    if( grand_parent == KE_BVH_NULL_NODE )
+    {
+        root = sibling;
+        info[sibling].parent = KE_BVH_NULL_NODE;
+    }
+    else
+    {
+        if( nodes[grand_parent].child1 == parent )
+            nodes[grand_parent].child1 = sibling;
+        else
+            nodes[grand_parent].child2 = sibling;
+        info[sibling].parent = grand_parent;
+
+        PVT_Refit( grand_parent );
+    }
+
+    PVT_FreeNode( parent );
+    info[leaf].parent = KE_BVH_NULL_NODE;
+}
+
+/* Refits the boxes from a node up to the root, rotating where it reduces the surface area */
+void KeBVH::PVT_Refit( int node )
+{
+    while( node != KE_BVH_NULL_NODE )
+    {
+        PVT_UpdateNode( node );
+        PVT_Rotate( node );
+        node = info[node].parent;
+    }
+}
+
+/* Swaps one of a node's children with one of its grandchildren on the other side, if that
+   reduces the surface area of the child that changes (the node's own box stays the same) */
+void KeBVH::PVT_Rotate( int node )
+{
+    int b = nodes[node].child1;
+    int c = nodes[node].child2;
+
+    if( nodes[b].child1 == KE_BVH_NULL_NODE && nodes[c].child1 == KE_BVH_NULL_NODE )
+        return;
+
+    /* Candidate rotations: 0 = B<->F, 1 = B<->G, 2 = C<->D, 3 = C<->E, where D/E are B's children
+       and F/G are C's */
+    float best_saving = 0.0f;
+    int best = -1;
+
+    if( nodes[c].child1 != KE_BVH_NULL_NODE )
+    {
+        float area = KeBoxArea( nodes[c].min, nodes[c].max );
+        float saving_f = area - KeUnionArea( &nodes[b], &nodes[nodes[c].child2] );
+        float saving_g = area - KeUnionArea( &nodes[b], &nodes[nodes[c].child1] );
+
+        if( saving_f > best_saving ) { best_saving = saving_f; best = 0; }
+        if( saving_g > best_saving ) { best_saving = saving_g; best = 1; }
+    }
+
+    if( nodes[b].child1 != KE_BVH_NULL_NODE )
+    {
+        float area = KeBoxArea( nodes[b].min, nodes[b].max );
+        float saving_d = area - KeUnionArea( &nodes[c], &nodes[nodes[b].child2] );
+        float saving_e = area - KeUnionArea( &nodes[c], &nodes[nodes[b].child1] );
+
+        if( saving_d > best_saving ) { best_saving = saving_d; best = 2; }
+        if( saving_e > best_saving ) { best_saving = saving_e; best = 3; }
+    }
+
+    if( best == -1 )
+        return;
+
+    /* Swap the child (on one side) with the grandchild (on the other) */
+    int child = best < 2 ? b : c;
+    int other = best < 2 ? c : b;
+    int grand_child = ( best & 1 ) ? nodes[other].child2 : nodes[other].child1;
+
+    if( nodes[node].child1 == child )
+        nodes[node].child1 = grand_child;
+    else
+        nodes[node].child2 = grand_child;
+
+    if( nodes[other].child1 == grand_child )
+        nodes[other].child1 = child;
+    else
+        nodes[other].child2 = child;
+
+    info[grand_child].parent = node;
+    info[child].parent = other;
+
+    PVT_UpdateNode( other );
+    PVT_UpdateNode( node );
+    rotations++;
+}
+
+/* Recomputes an internal node's box and height from its children */
+void KeBVH::PVT_UpdateNode( int node )
+{
+    KeBVHNode* n = &nodes[node];
+    const KeBVHNode* c1 = &nodes[n->child1];
+    const KeBVHNode* c2 = &nodes[n->child2];
+
+    for( int i = 0; i < 3; i++ )
+    {
+        n->min[i] = c1->min[i] < c2->min[i] ? c1->min[i] : c2->min[i];
+        n->max[i] = c1->max[i] > c2->max[i] ? c1->max[i] : c2->max[i];
+    }
+
+    int h1 = info[n->child1].height, h2 = info[n->child2].height;
+    info[node].height = 1 + ( h1 > h2 ? h1 : h2 );
+}
+
+/* Calls proc for every leaf below a node without any further tests */
+bool KeBVH::PVT_ReportSubtree( int node, KeBVHQueryProc proc, void* context ) const
+{
+    KeBVHStack<int> stack;
+    stack.Push( node );
+
+    while( !stack.Empty() )
+    {
+        int index = stack.Pop();
+        const KeBVHNode* n = &nodes[index];
+
+        if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            if( !proc( index, info[index].user_data, context ) )
+                return false;
+        }
+        else
+        {
+            stack.Push( n->child1 );
+            stack.Push( n->child2 );
+        }
+    }
+
+    return true;
+}
+
+/* Calls proc for every leaf below a node with the same view mask, without any further tests */
+bool KeBVH::PVT_ReportSubtree( int node, uint32_t view_mask, KeBVHViewQueryProc proc, void* context ) const
+{
+    KeBVHStack<int> stack;
+    stack.Push( node );
+
+    while( !stack.Empty() )
+    {
+        int index = stack.Pop();
+        const KeBVHNode* n = &nodes[index];
+
+        if( n->child1 == KE_BVH_NULL_NODE )
+        {
+            if( !proc( index, info[index].user_data, view_mask, context ) )
+                return false;
+        }
+        else
+        {
+            stack.Push( n->child1 );
+            stack.Push( n->child2 );
+        }
+    }
+
+    return true;
+}
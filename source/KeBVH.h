@@ -0,0 +1,118 @@
+//
+//  KeBVH.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeBVH__
+#define __KeBVH__
+
+#include <vector>
+#include "NV/NvMath.h"
+#include "KeFrustum.h"
+
+
+/*
+ * BVH defaults
+ */
+#define KE_BVH_NULL_NODE        -1
+#define KE_BVH_DEFAULT_MARGIN   0.1f    /* Leaf boxes are fattened by this much, so small movements don't touch the tree */
+#define KE_BVH_STACK_SIZE       64      /* Traversal stack entries kept on the stack (deeper trees spill to the heap) */
+
+
+/*
+ * Query callbacks.  Return false from a query callback to stop the query.  Ray cast callbacks
+ * return the distance to clip the ray to (max_distance to carry on unchanged, 0 to stop).
+ * Multi-view callbacks receive a mask with bit v set for each view the object is visible in.
+ */
+typedef bool (*KeBVHQueryProc)( int handle, void* user_data, void* context );
+typedef float (*KeBVHRayCastProc)( int handle, void* user_data, const float* origin, const float* direction, float max_distance, void* context );
+typedef bool (*KeBVHViewQueryProc)( int handle, void* user_data, uint32_t view_mask, void* context );
+
+/*
+ * BVH node (the data touched by queries, two per cache line)
+ */
+struct KeBVHNode
+{
+    float   min[3];
+    int     child1;         /* KE_BVH_NULL_NODE for leaves */
+    float   max[3];
+    int     child2;
+};
+
+/*
+ * BVH node bookkeeping (only touched when the tree changes)
+ */
+struct KeBVHNodeInfo
+{
+    int     parent;         /* Next free node while not in use */
+    int     height;         /* 0 for leaves, -1 while not in use */
+    void*   user_data;
+};
+
+/*
+ * BVH statistics
+ */
+struct KeBVHStats
+{
+    uint32_t    leaves;
+    uint32_t    nodes;
+    int         height;
+    float       sah_cost;       /* Total surface area of the internal nodes relative to the root's */
+    uint32_t    rotations;      /* Since the tree was created */
+    uint32_t    reinserts;      /* Updates that left the fattened box (since the tree was created) */
+};
+
+
+/* Dynamic bounding volume hierarchy (AABB tree).  Objects are inserted as leaves with a
+   fattened bounding box, and Update only touches the tree once an object leaves it.  Leaves
+   are inserted next to the sibling that adds the least surface area, and each node that is
+   refitted afterwards tries the rotations that reduce its surface area the most, which keeps
+   the tree's SAH cost low without ever rebuilding it.  Queries may run on several threads at
+   once, but not at the same time as Insert, Remove or Update. */
+class KeBVH
+{
+public:
+    KeBVH( float margin = KE_BVH_DEFAULT_MARGIN );
+    virtual ~KeBVH();
+
+public:
+    int Insert( const float* min, const float* max, void* user_data );
+    void Remove( int handle );
+    bool Update( int handle, const float* min, const float* max );
+    void Clear();
+
+    void QueryAABB( const float* min, const float* max, KeBVHQueryProc proc, void* context ) const;
+    void QuerySphere( const float* centre, float radius, KeBVHQueryProc proc, void* context ) const;
+    void QueryFrustum( const KeFrustumPlanes* frustum, KeBVHQueryProc proc, void* context ) const;
+    void QueryFrusta( const KeFrustumPlanes* frusta, int view_count, KeBVHViewQueryProc proc, void* context ) const;
+    void RayCast( const float* origin, const float* direction, float max_distance, KeBVHRayCastProc proc, void* context ) const;
+
+    void* GetUserData( int handle ) const;
+    void GetFatBounds( int handle, float* min, float* max ) const;
+    void GetStats( KeBVHStats* stats ) const;
+
+protected:
+    int PVT_AllocateNode();
+    void PVT_FreeNode( int node );
+    void PVT_InsertLeaf( int leaf );
+    void PVT_RemoveLeaf( int leaf );
+    void PVT_Refit( int node );
+    void PVT_Rotate( int node );
+    void PVT_UpdateNode( int node );
+    bool PVT_ReportSubtree( int node, KeBVHQueryProc proc, void* context ) const;
+    bool PVT_ReportSubtree( int node, uint32_t view_mask, KeBVHViewQueryProc proc, void* context ) const;
+
+protected:
+    std::vector<KeBVHNode>      nodes;      /* Indexed by node (leaf nodes are the handles) */
+    std::vector<KeBVHNodeInfo>  info;
+    int                         root;
+    int                         free_list;
+    float                       margin;
+    uint32_t                    leaf_count;
+    uint32_t                    rotations;
+    uint32_t                    reinserts;
+};
+
+#endif /* defined(__KeBVH__) */
@@ -77,6 +77,18 @@ bool IKeDirect3D11GeometryBuffer::SetIndexData( uint32_t offset, uint32_t size,
     return true;
 }
 
+bool IKeDirect3D11GeometryBuffer::CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+    return false;
+}
+
+bool IKeDirect3D11GeometryBuffer::CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+    return false;
+}
+
 void IKeDirect3D11GeometryBuffer::GetDesc( KeGeometryBufferDesc* desc )
 {
 	if( desc )
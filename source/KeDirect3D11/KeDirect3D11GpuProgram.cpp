@@ -35,6 +35,15 @@ void IKeDirect3D11GpuProgram::Destroy()
     delete this;
 }
 
+/*
+ * Name: IKeDirect3D11GpuProgram::IsReady
+ * Desc: Direct3D programs are always built synchronously.
+ */
+bool IKeDirect3D11GpuProgram::IsReady()
+{
+	return true;
+}
+
 /*
  * Name: IKeDirect3D11GpuProgram::GetVertexAttributes
  * Desc: 
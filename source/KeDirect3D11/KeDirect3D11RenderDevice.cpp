@@ -182,6 +182,18 @@ DXGI_FORMAT texture_formats[] =
 	DXGI_FORMAT_B8G8R8A8_UNORM
 };
 
+/* Direct3D compressed texture formats (ETC2/EAC and ASTC are not supported) */
+DXGI_FORMAT compressed_texture_formats[] =
+{
+	DXGI_FORMAT_BC1_UNORM,
+	DXGI_FORMAT_BC2_UNORM,
+	DXGI_FORMAT_BC3_UNORM,
+	DXGI_FORMAT_BC4_UNORM,
+	DXGI_FORMAT_BC5_UNORM,
+	DXGI_FORMAT_BC6H_UF16,
+	DXGI_FORMAT_BC7_UNORM
+};
+
 #if 0
 
 /* OpenGL texture targets */
@@ -743,6 +755,7 @@ IKeDirect3D11RenderDevice::IKeDirect3D11RenderDevice( KeRenderDeviceDesc* render
 {
 	/* Until we are finished initializing, mark this flag as false */
 	initialized = false;
+	device_caps = NULL;
 
 	/* Sanity checks */
 	if( !renderdevice_desc )
@@ -802,6 +815,18 @@ IKeDirect3D11RenderDevice::IKeDirect3D11RenderDevice( KeRenderDeviceDesc* render
 	current_vertexattribute[0].offset = 0;
 	current_vertexattribute[1].index = -1;
 
+	/* Fill out the device capabilities we currently check for */
+	device_caps = new KeRenderDeviceCaps;
+	ZeroMemory( device_caps, sizeof( KeRenderDeviceCaps ) );
+	device_caps->instancing_supported = Yes;
+	device_caps->base_vertex_supported = Yes;
+	device_caps->half_float_vertices_supported = Yes;
+	device_caps->packed_vertices_supported = No;	/* No signed 10:10:10:2 format */
+
+	/* Limit how far ahead of the GPU we can queue frames */
+	max_frame_latency = 0;
+	SetMaxFrameLatency( KE_DEFAULT_FRAME_LATENCY );
+
 	/* Nullify current geometry buffer */
 	current_geometrybuffer = NULL;
 
@@ -820,6 +845,7 @@ IKeDirect3D11RenderDevice::IKeDirect3D11RenderDevice( KeRenderDeviceDesc* render
 IKeDirect3D11RenderDevice::~IKeDirect3D11RenderDevice()
 {
 	delete device_desc;
+	delete device_caps;
 
 	/* Uninitialize and close Direct3D and SDL video */
 	
@@ -1289,6 +1315,18 @@ bool IKeDirect3D11RenderDevice::CreateProgram( const char* vertex_shader, const
 				fmt = DXGI_FORMAT_R32G32B32_FLOAT;
 			if( vertex_attributes[i].type == KE_FLOAT && vertex_attributes[i].size == 4 ) 
 				fmt = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			if( vertex_attributes[i].type == KE_HALF_FLOAT && vertex_attributes[i].size == 2 )
+				fmt = DXGI_FORMAT_R16G16_FLOAT;
+			if( vertex_attributes[i].type == KE_HALF_FLOAT && vertex_attributes[i].size == 4 )
+				fmt = DXGI_FORMAT_R16G16B16A16_FLOAT;
+			if( vertex_attributes[i].type == KE_SHORT && vertex_attributes[i].size == 2 )
+				fmt = vertex_attributes[i].normalize ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R16G16_SINT;
+			if( vertex_attributes[i].type == KE_SHORT && vertex_attributes[i].size == 4 )
+				fmt = vertex_attributes[i].normalize ? DXGI_FORMAT_R16G16B16A16_SNORM : DXGI_FORMAT_R16G16B16A16_SINT;
+			if( vertex_attributes[i].type == KE_UNSIGNED_SHORT && vertex_attributes[i].size == 2 )
+				fmt = vertex_attributes[i].normalize ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R16G16_UINT;
+			if( vertex_attributes[i].type == KE_UNSIGNED_INT_2_10_10_10_REV )
+				fmt = vertex_attributes[i].normalize ? DXGI_FORMAT_R10G10B10A2_UNORM : DXGI_FORMAT_R10G10B10A2_UINT;
 
 			if( !strcmp( "POSITION", semantic_list[vertex_attributes[i].index].name ) )
 				layout[i].SemanticName = "POSITION";
@@ -1411,6 +1449,42 @@ void IKeDirect3D11RenderDevice::DeleteProgram( IKeGpuProgram* gpu_program )
 	}
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::CreateProgramAsync
+* Desc: Creates a GPU program.  For now, programs are always created synchronously.
+*/
+bool IKeDirect3D11RenderDevice::CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+{
+	return CreateProgram( vertex_shader, fragment_shader, geometry_shader, tesselation_shader, vertex_attributes, gpu_program );
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::SetFallbackProgram
+* Desc: Sets the program used in place of programs that aren't ready.  Unused, since Direct3D
+*		programs are always ready.
+*/
+void IKeDirect3D11RenderDevice::SetFallbackProgram( IKeGpuProgram* gpu_program )
+{
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::SetProgramCachePath
+* Desc: Enables the on-disk program binary cache.
+*/
+void IKeDirect3D11RenderDevice::SetProgramCachePath( const char* path )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::GetProgramCacheStats
+* Desc: Returns the program cache's hit/miss statistics.
+*/
+void IKeDirect3D11RenderDevice::GetProgramCacheStats( KeProgramCacheStats* stats )
+{
+	ZeroMemory( stats, sizeof( KeProgramCacheStats ) );
+}
+
 /*
 * Name: IKeDirect3D11RenderDevice::set_program
 * Desc: Sets the GPU program.  If NULL, the GPU program is set to 0.
@@ -1623,6 +1697,17 @@ void IKeDirect3D11RenderDevice::SetConstantBuffer(  int slot, int shader_type, I
 	}
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::SetTransientConstants
+* Desc: Writes a block of constants into this frame's region of the constant ring.
+*/
+bool IKeDirect3D11RenderDevice::SetTransientConstants( int slot, void* data, uint32_t size )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+
+	return false;
+}
+
 /*
 * Name: IKeDirect3D11RenderDevice::create_texture_1d
 * Desc: Creates a 1D texture.
@@ -1658,7 +1743,7 @@ bool IKeDirect3D11RenderDevice::CreateTexture2D( uint32_t target, int width, int
 	ZeroMemory( &desc, sizeof( desc ) );
 	desc.Width = width;
 	desc.Height = height;
-	desc.MipLevels = mipmaps;
+	desc.MipLevels = 1;	/* Dynamic textures are limited to a single level; TODO: honour mipmaps */
 	desc.ArraySize = 1;  /* TODO */
 	desc.Format = texture_formats[format];
 	desc.SampleDesc.Count = 1;
@@ -1716,6 +1801,65 @@ bool IKeDirect3D11RenderDevice::CreateTexture3D( uint32_t target, int width, int
 	return true;
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::CreateCompressedTexture2D
+* Desc: Creates a 2D texture from pre-compressed block data.  Only the BC formats are supported.
+*/
+bool IKeDirect3D11RenderDevice::CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture )
+{
+	D3D11_SUBRESOURCE_DATA data[16];
+
+	/* Sanity checks */
+	if( format < KE_TEXTUREFORMAT_BC1 || format > KE_TEXTUREFORMAT_BC7 )
+		DISPDBG_RB( KE_ERROR, "Compressed texture format (" << format << ") is not supported by this device!" );
+
+	if( !mip_data || !mip_sizes || mip_count < 1 || mip_count > 16 )
+		DISPDBG_RB( KE_ERROR, "Invalid parameter(s)!" );
+
+	/* Fill in the data for each mip level; rows are 4 texels tall */
+	int block_size = ( format == KE_TEXTUREFORMAT_BC1 || format == KE_TEXTUREFORMAT_BC4 ) ? 8 : 16;
+
+	for( int i = 0; i < mip_count; i++ )
+	{
+		int w = width >> i;
+		if( !w ) w = 1;
+
+		data[i].pSysMem = mip_data[i];
+		data[i].SysMemPitch = ( ( w + 3 ) / 4 ) * block_size;
+		data[i].SysMemSlicePitch = mip_sizes[i];
+	}
+
+	/* Allocate a new texture */
+	(*texture) = new IKeDirect3D11Texture;
+	IKeDirect3D11Texture* t = static_cast<IKeDirect3D11Texture*>(*texture);
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory( &desc, sizeof( desc ) );
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = mip_count;
+	desc.ArraySize = 1;
+	desc.Format = compressed_texture_formats[format - KE_TEXTUREFORMAT_BC1];
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	HRESULT hr = d3ddevice->CreateTexture2D( &desc, data, &t->tex2d );
+	D3D_DISPDBG_RB( KE_ERROR, "Error creating compressed 2D texture!", hr );
+
+	/* Set texture attributes */
+	t->width = width;
+	t->height = height;
+	t->target = target;
+	t->data_type = 0;
+	t->depth_format = desc.Format;
+	t->internal_format = desc.Format;
+
+	return true;
+}
+
 /*
 * Name: IKeDirect3D11RenderDevice::delete_texture
 * Desc: Deletes a texture from memory.
@@ -1758,6 +1902,25 @@ void IKeDirect3D11RenderDevice::SetTextureData3D( int offsetx, int offsety, int
 	IKeDirect3D11Texture* t = static_cast<IKeDirect3D11Texture*>(texture);
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::SetTextureData2DAsync
+* Desc: Uploads texture data without stalling.  For now, this simply uploads synchronously.
+*/
+bool IKeDirect3D11RenderDevice::SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture )
+{
+	SetTextureData2D( offsetx, offsety, width, height, miplevel, pixels, texture );
+	return true;
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::SetTextureMipRange
+* Desc: Limits sampling of a texture to the given range of mipmap levels.
+*/
+void IKeDirect3D11RenderDevice::SetTextureMipRange( IKeTexture* texture, int base_level, int max_level )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+}
+
 /*
 * Name: IKeDirect3D11RenderDevice::create_render_target
 * Desc: Creates a seperate render target (FBO), typically used for rendering to a texture.
@@ -1961,6 +2124,11 @@ bool IKeDirect3D11RenderDevice::CreateRenderStateBuffer( KeState* state_params,
 			depth_stencil_desc.DepthWriteMask = (D3D11_DEPTH_WRITE_MASK)state_params[i].param1;
 			break;
 
+		case KE_RS_COLOURMASK:
+			use_blend = true;
+			blend_desc.RenderTarget[0].RenderTargetWriteMask = state_params[i].param1 ? D3D11_COLOR_WRITE_ENABLE_ALL : 0;
+			break;
+
 			/*case KE_RS_CLEARDEPTH:
 			glClearDepth( state_params[i].fparam );
 			break;*/
@@ -2442,6 +2610,78 @@ void IKeDirect3D11RenderDevice::DrawIndexedVerticesRange( uint32_t primtype, uin
 	d3ddevice_context->DrawIndexed( count, start, 0 );
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::DrawIndexedVerticesBaseVertex
+* Desc: Draws a range of indices, adding base_vertex to each index before fetching vertices.
+*/
+void IKeDirect3D11RenderDevice::DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex )
+{
+	IKeDirect3D11GeometryBuffer* gb = static_cast<IKeDirect3D11GeometryBuffer*>(current_geometrybuffer);
+
+	uint32_t offset = 0;
+	d3ddevice_context->IASetVertexBuffers( 0, 1, &gb->vb, &stride, &offset );
+	d3ddevice_context->IASetIndexBuffer( gb->ib, data_types[gb->index_type], 0 );
+	d3ddevice_context->IASetPrimitiveTopology( primitive_types[primtype] );
+	d3ddevice_context->DrawIndexed( count, first_index, base_vertex );
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::CreateIndirectBuffer
+* Desc: Creates a buffer of indexed draw commands to be used with DrawIndexedVerticesIndirect.
+*/
+bool IKeDirect3D11RenderDevice::CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer )
+{
+	DISPDBG_RB( KE_WARNING, "Not yet implemented..." );
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::DeleteIndirectBuffer
+* Desc: Deletes an indirect draw buffer.
+*/
+void IKeDirect3D11RenderDevice::DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer )
+{
+	if( indirect_buffer )
+		indirect_buffer->Destroy();
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::DrawIndexedVerticesIndirect
+* Desc: Draws a range of commands from an indirect draw buffer.
+*/
+void IKeDirect3D11RenderDevice::DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::CreateOcclusionQuery
+* Desc: 
+*/
+bool IKeDirect3D11RenderDevice::CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+
+	return false;
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::BeginConditionalRender
+* Desc: 
+*/
+void IKeDirect3D11RenderDevice::BeginConditionalRender( IKeOcclusionQuery* query, int wait )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::EndConditionalRender
+* Desc: 
+*/
+void IKeDirect3D11RenderDevice::EndConditionalRender()
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+}
+
 /*
 * Name: IKeDirect3D11RenderDevice::get_framebuffer_region
 * Desc: Returns a pointer filled with pixels of the given region of the current framebuffer.
@@ -2462,6 +2702,34 @@ bool IKeDirect3D11RenderDevice::GetFramebufferRegion( int x, int y, int width, i
 	return true;
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::RequestFramebufferRegion
+* Desc: Starts reading a region of the current framebuffer without waiting for the GPU.
+*/
+uint32_t IKeDirect3D11RenderDevice::RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+
+	return 0;
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::ReadFramebufferRegion
+* Desc: Checks whether a framebuffer read is finished, and returns its pixels if so.
+*/
+int IKeDirect3D11RenderDevice::ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels )
+{
+	return KE_READBACK_FAILED;
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::ReleaseFramebufferRegion
+* Desc: Returns a readback's pixel buffer to the pool.
+*/
+void IKeDirect3D11RenderDevice::ReleaseFramebufferRegion( uint32_t ticket )
+{
+}
+
 /*
 * Name: IKeDirect3D11RenderDevice::set_viewport
 * Desc: Sets the viewport.
@@ -2642,6 +2910,25 @@ void IKeDirect3D11RenderDevice::GetProjectionMatrix( nv::matrix4f* projection )
     memmove( projection->_array, projection_matrix._array, sizeof( float ) * 16 );
 }
 
+/*
+* Name: IKeDirect3D11RenderDevice::SetWorldMatrixBatch
+* Desc: 
+*/
+bool IKeDirect3D11RenderDevice::SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+	return false;
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::SetDrawIndex
+* Desc: 
+*/
+void IKeDirect3D11RenderDevice::SetDrawIndex( uint32_t index )
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+}
+
 
 /*
 * Name: IKeDirect3D11RenderDevice::block_until_vertical_blank
@@ -2761,6 +3048,80 @@ bool IKeDirect3D11RenderDevice::CreateFence( IKeFence** fence, uint32_t flags )
     return true;
 }
 
+
+/*
+* Name: IKeDirect3D11RenderDevice::SetMaxFrameLatency
+* Desc: Sets the number of frames the CPU may queue ahead of the GPU.  DXGI enforces this for us
+*		when presenting.
+*/
+void IKeDirect3D11RenderDevice::SetMaxFrameLatency( int latency )
+{
+	if( latency < 1 || latency > KE_MAX_FRAMES_IN_FLIGHT )
+	{
+		DISPDBG( KE_WARNING, "Invalid frame latency (" << latency << ")!" );
+		return;
+	}
+
+	CDXGIDevice1 dxgidevice1;
+	HRESULT hr;
+
+	if( SUCCEEDED( hr = d3ddevice->QueryInterface( &dxgidevice1 ) ) )
+	{
+		if( SUCCEEDED( hr = dxgidevice1->SetMaximumFrameLatency( latency ) ) )
+		{
+			max_frame_latency = latency;
+			return;
+		}
+	}
+
+	D3D_DISPDBG( KE_WARNING, "Unable to set the maximum frame latency!", hr );
+}
+
+
+/*
+* Name: IKeDirect3D11RenderDevice::GetMaxFrameLatency
+* Desc: Returns the number of frames the CPU may queue ahead of the GPU.
+*/
+int IKeDirect3D11RenderDevice::GetMaxFrameLatency()
+{
+	return max_frame_latency;
+}
+
+
+/*
+* Name: IKeDirect3D11RenderDevice::GetCompletedFrame
+* Desc: 
+*/
+uint32_t IKeDirect3D11RenderDevice::GetCompletedFrame()
+{
+	DISPDBG( KE_WARNING, "Not yet implemented..." );
+
+	return 0;
+}
+
+
+/*
+* Name: IKeDirect3D11RenderDevice::DestroyDeferred
+* Desc: Destroys a resource that may still be in use by the GPU.
+* NOTE: The Direct3D runtime already keeps released resources alive until the GPU is done
+*		with them, so there is nothing to queue here.
+*/
+void IKeDirect3D11RenderDevice::DestroyDeferred( IKeUnknown* resource )
+{
+	if( resource )
+		resource->Destroy();
+}
+
+/*
+* Name: IKeDirect3D11RenderDevice::MakeCurrent
+* Desc: Direct3D 11 devices are not bound to a thread, so there is nothing to do here.
+* NOTE: The immediate context must still only be used by one thread at a time.
+*/
+bool IKeDirect3D11RenderDevice::MakeCurrent( int current )
+{
+	return true;
+}
+
 #if 0
 /*
  * Name: IKeDirect3D11RenderDevice::insert_fence
@@ -139,6 +139,8 @@ struct IKeDirect3D11GeometryBuffer : public IKeGeometryBuffer
 
 	_KEMETHOD(bool) SetVertexData( uint32_t offset, uint32_t size, void* ptr );
     _KEMETHOD(bool) SetIndexData( uint32_t offset, uint32_t size, void* ptr );
+    _KEMETHOD(bool) CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size );
+    _KEMETHOD(bool) CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size );
 	KEMETHOD GetDesc( KeGeometryBufferDesc* desc );
 
 	CD3D11Buffer	vb;		/* Vertex buffer */
@@ -165,6 +167,7 @@ struct IKeDirect3D11GpuProgram : public IKeGpuProgram
 {
 	KEMETHOD Destroy();
 	KEMETHOD GetVertexAttributes( KeVertexAttribute* vertex_attributes );
+	_KEMETHOD(bool) IsReady();
     
 	CD3D11VertexShader		vs;		/* Vertex shader */
 	CD3D11PixelShader		ps;		/* Pixel shader */
@@ -308,7 +311,11 @@ public:
 	_KEMETHOD(bool) ExecuteCommandList( IKeCommandList* command_list, int restore_state );
 	KEMETHOD RestoreImmediateContext();
     _KEMETHOD(bool) CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
+    _KEMETHOD(bool) CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
     KEMETHOD DeleteProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetFallbackProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetProgramCachePath( const char* path );
+    KEMETHOD GetProgramCacheStats( KeProgramCacheStats* stats );
     KEMETHOD SetProgram( IKeGpuProgram* gpu_program );
     KEMETHOD SetProgramConstant1FV( const char* location, int count, float* value );
     KEMETHOD SetProgramConstant2FV( const char* location, int count, float* value );
@@ -324,13 +331,17 @@ public:
 	KEMETHOD DeleteConstantBuffer( IKeConstantBuffer* constant_buffer );
 	_KEMETHOD(bool) SetConstantBufferData( void* data, IKeConstantBuffer* constant_buffer );
 	KEMETHOD SetConstantBuffer( int slot, int shader_type, IKeConstantBuffer* constant_buffer );
+	_KEMETHOD(bool) SetTransientConstants( int slot, void* data, uint32_t size );
     _KEMETHOD(bool) CreateTexture1D( uint32_t target, int width, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
     _KEMETHOD(bool) CreateTexture2D( uint32_t target, int width, int height, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
     _KEMETHOD(bool) CreateTexture3D( uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
+    _KEMETHOD(bool) CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture );
     KEMETHOD DeleteTexture( IKeTexture* texture );
     KEMETHOD SetTextureData1D( int offsetx, int width, int miplevel, void* pixels, IKeTexture* texture );
     KEMETHOD SetTextureData2D( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture );
     KEMETHOD SetTextureData3D( int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture );
+    _KEMETHOD(bool) SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture );
+    KEMETHOD SetTextureMipRange( IKeTexture* texture, int base_level, int max_level );
     _KEMETHOD(bool) CreateRenderTarget( int width, int height, int depth, uint32_t flags, IKeRenderTarget** rendertarget );
     KEMETHOD DeleteRenderTarget( IKeRenderTarget* rendertarget );
     KEMETHOD BindRenderTarget( IKeRenderTarget* rendertarget );
@@ -347,8 +358,18 @@ public:
     KEMETHOD DrawVertices( uint32_t primtype, uint32_t stride, int first, int count );
     KEMETHOD DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count );
     KEMETHOD DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count );
+    KEMETHOD DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex );
+    _KEMETHOD(bool) CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer );
+    KEMETHOD DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer );
+    KEMETHOD DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count );
+    _KEMETHOD(bool) CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query );
+    KEMETHOD BeginConditionalRender( IKeOcclusionQuery* query, int wait );
+    KEMETHOD EndConditionalRender();
     
     _KEMETHOD(bool) GetFramebufferRegion( int x, int y, int width, int height, uint32_t flags, int* bpp, void** pixels );
+    _KEMETHOD(uint32_t) RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags );
+    _KEMETHOD(int) ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels );
+    KEMETHOD ReleaseFramebufferRegion( uint32_t ticket );
     
     /* Matrix/viewport related */
     KEMETHOD SetViewport( int x, int y, int width, int height );
@@ -364,6 +385,8 @@ public:
     KEMETHOD GetWorldMatrix( nv::matrix4f* world );
     KEMETHOD GetModelviewMatrix( nv::matrix4f* modelview );
     KEMETHOD GetProjectionMatrix( nv::matrix4f* projection );
+    _KEMETHOD(bool) SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count );
+    KEMETHOD SetDrawIndex( uint32_t index );
     
     /* Synchronization */
     KEMETHOD BlockUntilVerticalBlank();
@@ -372,6 +395,11 @@ public:
 	KEMETHOD BlockUntilIdle();
 	KEMETHOD Kick();
 	_KEMETHOD(bool) CreateFence( IKeFence** fence, uint32_t flags );
+	KEMETHOD SetMaxFrameLatency( int latency );
+	_KEMETHOD(int) GetMaxFrameLatency();
+	_KEMETHOD(uint32_t) GetCompletedFrame();
+	KEMETHOD DestroyDeferred( IKeUnknown* resource );
+	_KEMETHOD(bool) MakeCurrent( int current );
     
     /* Misc */
     KEMETHOD GpuMemoryInfo( uint32_t* total_memory, uint32_t* free_memory );
@@ -409,6 +437,7 @@ protected:
 	DXGI_SWAP_CHAIN_DESC			swapchain_desc;
 #endif
 	int								swap_interval;
+	int								max_frame_latency;
 #ifndef _UWP
 	CDirectDraw7					dd;
 #else
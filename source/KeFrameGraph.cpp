@@ -0,0 +1,689 @@
+//
+//  KeFrameGraph.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeFrameGraph.h"
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/*
+ * Buffers that must all be cleared for a pass to discard a target's previous contents
+ */
+#define KE_FRAMEGRAPH_DISCARD_BUFFERS   ( KE_COLOUR_BUFFER | KE_DEPTH_BUFFER )
+
+
+/*
+ * Name: KeFrameGraph::KeFrameGraph
+ * Desc: Default constructor.
+ */
+KeFrameGraph::KeFrameGraph( IKeRenderDevice* device ) : device(device), frame(0),
+    pool_timeout(KE_FRAMEGRAPH_POOL_TIMEOUT), compiled(No)
+{
+    ZeroMemory( &stats, sizeof( KeFrameGraphStats ) );
+
+    BeginFrame();
+}
+
+
+/*
+ * Name: KeFrameGraph::~KeFrameGraph
+ * Desc: Default deconstructor.  Deletes every pooled render target, so textures returned by
+ *       GetTexture become invalid.
+ */
+KeFrameGraph::~KeFrameGraph()
+{
+    for( size_t i = 0; i < pool.size(); i++ )
+        device->DeleteRenderTarget( pool[i].rendertarget );
+}
+
+
+/*
+ * Name: KeFrameGraph::BeginFrame
+ * Desc: Discards the previous frame's passes and targets.  Pooled render targets are kept for
+ *       reuse.
+ */
+void KeFrameGraph::BeginFrame()
+{
+    KeFrameGraphTarget back_buffer;
+
+    passes.clear();
+    targets.clear();
+    order.clear();
+    compiled = No;
+    frame++;
+
+    /* The back buffer is always target 0 */
+    ZeroMemory( &back_buffer, sizeof( KeFrameGraphTarget ) );
+    back_buffer.pooled = -1;
+    back_buffer.first_use = back_buffer.last_use = -1;
+    targets.push_back( back_buffer );
+}
+
+
+/*
+ * Name: KeFrameGraph::CreateTarget
+ * Desc: Declares a transient render target.  It only has a render target assigned to it while
+ *       the passes using it execute, and its contents are undefined until a pass writes to it.
+ *       The parameters are the same as for IKeRenderDevice::CreateRenderTarget.
+ */
+int KeFrameGraph::CreateTarget( int width, int height, int depth, uint32_t flags )
+{
+    KeFrameGraphTarget t;
+
+    if( width < 1 || height < 1 )
+    {
+        DISPDBG( KE_ERROR, "Invalid render target resolution (" << width << "x" << height << ")!" );
+        return KE_FRAMEGRAPH_INVALID_HANDLE;
+    }
+
+    ZeroMemory( &t, sizeof( KeFrameGraphTarget ) );
+    t.width = width;
+    t.height = height;
+    t.depth = depth;
+    t.flags = flags;
+    t.transient = Yes;
+    t.pooled = -1;
+    t.first_use = t.last_use = -1;
+
+    compiled = No;
+    targets.push_back( t );
+
+    return (int) targets.size() - 1;
+}
+
+
+/*
+ * Name: KeFrameGraph::ImportTarget
+ * Desc: Declares a render target owned by the caller.  Its contents are kept between frames,
+ *       so passes writing to it are never culled.
+ */
+int KeFrameGraph::ImportTarget( IKeRenderTarget* rendertarget, int width, int height )
+{
+    KeFrameGraphTarget t;
+
+    if( !rendertarget )
+    {
+        DISPDBG( KE_ERROR, "Invalid render target!  Use KE_FRAMEGRAPH_BACKBUFFER for the back buffer." );
+        return KE_FRAMEGRAPH_INVALID_HANDLE;
+    }
+
+    ZeroMemory( &t, sizeof( KeFrameGraphTarget ) );
+    t.width = width;
+    t.height = height;
+    t.rendertarget = rendertarget;
+    t.pooled = -1;
+    t.first_use = t.last_use = -1;
+
+    compiled = No;
+    targets.push_back( t );
+
+    return (int) targets.size() - 1;
+}
+
+
+/*
+ * Name: KeFrameGraph::AddPass
+ * Desc: Declares a render pass.  Returns a handle to be used with Read, Write, etc.
+ */
+int KeFrameGraph::AddPass( const char* name, KeFrameGraphPassProc proc, void* context )
+{
+    KeFrameGraphPass p;
+
+    p.name = name ? name : "";
+    p.proc = proc;
+    p.context = context;
+    p.write = KE_FRAMEGRAPH_INVALID_HANDLE;
+    p.clear_buffers = 0;
+    p.clear_colour[0] = p.clear_colour[1] = p.clear_colour[2] = p.clear_colour[3] = 0.0f;
+    p.clear_depth = 1.0f;
+    p.clear_stencil = 0;
+    p.side_effect = No;
+    p.live = No;
+
+    compiled = No;
+    passes.push_back( p );
+
+    return (int) passes.size() - 1;
+}
+
+
+/*
+ * Name: KeFrameGraph::Read
+ * Desc: Declares that a pass samples a target.  The pass sees what the passes declared before
+ *       it wrote to the target.
+ */
+void KeFrameGraph::Read( int pass, int target )
+{
+    if( !PVT_IsValidPass( pass ) || !PVT_IsValidTarget( target ) )
+        return;
+    if( target == KE_FRAMEGRAPH_BACKBUFFER )
+        DISPDBG_R( KE_WARNING, "The back buffer cannot be sampled (pass: " << passes[pass].name << ")!" );
+    if( passes[pass].write == target )
+        DISPDBG_R( KE_WARNING, "A pass cannot read the target it writes to (pass: " << passes[pass].name << ")!" );
+
+    compiled = No;
+    passes[pass].reads.push_back( target );
+}
+
+
+/*
+ * Name: KeFrameGraph::Write
+ * Desc: Declares the target a pass renders to, and which of its buffers are cleared before the
+ *       pass runs.  A pass clearing both the colour and depth buffers discards whatever earlier
+ *       passes wrote, which lets those passes be culled.  Each pass writes at most one target.
+ */
+void KeFrameGraph::Write( int pass, int target, uint32_t clear_buffers )
+{
+    if( !PVT_IsValidPass( pass ) || !PVT_IsValidTarget( target ) )
+        return;
+    if( passes[pass].write != KE_FRAMEGRAPH_INVALID_HANDLE )
+        DISPDBG_R( KE_WARNING, "Pass already writes to a target (pass: " << passes[pass].name << ")!" );
+
+    for( size_t i = 0; i < passes[pass].reads.size(); i++ )
+    {
+        if( passes[pass].reads[i] == target )
+            DISPDBG_R( KE_WARNING, "A pass cannot write to a target it reads (pass: " << passes[pass].name << ")!" );
+    }
+
+    compiled = No;
+    passes[pass].write = target;
+    passes[pass].clear_buffers = clear_buffers;
+}
+
+
+/*
+ * Name: KeFrameGraph::SetClearValues
+ * Desc: Sets the values a pass clears its target with (default: transparent black, 1.0 and 0).
+ */
+void KeFrameGraph::SetClearValues( int pass, const float* colour, float depth, uint32_t stencil )
+{
+    if( !PVT_IsValidPass( pass ) )
+        return;
+
+    if( colour )
+        memmove( passes[pass].clear_colour, colour, sizeof( float ) * 4 );
+    passes[pass].clear_depth = depth;
+    passes[pass].clear_stencil = stencil;
+}
+
+
+/*
+ * Name: KeFrameGraph::SetSideEffect
+ * Desc: Marks a pass as having effects outside of the graph (i.e. a readback or an occlusion
+ *       query), so that it is never culled.
+ */
+void KeFrameGraph::SetSideEffect( int pass )
+{
+    if( !PVT_IsValidPass( pass ) )
+        return;
+
+    compiled = No;
+    passes[pass].side_effect = Yes;
+}
+
+
+/*
+ * Name: KeFrameGraph::Compile
+ * Desc: Culls, orders and assigns render targets to this frame's passes.  Called by Execute if
+ *       the graph has changed since the last call.
+ */
+bool KeFrameGraph::Compile()
+{
+    stats.passes = (uint32_t) passes.size();
+    stats.passes_culled = 0;
+    stats.transient_targets = 0;
+    stats.targets_created = 0;
+    stats.targets_deleted = 0;
+
+    PVT_CullPasses();
+    PVT_OrderPasses();
+
+    if( !PVT_AllocateTargets() )
+        return false;
+
+    PVT_TrimPool();
+
+    stats.pooled_targets = (uint32_t) pool.size();
+    compiled = Yes;
+
+    return true;
+}
+
+
+/*
+ * Name: KeFrameGraph::Execute
+ * Desc: Runs this frame's passes.  The back buffer must be bound beforehand, and is bound again
+ *       (with the viewport restored) afterwards.
+ */
+void KeFrameGraph::Execute()
+{
+    int viewport[4];
+    IKeRenderTarget* bound = NULL;
+
+    /* Buffers of the bound target that were cleared and haven't been rendered to since */
+    uint32_t clean = 0;
+    float clean_colour[4] = { 0, 0, 0, 0 };
+    float clean_depth = 0;
+    uint32_t clean_stencil = 0;
+
+    if( !compiled && !Compile() )
+        DISPDBG_R( KE_ERROR, "Error compiling frame graph!" );
+
+    stats.binds = stats.binds_skipped = 0;
+    stats.clears = stats.clears_skipped = 0;
+
+    device->GetViewportV( viewport );
+
+    for( size_t i = 0; i < order.size(); i++ )
+    {
+        KeFrameGraphPass* p = &passes[order[i]];
+
+        if( p->write != KE_FRAMEGRAPH_INVALID_HANDLE )
+        {
+            KeFrameGraphTarget* t = &targets[p->write];
+
+            /* Only switch render targets when the previous pass used a different one */
+            if( t->rendertarget != bound )
+            {
+                device->BindRenderTarget( t->rendertarget );
+                if( t->rendertarget )
+                    device->SetViewport( 0, 0, t->width, t->height );
+                else
+                    device->SetViewportV( viewport );
+
+                bound = t->rendertarget;
+                clean = 0;
+                stats.binds++;
+            }
+            else
+                stats.binds_skipped++;
+
+            /* Clear whatever isn't already clear */
+            uint32_t buffers = p->clear_buffers;
+            if( buffers )
+            {
+                if( memcmp( clean_colour, p->clear_colour, sizeof( float ) * 4 ) || clean_depth != p->clear_depth || clean_stencil != p->clear_stencil )
+                    clean = 0;
+
+                if( buffers & clean )
+                    stats.clears_skipped++;
+
+                buffers &= ~clean;
+                if( buffers )
+                {
+                    if( buffers & KE_COLOUR_BUFFER )
+                        device->SetClearColourFV( p->clear_colour );
+                    if( buffers & KE_DEPTH_BUFFER )
+                        device->SetClearDepth( p->clear_depth );
+                    if( buffers & KE_STENCIL_BUFFER )
+                        device->SetClearStencil( p->clear_stencil );
+
+                    device->Clear( buffers );
+                    stats.clears++;
+
+                    clean |= buffers;
+                    memmove( clean_colour, p->clear_colour, sizeof( float ) * 4 );
+                    clean_depth = p->clear_depth;
+                    clean_stencil = p->clear_stencil;
+                }
+            }
+        }
+
+        if( p->proc )
+        {
+            p->proc( this, device, p->context );
+            clean = 0;
+        }
+    }
+
+    /* Put the back buffer back */
+    if( bound )
+    {
+        device->BindRenderTarget( NULL );
+        device->SetViewportV( viewport );
+        stats.binds++;
+    }
+}
+
+
+/*
+ * Name: KeFrameGraph::GetRenderTarget
+ * Desc: Returns the render target assigned to a target.  For transient targets, this is only
+ *       valid while the passes using the target execute (NULL for the back buffer).
+ */
+IKeRenderTarget* KeFrameGraph::GetRenderTarget( int target )
+{
+    if( !PVT_IsValidTarget( target ) )
+        return NULL;
+
+    return targets[target].rendertarget;
+}
+
+
+/*
+ * Name: KeFrameGraph::GetTexture
+ * Desc: Returns the texture of the render target assigned to a target, for use in the passes
+ *       that read it.
+ */
+IKeTexture* KeFrameGraph::GetTexture( int target )
+{
+    IKeRenderTarget* rt = GetRenderTarget( target );
+
+    return rt ? rt->GetTexture2() : NULL;
+}
+
+
+/*
+ * Name: KeFrameGraph::SetPoolTimeout
+ * Desc: Sets how many frames a pooled render target may go unused before it is deleted.
+ */
+void KeFrameGraph::SetPoolTimeout( int frames )
+{
+    pool_timeout = frames < 0 ? 0 : frames;
+}
+
+
+/*
+ * Name: KeFrameGraph::GetStats
+ * Desc: Returns statistics for the last compiled and executed frame.
+ */
+void KeFrameGraph::GetStats( KeFrameGraphStats* stats )
+{
+    memmove( stats, &this->stats, sizeof( KeFrameGraphStats ) );
+}
+
+
+/* Returns true if the pass handle is valid */
+bool KeFrameGraph::PVT_IsValidPass( int pass )
+{
+    if( pass < 0 || pass >= (int) passes.size() )
+        DISPDBG_RB( KE_WARNING, "Invalid frame graph pass handle (" << pass << ")!" );
+
+    return true;
+}
+
+/* Returns true if the target handle is valid */
+bool KeFrameGraph::PVT_IsValidTarget( int target )
+{
+    if( target < 0 || target >= (int) targets.size() )
+        DISPDBG_RB( KE_WARNING, "Invalid frame graph target handle (" << target << ")!" );
+
+    return true;
+}
+
+/* Walks the passes backwards, keeping only those whose output is used */
+void KeFrameGraph::PVT_CullPasses()
+{
+    /* The back buffer and imported targets are used after the frame */
+    std::vector<int> needed( targets.size(), No );
+    for( size_t i = 0; i < targets.size(); i++ )
+        needed[i] = !targets[i].transient;
+
+    for( int i = (int) passes.size() - 1; i >= 0; i-- )
+    {
+        KeFrameGraphPass* p = &passes[i];
+
+        p->live = p->side_effect;
+        if( p->write != KE_FRAMEGRAPH_INVALID_HANDLE && needed[p->write] )
+            p->live = Yes;
+
+        if( !p->live )
+        {
+            stats.passes_culled++;
+            continue;
+        }
+
+        /* Passes before this one only matter for what this pass keeps */
+        if( p->write != KE_FRAMEGRAPH_INVALID_HANDLE && targets[p->write].transient &&
+           ( p->clear_buffers & KE_FRAMEGRAPH_DISCARD_BUFFERS ) == KE_FRAMEGRAPH_DISCARD_BUFFERS )
+            needed[p->write] = No;
+
+        for( size_t j = 0; j < p->reads.size(); j++ )
+            needed[p->reads[j]] = Yes;
+    }
+}
+
+/* Sorts the live passes by their dependencies, preferring to stay on the bound target */
+void KeFrameGraph::PVT_OrderPasses()
+{
+    std::vector< std::vector<int> > successors( passes.size() );
+    std::vector<int> dependencies( passes.size(), 0 );
+    std::vector<int> last_writer( targets.size(), -1 );
+    std::vector< std::vector<int> > readers( targets.size() );
+    std::vector<int> ready;
+    int last_side_effect = -1;
+
+    /* Build the dependencies in declaration order */
+    for( int i = 0; i < (int) passes.size(); i++ )
+    {
+        KeFrameGraphPass* p = &passes[i];
+
+        if( !p->live )
+            continue;
+
+        for( size_t j = 0; j < p->reads.size(); j++ )
+        {
+            int r = p->reads[j];
+
+            if( last_writer[r] != -1 )
+            {
+                successors[last_writer[r]].push_back( i );
+                dependencies[i]++;
+            }
+            else if( targets[r].transient )
+                DISPDBG( KE_WARNING, "Pass reads a target nothing has written to (pass: " << p->name << ")!" );
+
+            readers[r].push_back( i );
+        }
+
+        if( p->write != KE_FRAMEGRAPH_INVALID_HANDLE )
+        {
+            int w = p->write;
+
+            if( last_writer[w] != -1 )
+            {
+                successors[last_writer[w]].push_back( i );
+                dependencies[i]++;
+            }
+            for( size_t j = 0; j < readers[w].size(); j++ )
+            {
+                successors[readers[w][j]].push_back( i );
+                dependencies[i]++;
+            }
+
+            last_writer[w] = i;
+            readers[w].clear();
+        }
+
+        /* Passes with effects outside of the graph keep their relative order */
+        if( p->side_effect )
+        {
+            if( last_side_effect != -1 )
+            {
+                successors[last_side_effect].push_back( i );
+                dependencies[i]++;
+            }
+            last_side_effect = i;
+        }
+    }
+
+    for( int i = 0; i < (int) passes.size(); i++ )
+    {
+        if( passes[i].live && !dependencies[i] )
+            ready.push_back( i );
+    }
+
+    /* Repeatedly pick the earliest declared ready pass, unless one renders to the bound target */
+    int bound = KE_FRAMEGRAPH_BACKBUFFER;
+    order.clear();
+    while( !ready.empty() )
+    {
+        size_t pick = 0;
+        for( size_t j = 0; j < ready.size(); j++ )
+        {
+            if( passes[ready[j]].write == bound )
+            {
+                if( passes[ready[pick]].write != bound || ready[j] < ready[pick] )
+                    pick = j;
+            }
+            else if( passes[ready[pick]].write != bound && ready[j] < ready[pick] )
+                pick = j;
+        }
+
+        int i = ready[pick];
+        ready.erase( ready.begin() + pick );
+        order.push_back( i );
+
+        if( passes[i].write != KE_FRAMEGRAPH_INVALID_HANDLE )
+            bound = passes[i].write;
+
+        for( size_t j = 0; j < successors[i].size(); j++ )
+        {
+            if( !--dependencies[successors[i][j]] )
+                ready.push_back( successors[i][j] );
+        }
+    }
+}
+
+/* Assigns pooled render targets to the transient targets, sharing them between targets whose
+   lifetimes don't overlap */
+bool KeFrameGraph::PVT_AllocateTargets()
+{
+    for( size_t i = 0; i < targets.size(); i++ )
+    {
+        targets[i].first_use = targets[i].last_use = -1;
+        if( targets[i].transient )
+        {
+            targets[i].rendertarget = NULL;
+            targets[i].pooled = -1;
+        }
+    }
+
+    for( size_t i = 0; i < pool.size(); i++ )
+        pool[i].in_use = No;
+
+    /* Find each target's lifetime in the execution order */
+    for( int i = 0; i < (int) order.size(); i++ )
+    {
+        KeFrameGraphPass* p = &passes[order[i]];
+
+        for( size_t j = 0; j <= p->reads.size(); j++ )
+        {
+            int t = j < p->reads.size() ? p->reads[j] : p->write;
+            if( t == KE_FRAMEGRAPH_INVALID_HANDLE )
+                continue;
+
+            if( targets[t].first_use == -1 )
+                targets[t].first_use = i;
+            targets[t].last_use = i;
+        }
+    }
+
+    for( int i = 0; i < (int) order.size(); i++ )
+    {
+        /* Targets first used here can't share with targets still in use... */
+        for( size_t t = 0; t < targets.size(); t++ )
+        {
+            if( targets[t].transient && targets[t].first_use == i )
+            {
+                if( PVT_AcquirePooledTarget( &targets[t] ) == -1 )
+                    return false;
+                stats.transient_targets++;
+            }
+        }
+
+        /* ...but targets last used here are free for the next pass */
+        for( size_t t = 0; t < targets.size(); t++ )
+        {
+            if( targets[t].transient && targets[t].last_use == i )
+                pool[targets[t].pooled].in_use = No;
+        }
+    }
+
+    return true;
+}
+
+/* Finds a free pooled render target matching a target, creating one if needed */
+int KeFrameGraph::PVT_AcquirePooledTarget( KeFrameGraphTarget* t )
+{
+    int index = -1;
+
+    for( size_t i = 0; i < pool.size(); i++ )
+    {
+        KeFrameGraphPooledTarget* pt = &pool[i];
+
+        if( !pt->in_use && pt->width == t->width && pt->height == t->height && pt->depth == t->depth && pt->flags == t->flags )
+        {
+            index = (int) i;
+            break;
+        }
+    }
+
+    if( index == -1 )
+    {
+        KeFrameGraphPooledTarget pt;
+
+        ZeroMemory( &pt, sizeof( KeFrameGraphPooledTarget ) );
+        pt.width = t->width;
+        pt.height = t->height;
+        pt.depth = t->depth;
+        pt.flags = t->flags;
+
+        if( !device->CreateRenderTarget( t->width, t->height, t->depth, t->flags, &pt.rendertarget ) )
+        {
+            DISPDBG( KE_ERROR, "Error creating render target (" << t->width << "x" << t->height << ")!" );
+            return -1;
+        }
+
+        index = (int) pool.size();
+        pool.push_back( pt );
+        stats.targets_created++;
+    }
+
+    pool[index].in_use = Yes;
+    pool[index].last_frame = frame;
+    t->rendertarget = pool[index].rendertarget;
+    t->pooled = index;
+
+    return index;
+}
+
+/* Deletes pooled render targets that haven't been used for a while */
+void KeFrameGraph::PVT_TrimPool()
+{
+    for( size_t i = 0; i < pool.size(); )
+    {
+        if( frame - pool[i].last_frame > (uint32_t) pool_timeout )
+        {
+            device->DeleteRenderTarget( pool[i].rendertarget );
+            pool.erase( pool.begin() + i );
+            stats.targets_deleted++;
+        }
+        else
+            i++;
+    }
+
+    /* Erasing moved the remaining entries */
+    for( size_t t = 0; t < targets.size(); t++ )
+    {
+        if( targets[t].pooled == -1 )
+            continue;
+
+        for( size_t i = 0; i < pool.size(); i++ )
+        {
+            if( pool[i].rendertarget == targets[t].rendertarget )
+                targets[t].pooled = (int) i;
+        }
+    }
+}
@@ -0,0 +1,153 @@
+//
+//  KeFrameGraph.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeFrameGraph__
+#define __KeFrameGraph__
+
+#include <vector>
+#include <string>
+#include "KeRenderDevice.h"
+
+
+/*
+ * Frame graph defaults
+ */
+#define KE_FRAMEGRAPH_BACKBUFFER        0   /* Target handle of the back buffer (always available) */
+#define KE_FRAMEGRAPH_INVALID_HANDLE    -1
+#define KE_FRAMEGRAPH_POOL_TIMEOUT      60  /* Frames a pooled render target may go unused before it is deleted */
+
+
+class KeFrameGraph;
+
+/*
+ * Pass callback.  The pass's target is already bound (and cleared, if requested) when it is
+ * called; use KeFrameGraph::GetTexture to find the textures of the targets it reads.
+ */
+typedef void (*KeFrameGraphPassProc)( KeFrameGraph* graph, IKeRenderDevice* device, void* context );
+
+/*
+ * Virtual render target (valid for the frame it was declared in)
+ */
+struct KeFrameGraphTarget
+{
+    int                 width;
+    int                 height;
+    int                 depth;
+    uint32_t            flags;
+    IKeRenderTarget*    rendertarget;   /* Imported target, or the pooled target assigned by Compile */
+    int                 transient;      /* Yes if allocated from the pool */
+    int                 pooled;         /* Index of the pooled target (-1 if none) */
+    int                 first_use;      /* First and last positions in the execution order */
+    int                 last_use;
+};
+
+/*
+ * Render pass
+ */
+struct KeFrameGraphPass
+{
+    std::string             name;
+    KeFrameGraphPassProc    proc;           /* May be NULL for passes that only clear */
+    void*                   context;
+    int                     write;          /* Target rendered to (KE_FRAMEGRAPH_INVALID_HANDLE if none) */
+    std::vector<int>        reads;          /* Targets sampled */
+    uint32_t                clear_buffers;  /* KE_COLOUR_BUFFER, etc. cleared before the pass runs */
+    float                   clear_colour[4];
+    float                   clear_depth;
+    uint32_t                clear_stencil;
+    int                     side_effect;    /* Yes if the pass must run even when nothing reads its output */
+    int                     live;           /* Set by Compile */
+};
+
+/*
+ * Render target owned by the pool
+ */
+struct KeFrameGraphPooledTarget
+{
+    IKeRenderTarget*    rendertarget;
+    int                 width;
+    int                 height;
+    int                 depth;
+    uint32_t            flags;
+    int                 in_use;         /* Yes while assigned to a virtual target during Compile */
+    uint32_t            last_frame;     /* Last frame it was assigned in */
+};
+
+/*
+ * Frame graph statistics (for the current frame)
+ */
+struct KeFrameGraphStats
+{
+    uint32_t    passes;
+    uint32_t    passes_culled;
+    uint32_t    transient_targets;      /* Virtual targets that were assigned a render target */
+    uint32_t    pooled_targets;         /* Render targets in the pool */
+    uint32_t    targets_created;
+    uint32_t    targets_deleted;
+    uint32_t    binds;
+    uint32_t    binds_skipped;          /* Passes that kept the previous pass's target */
+    uint32_t    clears;
+    uint32_t    clears_skipped;         /* Buffers that were still clear */
+};
+
+
+/* Per-frame render graph.  Each frame:
+   1. BeginFrame, then declare the targets (CreateTarget/ImportTarget) and the passes (AddPass)
+      along with the targets each pass reads and writes.  Passes see targets in the order they
+      are declared in, as if they were executed immediately.
+   2. Compile culls passes whose output is never used, orders the rest to keep passes that
+      share a target together, and assigns each transient target a pooled render target.
+      Transient targets whose lifetimes don't overlap share the same render target.
+   3. Execute binds, clears and runs each pass, skipping binds and clears that would have no
+      effect, and then puts the back buffer back. */
+class KeFrameGraph
+{
+public:
+    KeFrameGraph( IKeRenderDevice* device );
+    virtual ~KeFrameGraph();
+
+public:
+    void BeginFrame();
+    int CreateTarget( int width, int height, int depth = 0, uint32_t flags = 0 );
+    int ImportTarget( IKeRenderTarget* rendertarget, int width, int height );
+
+    int AddPass( const char* name, KeFrameGraphPassProc proc, void* context );
+    void Read( int pass, int target );
+    void Write( int pass, int target, uint32_t clear_buffers = 0 );
+    void SetClearValues( int pass, const float* colour, float depth, uint32_t stencil );
+    void SetSideEffect( int pass );
+
+    bool Compile();
+    void Execute();
+
+    IKeRenderTarget* GetRenderTarget( int target );
+    IKeTexture* GetTexture( int target );
+    void SetPoolTimeout( int frames );
+    void GetStats( KeFrameGraphStats* stats );
+
+protected:
+    bool PVT_IsValidPass( int pass );
+    bool PVT_IsValidTarget( int target );
+    void PVT_CullPasses();
+    void PVT_OrderPasses();
+    bool PVT_AllocateTargets();
+    int PVT_AcquirePooledTarget( KeFrameGraphTarget* t );
+    void PVT_TrimPool();
+
+protected:
+    IKeRenderDevice*                        device;
+    std::vector<KeFrameGraphTarget>         targets;    /* Indexed by handle */
+    std::vector<KeFrameGraphPass>           passes;     /* Indexed by handle, in declaration order */
+    std::vector<int>                        order;      /* Live passes in execution order */
+    std::vector<KeFrameGraphPooledTarget>   pool;
+    uint32_t                                frame;
+    int                                     pool_timeout;
+    int                                     compiled;
+    KeFrameGraphStats                       stats;
+};
+
+#endif /* defined(__KeFrameGraph__) */
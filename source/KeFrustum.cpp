@@ -9,6 +9,19 @@
 #include "KePlatform.h"
 #include "NV/NvMath.h"
 #include "KeFrustum.h"
+#include "KeThread.h"
+
+/* SIMD intrinsics */
+#if defined(__AVX__)
+#define KE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define KE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KE_NEON
+#include <arm_neon.h>
+#endif
 
 
 
@@ -16,7 +29,7 @@
  * Globals
  */
 
-float frustum[6][4];    /* The frustum created from the supplied modelview and projection matrices */
+KeFrustumPlanes current_frustum;    /* The frustum created from the supplied modelview and projection matrices */
 
 
 
@@ -27,6 +40,17 @@ float frustum[6][4];    /* The frustum created from the supplied modelview and p
  */
 void KeCalculateFrustum( nv::matrix4f modelview_matrix, nv::matrix4f projection_matrix )
 {
+    KeCalculateFrustumPlanes( modelview_matrix, projection_matrix, &current_frustum );
+}
+
+
+/*
+ * Name: KeCalculateFrustumPlanes
+ * Desc: Same as the above, but writes the frustum to frustum_out instead of the current frustum.
+ */
+void KeCalculateFrustumPlanes( const nv::matrix4f& modelview_matrix, const nv::matrix4f& projection_matrix, KeFrustumPlanes* frustum_out )
+{
+    float   (*frustum)[4] = frustum_out->planes;
     float   proj[16];
     float   modl[16];
     float   clip[16];
@@ -136,6 +160,16 @@ void KeCalculateFrustum( nv::matrix4f modelview_matrix, nv::matrix4f projection_
 }
 
 
+/*
+ * Name: KeGetFrustumPlanes
+ * Desc: Returns a copy of the current frustum (the one used by the functions below).
+ */
+void KeGetFrustumPlanes( KeFrustumPlanes* frustum_out )
+{
+    memmove( frustum_out, &current_frustum, sizeof( KeFrustumPlanes ) );
+}
+
+
 /*
  * Name: KePointInFrustum
  * Desc: Returns yes if this point is in the viewing frustum.
@@ -148,7 +182,7 @@ bool KePointInFrustum( nv::vec3f v )
        plane, then the points are inside the frustum. */
     
     for( p = 0; p < 6; p++ )
-        if( frustum[p][0] * v.x + frustum[p][1] * v.y + frustum[p][2] * v.z + frustum[p][3] <= 0 )
+        if( current_frustum.planes[p][0] * v.x + current_frustum.planes[p][1] * v.y + current_frustum.planes[p][2] * v.z + current_frustum.planes[p][3] <= 0 )
             return No;
     
     return Yes;
@@ -169,7 +203,7 @@ float KeSphereInFrustum( nv::vec3f v, float radius )
     
     for( p = 0; p < 6; p++ )
     {
-        d = frustum[p][0] * v.x + frustum[p][1] * v.y + frustum[p][2] * v.z + frustum[p][3];
+        d = current_frustum.planes[p][0] * v.x + current_frustum.planes[p][1] * v.y + current_frustum.planes[p][2] * v.z + current_frustum.planes[p][3];
         if( d <= -radius )
             return 0;
     }
@@ -188,21 +222,21 @@ bool KeCubeInFrustum( nv::vec3f v, float size )
     
     for( p = 0; p < 6; p++ )
     {
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             continue;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             continue;
         return No;
     }
@@ -223,7 +257,7 @@ int KeSphereInFrustum2( nv::vec3f v, float radius )
     
     for( p = 0; p < 6; p++ )
     {
-        d = frustum[p][0] * v.x + frustum[p][1] * v.y + frustum[p][2] * v.z + frustum[p][3];
+        d = current_frustum.planes[p][0] * v.x + current_frustum.planes[p][1] * v.y + current_frustum.planes[p][2] * v.z + current_frustum.planes[p][3];
         if( d <= -radius )
             return 0;
         if( d > radius )
@@ -247,21 +281,21 @@ int KeCubeInFrustum2( nv::vec3f v, float size )
     for( p = 0; p < 6; p++ )
     {
         c = 0;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z - size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z - size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y - size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y - size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x - size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x - size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             c++;
-        if( frustum[p][0] * (v.x + size) + frustum[p][1] * (v.y + size) + frustum[p][2] * (v.z + size) + frustum[p][3] > 0 )
+        if( current_frustum.planes[p][0] * (v.x + size) + current_frustum.planes[p][1] * (v.y + size) + current_frustum.planes[p][2] * (v.z + size) + current_frustum.planes[p][3] > 0 )
             c++;
         if( c == 0 )
             return 0;
@@ -285,7 +319,7 @@ bool KePolygonInFrustum( int num_points, nv::vec3f* point_list )
     {
         for( p = 0; p < num_points; p++ )
         {
-            if( frustum[f][0] * point_list[p].x + frustum[f][1] * point_list[p].y + frustum[f][2] * point_list[p].z + frustum[f][3] > 0 )
+            if( current_frustum.planes[f][0] * point_list[p].x + current_frustum.planes[f][1] * point_list[p].y + current_frustum.planes[f][2] * point_list[p].z + current_frustum.planes[f][3] > 0 )
                 break;
         }
         
@@ -297,6 +331,608 @@ bool KePolygonInFrustum( int num_points, nv::vec3f* point_list )
 }
 
 
+/*
+ * Batch culling
+ */
+
+/* Work for a single culling thread (radius is stored in extent_x for spheres) */
+struct KeFrustumCullJob
+{
+    const KeFrustumPlanes* frustum;
+    const float* x, *y, *z;
+    const float* extent_x, *extent_y, *extent_z;
+    uint8_t* visible;
+    uint32_t* view_masks;   /* Per object view masks (multi-view jobs only) */
+    int view_count;         /* Frusta pointed to by frustum (0 for single view jobs) */
+    int first, last;        /* Objects [first, last) */
+    int spheres;            /* Yes for spheres, No for boxes */
+    uint32_t visible_count;
+};
+
+/* Objects tested against every view before moving on (small enough to stay in the L1 cache) */
+#define KE_CULL_VIEW_BLOCK_SIZE 256
+
+/* Number of set bits in a 4-bit mask */
+static const uint8_t mask_bit_counts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+/* Tests the spheres of a single job.  A sphere is visible if it isn't entirely behind any plane. */
+static void KeCullSphereRange( KeFrustumCullJob* job )
+{
+    const float (*f)[4] = job->frustum->planes;
+    const float* x = job->x, *y = job->y, *z = job->z, *r = job->extent_x;
+    uint8_t* visible = job->visible;
+    uint32_t visible_count = 0;
+    int i = job->first;
+    
+#if defined(KE_AVX)
+    __m256 px[6], py[6], pz[6], pw[6];
+    for( int p = 0; p < 6; p++ )
+    {
+        px[p] = _mm256_set1_ps( f[p][0] ); py[p] = _mm256_set1_ps( f[p][1] );
+        pz[p] = _mm256_set1_ps( f[p][2] ); pw[p] = _mm256_set1_ps( f[p][3] );
+    }
+    
+    for( ; i + 8 <= job->last; i += 8 )
+    {
+        __m256 vx = _mm256_loadu_ps( x + i ), vy = _mm256_loadu_ps( y + i ), vz = _mm256_loadu_ps( z + i );
+        __m256 nr = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( r + i ) );
+        __m256 inside = _mm256_cmp_ps( nr, nr, _CMP_EQ_OQ );
+        
+        for( int p = 0; p < 6; p++ )
+        {
+            __m256 d = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( vx, px[p] ), _mm256_mul_ps( vy, py[p] ) ),
+                                      _mm256_add_ps( _mm256_mul_ps( vz, pz[p] ), pw[p] ) );
+            inside = _mm256_and_ps( inside, _mm256_cmp_ps( d, nr, _CMP_GT_OQ ) );
+        }
+        
+        int mask = _mm256_movemask_ps( inside );
+        for( int j = 0; j < 8; j++ )
+            visible[i+j] = ( mask >> j ) & 1;
+        visible_count += mask_bit_counts[mask & 0xF] + mask_bit_counts[mask >> 4];
+    }
+#elif defined(KE_SSE2)
+    __m128 px[6], py[6], pz[6], pw[6];
+    for( int p = 0; p < 6; p++ )
+    {
+        px[p] = _mm_set1_ps( f[p][0] ); py[p] = _mm_set1_ps( f[p][1] );
+        pz[p] = _mm_set1_ps( f[p][2] ); pw[p] = _mm_set1_ps( f[p][3] );
+    }
+    
+    for( ; i + 4 <= job->last; i += 4 )
+    {
+        __m128 vx = _mm_loadu_ps( x + i ), vy = _mm_loadu_ps( y + i ), vz = _mm_loadu_ps( z + i );
+        __m128 nr = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( r + i ) );
+        __m128 inside = _mm_cmpeq_ps( nr, nr );
+        
+        for( int p = 0; p < 6; p++ )
+        {
+            __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( vx, px[p] ), _mm_mul_ps( vy, py[p] ) ),
+                                   _mm_add_ps( _mm_mul_ps( vz, pz[p] ), pw[p] ) );
+            inside = _mm_and_ps( inside, _mm_cmpgt_ps( d, nr ) );
+        }
+        
+        int mask = _mm_movemask_ps( inside );
+        visible[i+0] = mask & 1;
+        visible[i+1] = ( mask >> 1 ) & 1;
+        visible[i+2] = ( mask >> 2 ) & 1;
+        visible[i+3] = ( mask >> 3 ) & 1;
+        visible_count += mask_bit_counts[mask];
+    }
+#elif defined(KE_NEON)
+    float32x4_t px[6], py[6], pz[6], pw[6];
+    for( int p = 0; p < 6; p++ )
+    {
+        px[p] = vdupq_n_f32( f[p][0] ); py[p] = vdupq_n_f32( f[p][1] );
+        pz[p] = vdupq_n_f32( f[p][2] ); pw[p] = vdupq_n_f32( f[p][3] );
+    }
+    
+    for( ; i + 4 <= job->last; i += 4 )
+    {
+        float32x4_t vx = vld1q_f32( x + i ), vy = vld1q_f32( y + i ), vz = vld1q_f32( z + i );
+        float32x4_t nr = vnegq_f32( vld1q_f32( r + i ) );
+        uint32x4_t inside = vdupq_n_u32( 1 );
+        
+        for( int p = 0; p < 6; p++ )
+        {
+            float32x4_t d = vaddq_f32( vaddq_f32( vmulq_f32( vx, px[p] ), vmulq_f32( vy, py[p] ) ),
+                                       vaddq_f32( vmulq_f32( vz, pz[p] ), pw[p] ) );
+            inside = vandq_u32( inside, vcgtq_f32( d, nr ) );
+        }
+        
+        visible[i+0] = (uint8_t) vgetq_lane_u32( inside, 0 );
+        visible[i+1] = (uint8_t) vgetq_lane_u32( inside, 1 );
+        visible[i+2] = (uint8_t) vgetq_lane_u32( inside, 2 );
+        visible[i+3] = (uint8_t) vgetq_lane_u32( inside, 3 );
+        visible_count += visible[i+0] + visible[i+1] + visible[i+2] + visible[i+3];
+    }
+#endif
+    
+    /* Whatever is left over */
+    for( ; i < job->last; i++ )
+    {
+        int inside = Yes;
+        
+        for( int p = 0; p < 6 && inside; p++ )
+        {
+            if( f[p][0] * x[i] + f[p][1] * y[i] + f[p][2] * z[i] + f[p][3] <= -r[i] )
+                inside = No;
+        }
+        
+        visible[i] = inside;
+        visible_count += inside;
+    }
+    
+    job->visible_count = visible_count;
+}
+
+/* Tests the boxes of a single job.  A box is visible if its corner furthest along each plane's
+   normal is in front of that plane (the same result as testing every corner). */
+static void KeCullBoxRange( KeFrustumCullJob* job )
+{
+    const float (*f)[4] = job->frustum->planes;
+    const float* x = job->x, *y = job->y, *z = job->z;
+    const float* ex = job->extent_x, *ey = job->extent_y, *ez = job->extent_z;
+    uint8_t* visible = job->visible;
+    uint32_t visible_count = 0;
+    int i = job->first;
+    
+#if defined(KE_AVX)
+    __m256 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for( int p = 0; p < 6; p++ )
+    {
+        px[p] = _mm256_set1_ps( f[p][0] ); py[p] = _mm256_set1_ps( f[p][1] );
+        pz[p] = _mm256_set1_ps( f[p][2] ); pw[p] = _mm256_set1_ps( f[p][3] );
+        ax[p] = _mm256_set1_ps( fabsf( f[p][0] ) ); ay[p] = _mm256_set1_ps( fabsf( f[p][1] ) );
+        az[p] = _mm256_set1_ps( fabsf( f[p][2] ) );
+    }
+    
+    for( ; i + 8 <= job->last; i += 8 )
+    {
+        __m256 vx = _mm256_loadu_ps( x + i ), vy = _mm256_loadu_ps( y + i ), vz = _mm256_loadu_ps( z + i );
+        __m256 vex = _mm256_loadu_ps( ex + i ), vey = _mm256_loadu_ps( ey + i ), vez = _mm256_loadu_ps( ez + i );
+        __m256 zero = _mm256_setzero_ps();
+        __m256 inside = _mm256_cmp_ps( zero, zero, _CMP_EQ_OQ );
+        
+        for( int p = 0; p < 6; p++ )
+        {
+            __m256 d = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( vx, px[p] ), _mm256_mul_ps( vy, py[p] ) ),
+                                      _mm256_add_ps( _mm256_mul_ps( vz, pz[p] ), pw[p] ) );
+            __m256 e = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( vex, ax[p] ), _mm256_mul_ps( vey, ay[p] ) ),
+                                      _mm256_mul_ps( vez, az[p] ) );
+            inside = _mm256_and_ps( inside, _mm256_cmp_ps( _mm256_add_ps( d, e ), zero, _CMP_GT_OQ ) );
+        }
+        
+        int mask = _mm256_movemask_ps( inside );
+        for( int j = 0; j < 8; j++ )
+            visible[i+j] = ( mask >> j ) & 1;
+        visible_count += mask_bit_counts[mask & 0xF] + mask_bit_counts[mask >> 4];
+    }
+#elif defined(KE_SSE2)
+    __m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for( int p = 0; p < 6; p++ )
+    {
+        px[p] = _mm_set1_ps( f[p][0] ); py[p] = _mm_set1_ps( f[p][1] );
+        pz[p] = _mm_set1_ps( f[p][2] ); pw[p] = _mm_set1_ps( f[p][3] );
+        ax[p] = _mm_set1_ps( fabsf( f[p][0] ) ); ay[p] = _mm_set1_ps( fabsf( f[p][1] ) );
+        az[p] = _mm_set1_ps( fabsf( f[p][2] ) );
+    }
+    
+    for( ; i + 4 <= job->last; i += 4 )
+    {
+        __m128 vx = _mm_loadu_ps( x + i ), vy = _mm_loadu_ps( y + i ), vz = _mm_loadu_ps( z + i );
+        __m128 vex = _mm_loadu_ps( ex + i ), vey = _mm_loadu_ps( ey + i ), vez = _mm_loadu_ps( ez + i );
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_cmpeq_ps( zero, zero );
+        
+        for( int p = 0; p < 6; p++ )
+        {
+            __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( vx, px[p] ), _mm_mul_ps( vy, py[p] ) ),
+                                   _mm_add_ps( _mm_mul_ps( vz, pz[p] ), pw[p] ) );
+            __m128 e = _mm_add_ps( _mm_add_ps( _mm_mul_ps( vex, ax[p] ), _mm_mul_ps( vey, ay[p] ) ),
+                                   _mm_mul_ps( vez, az[p] ) );
+            inside = _mm_and_ps( inside, _mm_cmpgt_ps( _mm_add_ps( d, e ), zero ) );
+        }
+        
+        int mask = _mm_movemask_ps( inside );
+        visible[i+0] = mask & 1;
+        visible[i+1] = ( mask >> 1 ) & 1;
+        visible[i+2] = ( mask >> 2 ) & 1;
+        visible[i+3] = ( mask >> 3 ) & 1;
+        visible_count += mask_bit_counts[mask];
+    }
+#elif defined(KE_NEON)
+    float32x4_t px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for( int p = 0; p < 6; p++ )
+    {
+        px[p] = vdupq_n_f32( f[p][0] ); py[p] = vdupq_n_f32( f[p][1] );
+        pz[p] = vdupq_n_f32( f[p][2] ); pw[p] = vdupq_n_f32( f[p][3] );
+        ax[p] = vdupq_n_f32( fabsf( f[p][0] ) ); ay[p] = vdupq_n_f32( fabsf( f[p][1] ) );
+        az[p] = vdupq_n_f32( fabsf( f[p][2] ) );
+    }
+    
+    for( ; i + 4 <= job->last; i += 4 )
+    {
+        float32x4_t vx = vld1q_f32( x + i ), vy = vld1q_f32( y + i ), vz = vld1q_f32( z + i );
+        float32x4_t vex = vld1q_f32( ex + i ), vey = vld1q_f32( ey + i ), vez = vld1q_f32( ez + i );
+        float32x4_t zero = vdupq_n_f32( 0.0f );
+        uint32x4_t inside = vdupq_n_u32( 1 );
+        
+        for( int p = 0; p < 6; p++ )
+        {
+            float32x4_t d = vaddq_f32( vaddq_f32( vmulq_f32( vx, px[p] ), vmulq_f32( vy, py[p] ) ),
+                                       vaddq_f32( vmulq_f32( vz, pz[p] ), pw[p] ) );
+            float32x4_t e = vaddq_f32( vaddq_f32( vmulq_f32( vex, ax[p] ), vmulq_f32( vey, ay[p] ) ),
+                                       vmulq_f32( vez, az[p] ) );
+            inside = vandq_u32( inside, vcgtq_f32( vaddq_f32( d, e ), zero ) );
+        }
+        
+        visible[i+0] = (uint8_t) vgetq_lane_u32( inside, 0 );
+        visible[i+1] = (uint8_t) vgetq_lane_u32( inside, 1 );
+        visible[i+2] = (uint8_t) vgetq_lane_u32( inside, 2 );
+        visible[i+3] = (uint8_t) vgetq_lane_u32( inside, 3 );
+        visible_count += visible[i+0] + visible[i+1] + visible[i+2] + visible[i+3];
+    }
+#endif
+    
+    /* Whatever is left over */
+    for( ; i < job->last; i++ )
+    {
+        int inside = Yes;
+        
+        for( int p = 0; p < 6 && inside; p++ )
+        {
+            float d = f[p][0] * x[i] + f[p][1] * y[i] + f[p][2] * z[i] + f[p][3];
+            float e = fabsf( f[p][0] ) * ex[i] + fabsf( f[p][1] ) * ey[i] + fabsf( f[p][2] ) * ez[i];
+            if( d + e <= 0 )
+                inside = No;
+        }
+        
+        visible[i] = inside;
+        visible_count += inside;
+    }
+    
+    job->visible_count = visible_count;
+}
+
+/* Tests the spheres or boxes of a single job against every view.  The objects are processed in
+   blocks small enough to stay in the L1 cache while each view is tested in turn, so they're
+   only read from memory once however many views there are.  Bit v of an object's mask is set
+   if it is visible in view v.  (Templated so that the sphere/box choice isn't made inside the
+   loops.) */
+template <int spheres> static void KeCullMultiViewRange( KeFrustumCullJob* job )
+{
+    const float* x = job->x, *y = job->y, *z = job->z;
+    const float* ex = job->extent_x, *ey = job->extent_y, *ez = job->extent_z;
+    uint32_t* masks = job->view_masks;
+    uint32_t visible_count = 0;
+    
+    for( int block = job->first; block < job->last; block += KE_CULL_VIEW_BLOCK_SIZE )
+    {
+        int block_end = block + KE_CULL_VIEW_BLOCK_SIZE < job->last ? block + KE_CULL_VIEW_BLOCK_SIZE : job->last;
+        
+        memset( masks + block, 0, sizeof( uint32_t ) * ( block_end - block ) );
+        
+        for( int v = 0; v < job->view_count; v++ )
+        {
+            const float (*f)[4] = job->frustum[v].planes;
+            int i = block;
+            
+#if defined(KE_AVX)
+            __m256 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+            for( int p = 0; p < 6; p++ )
+            {
+                px[p] = _mm256_set1_ps( f[p][0] ); py[p] = _mm256_set1_ps( f[p][1] );
+                pz[p] = _mm256_set1_ps( f[p][2] ); pw[p] = _mm256_set1_ps( f[p][3] );
+                ax[p] = _mm256_set1_ps( fabsf( f[p][0] ) ); ay[p] = _mm256_set1_ps( fabsf( f[p][1] ) );
+                az[p] = _mm256_set1_ps( fabsf( f[p][2] ) );
+            }
+            __m256 bit = _mm256_castsi256_ps( _mm256_set1_epi32( (int) ( 1u << v ) ) );
+            
+            for( ; i + 8 <= block_end; i += 8 )
+            {
+                __m256 vx = _mm256_loadu_ps( x + i ), vy = _mm256_loadu_ps( y + i ), vz = _mm256_loadu_ps( z + i );
+                __m256 vex = _mm256_loadu_ps( ex + i ), vey = vex, vez = vex;
+                if( !spheres )
+                {
+                    vey = _mm256_loadu_ps( ey + i );
+                    vez = _mm256_loadu_ps( ez + i );
+                }
+                __m256 zero = _mm256_setzero_ps();
+                __m256 inside = _mm256_cmp_ps( zero, zero, _CMP_EQ_OQ );
+                
+                for( int p = 0; p < 6; p++ )
+                {
+                    __m256 d = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( vx, px[p] ), _mm256_mul_ps( vy, py[p] ) ),
+                                              _mm256_add_ps( _mm256_mul_ps( vz, pz[p] ), pw[p] ) );
+                    __m256 e = spheres ? vex : _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( vex, ax[p] ), _mm256_mul_ps( vey, ay[p] ) ),
+                                                              _mm256_mul_ps( vez, az[p] ) );
+                    inside = _mm256_and_ps( inside, _mm256_cmp_ps( _mm256_add_ps( d, e ), zero, _CMP_GT_OQ ) );
+                }
+                
+                float* m = (float*) ( masks + i );
+                _mm256_storeu_ps( m, _mm256_or_ps( _mm256_loadu_ps( m ), _mm256_and_ps( inside, bit ) ) );
+            }
+#elif defined(KE_SSE2)
+            __m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+            for( int p = 0; p < 6; p++ )
+            {
+                px[p] = _mm_set1_ps( f[p][0] ); py[p] = _mm_set1_ps( f[p][1] );
+                pz[p] = _mm_set1_ps( f[p][2] ); pw[p] = _mm_set1_ps( f[p][3] );
+                ax[p] = _mm_set1_ps( fabsf( f[p][0] ) ); ay[p] = _mm_set1_ps( fabsf( f[p][1] ) );
+                az[p] = _mm_set1_ps( fabsf( f[p][2] ) );
+            }
+            __m128i bit = _mm_set1_epi32( (int) ( 1u << v ) );
+            
+            for( ; i + 4 <= block_end; i += 4 )
+            {
+                __m128 vx = _mm_loadu_ps( x + i ), vy = _mm_loadu_ps( y + i ), vz = _mm_loadu_ps( z + i );
+                __m128 vex = _mm_loadu_ps( ex + i ), vey = vex, vez = vex;
+                if( !spheres )
+                {
+                    vey = _mm_loadu_ps( ey + i );
+                    vez = _mm_loadu_ps( ez + i );
+                }
+                __m128 zero = _mm_setzero_ps();
+                __m128 inside = _mm_cmpeq_ps( zero, zero );
+                
+                for( int p = 0; p < 6; p++ )
+                {
+                    __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( vx, px[p] ), _mm_mul_ps( vy, py[p] ) ),
+                                           _mm_add_ps( _mm_mul_ps( vz, pz[p] ), pw[p] ) );
+                    __m128 e = spheres ? vex : _mm_add_ps( _mm_add_ps( _mm_mul_ps( vex, ax[p] ), _mm_mul_ps( vey, ay[p] ) ),
+                                                           _mm_mul_ps( vez, az[p] ) );
+                    inside = _mm_and_ps( inside, _mm_cmpgt_ps( _mm_add_ps( d, e ), zero ) );
+                }
+                
+                __m128i* m = (__m128i*) ( masks + i );
+                _mm_storeu_si128( m, _mm_or_si128( _mm_loadu_si128( m ), _mm_and_si128( _mm_castps_si128( inside ), bit ) ) );
+            }
+#elif defined(KE_NEON)
+            float32x4_t px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+            for( int p = 0; p < 6; p++ )
+            {
+                px[p] = vdupq_n_f32( f[p][0] ); py[p] = vdupq_n_f32( f[p][1] );
+                pz[p] = vdupq_n_f32( f[p][2] ); pw[p] = vdupq_n_f32( f[p][3] );
+                ax[p] = vdupq_n_f32( fabsf( f[p][0] ) ); ay[p] = vdupq_n_f32( fabsf( f[p][1] ) );
+                az[p] = vdupq_n_f32( fabsf( f[p][2] ) );
+            }
+            uint32x4_t bit = vdupq_n_u32( 1u << v );
+            
+            for( ; i + 4 <= block_end; i += 4 )
+            {
+                float32x4_t vx = vld1q_f32( x + i ), vy = vld1q_f32( y + i ), vz = vld1q_f32( z + i );
+                float32x4_t vex = vld1q_f32( ex + i ), vey = vex, vez = vex;
+                if( !spheres )
+                {
+                    vey = vld1q_f32( ey + i );
+                    vez = vld1q_f32( ez + i );
+                }
+                float32x4_t zero = vdupq_n_f32( 0.0f );
+                uint32x4_t inside = vdupq_n_u32( 0xFFFFFFFF );
+                
+                for( int p = 0; p < 6; p++ )
+                {
+                    float32x4_t d = vaddq_f32( vaddq_f32( vmulq_f32( vx, px[p] ), vmulq_f32( vy, py[p] ) ),
+                                               vaddq_f32( vmulq_f32( vz, pz[p] ), pw[p] ) );
+                    float32x4_t e = spheres ? vex : vaddq_f32( vaddq_f32( vmulq_f32( vex, ax[p] ), vmulq_f32( vey, ay[p] ) ),
+                                                               vmulq_f32( vez, az[p] ) );
+                    inside = vandq_u32( inside, vcgtq_f32( vaddq_f32( d, e ), zero ) );
+                }
+                
+                vst1q_u32( masks + i, vorrq_u32( vld1q_u32( masks + i ), vandq_u32( inside, bit ) ) );
+            }
+#endif
+            
+            /* Whatever is left over */
+            for( ; i < block_end; i++ )
+            {
+                int inside = Yes;
+                
+                for( int p = 0; p < 6 && inside; p++ )
+                {
+                    float d = f[p][0] * x[i] + f[p][1] * y[i] + f[p][2] * z[i] + f[p][3];
+                    float e = spheres ? ex[i] : fabsf( f[p][0] ) * ex[i] + fabsf( f[p][1] ) * ey[i] + fabsf( f[p][2] ) * ez[i];
+                    if( d + e <= 0 )
+                        inside = No;
+                }
+                
+                masks[i] |= uint32_t( inside ) << v;
+            }
+        }
+        
+        for( int i = block; i < block_end; i++ )
+            visible_count += masks[i] ? 1 : 0;
+    }
+    
+    job->visible_count = visible_count;
+}
+
+/* Culling thread entry point */
+#ifdef _WIN32
+static uint32_t __stdcall KeFrustumCullThreadProc( void* context )
+#else
+static void KeFrustumCullThreadProc( void* context )
+#endif
+{
+    KeFrustumCullJob* job = (KeFrustumCullJob*) context;
+    
+    if( job->view_count > 0 && job->spheres )
+        KeCullMultiViewRange<Yes>( job );
+    else if( job->view_count > 0 )
+        KeCullMultiViewRange<No>( job );
+    else if( job->spheres )
+        KeCullSphereRange( job );
+    else
+        KeCullBoxRange( job );
+    
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+/* Splits a culling job into ranges (multiples of 64 objects, so no two threads write to the
+   same cache line of the output) and runs them on up to thread_count threads */
+static uint32_t KeFrustumCull( KeFrustumCullJob* job, int count, int thread_count )
+{
+    if( thread_count <= 0 )
+        thread_count = count >= KE_MIN_THREADED_CULL_OBJECTS ? 4 : 1;
+    if( thread_count > KE_MAX_CULL_THREADS )
+        thread_count = KE_MAX_CULL_THREADS;
+    if( thread_count > ( count + 63 ) / 64 )
+        thread_count = ( count + 63 ) / 64;
+    if( thread_count < 1 )
+        thread_count = 1;
+    
+    KeFrustumCullJob jobs[KE_MAX_CULL_THREADS];
+    KeThread* threads[KE_MAX_CULL_THREADS];
+    int objects_per_job = ( ( ( count + thread_count - 1 ) / thread_count ) + 63 ) & ~63;
+    
+    for( int i = 0; i < thread_count; i++ )
+    {
+        jobs[i] = *job;
+        jobs[i].first = i * objects_per_job < count ? i * objects_per_job : count;
+        jobs[i].last = ( i + 1 ) * objects_per_job < count ? ( i + 1 ) * objects_per_job : count;
+        jobs[i].visible_count = 0;
+    }
+    
+    /* The calling thread takes the first range */
+    for( int i = 1; i < thread_count; i++ )
+        threads[i] = new KeThread( KeFrustumCullThreadProc, &jobs[i] );
+    
+    KeFrustumCullThreadProc( &jobs[0] );
+    
+    /* Wait for the worker threads to finish (the destructor joins POSIX threads) */
+    uint32_t visible_count = jobs[0].visible_count;
+    for( int i = 1; i < thread_count; i++ )
+    {
+#ifdef _WIN32
+        threads[i]->Wait( INFINITE );
+#endif
+        delete threads[i];
+        visible_count += jobs[i].visible_count;
+    }
+    
+    return visible_count;
+}
+
+
+/*
+ * Name: KeCullSpheres
+ * Desc: Tests an array of bounding spheres (stored as separate x, y, z and radius arrays)
+ *       against a frustum, writing 1 to visible_out for each sphere that is at least partly
+ *       inside and 0 otherwise, and returns the number of visible spheres.
+ */
+uint32_t KeCullSpheres( const KeFrustumPlanes* frustum, const float* x, const float* y, const float* z, const float* radius, int count, uint8_t* visible_out, int thread_count )
+{
+    if( count <= 0 )
+        return 0;
+    
+    KeFrustumCullJob job;
+    ZeroMemory( &job, sizeof( KeFrustumCullJob ) );
+    job.frustum = frustum;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.extent_x = radius;
+    job.visible = visible_out;
+    job.spheres = Yes;
+    
+    return KeFrustumCull( &job, count, thread_count );
+}
+
+
+/*
+ * Name: KeCullBoxes
+ * Desc: Same as the above, but for axis aligned bounding boxes stored as separate centre and
+ *       half extent arrays.
+ */
+uint32_t KeCullBoxes( const KeFrustumPlanes* frustum, const float* x, const float* y, const float* z, const float* extent_x, const float* extent_y, const float* extent_z, int count, uint8_t* visible_out, int thread_count )
+{
+    if( count <= 0 )
+        return 0;
+    
+    KeFrustumCullJob job;
+    ZeroMemory( &job, sizeof( KeFrustumCullJob ) );
+    job.frustum = frustum;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.extent_x = extent_x;
+    job.extent_y = extent_y;
+    job.extent_z = extent_z;
+    job.visible = visible_out;
+    job.spheres = No;
+    
+    return KeFrustumCull( &job, count, thread_count );
+}
+
+
+/*
+ * Name: KeCullSpheresMultiView
+ * Desc: Tests an array of bounding spheres against several frusta (shadow cascades, split
+ *       screen views, etc.) in a single pass, writing a mask to view_masks_out for each sphere
+ *       with bit v set if it is at least partly inside frusta[v].  Returns the number of
+ *       spheres visible in at least one view.
+ */
+uint32_t KeCullSpheresMultiView( const KeFrustumPlanes* frusta, int view_count, const float* x, const float* y, const float* z, const float* radius, int count, uint32_t* view_masks_out, int thread_count )
+{
+    if( count <= 0 || view_count <= 0 )
+        return 0;
+    
+    if( view_count > KE_MAX_CULL_VIEWS )
+    {
+        DISPDBG( KE_WARNING, "Only the first " << KE_MAX_CULL_VIEWS << " views are culled!" );
+        view_count = KE_MAX_CULL_VIEWS;
+    }
+    
+    KeFrustumCullJob job;
+    ZeroMemory( &job, sizeof( KeFrustumCullJob ) );
+    job.frustum = frusta;
+    job.view_count = view_count;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.extent_x = radius;
+    job.view_masks = view_masks_out;
+    job.spheres = Yes;
+    
+    return KeFrustumCull( &job, count, thread_count );
+}
+
+
+/*
+ * Name: KeCullBoxesMultiView
+ * Desc: Same as the above, but for axis aligned bounding boxes stored as separate centre and
+ *       half extent arrays.
+ */
+uint32_t KeCullBoxesMultiView( const KeFrustumPlanes* frusta, int view_count, const float* x, const float* y, const float* z, const float* extent_x, const float* extent_y, const float* extent_z, int count, uint32_t* view_masks_out, int thread_count )
+{
+    if( count <= 0 || view_count <= 0 )
+        return 0;
+    
+    if( view_count > KE_MAX_CULL_VIEWS )
+    {
+        DISPDBG( KE_WARNING, "Only the first " << KE_MAX_CULL_VIEWS << " views are culled!" );
+        view_count = KE_MAX_CULL_VIEWS;
+    }
+    
+    KeFrustumCullJob job;
+    ZeroMemory( &job, sizeof( KeFrustumCullJob ) );
+    job.frustum = frusta;
+    job.view_count = view_count;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.extent_x = extent_x;
+    job.extent_y = extent_y;
+    job.extent_z = extent_z;
+    job.view_masks = view_masks_out;
+    job.spheres = No;
+    
+    return KeFrustumCull( &job, count, thread_count );
+}
+
+
 /*
  * Name: KeProjectVertex
  * Desc: Takes a point in 3D space and returns a 2D screen coordinate. This func-
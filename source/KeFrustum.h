@@ -9,6 +9,24 @@
 #define __frustum__
 
 
+/*
+ * Frustum planes (right, left, bottom, top, far, near), each as a normalized ax+by+cz+d with
+ * the normal facing inwards.  Being a plain value, any number of these can be used at once
+ * from any thread.
+ */
+struct KeFrustumPlanes
+{
+    float planes[6][4];
+};
+
+/*
+ * Batch culling defaults
+ */
+#define KE_MIN_THREADED_CULL_OBJECTS    (256*1024)  /* Objects below which threads cost more than they save */
+#define KE_MAX_CULL_THREADS             8
+#define KE_MAX_CULL_VIEWS               32          /* One bit per view in a view mask */
+
+
 /*
  * Name: KeCalculateFrustum
  * Desc: Calculates the current frustum based on the supplied modelview and projection
@@ -16,6 +34,53 @@
  */
 void KeCalculateFrustum( nv::matrix4f modelview_matrix, nv::matrix4f projection_matrix );
 
+/*
+ * Name: KeCalculateFrustumPlanes
+ * Desc: Same as the above, but writes the frustum to frustum_out instead of the current frustum.
+ */
+void KeCalculateFrustumPlanes( const nv::matrix4f& modelview_matrix, const nv::matrix4f& projection_matrix, KeFrustumPlanes* frustum_out );
+
+/*
+ * Name: KeGetFrustumPlanes
+ * Desc: Returns a copy of the current frustum (the one used by the functions below).
+ */
+void KeGetFrustumPlanes( KeFrustumPlanes* frustum_out );
+
+/*
+ * Name: KeCullSpheres
+ * Desc: Tests an array of bounding spheres (stored as separate x, y, z and radius arrays)
+ *       against a frustum, writing 1 to visible_out for each sphere that is at least partly
+ *       inside and 0 otherwise, and returns the number of visible spheres.  Uses SSE/AVX/NEON
+ *       to test 4-8 spheres at once.  Large arrays are split across several threads; pass 0
+ *       for thread_count to use a default, or 1 to stay on the calling thread.  To split the
+ *       work yourself, call this with offset pointers and a thread_count of 1.
+ */
+uint32_t KeCullSpheres( const KeFrustumPlanes* frustum, const float* x, const float* y, const float* z, const float* radius, int count, uint8_t* visible_out, int thread_count = 0 );
+
+/*
+ * Name: KeCullBoxes
+ * Desc: Same as the above, but for axis aligned bounding boxes stored as separate centre and
+ *       half extent arrays.
+ */
+uint32_t KeCullBoxes( const KeFrustumPlanes* frustum, const float* x, const float* y, const float* z, const float* extent_x, const float* extent_y, const float* extent_z, int count, uint8_t* visible_out, int thread_count = 0 );
+
+/*
+ * Name: KeCullSpheresMultiView
+ * Desc: Tests an array of bounding spheres against up to KE_MAX_CULL_VIEWS frusta (shadow
+ *       cascades, reflection views, split screen views, etc.) in a single pass, so the spheres
+ *       are only read once.  Writes a mask to view_masks_out for each sphere with bit v set if
+ *       it is at least partly inside frusta[v], and returns the number of spheres visible in at
+ *       least one view.  Threads are used in the same way as KeCullSpheres.
+ */
+uint32_t KeCullSpheresMultiView( const KeFrustumPlanes* frusta, int view_count, const float* x, const float* y, const float* z, const float* radius, int count, uint32_t* view_masks_out, int thread_count = 0 );
+
+/*
+ * Name: KeCullBoxesMultiView
+ * Desc: Same as the above, but for axis aligned bounding boxes stored as separate centre and
+ *       half extent arrays.
+ */
+uint32_t KeCullBoxesMultiView( const KeFrustumPlanes* frusta, int view_count, const float* x, const float* y, const float* z, const float* extent_x, const float* extent_y, const float* extent_z, int count, uint32_t* view_masks_out, int thread_count = 0 );
+
 /*
  * Name: KePointInFrustum
  * Desc: Returns yes if this point is in the viewing frustum.
@@ -73,6 +138,12 @@ namespace Ke
     namespace Frustum
     {
         static void    (*Calculate)( nv::matrix4f, nv::matrix4f ) = KeCalculateFrustum;
+        static void    (*CalculatePlanes)( const nv::matrix4f&, const nv::matrix4f&, KeFrustumPlanes* ) = KeCalculateFrustumPlanes;
+        static void    (*GetPlanes)( KeFrustumPlanes* ) = KeGetFrustumPlanes;
+        static uint32_t (*CullSpheres)( const KeFrustumPlanes*, const float*, const float*, const float*, const float*, int, uint8_t*, int ) = KeCullSpheres;
+        static uint32_t (*CullBoxes)( const KeFrustumPlanes*, const float*, const float*, const float*, const float*, const float*, const float*, int, uint8_t*, int ) = KeCullBoxes;
+        static uint32_t (*CullSpheresMultiView)( const KeFrustumPlanes*, int, const float*, const float*, const float*, const float*, int, uint32_t*, int ) = KeCullSpheresMultiView;
+        static uint32_t (*CullBoxesMultiView)( const KeFrustumPlanes*, int, const float*, const float*, const float*, const float*, const float*, const float*, int, uint32_t*, int ) = KeCullBoxesMultiView;
         static bool    (*PointVisible)( nv::vec3f ) = KePointInFrustum;
         static float   (*SphereVisible)( nv::vec3f, float ) = KeSphereInFrustum;
         static bool    (*CubeVisible)( nv::vec3f, float ) = KeCubeInFrustum;
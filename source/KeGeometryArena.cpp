@@ -0,0 +1,838 @@
+//
+//  KeGeometryArena.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeGeometryArena.h"
+#include <algorithm>
+#include <functional>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/* Index of the highest set bit (x must be non-zero) */
+static inline int KeFls( uint32_t x )
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse( &index, x );
+    return (int) index;
+#else
+    return 31 - __builtin_clz( x );
+#endif
+}
+
+/* Index of the lowest set bit (x must be non-zero) */
+static inline int KeFfs( uint32_t x )
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward( &index, x );
+    return (int) index;
+#else
+    return __builtin_ctz( x );
+#endif
+}
+
+
+/*
+ * Name: KeTlsfAllocator::KeTlsfAllocator
+ * Desc: Default constructor
+ */
+KeTlsfAllocator::KeTlsfAllocator() : fl_bitmap(0), size(0), free_size(0)
+{
+    ZeroMemory( sl_bitmap, sizeof( sl_bitmap ) );
+}
+
+
+/*
+ * Name: KeTlsfAllocator::~KeTlsfAllocator
+ * Desc: Default deconstructor
+ */
+KeTlsfAllocator::~KeTlsfAllocator()
+{
+}
+
+
+/*
+ * Name: KeTlsfAllocator::Initialize
+ * Desc: Resets the allocator to manage a single free range of the given size.
+ */
+void KeTlsfAllocator::Initialize( uint32_t size )
+{
+    blocks.clear();
+    unused_blocks.clear();
+
+    fl_bitmap = 0;
+    ZeroMemory( sl_bitmap, sizeof( sl_bitmap ) );
+    for( int fl = 0; fl < KE_TLSF_FL_COUNT; fl++ )
+    {
+        for( int sl = 0; sl < KE_TLSF_SL_COUNT; sl++ )
+            free_lists[fl][sl] = KE_TLSF_INVALID;
+    }
+
+    this->size = size;
+    this->free_size = 0;
+
+    if( !size )
+        return;
+
+    uint32_t block = PVT_NewBlock();
+    blocks[block].offset = 0;
+    blocks[block].size = size;
+    blocks[block].prev_physical = KE_TLSF_INVALID;
+    blocks[block].next_physical = KE_TLSF_INVALID;
+    blocks[block].free = Yes;
+
+    PVT_InsertFreeBlock( block );
+    free_size = size;
+}
+
+
+/*
+ * Name: KeTlsfAllocator::Alloc
+ * Desc: Allocates a range of the requested size.  Returns the block identifier to pass to
+ *       KeTlsfAllocator::Free, or KE_TLSF_INVALID if no free range is large enough.
+ */
+uint32_t KeTlsfAllocator::Alloc( uint32_t size, uint32_t* offset )
+{
+    if( !size )
+        return KE_TLSF_INVALID;
+
+    uint32_t block = PVT_FindFreeBlock( size );
+    if( block == KE_TLSF_INVALID )
+        return KE_TLSF_INVALID;
+
+    PVT_RemoveFreeBlock( block );
+
+    /* Split off whatever we don't need and return it to the free lists */
+    if( blocks[block].size > size )
+    {
+        uint32_t remainder = PVT_NewBlock();
+        KeTlsfBlock* b = &blocks[block];
+        KeTlsfBlock* r = &blocks[remainder];
+
+        r->offset = b->offset + size;
+        r->size = b->size - size;
+        r->prev_physical = block;
+        r->next_physical = b->next_physical;
+        r->free = Yes;
+
+        if( b->next_physical != KE_TLSF_INVALID )
+            blocks[b->next_physical].prev_physical = remainder;
+
+        b->next_physical = remainder;
+        b->size = size;
+
+        PVT_InsertFreeBlock( remainder );
+    }
+
+    blocks[block].free = No;
+    free_size -= size;
+
+    if( offset )
+        *offset = blocks[block].offset;
+
+    return block;
+}
+
+
+/*
+ * Name: KeTlsfAllocator::Free
+ * Desc: Releases a block, merging it with any free neighbours.
+ */
+void KeTlsfAllocator::Free( uint32_t block )
+{
+    if( block == KE_TLSF_INVALID || block >= blocks.size() || blocks[block].free )
+        return;
+
+    blocks[block].free = Yes;
+    free_size += blocks[block].size;
+
+    /* Merge with the previous block */
+    uint32_t prev = blocks[block].prev_physical;
+    if( prev != KE_TLSF_INVALID && blocks[prev].free )
+    {
+        PVT_RemoveFreeBlock( prev );
+
+        blocks[prev].size += blocks[block].size;
+        blocks[prev].next_physical = blocks[block].next_physical;
+        if( blocks[block].next_physical != KE_TLSF_INVALID )
+            blocks[blocks[block].next_physical].prev_physical = prev;
+
+        unused_blocks.push_back( block );
+        block = prev;
+    }
+
+    /* Merge with the next block */
+    uint32_t next = blocks[block].next_physical;
+    if( next != KE_TLSF_INVALID && blocks[next].free )
+    {
+        PVT_RemoveFreeBlock( next );
+
+        blocks[block].size += blocks[next].size;
+        blocks[block].next_physical = blocks[next].next_physical;
+        if( blocks[next].next_physical != KE_TLSF_INVALID )
+            blocks[blocks[next].next_physical].prev_physical = block;
+
+        unused_blocks.push_back( next );
+    }
+
+    PVT_InsertFreeBlock( block );
+}
+
+
+/*
+ * Name: KeTlsfAllocator::GetLargestFreeBlock
+ * Desc: Returns the size of the largest free range.
+ */
+uint32_t KeTlsfAllocator::GetLargestFreeBlock()
+{
+    if( !fl_bitmap )
+        return 0;
+
+    /* The largest block lives in the highest non-empty list */
+    int fl = KeFls( fl_bitmap );
+    int sl = KeFls( sl_bitmap[fl] );
+    uint32_t largest = 0;
+
+    for( uint32_t block = free_lists[fl][sl]; block != KE_TLSF_INVALID; block = blocks[block].next_free )
+    {
+        if( blocks[block].size > largest )
+            largest = blocks[block].size;
+    }
+
+    return largest;
+}
+
+
+/* Maps a size to its first and second level list */
+void KeTlsfAllocator::PVT_Mapping( uint32_t size, int* fl, int* sl )
+{
+    if( size < KE_TLSF_SL_COUNT )
+    {
+        *fl = 0;
+        *sl = (int) size;
+    }
+    else
+    {
+        int f = KeFls( size );
+        *sl = (int) ( ( size >> ( f - KE_TLSF_SL_BITS ) ) ^ KE_TLSF_SL_COUNT );
+        *fl = f - KE_TLSF_SL_BITS + 1;
+    }
+}
+
+/* Finds a free block at least as large as size; every block in the list searched is big enough */
+uint32_t KeTlsfAllocator::PVT_FindFreeBlock( uint32_t size )
+{
+    int fl, sl;
+    uint32_t search = size;
+
+    /* Round up to the next list so that we never have to walk a list looking for a fit */
+    if( size >= KE_TLSF_SL_COUNT )
+        search += ( 1U << ( KeFls( size ) - KE_TLSF_SL_BITS ) ) - 1;
+
+    if( search >= size )
+    {
+        PVT_Mapping( search, &fl, &sl );
+
+        uint32_t sl_map = sl_bitmap[fl] & ( 0xFFFFFFFF << sl );
+        if( !sl_map && fl + 1 < KE_TLSF_FL_COUNT )
+        {
+            uint32_t fl_map = fl_bitmap & ( 0xFFFFFFFF << ( fl + 1 ) );
+            if( fl_map )
+            {
+                fl = KeFfs( fl_map );
+                sl_map = sl_bitmap[fl];
+            }
+        }
+
+        if( sl_map )
+            return free_lists[fl][KeFfs( sl_map )];
+    }
+
+    /* Nothing in the larger lists; a block in the request's own list may still fit */
+    PVT_Mapping( size, &fl, &sl );
+
+    for( uint32_t block = free_lists[fl][sl]; block != KE_TLSF_INVALID; block = blocks[block].next_free )
+    {
+        if( blocks[block].size >= size )
+            return block;
+    }
+
+    return KE_TLSF_INVALID;
+}
+
+/* Pushes a block onto the front of its free list */
+void KeTlsfAllocator::PVT_InsertFreeBlock( uint32_t block )
+{
+    int fl, sl;
+    PVT_Mapping( blocks[block].size, &fl, &sl );
+
+    uint32_t head = free_lists[fl][sl];
+
+    blocks[block].prev_free = KE_TLSF_INVALID;
+    blocks[block].next_free = head;
+    if( head != KE_TLSF_INVALID )
+        blocks[head].prev_free = block;
+
+    free_lists[fl][sl] = block;
+    fl_bitmap |= ( 1U << fl );
+    sl_bitmap[fl] |= ( 1U << sl );
+}
+
+/* Unlinks a block from its free list */
+void KeTlsfAllocator::PVT_RemoveFreeBlock( uint32_t block )
+{
+    int fl, sl;
+    PVT_Mapping( blocks[block].size, &fl, &sl );
+
+    uint32_t prev = blocks[block].prev_free;
+    uint32_t next = blocks[block].next_free;
+
+    if( prev != KE_TLSF_INVALID )
+        blocks[prev].next_free = next;
+    if( next != KE_TLSF_INVALID )
+        blocks[next].prev_free = prev;
+
+    if( free_lists[fl][sl] == block )
+    {
+        free_lists[fl][sl] = next;
+
+        if( next == KE_TLSF_INVALID )
+        {
+            sl_bitmap[fl] &= ~( 1U << sl );
+            if( !sl_bitmap[fl] )
+                fl_bitmap &= ~( 1U << fl );
+        }
+    }
+
+    blocks[block].prev_free = KE_TLSF_INVALID;
+    blocks[block].next_free = KE_TLSF_INVALID;
+}
+
+/* Returns an unused block header */
+uint32_t KeTlsfAllocator::PVT_NewBlock()
+{
+    if( !unused_blocks.empty() )
+    {
+        uint32_t block = unused_blocks.back();
+        unused_blocks.pop_back();
+        return block;
+    }
+
+    KeTlsfBlock b;
+    ZeroMemory( &b, sizeof( KeTlsfBlock ) );
+    blocks.push_back( b );
+
+    return (uint32_t) blocks.size() - 1;
+}
+
+
+/*
+ * Name: KeGeometryArena::KeGeometryArena
+ * Desc: Default constructor.  Pages are created on demand with room for the given number of
+ *       vertices and indices (larger allocations get a page of their own).
+ */
+KeGeometryArena::KeGeometryArena( IKeRenderDevice* device, uint32_t page_vertices, uint32_t page_indices ) : device(device), page_vertices(page_vertices), page_indices(page_indices)
+{
+    KeRenderDeviceCaps caps;
+
+    ZeroMemory( &caps, sizeof( KeRenderDeviceCaps ) );
+    if( device )
+        device->GetDeviceCaps( &caps );
+
+    base_vertex_supported = caps.base_vertex_supported;
+}
+
+
+/*
+ * Name: KeGeometryArena::~KeGeometryArena
+ * Desc: Default deconstructor.  Deletes every page, so all handles become invalid.
+ */
+KeGeometryArena::~KeGeometryArena()
+{
+    for( size_t i = 0; i < pools.size(); i++ )
+    {
+        for( size_t j = 0; j < pools[i]->pages.size(); j++ )
+        {
+            device->DeleteGeometryBuffer( pools[i]->pages[j]->geometry_buffer );
+            delete pools[i]->pages[j];
+        }
+
+        delete pools[i];
+    }
+}
+
+
+/*
+ * Name: KeGeometryArena::Allocate
+ * Desc: Sub-allocates room for a mesh within a page sharing its vertex layout and index type,
+ *       and optionally fills it with the given data.  Indices are relative to the mesh's own
+ *       first vertex.  Returns a handle, or KE_ARENA_INVALID_HANDLE on failure.
+ * NOTE: Without base vertex support, indices are rebased as they are written, so 16-bit index
+ *       pages must not hold more than 65536 vertices.
+ */
+int KeGeometryArena::Allocate( KeVertexAttribute* va, uint32_t index_type, void* vertex_data, uint32_t vertex_count, void* index_data, uint32_t index_count )
+{
+    /* Sanity checks */
+    if( !device || !va || va[0].index == -1 )
+    {
+        DISPDBG( KE_ERROR, "Invalid device or vertex attributes!" );
+        return KE_ARENA_INVALID_HANDLE;
+    }
+    if( !vertex_count )
+    {
+        DISPDBG( KE_ERROR, "(vertex_count == 0) condition is not allowed..." );
+        return KE_ARENA_INVALID_HANDLE;
+    }
+    if( index_type != KE_UNSIGNED_SHORT && index_type != KE_UNSIGNED_INT )
+    {
+        DISPDBG( KE_ERROR, "Index type must be KE_UNSIGNED_SHORT or KE_UNSIGNED_INT!" );
+        return KE_ARENA_INVALID_HANDLE;
+    }
+
+    int p = PVT_FindPool( va, index_type );
+    KeGeometryPool* pool = pools[p];
+
+    KeGeometryAllocation a;
+    ZeroMemory( &a, sizeof( KeGeometryAllocation ) );
+    a.pool = p;
+    a.page = -1;
+    a.index_block = KE_TLSF_INVALID;
+    a.vertex_count = vertex_count;
+    a.index_count = index_count;
+    a.in_use = Yes;
+
+    /* Look for a page with enough room for both the vertices and indices */
+    for( size_t i = 0; i < pool->pages.size() && a.page == -1; i++ )
+    {
+        KeGeometryPage* page = pool->pages[i];
+
+        a.vertex_block = page->vertices.Alloc( vertex_count, &a.base_vertex );
+        if( a.vertex_block == KE_TLSF_INVALID )
+            continue;
+
+        if( index_count )
+        {
+            a.index_block = page->indices.Alloc( index_count, &a.first_index );
+            if( a.index_block == KE_TLSF_INVALID )
+            {
+                page->vertices.Free( a.vertex_block );
+                continue;
+            }
+        }
+
+        a.page = (int) i;
+    }
+
+    /* Nothing fits, so start a new page */
+    if( a.page == -1 )
+    {
+        KeGeometryPage* page = PVT_CreatePage( pool, vertex_count > page_vertices ? vertex_count : page_vertices,
+                                                      index_count > page_indices ? index_count : page_indices );
+        if( !page )
+            return KE_ARENA_INVALID_HANDLE;
+
+        a.vertex_block = page->vertices.Alloc( vertex_count, &a.base_vertex );
+        if( index_count )
+            a.index_block = page->indices.Alloc( index_count, &a.first_index );
+
+        a.page = (int) pool->pages.size() - 1;
+    }
+
+    pool->pages[a.page]->allocation_count++;
+
+    /* Store the allocation under a new or recycled handle */
+    int handle;
+    if( !free_handles.empty() )
+    {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        allocations[handle] = a;
+    }
+    else
+    {
+        handle = (int) allocations.size();
+        allocations.push_back( a );
+    }
+
+    /* Upload the initial contents */
+    if( vertex_data )
+        SetVertexData( handle, 0, vertex_count, vertex_data );
+    if( index_data && index_count )
+        SetIndexData( handle, 0, index_count, index_data );
+
+    return handle;
+}
+
+
+/*
+ * Name: KeGeometryArena::Free
+ * Desc: Releases an allocation.  Empty pages are kept until the next call to
+ *       KeGeometryArena::Compact.
+ */
+void KeGeometryArena::Free( int handle )
+{
+    if( handle < 0 || handle >= (int) allocations.size() || !allocations[handle].in_use )
+        DISPDBG_R( KE_WARNING, "Invalid geometry arena handle!" );
+
+    KeGeometryAllocation* a = &allocations[handle];
+    KeGeometryPage* page = pools[a->pool]->pages[a->page];
+
+    page->vertices.Free( a->vertex_block );
+    if( a->index_block != KE_TLSF_INVALID )
+        page->indices.Free( a->index_block );
+    page->allocation_count--;
+
+    a->in_use = No;
+    free_handles.push_back( handle );
+}
+
+
+/*
+ * Name: KeGeometryArena::SetVertexData
+ * Desc: Updates a range of an allocation's vertices.  first_vertex is relative to the
+ *       allocation.
+ */
+bool KeGeometryArena::SetVertexData( int handle, uint32_t first_vertex, uint32_t vertex_count, void* vertex_data )
+{
+    if( handle < 0 || handle >= (int) allocations.size() || !allocations[handle].in_use )
+        DISPDBG_RB( KE_ERROR, "Invalid geometry arena handle!" );
+
+    KeGeometryAllocation* a = &allocations[handle];
+    KeGeometryPool* pool = pools[a->pool];
+
+    if( first_vertex + vertex_count > a->vertex_count )
+        DISPDBG_RB( KE_ERROR, "Vertex range exceeds the size of the allocation!" );
+
+    return pool->pages[a->page]->geometry_buffer->SetVertexData( ( a->base_vertex + first_vertex ) * pool->vertex_size,
+                                                                  vertex_count * pool->vertex_size, vertex_data );
+}
+
+
+/*
+ * Name: KeGeometryArena::SetIndexData
+ * Desc: Updates a range of an allocation's indices.  first_index is relative to the
+ *       allocation, and index values are relative to the allocation's first vertex.
+ */
+bool KeGeometryArena::SetIndexData( int handle, uint32_t first_index, uint32_t index_count, void* index_data )
+{
+    if( handle < 0 || handle >= (int) allocations.size() || !allocations[handle].in_use )
+        DISPDBG_RB( KE_ERROR, "Invalid geometry arena handle!" );
+
+    KeGeometryAllocation* a = &allocations[handle];
+
+    if( first_index + index_count > a->index_count )
+        DISPDBG_RB( KE_ERROR, "Index range exceeds the size of the allocation!" );
+
+    return PVT_WriteIndices( pools[a->pool], a, first_index, index_count, index_data );
+}
+
+
+/*
+ * Name: KeGeometryArena::GetAllocation
+ * Desc: Returns the current placement of an allocation.
+ * NOTE: Placement changes whenever KeGeometryArena::Compact moves the allocation, so don't
+ *       hold on to base_vertex or first_index across calls to it.
+ */
+bool KeGeometryArena::GetAllocation( int handle, KeGeometryAllocation* allocation )
+{
+    if( handle < 0 || handle >= (int) allocations.size() || !allocations[handle].in_use || !allocation )
+        return false;
+
+    *allocation = allocations[handle];
+
+    return true;
+}
+
+
+/*
+ * Name: KeGeometryArena::GetGeometryBuffer
+ * Desc: Returns the geometry buffer shared by the allocation's page.
+ */
+IKeGeometryBuffer* KeGeometryArena::GetGeometryBuffer( int handle )
+{
+    if( handle < 0 || handle >= (int) allocations.size() || !allocations[handle].in_use )
+        return NULL;
+
+    KeGeometryAllocation* a = &allocations[handle];
+
+    return pools[a->pool]->pages[a->page]->geometry_buffer;
+}
+
+
+/*
+ * Name: KeGeometryArena::Draw
+ * Desc: Sets the allocation's page as the current geometry buffer and draws the allocation.
+ *       Allocations without indices are drawn as a plain vertex range.
+ */
+void KeGeometryArena::Draw( int handle, uint32_t primtype )
+{
+    if( handle < 0 || handle >= (int) allocations.size() || !allocations[handle].in_use )
+        DISPDBG_R( KE_ERROR, "Invalid geometry arena handle!" );
+
+    KeGeometryAllocation* a = &allocations[handle];
+    KeGeometryPool* pool = pools[a->pool];
+
+    device->SetGeometryBuffer( pool->pages[a->page]->geometry_buffer );
+
+    if( a->index_count )
+        device->DrawIndexedVerticesBaseVertex( primtype, pool->vertex_size, a->first_index, a->index_count, base_vertex_supported ? a->base_vertex : 0 );
+    else
+        device->DrawVertices( primtype, pool->vertex_size, a->base_vertex, a->vertex_count );
+}
+
+
+/*
+ * Name: KeGeometryArena::Compact
+ * Desc: Reclaims fragmented space by moving allocations towards the start of their page, and
+ *       deletes pages that no longer hold anything.  At most max_bytes of data are copied,
+ *       so this can be called once per frame to compact the arena in the background.
+ *       Returns the number of bytes moved.
+ * NOTE: Data is copied on the GPU (see IKeGeometryBuffer::CopyVertexData).  Vertices are
+ *       only moved when base vertex draws are supported, since rebased indices would have to
+ *       be rewritten from system memory.
+ */
+uint32_t KeGeometryArena::Compact( uint32_t max_bytes )
+{
+    uint32_t bytes = 0;
+
+    for( size_t p = 0; p < pools.size(); p++ )
+    {
+        KeGeometryPool* pool = pools[p];
+
+        for( int i = (int) pool->pages.size() - 1; i >= 0; i-- )
+        {
+            KeGeometryPage* page = pool->pages[i];
+
+            /* Release empty pages, but always keep one around to avoid thrashing */
+            if( !page->allocation_count && pool->pages.size() > 1 )
+            {
+                device->DeleteGeometryBuffer( page->geometry_buffer );
+                delete page;
+                pool->pages.erase( pool->pages.begin() + i );
+
+                for( size_t j = 0; j < allocations.size(); j++ )
+                {
+                    if( allocations[j].in_use && allocations[j].pool == (int) p && allocations[j].page > i )
+                        allocations[j].page--;
+                }
+                continue;
+            }
+
+            if( bytes >= max_bytes )
+                continue;
+
+            /* Skip pages whose free space is already contiguous */
+            if( page->vertices.GetFreeSize() == page->vertices.GetLargestFreeBlock() &&
+                page->indices.GetFreeSize() == page->indices.GetLargestFreeBlock() )
+                continue;
+
+            /* Try to move allocations furthest from the start of the page first */
+            std::vector< std::pair<uint32_t, int> > candidates;
+            for( size_t j = 0; j < allocations.size(); j++ )
+            {
+                if( allocations[j].in_use && allocations[j].pool == (int) p && allocations[j].page == i )
+                    candidates.push_back( std::make_pair( allocations[j].base_vertex, (int) j ) );
+            }
+            std::sort( candidates.begin(), candidates.end(), std::greater< std::pair<uint32_t, int> >() );
+
+            for( size_t j = 0; j < candidates.size() && bytes < max_bytes; j++ )
+                PVT_MoveAllocation( pool, page, &allocations[candidates[j].second], &bytes );
+        }
+    }
+
+    return bytes;
+}
+
+
+/*
+ * Name: KeGeometryArena::GetFragmentation
+ * Desc: Returns the fraction of free vertex space that is not part of the largest free range
+ *       of its page (0 = no fragmentation).
+ */
+float KeGeometryArena::GetFragmentation()
+{
+    uint64_t free_size = 0, largest = 0;
+
+    for( size_t p = 0; p < pools.size(); p++ )
+    {
+        for( size_t i = 0; i < pools[p]->pages.size(); i++ )
+        {
+            free_size += pools[p]->pages[i]->vertices.GetFreeSize();
+            largest += pools[p]->pages[i]->vertices.GetLargestFreeBlock();
+        }
+    }
+
+    if( !free_size )
+        return 0.0f;
+
+    return 1.0f - ( float( largest ) / float( free_size ) );
+}
+
+
+/*
+ * Name: KeGeometryArena::GetPageCount
+ * Desc: Returns the number of geometry buffers in use by the arena.
+ */
+int KeGeometryArena::GetPageCount()
+{
+    int count = 0;
+
+    for( size_t p = 0; p < pools.size(); p++ )
+        count += (int) pools[p]->pages.size();
+
+    return count;
+}
+
+
+/* Returns the pool matching the vertex layout and index type, creating it if necessary */
+int KeGeometryArena::PVT_FindPool( KeVertexAttribute* va, uint32_t index_type )
+{
+    int va_count = 0;
+    while( va[va_count].index != -1 )
+        va_count++;
+
+    for( size_t p = 0; p < pools.size(); p++ )
+    {
+        KeGeometryPool* pool = pools[p];
+
+        if( pool->index_type != index_type || (int) pool->va.size() != va_count + 1 )
+            continue;
+
+        int i;
+        for( i = 0; i < va_count; i++ )
+        {
+            KeVertexAttribute* a = &pool->va[i];
+
+            if( a->index != va[i].index || a->size != va[i].size || a->type != va[i].type ||
+                a->normalize != va[i].normalize || a->stride != va[i].stride || a->offset != va[i].offset )
+                break;
+        }
+
+        if( i == va_count )
+            return (int) p;
+    }
+
+    KeGeometryPool* pool = new KeGeometryPool;
+    pool->va.assign( va, va + va_count + 1 );
+    pool->vertex_size = va[0].stride;
+    pool->index_type = index_type;
+    pool->index_size = index_type == KE_UNSIGNED_INT ? sizeof( uint32_t ) : sizeof( uint16_t );
+    pools.push_back( pool );
+
+    return (int) pools.size() - 1;
+}
+
+/* Creates a new page for the pool, with room for at least the given number of vertices/indices */
+KeGeometryPage* KeGeometryArena::PVT_CreatePage( KeGeometryPool* pool, uint32_t vertex_count, uint32_t index_count )
+{
+    KeGeometryPage* page = new KeGeometryPage;
+
+    page->geometry_buffer = NULL;
+    page->allocation_count = 0;
+
+    if( !device->CreateGeometryBuffer( NULL, vertex_count * pool->vertex_size, NULL, index_count * pool->index_size, pool->index_type,
+                                       KE_USAGE_DYNAMIC_WRITE, &pool->va[0], &page->geometry_buffer ) )
+    {
+        DISPDBG( KE_ERROR, "Error creating geometry arena page!" );
+        delete page;
+        return NULL;
+    }
+
+    page->vertices.Initialize( vertex_count );
+    page->indices.Initialize( index_count );
+    pool->pages.push_back( page );
+
+    return page;
+}
+
+/* Writes index data, rebasing it to the allocation's first vertex if base vertex draws aren't available */
+bool KeGeometryArena::PVT_WriteIndices( KeGeometryPool* pool, KeGeometryAllocation* a, uint32_t first_index, uint32_t index_count, void* index_data )
+{
+    IKeGeometryBuffer* gb = pool->pages[a->page]->geometry_buffer;
+    uint32_t offset = ( a->first_index + first_index ) * pool->index_size;
+
+    if( base_vertex_supported || !a->base_vertex )
+        return gb->SetIndexData( offset, index_count * pool->index_size, index_data );
+
+    uint8_t* rebased = new uint8_t[index_count * pool->index_size];
+
+    if( pool->index_type == KE_UNSIGNED_INT )
+    {
+        for( uint32_t i = 0; i < index_count; i++ )
+            ((uint32_t*) rebased)[i] = ((uint32_t*) index_data)[i] + a->base_vertex;
+    }
+    else
+    {
+        for( uint32_t i = 0; i < index_count; i++ )
+            ((uint16_t*) rebased)[i] = (uint16_t) ( ((uint16_t*) index_data)[i] + a->base_vertex );
+    }
+
+    bool ret = gb->SetIndexData( offset, index_count * pool->index_size, rebased );
+    delete[] rebased;
+
+    return ret;
+}
+
+/* Moves an allocation's vertices and indices to lower free ranges of the same page, if any */
+bool KeGeometryArena::PVT_MoveAllocation( KeGeometryPool* pool, KeGeometryPage* page, KeGeometryAllocation* a, uint32_t* bytes )
+{
+    IKeGeometryBuffer* gb = page->geometry_buffer;
+    bool moved = false;
+    uint32_t offset;
+
+    if( base_vertex_supported )
+    {
+        uint32_t block = page->vertices.Alloc( a->vertex_count, &offset );
+
+        if( block != KE_TLSF_INVALID )
+        {
+            if( offset < a->base_vertex && gb->CopyVertexData( offset * pool->vertex_size, a->base_vertex * pool->vertex_size, a->vertex_count * pool->vertex_size ) )
+            {
+                page->vertices.Free( a->vertex_block );
+                a->vertex_block = block;
+                a->base_vertex = offset;
+                *bytes += a->vertex_count * pool->vertex_size;
+                moved = true;
+            }
+            else
+                page->vertices.Free( block );
+        }
+    }
+
+    if( a->index_count )
+    {
+        uint32_t block = page->indices.Alloc( a->index_count, &offset );
+
+        if( block != KE_TLSF_INVALID )
+        {
+            if( offset < a->first_index && gb->CopyIndexData( offset * pool->index_size, a->first_index * pool->index_size, a->index_count * pool->index_size ) )
+            {
+                page->indices.Free( a->index_block );
+                a->index_block = block;
+                a->first_index = offset;
+                *bytes += a->index_count * pool->index_size;
+                moved = true;
+            }
+            else
+                page->indices.Free( block );
+        }
+    }
+
+    return moved;
+}
@@ -0,0 +1,158 @@
+//
+//  KeGeometryArena.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeGeometryArena__
+#define __KeGeometryArena__
+
+#include <vector>
+#include "KeRenderDevice.h"
+
+
+/*
+ * TLSF allocator constants
+ */
+#define KE_TLSF_SL_BITS         4                       /* Log2 of the number of second level lists */
+#define KE_TLSF_SL_COUNT        (1<<KE_TLSF_SL_BITS)
+#define KE_TLSF_FL_COUNT        32
+#define KE_TLSF_INVALID         0xFFFFFFFF
+
+/*
+ * Geometry arena defaults
+ */
+#define KE_ARENA_PAGE_VERTICES  65536       /* Vertices per page */
+#define KE_ARENA_PAGE_INDICES   (65536*3)   /* Indices per page */
+#define KE_ARENA_INVALID_HANDLE -1
+
+
+/*
+ * TLSF block; tracks a range of units and its physical/free list neighbours
+ */
+struct KeTlsfBlock
+{
+    uint32_t    offset;         /* Start of the range (in allocation units) */
+    uint32_t    size;           /* Length of the range (in allocation units) */
+    uint32_t    prev_physical;  /* Adjacent blocks in address order */
+    uint32_t    next_physical;
+    uint32_t    prev_free;      /* Neighbours in this block's free list */
+    uint32_t    next_free;
+    int         free;           /* Yes if this block is available */
+};
+
+
+/* Two level segregated fit allocator.  Hands out ranges of an abstract address space in
+   constant time; it manages offsets only, never memory. */
+class KeTlsfAllocator
+{
+public:
+    KeTlsfAllocator();
+    virtual ~KeTlsfAllocator();
+
+public:
+    void Initialize( uint32_t size );
+    uint32_t Alloc( uint32_t size, uint32_t* offset );
+    void Free( uint32_t block );
+
+    uint32_t GetSize() { return size; }
+    uint32_t GetFreeSize() { return free_size; }
+    uint32_t GetLargestFreeBlock();
+    uint32_t GetBlockOffset( uint32_t block ) { return blocks[block].offset; }
+
+protected:
+    void PVT_Mapping( uint32_t size, int* fl, int* sl );
+    uint32_t PVT_FindFreeBlock( uint32_t size );
+    void PVT_InsertFreeBlock( uint32_t block );
+    void PVT_RemoveFreeBlock( uint32_t block );
+    uint32_t PVT_NewBlock();
+
+protected:
+    std::vector<KeTlsfBlock>    blocks;         /* Block headers, referenced by index */
+    std::vector<uint32_t>       unused_blocks;  /* Recycled block headers */
+    uint32_t                    fl_bitmap;      /* First level lists with free blocks */
+    uint32_t                    sl_bitmap[KE_TLSF_FL_COUNT];
+    uint32_t                    free_lists[KE_TLSF_FL_COUNT][KE_TLSF_SL_COUNT];
+    uint32_t                    size;           /* Size of the entire range */
+    uint32_t                    free_size;      /* Total size of the free blocks */
+};
+
+
+/*
+ * Geometry arena page; one shared vertex and index buffer
+ */
+struct KeGeometryPage
+{
+    IKeGeometryBuffer*  geometry_buffer;
+    KeTlsfAllocator     vertices;           /* Sub-allocates vertices */
+    KeTlsfAllocator     indices;            /* Sub-allocates indices */
+    uint32_t            allocation_count;   /* Number of live allocations in this page */
+};
+
+/*
+ * Geometry arena pool; all pages sharing the same vertex layout and index type
+ */
+struct KeGeometryPool
+{
+    std::vector<KeVertexAttribute>  va;             /* Vertex layout (including the -1 terminator) */
+    uint32_t                        vertex_size;    /* Size of each vertex (in bytes) */
+    uint32_t                        index_type;     /* KE_UNSIGNED_SHORT or KE_UNSIGNED_INT */
+    uint32_t                        index_size;     /* Size of each index (in bytes) */
+    std::vector<KeGeometryPage*>    pages;
+};
+
+/*
+ * Geometry arena allocation
+ */
+struct KeGeometryAllocation
+{
+    int         pool;           /* Pool and page holding this allocation */
+    int         page;
+    uint32_t    vertex_block;   /* Allocator blocks */
+    uint32_t    index_block;
+    uint32_t    base_vertex;    /* First vertex within the page's vertex buffer */
+    uint32_t    vertex_count;
+    uint32_t    first_index;    /* First index within the page's index buffer */
+    uint32_t    index_count;
+    int         in_use;
+};
+
+
+/* Geometry arena class; packs many small meshes into a few large geometry buffers */
+class KeGeometryArena
+{
+public:
+    KeGeometryArena( IKeRenderDevice* device, uint32_t page_vertices = KE_ARENA_PAGE_VERTICES, uint32_t page_indices = KE_ARENA_PAGE_INDICES );
+    virtual ~KeGeometryArena();
+
+public:
+    int Allocate( KeVertexAttribute* va, uint32_t index_type, void* vertex_data, uint32_t vertex_count, void* index_data, uint32_t index_count );
+    void Free( int handle );
+    bool SetVertexData( int handle, uint32_t first_vertex, uint32_t vertex_count, void* vertex_data );
+    bool SetIndexData( int handle, uint32_t first_index, uint32_t index_count, void* index_data );
+    bool GetAllocation( int handle, KeGeometryAllocation* allocation );
+    IKeGeometryBuffer* GetGeometryBuffer( int handle );
+    void Draw( int handle, uint32_t primtype );
+
+    uint32_t Compact( uint32_t max_bytes );
+    float GetFragmentation();
+    int GetPageCount();
+
+protected:
+    int PVT_FindPool( KeVertexAttribute* va, uint32_t index_type );
+    KeGeometryPage* PVT_CreatePage( KeGeometryPool* pool, uint32_t vertex_count, uint32_t index_count );
+    bool PVT_WriteIndices( KeGeometryPool* pool, KeGeometryAllocation* a, uint32_t first_index, uint32_t index_count, void* index_data );
+    bool PVT_MoveAllocation( KeGeometryPool* pool, KeGeometryPage* page, KeGeometryAllocation* a, uint32_t* bytes );
+
+protected:
+    IKeRenderDevice*                    device;         /* Device used to create the page buffers */
+    std::vector<KeGeometryPool*>        pools;          /* One pool per vertex layout/index type */
+    std::vector<KeGeometryAllocation>   allocations;    /* Indexed by handle */
+    std::vector<int>                    free_handles;   /* Recycled handles */
+    uint32_t                            page_vertices;  /* Default page size */
+    uint32_t                            page_indices;
+    int                                 base_vertex_supported;  /* No if indices must be rebased */
+};
+
+#endif /* defined(__KeGeometryArena__) */
@@ -0,0 +1,117 @@
+//
+//  KeMath.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeMath.h"
+
+
+/*
+ * Name: KeMat4TransformArray
+ * Desc: Transforms count 4D vectors by a matrix.  in and out may be the same array.
+ */
+void KeMat4TransformArray( const KeMat4& m, const float* in, float* out, int count )
+{
+    KeFloat4 c0 = m.col[0], c1 = m.col[1], c2 = m.col[2], c3 = m.col[3];
+
+    for( int i = 0; i < count; i++, in += 4, out += 4 )
+    {
+        KeFloat4 v = KeF4Load( in );
+        KeFloat4 r = KeF4Mul( c0, KeF4SplatX( v ) );
+        r = KeF4MulAdd( c1, KeF4SplatY( v ), r );
+        r = KeF4MulAdd( c2, KeF4SplatZ( v ), r );
+        r = KeF4MulAdd( c3, KeF4SplatW( v ), r );
+        KeF4Store( out, r );
+    }
+}
+
+
+/*
+ * Name: KeMat4TransformPointArray
+ * Desc: Transforms count 3D points (w = 1) by a matrix.  The strides are in bytes, so points
+ *       can be transformed in place inside vertex arrays (e.g. KeMeshVertex::pos).
+ */
+void KeMat4TransformPointArray( const KeMat4& m, const float* in, int in_stride, float* out, int out_stride, int count )
+{
+    KeFloat4 c0 = m.col[0], c1 = m.col[1], c2 = m.col[2], c3 = m.col[3];
+    const uint8_t* src = (const uint8_t*) in;
+    uint8_t* dst = (uint8_t*) out;
+
+    for( int i = 0; i < count; i++, src += in_stride, dst += out_stride )
+    {
+        const float* p = (const float*) src;
+        float* o = (float*) dst;
+
+        /* Only 3 floats are read and written, so neighbouring vertex attributes are left alone */
+        KeFloat4 r = KeF4MulAdd( c0, KeF4Splat( p[0] ), c3 );
+        r = KeF4MulAdd( c1, KeF4Splat( p[1] ), r );
+        r = KeF4MulAdd( c2, KeF4Splat( p[2] ), r );
+
+        o[0] = KeF4GetX( r );
+        o[1] = KeF4GetY( r );
+        o[2] = KeF4GetZ( r );
+    }
+}
+
+
+/*
+ * Name: KeMat4MulArray
+ * Desc: out[i] = m * in[i] for count matrices.
+ */
+void KeMat4MulArray( const KeMat4& m, const float* in, float* out, int count )
+{
+    KeFloat4 c0 = m.col[0], c1 = m.col[1], c2 = m.col[2], c3 = m.col[3];
+
+    for( int i = 0; i < count; i++, in += 16, out += 16 )
+    {
+        /* Load the whole source matrix first, in case in and out are the same */
+        KeFloat4 b[4] = { KeF4Load( in ), KeF4Load( in + 4 ), KeF4Load( in + 8 ), KeF4Load( in + 12 ) };
+
+        for( int j = 0; j < 4; j++ )
+        {
+            KeFloat4 r = KeF4Mul( c0, KeF4SplatX( b[j] ) );
+            r = KeF4MulAdd( c1, KeF4SplatY( b[j] ), r );
+            r = KeF4MulAdd( c2, KeF4SplatZ( b[j] ), r );
+            r = KeF4MulAdd( c3, KeF4SplatW( b[j] ), r );
+            KeF4Store( out + j * 4, r );
+        }
+    }
+}
+
+
+/*
+ * Name: KeMat4MulPairs
+ * Desc: out[i] = a[i] * b[i] for count matrices.
+ */
+void KeMat4MulPairs( const float* a, const float* b, float* out, int count )
+{
+    for( int i = 0; i < count; i++, a += 16, b += 16, out += 16 )
+    {
+        KeMat4 r = KeMat4Mul( KeMat4Load( a ), KeMat4Load( b ) );
+        KeMat4Store( out, r );
+    }
+}
+
+
+/*
+ * Name: KeMat4FromNeT3Array
+ * Desc: Converts count Tokamak transforms to column major 4x4 matrices, optionally applying a
+ *       matrix afterwards (out[i] = m * in[i]), with a stride in bytes between transforms.
+ */
+void KeMat4FromNeT3Array( const neT3* in, int in_stride, float* out, int count, const KeMat4* m )
+{
+    const uint8_t* src = (const uint8_t*) in;
+
+    for( int i = 0; i < count; i++, src += in_stride, out += 16 )
+    {
+        KeMat4 t = KeMat4FromNeT3( (const neT3*) src );
+
+        if( m )
+            t = KeMat4Mul( *m, t );
+
+        KeMat4Store( out, t );
+    }
+}
@@ -0,0 +1,435 @@
+//
+//  KeMath.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeMath__
+#define __KeMath__
+
+#include <math.h>
+#include "KePlatform.h"
+#include "NV/NvMath.h"
+
+/* SIMD intrinsics */
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define KE_MATH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KE_MATH_NEON
+#include <arm_neon.h>
+#endif
+
+
+/*
+ * Layouts bridged by this module.  KeMat4 is a column major 4x4 matrix with each column in a
+ * 16 byte register, which is exactly how nv::matrix4f, vectormath's VmathMatrix4 and Tokamak's
+ * neT3 (rotation columns followed by the position) are laid out, so converting between them
+ * is a reinterpret or four loads rather than a per-element copy.  (neT3 doesn't keep its w
+ * lanes at 0/0/0/1, so it is loaded with KeMat4FromNeT3 rather than viewed.)
+ */
+struct neV3;
+struct neT3;
+struct _VmathMatrix4;
+
+
+/*
+ * 4 lane float register
+ */
+#if defined(KE_MATH_SSE2)
+typedef __m128 KeFloat4;
+#elif defined(KE_MATH_NEON)
+typedef float32x4_t KeFloat4;
+#else
+struct KeFloat4 { float v[4]; };
+#endif
+
+/*
+ * Vector, quaternion and matrix types.  These are 16 byte aligned; the array functions in
+ * KeMath.cpp use unaligned loads, so they also accept nv::matrix4f arrays, etc.
+ */
+struct KeVec3 { KeFloat4 m; };          /* w is kept at 0 */
+struct KeVec4 { KeFloat4 m; };
+struct KeQuat { KeFloat4 m; };          /* x, y, z, w */
+struct KeMat4 { KeFloat4 col[4]; };     /* Column major */
+
+
+/*
+ * Lane primitives
+ */
+#if defined(KE_MATH_SSE2)
+inline KeFloat4 KeF4Set( float x, float y, float z, float w ) { return _mm_setr_ps( x, y, z, w ); }
+inline KeFloat4 KeF4Splat( float f )                          { return _mm_set1_ps( f ); }
+inline KeFloat4 KeF4Load( const float* p )                    { return _mm_loadu_ps( p ); }
+inline void KeF4Store( float* p, const KeFloat4& a )          { _mm_storeu_ps( p, a ); }
+inline KeFloat4 KeF4Add( const KeFloat4& a, const KeFloat4& b ) { return _mm_add_ps( a, b ); }
+inline KeFloat4 KeF4Sub( const KeFloat4& a, const KeFloat4& b ) { return _mm_sub_ps( a, b ); }
+inline KeFloat4 KeF4Mul( const KeFloat4& a, const KeFloat4& b ) { return _mm_mul_ps( a, b ); }
+inline KeFloat4 KeF4MulAdd( const KeFloat4& a, const KeFloat4& b, const KeFloat4& c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+inline KeFloat4 KeF4SplatX( const KeFloat4& a ) { return _mm_shuffle_ps( a, a, _MM_SHUFFLE( 0, 0, 0, 0 ) ); }
+inline KeFloat4 KeF4SplatY( const KeFloat4& a ) { return _mm_shuffle_ps( a, a, _MM_SHUFFLE( 1, 1, 1, 1 ) ); }
+inline KeFloat4 KeF4SplatZ( const KeFloat4& a ) { return _mm_shuffle_ps( a, a, _MM_SHUFFLE( 2, 2, 2, 2 ) ); }
+inline KeFloat4 KeF4SplatW( const KeFloat4& a ) { return _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 3, 3, 3 ) ); }
+inline float KeF4GetX( const KeFloat4& a ) { return _mm_cvtss_f32( a ); }
+inline float KeF4GetY( const KeFloat4& a ) { return _mm_cvtss_f32( KeF4SplatY( a ) ); }
+inline float KeF4GetZ( const KeFloat4& a ) { return _mm_cvtss_f32( KeF4SplatZ( a ) ); }
+inline float KeF4GetW( const KeFloat4& a ) { return _mm_cvtss_f32( KeF4SplatW( a ) ); }
+inline KeFloat4 KeF4ClearW( const KeFloat4& a ) { return _mm_and_ps( a, _mm_castsi128_ps( _mm_setr_epi32( -1, -1, -1, 0 ) ) ); }
+#elif defined(KE_MATH_NEON)
+inline KeFloat4 KeF4Set( float x, float y, float z, float w ) { float f[4] = { x, y, z, w }; return vld1q_f32( f ); }
+inline KeFloat4 KeF4Splat( float f )                          { return vdupq_n_f32( f ); }
+inline KeFloat4 KeF4Load( const float* p )                    { return vld1q_f32( p ); }
+inline void KeF4Store( float* p, const KeFloat4& a )          { vst1q_f32( p, a ); }
+inline KeFloat4 KeF4Add( const KeFloat4& a, const KeFloat4& b ) { return vaddq_f32( a, b ); }
+inline KeFloat4 KeF4Sub( const KeFloat4& a, const KeFloat4& b ) { return vsubq_f32( a, b ); }
+inline KeFloat4 KeF4Mul( const KeFloat4& a, const KeFloat4& b ) { return vmulq_f32( a, b ); }
+inline KeFloat4 KeF4MulAdd( const KeFloat4& a, const KeFloat4& b, const KeFloat4& c ) { return vmlaq_f32( c, a, b ); }
+inline KeFloat4 KeF4SplatX( const KeFloat4& a ) { return vdupq_lane_f32( vget_low_f32( a ), 0 ); }
+inline KeFloat4 KeF4SplatY( const KeFloat4& a ) { return vdupq_lane_f32( vget_low_f32( a ), 1 ); }
+inline KeFloat4 KeF4SplatZ( const KeFloat4& a ) { return vdupq_lane_f32( vget_high_f32( a ), 0 ); }
+inline KeFloat4 KeF4SplatW( const KeFloat4& a ) { return vdupq_lane_f32( vget_high_f32( a ), 1 ); }
+inline float KeF4GetX( const KeFloat4& a ) { return vgetq_lane_f32( a, 0 ); }
+inline float KeF4GetY( const KeFloat4& a ) { return vgetq_lane_f32( a, 1 ); }
+inline float KeF4GetZ( const KeFloat4& a ) { return vgetq_lane_f32( a, 2 ); }
+inline float KeF4GetW( const KeFloat4& a ) { return vgetq_lane_f32( a, 3 ); }
+inline KeFloat4 KeF4ClearW( const KeFloat4& a ) { return vreinterpretq_f32_u32( vsetq_lane_u32( 0, vreinterpretq_u32_f32( a ), 3 ) ); }
+#else
+inline KeFloat4 KeF4Set( float x, float y, float z, float w ) { KeFloat4 r = { { x, y, z, w } }; return r; }
+inline KeFloat4 KeF4Splat( float f )                          { return KeF4Set( f, f, f, f ); }
+inline KeFloat4 KeF4Load( const float* p )                    { return KeF4Set( p[0], p[1], p[2], p[3] ); }
+inline void KeF4Store( float* p, const KeFloat4& a )          { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+inline KeFloat4 KeF4Add( const KeFloat4& a, const KeFloat4& b ) { return KeF4Set( a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3] ); }
+inline KeFloat4 KeF4Sub( const KeFloat4& a, const KeFloat4& b ) { return KeF4Set( a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3] ); }
+inline KeFloat4 KeF4Mul( const KeFloat4& a, const KeFloat4& b ) { return KeF4Set( a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3] ); }
+inline KeFloat4 KeF4MulAdd( const KeFloat4& a, const KeFloat4& b, const KeFloat4& c ) { return KeF4Add( KeF4Mul( a, b ), c ); }
+inline KeFloat4 KeF4SplatX( const KeFloat4& a ) { return KeF4Splat( a.v[0] ); }
+inline KeFloat4 KeF4SplatY( const KeFloat4& a ) { return KeF4Splat( a.v[1] ); }
+inline KeFloat4 KeF4SplatZ( const KeFloat4& a ) { return KeF4Splat( a.v[2] ); }
+inline KeFloat4 KeF4SplatW( const KeFloat4& a ) { return KeF4Splat( a.v[3] ); }
+inline float KeF4GetX( const KeFloat4& a ) { return a.v[0]; }
+inline float KeF4GetY( const KeFloat4& a ) { return a.v[1]; }
+inline float KeF4GetZ( const KeFloat4& a ) { return a.v[2]; }
+inline float KeF4GetW( const KeFloat4& a ) { return a.v[3]; }
+inline KeFloat4 KeF4ClearW( const KeFloat4& a ) { return KeF4Set( a.v[0], a.v[1], a.v[2], 0.0f ); }
+#endif
+
+inline float KeF4Dot3( const KeFloat4& a, const KeFloat4& b )
+{
+    KeFloat4 p = KeF4Mul( a, b );
+    return KeF4GetX( p ) + KeF4GetY( p ) + KeF4GetZ( p );
+}
+
+inline float KeF4Dot4( const KeFloat4& a, const KeFloat4& b )
+{
+    KeFloat4 p = KeF4Mul( a, b );
+    return KeF4GetX( p ) + KeF4GetY( p ) + KeF4GetZ( p ) + KeF4GetW( p );
+}
+
+
+/*
+ * 3D vectors
+ */
+inline KeVec3 KeVec3Make( float x, float y, float z )               { KeVec3 r; r.m = KeF4Set( x, y, z, 0.0f ); return r; }
+inline KeVec3 KeVec3Load( const float* p )                          { return KeVec3Make( p[0], p[1], p[2] ); }
+inline void KeVec3Store( float* p, const KeVec3& v )                { p[0] = KeF4GetX( v.m ); p[1] = KeF4GetY( v.m ); p[2] = KeF4GetZ( v.m ); }
+inline KeVec3 KeVec3Add( const KeVec3& a, const KeVec3& b )         { KeVec3 r; r.m = KeF4Add( a.m, b.m ); return r; }
+inline KeVec3 KeVec3Sub( const KeVec3& a, const KeVec3& b )         { KeVec3 r; r.m = KeF4Sub( a.m, b.m ); return r; }
+inline KeVec3 KeVec3Mul( const KeVec3& a, const KeVec3& b )         { KeVec3 r; r.m = KeF4Mul( a.m, b.m ); return r; }
+inline KeVec3 KeVec3Scale( const KeVec3& a, float s )               { KeVec3 r; r.m = KeF4Mul( a.m, KeF4Splat( s ) ); return r; }
+inline float KeVec3Dot( const KeVec3& a, const KeVec3& b )          { return KeF4Dot3( a.m, b.m ); }
+inline float KeVec3Length( const KeVec3& a )                        { return sqrtf( KeF4Dot3( a.m, a.m ) ); }
+inline float KeVec3GetX( const KeVec3& v )                          { return KeF4GetX( v.m ); }
+inline float KeVec3GetY( const KeVec3& v )                          { return KeF4GetY( v.m ); }
+inline float KeVec3GetZ( const KeVec3& v )                          { return KeF4GetZ( v.m ); }
+
+inline KeVec3 KeVec3Cross( const KeVec3& a, const KeVec3& b )
+{
+    KeVec3 r;
+#if defined(KE_MATH_SSE2)
+    __m128 a_yzx = _mm_shuffle_ps( a.m, a.m, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    __m128 b_yzx = _mm_shuffle_ps( b.m, b.m, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    __m128 c = _mm_sub_ps( _mm_mul_ps( a.m, b_yzx ), _mm_mul_ps( a_yzx, b.m ) );
+    r.m = _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+#else
+    float ax = KeF4GetX( a.m ), ay = KeF4GetY( a.m ), az = KeF4GetZ( a.m );
+    float bx = KeF4GetX( b.m ), by = KeF4GetY( b.m ), bz = KeF4GetZ( b.m );
+    r.m = KeF4Set( ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx, 0.0f );
+#endif
+    return r;
+}
+
+inline KeVec3 KeVec3Normalize( const KeVec3& a )
+{
+    float l = KeVec3Length( a );
+    return l > 0.0f ? KeVec3Scale( a, 1.0f / l ) : a;
+}
+
+inline KeVec3 KeVec3Lerp( const KeVec3& a, const KeVec3& b, float t )
+{
+    KeVec3 r;
+    r.m = KeF4MulAdd( KeF4Sub( b.m, a.m ), KeF4Splat( t ), a.m );
+    return r;
+}
+
+
+/*
+ * 4D vectors
+ */
+inline KeVec4 KeVec4Make( float x, float y, float z, float w )      { KeVec4 r; r.m = KeF4Set( x, y, z, w ); return r; }
+inline KeVec4 KeVec4Load( const float* p )                          { KeVec4 r; r.m = KeF4Load( p ); return r; }
+inline void KeVec4Store( float* p, const KeVec4& v )                { KeF4Store( p, v.m ); }
+inline KeVec4 KeVec4Add( const KeVec4& a, const KeVec4& b )         { KeVec4 r; r.m = KeF4Add( a.m, b.m ); return r; }
+inline KeVec4 KeVec4Sub( const KeVec4& a, const KeVec4& b )         { KeVec4 r; r.m = KeF4Sub( a.m, b.m ); return r; }
+inline KeVec4 KeVec4Mul( const KeVec4& a, const KeVec4& b )         { KeVec4 r; r.m = KeF4Mul( a.m, b.m ); return r; }
+inline KeVec4 KeVec4Scale( const KeVec4& a, float s )               { KeVec4 r; r.m = KeF4Mul( a.m, KeF4Splat( s ) ); return r; }
+inline float KeVec4Dot( const KeVec4& a, const KeVec4& b )          { return KeF4Dot4( a.m, b.m ); }
+
+
+/*
+ * Quaternions
+ */
+inline KeQuat KeQuatMake( float x, float y, float z, float w )      { KeQuat r; r.m = KeF4Set( x, y, z, w ); return r; }
+inline KeQuat KeQuatIdentity()                                      { return KeQuatMake( 0.0f, 0.0f, 0.0f, 1.0f ); }
+inline KeQuat KeQuatConjugate( const KeQuat& q )                    { KeQuat r; r.m = KeF4Mul( q.m, KeF4Set( -1.0f, -1.0f, -1.0f, 1.0f ) ); return r; }
+
+inline KeQuat KeQuatFromAxisAngle( const KeVec3& axis, float radians )
+{
+    KeVec3 a = KeVec3Scale( KeVec3Normalize( axis ), sinf( radians * 0.5f ) );
+    return KeQuatMake( KeVec3GetX( a ), KeVec3GetY( a ), KeVec3GetZ( a ), cosf( radians * 0.5f ) );
+}
+
+inline KeQuat KeQuatNormalize( const KeQuat& q )
+{
+    float l = sqrtf( KeF4Dot4( q.m, q.m ) );
+    KeQuat r = q;
+    if( l > 0.0f )
+        r.m = KeF4Mul( q.m, KeF4Splat( 1.0f / l ) );
+    return r;
+}
+
+/* Rotation b followed by rotation a */
+inline KeQuat KeQuatMul( const KeQuat& a, const KeQuat& b )
+{
+    float ax = KeF4GetX( a.m ), ay = KeF4GetY( a.m ), az = KeF4GetZ( a.m ), aw = KeF4GetW( a.m );
+    float bx = KeF4GetX( b.m ), by = KeF4GetY( b.m ), bz = KeF4GetZ( b.m ), bw = KeF4GetW( b.m );
+
+    return KeQuatMake( aw * bx + ax * bw + ay * bz - az * by,
+                       aw * by - ax * bz + ay * bw + az * bx,
+                       aw * bz + ax * by - ay * bx + az * bw,
+                       aw * bw - ax * bx - ay * by - az * bz );
+}
+
+/* Normalized linear interpolation (along the shorter arc) */
+inline KeQuat KeQuatNlerp( const KeQuat& a, const KeQuat& b, float t )
+{
+    KeQuat r;
+    KeFloat4 ta = KeF4Splat( 1.0f - t );
+    KeFloat4 tb = KeF4Splat( KeF4Dot4( a.m, b.m ) < 0.0f ? -t : t );
+    r.m = KeF4MulAdd( b.m, tb, KeF4Mul( a.m, ta ) );
+    return KeQuatNormalize( r );
+}
+
+inline KeVec3 KeQuatRotate( const KeQuat& q, const KeVec3& v )
+{
+    /* v' = v + 2w(q x v) + 2q x (q x v) */
+    KeVec3 u;
+    u.m = KeF4ClearW( q.m );
+    KeVec3 t = KeVec3Scale( KeVec3Cross( u, v ), 2.0f );
+    return KeVec3Add( KeVec3Add( v, KeVec3Scale( t, KeF4GetW( q.m ) ) ), KeVec3Cross( u, t ) );
+}
+
+
+/*
+ * 4x4 matrices
+ */
+inline KeMat4 KeMat4Load( const float* column_major )
+{
+    KeMat4 r;
+    r.col[0] = KeF4Load( column_major );
+    r.col[1] = KeF4Load( column_major + 4 );
+    r.col[2] = KeF4Load( column_major + 8 );
+    r.col[3] = KeF4Load( column_major + 12 );
+    return r;
+}
+
+inline void KeMat4Store( float* column_major, const KeMat4& m )
+{
+    KeF4Store( column_major, m.col[0] );
+    KeF4Store( column_major + 4, m.col[1] );
+    KeF4Store( column_major + 8, m.col[2] );
+    KeF4Store( column_major + 12, m.col[3] );
+}
+
+inline KeMat4 KeMat4Identity()
+{
+    KeMat4 r;
+    r.col[0] = KeF4Set( 1.0f, 0.0f, 0.0f, 0.0f );
+    r.col[1] = KeF4Set( 0.0f, 1.0f, 0.0f, 0.0f );
+    r.col[2] = KeF4Set( 0.0f, 0.0f, 1.0f, 0.0f );
+    r.col[3] = KeF4Set( 0.0f, 0.0f, 0.0f, 1.0f );
+    return r;
+}
+
+inline KeVec4 KeMat4Transform( const KeMat4& m, const KeVec4& v )
+{
+    KeVec4 r;
+    r.m = KeF4Mul( m.col[0], KeF4SplatX( v.m ) );
+    r.m = KeF4MulAdd( m.col[1], KeF4SplatY( v.m ), r.m );
+    r.m = KeF4MulAdd( m.col[2], KeF4SplatZ( v.m ), r.m );
+    r.m = KeF4MulAdd( m.col[3], KeF4SplatW( v.m ), r.m );
+    return r;
+}
+
+/* Transforms a point (w = 1; no perspective divide) */
+inline KeVec3 KeMat4TransformPoint( const KeMat4& m, const KeVec3& p )
+{
+    KeVec3 r;
+    r.m = KeF4MulAdd( m.col[0], KeF4SplatX( p.m ), m.col[3] );
+    r.m = KeF4MulAdd( m.col[1], KeF4SplatY( p.m ), r.m );
+    r.m = KeF4MulAdd( m.col[2], KeF4SplatZ( p.m ), r.m );
+    r.m = KeF4ClearW( r.m );
+    return r;
+}
+
+/* Transforms a direction (w = 0) */
+inline KeVec3 KeMat4TransformVector( const KeMat4& m, const KeVec3& v )
+{
+    KeVec3 r;
+    r.m = KeF4Mul( m.col[0], KeF4SplatX( v.m ) );
+    r.m = KeF4MulAdd( m.col[1], KeF4SplatY( v.m ), r.m );
+    r.m = KeF4MulAdd( m.col[2], KeF4SplatZ( v.m ), r.m );
+    r.m = KeF4ClearW( r.m );
+    return r;
+}
+
+/* a * b (b is applied first, as with nv::matrix4f) */
+inline KeMat4 KeMat4Mul( const KeMat4& a, const KeMat4& b )
+{
+    KeMat4 r;
+    for( int i = 0; i < 4; i++ )
+    {
+        KeFloat4 c = KeF4Mul( a.col[0], KeF4SplatX( b.col[i] ) );
+        c = KeF4MulAdd( a.col[1], KeF4SplatY( b.col[i] ), c );
+        c = KeF4MulAdd( a.col[2], KeF4SplatZ( b.col[i] ), c );
+        r.col[i] = KeF4MulAdd( a.col[3], KeF4SplatW( b.col[i] ), c );
+    }
+    return r;
+}
+
+inline KeMat4 KeMat4Transpose( const KeMat4& m )
+{
+    KeMat4 r = m;
+#if defined(KE_MATH_SSE2)
+    _MM_TRANSPOSE4_PS( r.col[0], r.col[1], r.col[2], r.col[3] );
+#else
+    float f[16], t[16];
+    KeMat4Store( f, m );
+    for( int i = 0; i < 4; i++ )
+        for( int j = 0; j < 4; j++ )
+            t[i*4+j] = f[j*4+i];
+    r = KeMat4Load( t );
+#endif
+    return r;
+}
+
+inline KeMat4 KeMat4Translation( const KeVec3& t )
+{
+    KeMat4 r = KeMat4Identity();
+    r.col[3] = KeF4Add( t.m, KeF4Set( 0.0f, 0.0f, 0.0f, 1.0f ) );
+    return r;
+}
+
+inline KeMat4 KeMat4Scale( const KeVec3& s )
+{
+    KeMat4 r;
+    r.col[0] = KeF4Set( KeVec3GetX( s ), 0.0f, 0.0f, 0.0f );
+    r.col[1] = KeF4Set( 0.0f, KeVec3GetY( s ), 0.0f, 0.0f );
+    r.col[2] = KeF4Set( 0.0f, 0.0f, KeVec3GetZ( s ), 0.0f );
+    r.col[3] = KeF4Set( 0.0f, 0.0f, 0.0f, 1.0f );
+    return r;
+}
+
+/* Rotation (from a unit quaternion) followed by a translation */
+inline KeMat4 KeMat4FromRotationTranslation( const KeQuat& q, const KeVec3& t )
+{
+    float x = KeF4GetX( q.m ), y = KeF4GetY( q.m ), z = KeF4GetZ( q.m ), w = KeF4GetW( q.m );
+    KeMat4 r;
+
+    r.col[0] = KeF4Set( 1.0f - 2.0f * ( y*y + z*z ), 2.0f * ( x*y + z*w ), 2.0f * ( x*z - y*w ), 0.0f );
+    r.col[1] = KeF4Set( 2.0f * ( x*y - z*w ), 1.0f - 2.0f * ( x*x + z*z ), 2.0f * ( y*z + x*w ), 0.0f );
+    r.col[2] = KeF4Set( 2.0f * ( x*z + y*w ), 2.0f * ( y*z - x*w ), 1.0f - 2.0f * ( x*x + y*y ), 0.0f );
+    r.col[3] = KeF4Add( t.m, KeF4Set( 0.0f, 0.0f, 0.0f, 1.0f ) );
+    return r;
+}
+
+inline KeMat4 KeMat4FromQuat( const KeQuat& q )
+{
+    return KeMat4FromRotationTranslation( q, KeVec3Make( 0.0f, 0.0f, 0.0f ) );
+}
+
+
+/*
+ * Bridges to the other math libraries
+ */
+
+/* Views (no copy) for passing KeMat4s to functions that take nv::matrix4f, such as the render device.
+   KeMat4 is at least as aligned as nv::matrix4f, so this direction is always safe, but don't read a
+   KeMat4 through the view in the same function that wrote it (use KeMat4Store instead). */
+inline const nv::matrix4f* KeMat4AsNv( const KeMat4* m )            { return reinterpret_cast<const nv::matrix4f*>( m ); }
+inline nv::matrix4f* KeMat4AsNv( KeMat4* m )                        { return reinterpret_cast<nv::matrix4f*>( m ); }
+
+/* Loads (four unaligned loads; nothing is rearranged) */
+inline KeMat4 KeMat4FromNv( const nv::matrix4f& m )                 { return KeMat4Load( m._array ); }
+inline KeMat4 KeMat4FromVmath( const struct _VmathMatrix4* m )      { return KeMat4Load( reinterpret_cast<const float*>( m ) ); }
+inline void KeMat4ToVmath( struct _VmathMatrix4* out, const KeMat4& m ) { KeMat4Store( reinterpret_cast<float*>( out ), m ); }
+inline KeVec3 KeVec3FromNv( const nv::vec3f& v )                    { return KeVec3Make( v.x, v.y, v.z ); }
+inline KeVec3 KeVec3FromNeV3( const neV3* v )                       { return KeVec3Load( reinterpret_cast<const float*>( v ) ); }
+
+/* neT3's w lanes are undefined (possibly NaN), so they are masked off bitwise and replaced with 0, 0, 0, 1 */
+inline KeMat4 KeMat4FromNeT3( const neT3* t )
+{
+    KeMat4 r = KeMat4Load( reinterpret_cast<const float*>( t ) );
+
+    r.col[0] = KeF4ClearW( r.col[0] );
+    r.col[1] = KeF4ClearW( r.col[1] );
+    r.col[2] = KeF4ClearW( r.col[2] );
+    r.col[3] = KeF4Add( KeF4ClearW( r.col[3] ), KeF4Set( 0.0f, 0.0f, 0.0f, 1.0f ) );
+    return r;
+}
+
+
+/*
+ * Name: KeMat4TransformArray
+ * Desc: Transforms count 4D vectors by a matrix.  in and out may be the same array.
+ */
+void KeMat4TransformArray( const KeMat4& m, const float* in, float* out, int count );
+
+/*
+ * Name: KeMat4TransformPointArray
+ * Desc: Transforms count 3D points (w = 1) by a matrix.  The strides are in bytes, so points
+ *       can be transformed in place inside vertex arrays (e.g. KeMeshVertex::pos).
+ */
+void KeMat4TransformPointArray( const KeMat4& m, const float* in, int in_stride, float* out, int out_stride, int count );
+
+/*
+ * Name: KeMat4MulArray
+ * Desc: out[i] = m * in[i] for count matrices (e.g. the view projection matrix by each world
+ *       matrix).  The arrays may be KeMat4 or nv::matrix4f, and in and out may be the same.
+ */
+void KeMat4MulArray( const KeMat4& m, const float* in, float* out, int count );
+
+/*
+ * Name: KeMat4MulPairs
+ * Desc: out[i] = a[i] * b[i] for count matrices.
+ */
+void KeMat4MulPairs( const float* a, const float* b, float* out, int count );
+
+/*
+ * Name: KeMat4FromNeT3Array
+ * Desc: Converts count Tokamak transforms to column major 4x4 matrices, optionally applying a
+ *       matrix afterwards (out[i] = m * in[i]), with a stride in bytes between transforms.
+ */
+void KeMat4FromNeT3Array( const neT3* in, int in_stride, float* out, int count, const KeMat4* m = NULL );
+
+#endif /* defined(__KeMath__) */
@@ -8,6 +8,8 @@
 #include "Ke.h"
 #include "KeMesh.h"
 #include "nvdebug.h"
+#include <math.h>
+#include <float.h>
 
 
 /*
@@ -52,7 +54,7 @@ int KeGetMeshCount()
     return scene->mNumMeshes;
 }
 
-bool KeReadMeshVertexData( int index, KeMesh* mesh_out )
+bool KeReadMeshVertexData( int index, KeMesh* mesh_out, const KeMeshQuantizeDesc* quantize )
 {
     aiMesh* mesh;
     
@@ -66,6 +68,7 @@ bool KeReadMeshVertexData( int index, KeMesh* mesh_out )
     mesh_out->vertex_count = mesh->mNumVertices;
     mesh_out->index_count = mesh->mNumFaces * 3;
     mesh_out->face_count = mesh->mNumFaces;
+    mesh_out->material_index = mesh->mMaterialIndex;
     
     /* Allocate space for vertices */
     mesh_out->vertices = new KeMeshVertex[mesh_out->vertex_count];
@@ -95,6 +98,16 @@ bool KeReadMeshVertexData( int index, KeMesh* mesh_out )
         mesh_out->indices[(i*3)+2] = face.mIndices[2];
     }
     
+    /* Build the quantized copy of the vertices, if requested */
+    mesh_out->packed_vertices = NULL;
+    ZeroMemory( &mesh_out->packed_format, sizeof( KeMeshVertexFormat ) );
+    
+    if( quantize )
+    {
+        if( !KeQuantizeMeshVertices( mesh_out->vertices, mesh_out->vertex_count, quantize, &mesh_out->packed_format, &mesh_out->packed_vertices ) )
+            DISPDBG( KE_WARNING, "Unable to quantize the vertices of mesh " << index << "!" );
+    }
+    
     return true;
 }
 
@@ -102,4 +115,467 @@ void KeFreeMeshVertexData( KeMesh* mesh_out )
 {
     delete [] mesh_out->vertices;
     delete [] mesh_out->indices;
+    delete [] (uint8_t*) mesh_out->packed_vertices;
+    mesh_out->packed_vertices = NULL;
+}
+
+
+/*
+ * Vertex quantization
+ */
+
+/* Snorm/unorm conversions (rounded to nearest) */
+static int16_t KeFloatToSnorm16( float value )
+{
+    value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+    return (int16_t) floorf( value * 32767.0f + 0.5f );
+}
+
+static float KeSnorm16ToFloat( int16_t value )
+{
+    float f = float( value ) / 32767.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+static uint16_t KeFloatToUnorm16( float value )
+{
+    value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+    return (uint16_t) floorf( value * 65535.0f + 0.5f );
+}
+
+static float KeUnorm16ToFloat( uint16_t value )
+{
+    return float( value ) / 65535.0f;
+}
+
+/* Packs a normal as signed 10:10:10:2 (w = 0) */
+static uint32_t KePackNormal10_10_10_2( const float* normal )
+{
+    uint32_t packed = 0;
+    
+    for( int i = 0; i < 3; i++ )
+    {
+        float v = normal[i] < -1.0f ? -1.0f : normal[i] > 1.0f ? 1.0f : normal[i];
+        int32_t c = (int32_t) floorf( v * 511.0f + 0.5f );
+        packed |= ( uint32_t( c ) & 0x3FF ) << ( i * 10 );
+    }
+    
+    return packed;
+}
+
+static void KeUnpackNormal10_10_10_2( uint32_t packed, float* normal )
+{
+    for( int i = 0; i < 3; i++ )
+    {
+        int32_t c = int32_t( ( packed >> ( i * 10 ) ) << 22 ) >> 22;   /* Sign extend */
+        float f = float( c ) / 511.0f;
+        normal[i] = f < -1.0f ? -1.0f : f;
+    }
+}
+
+/* Returns the angle between two vectors in degrees (0 if either is zero length) */
+static float KeAngleBetween( const float* a, const float* b )
+{
+    float la = sqrtf( a[0]*a[0] + a[1]*a[1] + a[2]*a[2] );
+    float lb = sqrtf( b[0]*b[0] + b[1]*b[1] + b[2]*b[2] );
+    
+    if( la == 0.0f || lb == 0.0f )
+        return 0.0f;
+    
+    float d = ( a[0]*b[0] + a[1]*b[1] + a[2]*b[2] ) / ( la * lb );
+    d = d < -1.0f ? -1.0f : d > 1.0f ? 1.0f : d;
+    
+    return acosf( d ) * ( 180.0f / 3.14159265f );
+}
+
+/*
+ * Name: KeFloatToHalf
+ * Desc: Converts a 32-bit float to a 16-bit float, rounding to nearest even.
+ */
+uint16_t KeFloatToHalf( float value )
+{
+    uint32_t x;
+    memmove( &x, &value, sizeof( uint32_t ) );
+    
+    uint32_t sign = ( x >> 16 ) & 0x8000;
+    uint32_t mantissa = x & 0x7FFFFF;
+    int32_t exponent = int32_t( ( x >> 23 ) & 0xFF ) - 127 + 15;
+    
+    /* Infinity and NaN */
+    if( ( ( x >> 23 ) & 0xFF ) == 0xFF )
+        return uint16_t( sign | 0x7C00 | ( mantissa ? 0x200 : 0 ) );
+    
+    /* Too large */
+    if( exponent >= 31 )
+        return uint16_t( sign | 0x7C00 );
+    
+    /* Denormal or too small */
+    if( exponent <= 0 )
+    {
+        if( exponent < -10 )
+            return uint16_t( sign );
+        
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ( ( 1 << shift ) - 1 );
+        uint32_t mid = 1 << ( shift - 1 );
+        
+        if( rest > mid || ( rest == mid && ( half & 1 ) ) )
+            half++;
+        
+        return uint16_t( sign | half );
+    }
+    
+    /* Rounding may carry into the exponent, which is still correct */
+    uint32_t half = sign | ( exponent << 10 ) | ( mantissa >> 13 );
+    uint32_t rest = mantissa & 0x1FFF;
+    
+    if( rest > 0x1000 || ( rest == 0x1000 && ( half & 1 ) ) )
+        half++;
+    
+    return uint16_t( half );
+}
+
+/*
+ * Name: KeHalfToFloat
+ * Desc: Converts a 16-bit float to a 32-bit float.
+ */
+float KeHalfToFloat( uint16_t value )
+{
+    uint32_t sign = uint32_t( value & 0x8000 ) << 16;
+    uint32_t exponent = ( value >> 10 ) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t x;
+    
+    if( exponent == 0 )
+    {
+        /* Zero or denormal */
+        float f = ldexpf( float( mantissa ), -24 );
+        return sign ? -f : f;
+    }
+    
+    if( exponent == 31 )
+        x = sign | 0x7F800000 | ( mantissa << 13 );
+    else
+        x = sign | ( ( exponent - 15 + 127 ) << 23 ) | ( mantissa << 13 );
+    
+    float f;
+    memmove( &f, &x, sizeof( float ) );
+    return f;
+}
+
+/*
+ * Name: KeEncodeOctahedral
+ * Desc: Encodes a unit vector (normal or tangent) as two snorm16 values by projecting it onto
+ *       an octahedron and unfolding the lower half.  Decode in the shader with:
+ *       n = vec3( e.xy, 1 - abs(e.x) - abs(e.y) ); if( n.z < 0 ) n.xy = ( 1 - abs(n.yx) ) * sign(n.xy);
+ *       n = normalize( n );
+ */
+void KeEncodeOctahedral( const float* normal, int16_t* encoded )
+{
+    float l1 = fabsf( normal[0] ) + fabsf( normal[1] ) + fabsf( normal[2] );
+    
+    if( l1 == 0.0f )
+    {
+        encoded[0] = encoded[1] = 0;
+        return;
+    }
+    
+    float x = normal[0] / l1;
+    float y = normal[1] / l1;
+    
+    if( normal[2] < 0.0f )
+    {
+        float ox = x;
+        x = ( 1.0f - fabsf( y ) ) * ( ox >= 0.0f ? 1.0f : -1.0f );
+        y = ( 1.0f - fabsf( ox ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+    }
+    
+    encoded[0] = KeFloatToSnorm16( x );
+    encoded[1] = KeFloatToSnorm16( y );
+}
+
+/*
+ * Name: KeDecodeOctahedral
+ * Desc: Decodes a vector encoded with KeEncodeOctahedral.
+ */
+void KeDecodeOctahedral( const int16_t* encoded, float* normal )
+{
+    float x = KeSnorm16ToFloat( encoded[0] );
+    float y = KeSnorm16ToFloat( encoded[1] );
+    float z = 1.0f - fabsf( x ) - fabsf( y );
+    
+    if( z < 0.0f )
+    {
+        float ox = x;
+        x = ( 1.0f - fabsf( y ) ) * ( ox >= 0.0f ? 1.0f : -1.0f );
+        y = ( 1.0f - fabsf( ox ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+    }
+    
+    float l = sqrtf( x*x + y*y + z*z );
+    normal[0] = x / l;
+    normal[1] = y / l;
+    normal[2] = z / l;
+}
+
+/*
+ * Name: KeQuantizeMeshVertices
+ * Desc: Converts an array of mesh vertices into the smallest vertex format that stays within
+ *       the given error bounds.  Each attribute is encoded with every allowed candidate and
+ *       decoded again, and the first (smallest) candidate whose largest error is within the
+ *       bound is kept.  The packed vertices must be freed with delete [] (uint8_t*).
+ * NOTE: KE_MESH_POSITION_SNORM16 and KE_MESH_TEXCOORD_UNORM16 are stored relative to the
+ *       bounds of the mesh; fold position_scale/offset into the world matrix and apply
+ *       texcoord_scale/offset in the shader (or texture matrix).  Octahedral normals must
+ *       be decoded in the shader (see KeEncodeOctahedral).
+ */
+bool KeQuantizeMeshVertices( const KeMeshVertex* vertices, int vertex_count, const KeMeshQuantizeDesc* desc, KeMeshVertexFormat* format_out, void** packed_out )
+{
+    if( !vertices || vertex_count <= 0 || !format_out || !packed_out )
+        return false;
+    
+    KeMeshQuantizeDesc defaults;
+    if( !desc )
+    {
+        defaults.position_error = KE_MESH_DEFAULT_POSITION_ERROR;
+        defaults.normal_error = KE_MESH_DEFAULT_NORMAL_ERROR;
+        defaults.texcoord_error = KE_MESH_DEFAULT_TEXCOORD_ERROR;
+        defaults.half_float = Yes;
+        defaults.packed = Yes;
+        desc = &defaults;
+    }
+    
+    ZeroMemory( format_out, sizeof( KeMeshVertexFormat ) );
+    
+    /* Find the bounds of the positions and texture coordinates */
+    float pmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, pmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float tmin[2] = { FLT_MAX, FLT_MAX }, tmax[2] = { -FLT_MAX, -FLT_MAX };
+    
+    for( int i = 0; i < vertex_count; i++ )
+    {
+        for( int j = 0; j < 3; j++ )
+        {
+            pmin[j] = vertices[i].pos[j] < pmin[j] ? vertices[i].pos[j] : pmin[j];
+            pmax[j] = vertices[i].pos[j] > pmax[j] ? vertices[i].pos[j] : pmax[j];
+        }
+        for( int j = 0; j < 2; j++ )
+        {
+            tmin[j] = vertices[i].tex[j] < tmin[j] ? vertices[i].tex[j] : tmin[j];
+            tmax[j] = vertices[i].tex[j] > tmax[j] ? vertices[i].tex[j] : tmax[j];
+        }
+    }
+    
+    /* Position error is relative to the largest extent */
+    float extent = 0.0f;
+    for( int j = 0; j < 3; j++ )
+        extent = ( pmax[j] - pmin[j] ) > extent ? ( pmax[j] - pmin[j] ) : extent;
+    
+    float position_bound = desc->position_error * ( extent > 0.0f ? extent : 1.0f );
+    
+    /* Decode transforms for the bounded encodings (a zero extent axis stores 0) */
+    float pscale[3], poffset[3], tscale[2], toffset[2];
+    for( int j = 0; j < 3; j++ )
+    {
+        poffset[j] = ( pmin[j] + pmax[j] ) * 0.5f;
+        pscale[j] = ( pmax[j] - pmin[j] ) > 0.0f ? ( pmax[j] - pmin[j] ) * 0.5f : 1.0f;
+    }
+    for( int j = 0; j < 2; j++ )
+    {
+        toffset[j] = tmin[j];
+        tscale[j] = ( tmax[j] - tmin[j] ) > 0.0f ? ( tmax[j] - tmin[j] ) : 1.0f;
+    }
+    
+    /* Measure the largest error of each candidate encoding */
+    float error_half_pos = 0.0f, error_snorm_pos = 0.0f;
+    float error_packed_normal = 0.0f, error_octahedral_normal = 0.0f;
+    float error_half_tex = 0.0f, error_unorm_tex = 0.0f;
+    
+    for( int i = 0; i < vertex_count; i++ )
+    {
+        const KeMeshVertex* v = &vertices[i];
+        float n[3];
+        int16_t oct[2];
+        
+        for( int j = 0; j < 3; j++ )
+        {
+            float e = fabsf( KeHalfToFloat( KeFloatToHalf( v->pos[j] ) ) - v->pos[j] );
+            error_half_pos = e > error_half_pos ? e : error_half_pos;
+            
+            float s = KeSnorm16ToFloat( KeFloatToSnorm16( ( v->pos[j] - poffset[j] ) / pscale[j] ) );
+            e = fabsf( poffset[j] + s * pscale[j] - v->pos[j] );
+            error_snorm_pos = e > error_snorm_pos ? e : error_snorm_pos;
+        }
+        
+        KeUnpackNormal10_10_10_2( KePackNormal10_10_10_2( v->normal ), n );
+        float a = KeAngleBetween( v->normal, n );
+        error_packed_normal = a > error_packed_normal ? a : error_packed_normal;
+        
+        KeEncodeOctahedral( v->normal, oct );
+        KeDecodeOctahedral( oct, n );
+        a = KeAngleBetween( v->normal, n );
+        error_octahedral_normal = a > error_octahedral_normal ? a : error_octahedral_normal;
+        
+        for( int j = 0; j < 2; j++ )
+        {
+            float e = fabsf( KeHalfToFloat( KeFloatToHalf( v->tex[j] ) ) - v->tex[j] );
+            error_half_tex = e > error_half_tex ? e : error_half_tex;
+            
+            float u = KeUnorm16ToFloat( KeFloatToUnorm16( ( v->tex[j] - toffset[j] ) / tscale[j] ) );
+            e = fabsf( toffset[j] + u * tscale[j] - v->tex[j] );
+            error_unorm_tex = e > error_unorm_tex ? e : error_unorm_tex;
+        }
+    }
+    
+    /* Choose the encodings; candidates of the same size are ordered so that the ones that need
+       no decoding in the shader come first */
+    format_out->position = KE_MESH_POSITION_FLOAT;
+    format_out->position_error = 0.0f;
+    if( desc->half_float && error_half_pos <= position_bound )
+    {
+        format_out->position = KE_MESH_POSITION_HALF;
+        format_out->position_error = error_half_pos;
+    }
+    else if( error_snorm_pos <= position_bound )
+    {
+        format_out->position = KE_MESH_POSITION_SNORM16;
+        format_out->position_error = error_snorm_pos;
+    }
+    
+    format_out->normal = KE_MESH_NORMAL_FLOAT;
+    format_out->normal_error = 0.0f;
+    if( desc->packed && error_packed_normal <= desc->normal_error )
+    {
+        format_out->normal = KE_MESH_NORMAL_10_10_10_2;
+        format_out->normal_error = error_packed_normal;
+    }
+    else if( error_octahedral_normal <= desc->normal_error )
+    {
+        format_out->normal = KE_MESH_NORMAL_OCTAHEDRAL;
+        format_out->normal_error = error_octahedral_normal;
+    }
+    
+    format_out->texcoord = KE_MESH_TEXCOORD_FLOAT;
+    format_out->texcoord_error = 0.0f;
+    if( desc->half_float && error_half_tex <= desc->texcoord_error )
+    {
+        format_out->texcoord = KE_MESH_TEXCOORD_HALF;
+        format_out->texcoord_error = error_half_tex;
+    }
+    else if( error_unorm_tex <= desc->texcoord_error )
+    {
+        format_out->texcoord = KE_MESH_TEXCOORD_UNORM16;
+        format_out->texcoord_error = error_unorm_tex;
+    }
+    
+    /* Decode transforms (identity for the unbounded encodings) */
+    for( int j = 0; j < 3; j++ )
+    {
+        format_out->position_scale[j] = format_out->position == KE_MESH_POSITION_SNORM16 ? pscale[j] : 1.0f;
+        format_out->position_offset[j] = format_out->position == KE_MESH_POSITION_SNORM16 ? poffset[j] : 0.0f;
+    }
+    for( int j = 0; j < 2; j++ )
+    {
+        format_out->texcoord_scale[j] = format_out->texcoord == KE_MESH_TEXCOORD_UNORM16 ? tscale[j] : 1.0f;
+        format_out->texcoord_offset[j] = format_out->texcoord == KE_MESH_TEXCOORD_UNORM16 ? toffset[j] : 0.0f;
+    }
+    
+    /* Lay out the vertex (every attribute is 4 byte aligned; 3 component 16-bit positions are
+       padded with w = 1 so that they map to 4 component formats) */
+    static const int position_sizes[] = { 12, 8, 8 };
+    static const int normal_sizes[] = { 12, 4, 4 };
+    static const int texcoord_sizes[] = { 8, 4, 4 };
+    
+    int normal_offset = position_sizes[format_out->position];
+    int texcoord_offset = normal_offset + normal_sizes[format_out->normal];
+    format_out->stride = texcoord_offset + texcoord_sizes[format_out->texcoord];
+    
+    KeVertexAttribute position_attributes[] =
+    {
+        { KE_VA_POSITION, 3, KE_FLOAT, No, 0, 0 },
+        { KE_VA_POSITION, 4, KE_HALF_FLOAT, No, 0, 0 },
+        { KE_VA_POSITION, 4, KE_SHORT, Yes, 0, 0 },
+    };
+    KeVertexAttribute normal_attributes[] =
+    {
+        { KE_VA_NORMAL, 3, KE_FLOAT, No, 0, 0 },
+        { KE_VA_NORMAL, 4, KE_INT_2_10_10_10_REV, Yes, 0, 0 },
+        { KE_VA_NORMAL, 2, KE_SHORT, Yes, 0, 0 },
+    };
+    KeVertexAttribute texcoord_attributes[] =
+    {
+        { KE_VA_TEXTURE0, 2, KE_FLOAT, No, 0, 0 },
+        { KE_VA_TEXTURE0, 2, KE_HALF_FLOAT, No, 0, 0 },
+        { KE_VA_TEXTURE0, 2, KE_UNSIGNED_SHORT, Yes, 0, 0 },
+    };
+    KeVertexAttribute end = { -1, 0, 0, 0, 0, 0 };
+    
+    format_out->vertex_attributes[0] = position_attributes[format_out->position];
+    format_out->vertex_attributes[1] = normal_attributes[format_out->normal];
+    format_out->vertex_attributes[1].offset = normal_offset;
+    format_out->vertex_attributes[2] = texcoord_attributes[format_out->texcoord];
+    format_out->vertex_attributes[2].offset = texcoord_offset;
+    format_out->vertex_attributes[3] = end;
+    for( int j = 0; j < 3; j++ )
+        format_out->vertex_attributes[j].stride = format_out->stride;
+    
+    /* Encode the vertices */
+    uint8_t* packed = new uint8_t[vertex_count * format_out->stride];
+    
+    for( int i = 0; i < vertex_count; i++ )
+    {
+        const KeMeshVertex* v = &vertices[i];
+        uint8_t* p = packed + ( i * format_out->stride );
+        
+        if( format_out->position == KE_MESH_POSITION_FLOAT )
+            memmove( p, v->pos, sizeof( float ) * 3 );
+        else if( format_out->position == KE_MESH_POSITION_HALF )
+        {
+            uint16_t h[4] = { KeFloatToHalf( v->pos[0] ), KeFloatToHalf( v->pos[1] ), KeFloatToHalf( v->pos[2] ), KeFloatToHalf( 1.0f ) };
+            memmove( p, h, sizeof( h ) );
+        }
+        else
+        {
+            int16_t s[4];
+            for( int j = 0; j < 3; j++ )
+                s[j] = KeFloatToSnorm16( ( v->pos[j] - poffset[j] ) / pscale[j] );
+            s[3] = 32767;
+            memmove( p, s, sizeof( s ) );
+        }
+        
+        p += normal_offset;
+        if( format_out->normal == KE_MESH_NORMAL_FLOAT )
+            memmove( p, v->normal, sizeof( float ) * 3 );
+        else if( format_out->normal == KE_MESH_NORMAL_10_10_10_2 )
+        {
+            uint32_t n = KePackNormal10_10_10_2( v->normal );
+            memmove( p, &n, sizeof( n ) );
+        }
+        else
+        {
+            int16_t oct[2];
+            KeEncodeOctahedral( v->normal, oct );
+            memmove( p, oct, sizeof( oct ) );
+        }
+        
+        p = packed + ( i * format_out->stride ) + texcoord_offset;
+        if( format_out->texcoord == KE_MESH_TEXCOORD_FLOAT )
+            memmove( p, v->tex, sizeof( float ) * 2 );
+        else if( format_out->texcoord == KE_MESH_TEXCOORD_HALF )
+        {
+            uint16_t h[2] = { KeFloatToHalf( v->tex[0] ), KeFloatToHalf( v->tex[1] ) };
+            memmove( p, h, sizeof( h ) );
+        }
+        else
+        {
+            uint16_t u[2];
+            for( int j = 0; j < 2; j++ )
+                u[j] = KeFloatToUnorm16( ( v->tex[j] - toffset[j] ) / tscale[j] );
+            memmove( p, u, sizeof( u ) );
+        }
+    }
+    
+    *packed_out = packed;
+    
+    return true;
 }
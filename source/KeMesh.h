@@ -13,6 +13,7 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include "openctm.h"
+#include "KeRenderDevice.h"
 
 
 /*
@@ -35,6 +36,62 @@ struct KeMeshVertex
 };
 
 
+/*
+ * Quantized mesh vertex attribute encodings
+ */
+#define KE_MESH_POSITION_FLOAT          0   /* 3 x float (12 bytes) */
+#define KE_MESH_POSITION_HALF           1   /* 3 x half float, padded (8 bytes) */
+#define KE_MESH_POSITION_SNORM16        2   /* 3 x snorm16 within the bounding box, padded (8 bytes) */
+
+#define KE_MESH_NORMAL_FLOAT            0   /* 3 x float (12 bytes) */
+#define KE_MESH_NORMAL_10_10_10_2       1   /* Signed 10:10:10:2 (4 bytes) */
+#define KE_MESH_NORMAL_OCTAHEDRAL       2   /* 2 x snorm16, octahedral encoded (4 bytes) */
+
+#define KE_MESH_TEXCOORD_FLOAT          0   /* 2 x float (8 bytes) */
+#define KE_MESH_TEXCOORD_HALF           1   /* 2 x half float (4 bytes) */
+#define KE_MESH_TEXCOORD_UNORM16        2   /* 2 x unorm16 within the texture coordinate range (4 bytes) */
+
+/*
+ * Default quantization error bounds
+ */
+#define KE_MESH_DEFAULT_POSITION_ERROR  (1.0f/8192.0f)  /* Fraction of the bounding box's largest extent */
+#define KE_MESH_DEFAULT_NORMAL_ERROR    0.5f            /* Degrees */
+#define KE_MESH_DEFAULT_TEXCOORD_ERROR  (1.0f/8192.0f)  /* Texture coordinate units */
+
+/*
+ * Mesh quantization settings.  For each attribute, the smallest encoding whose largest error
+ * (measured over every vertex) stays within the bound is used.  Set the flags from the device's
+ * half_float_vertices_supported and packed_vertices_supported capabilities.
+ */
+struct KeMeshQuantizeDesc
+{
+    float   position_error;
+    float   normal_error;
+    float   texcoord_error;
+    int     half_float;         /* Allow half float encodings */
+    int     packed;             /* Allow 10:10:10:2 encodings */
+};
+
+/*
+ * Quantized vertex layout
+ */
+struct KeMeshVertexFormat
+{
+    uint32_t            position;               /* KE_MESH_POSITION_* */
+    uint32_t            normal;                 /* KE_MESH_NORMAL_* */
+    uint32_t            texcoord;               /* KE_MESH_TEXCOORD_* */
+    uint32_t            stride;                 /* Size of each vertex in bytes */
+    float               position_scale[3];      /* pos = position_offset + position_scale * stored */
+    float               position_offset[3];     /* (identity unless KE_MESH_POSITION_SNORM16) */
+    float               texcoord_scale[2];      /* tex = texcoord_offset + texcoord_scale * stored */
+    float               texcoord_offset[2];     /* (identity unless KE_MESH_TEXCOORD_UNORM16) */
+    float               position_error;         /* Largest error measured for each attribute */
+    float               normal_error;
+    float               texcoord_error;
+    KeVertexAttribute   vertex_attributes[4];   /* For CreateGeometryBuffer/CreateProgram */
+};
+
+
 /*
  * Mesh structure
  */
@@ -47,6 +104,9 @@ struct KeMesh
     
     KeMeshVertex* vertices;
     uint32_t* indices;
+    
+    void* packed_vertices;              /* Quantized copy of the vertices (NULL if not requested) */
+    KeMeshVertexFormat packed_format;
 };
 
 
@@ -54,7 +114,13 @@ bool KeOpenScene( char* meshfile );
 bool KeOpenSceneFromMemory( void* ptr, uint32_t size );
 void KeCloseScene();
 int KeGetMeshCount();
-bool KeReadMeshVertexData( int index, KeMesh* mesh_out );
+bool KeReadMeshVertexData( int index, KeMesh* mesh_out, const KeMeshQuantizeDesc* quantize = NULL );
 void KeFreeMeshVertexData( KeMesh* mesh_out );
 
+bool KeQuantizeMeshVertices( const KeMeshVertex* vertices, int vertex_count, const KeMeshQuantizeDesc* desc, KeMeshVertexFormat* format_out, void** packed_out );
+void KeEncodeOctahedral( const float* normal, int16_t* encoded );
+void KeDecodeOctahedral( const int16_t* encoded, float* normal );
+uint16_t KeFloatToHalf( float value );
+float KeHalfToFloat( uint16_t value );
+
 #endif /* defined(__ke_mesh__) */
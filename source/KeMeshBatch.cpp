@@ -0,0 +1,459 @@
+//
+//  KeMeshBatch.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeMeshBatch.h"
+#include <float.h>
+#include <math.h>
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/*
+ * Static batch file header
+ */
+#define KE_STATIC_BATCH_MAGIC       0x3142534B  /* 'KSB1' */
+
+struct KeStaticBatchFileHeader
+{
+    uint32_t magic;
+    uint32_t batch_count;
+};
+
+struct KeStaticBatchFileEntry
+{
+    uint32_t        material_id;
+    uint32_t        vertex_count;
+    uint32_t        index_count;
+    uint32_t        submesh_count;
+    KeMeshBounds    bounds;
+};
+
+
+/*
+ * Default vertex attributes for KeMeshVertex
+ */
+static KeVertexAttribute mesh_vertex_attributes[] =
+{
+    { KE_VA_POSITION, 3, KE_FLOAT, No, sizeof(KeMeshVertex), 0 },
+    { KE_VA_NORMAL, 3, KE_FLOAT, No, sizeof(KeMeshVertex), sizeof(float)*3 },
+    { KE_VA_TEXTURE0, 2, KE_FLOAT, No, sizeof(KeMeshVertex), sizeof(float)*6 },
+    { -1, 0, 0, 0, 0, 0 }
+};
+
+
+/*
+ * Name: KeCalculateMeshBounds
+ * Desc: Calculates the bounding box and sphere of the vertices referenced by the given indices.
+ *       If no indices are given, all vertices are used.
+ */
+void KeCalculateMeshBounds( const KeMeshVertex* vertices, int vertex_count, const uint32_t* indices, int index_count, KeMeshBounds* bounds )
+{
+    int count = indices ? index_count : vertex_count;
+
+    if( !count )
+    {
+        ZeroMemory( bounds, sizeof( KeMeshBounds ) );
+        return;
+    }
+
+    /* Bounding box */
+    for( int j = 0; j < 3; j++ )
+    {
+        bounds->min[j] = FLT_MAX;
+        bounds->max[j] = -FLT_MAX;
+    }
+
+    for( int i = 0; i < count; i++ )
+    {
+        const float* pos = vertices[indices ? indices[i] : i].pos;
+
+        for( int j = 0; j < 3; j++ )
+        {
+            if( pos[j] < bounds->min[j] ) bounds->min[j] = pos[j];
+            if( pos[j] > bounds->max[j] ) bounds->max[j] = pos[j];
+        }
+    }
+
+    /* Bounding sphere centred on the box */
+    float radius_sq = 0;
+
+    for( int j = 0; j < 3; j++ )
+        bounds->centre[j] = ( bounds->min[j] + bounds->max[j] ) * 0.5f;
+
+    for( int i = 0; i < count; i++ )
+    {
+        const float* pos = vertices[indices ? indices[i] : i].pos;
+        float dx = pos[0] - bounds->centre[0];
+        float dy = pos[1] - bounds->centre[1];
+        float dz = pos[2] - bounds->centre[2];
+        float d = dx*dx + dy*dy + dz*dz;
+
+        if( d > radius_sq )
+            radius_sq = d;
+    }
+
+    bounds->radius = sqrtf( radius_sq );
+}
+
+
+/*
+ * Name: KeStaticBatcher::KeStaticBatcher
+ * Desc: Default constructor
+ */
+KeStaticBatcher::KeStaticBatcher() : device(NULL)
+{
+}
+
+
+/*
+ * Name: KeStaticBatcher::~KeStaticBatcher
+ * Desc: Default deconstructor
+ */
+KeStaticBatcher::~KeStaticBatcher()
+{
+    Clear();
+}
+
+
+/*
+ * Name: KeStaticBatcher::PVT_FindBatch
+ * Desc: Returns the batch for the given material, creating it if it does not exist yet.
+ */
+KeStaticBatch* KeStaticBatcher::PVT_FindBatch( uint32_t material_id )
+{
+    for( size_t i = 0; i < batches.size(); i++ )
+    {
+        if( batches[i]->material_id == material_id )
+            return batches[i];
+    }
+
+    KeStaticBatch* batch = new KeStaticBatch;
+    batch->material_id = material_id;
+    batch->index_type = KE_UNSIGNED_INT;
+    batch->geometry_buffer = NULL;
+    ZeroMemory( &batch->bounds, sizeof( KeMeshBounds ) );
+
+    batches.push_back( batch );
+
+    return batch;
+}
+
+
+/*
+ * Name: KeStaticBatcher::AddMesh
+ * Desc: Merges a mesh into the batch for its material.  The material ID should uniquely
+ *       identify the combination of GPU program, textures and states the mesh is drawn with
+ *       (the mesh's material_index is usually a good choice).  If a world matrix is given,
+ *       the vertices are transformed into world space before being merged.  Returns the
+ *       index of the new sub-mesh within its batch, or -1 on failure.
+ * NOTE: Normals are transformed by the upper 3x3 of the world matrix and renormalized, so
+ *       non-uniform scaling is only approximated.
+ */
+int KeStaticBatcher::AddMesh( KeMesh* mesh, uint32_t material_id, const nv::matrix4f* world, int user_id )
+{
+    /* Sanity checks */
+    if( !mesh || !mesh->vertices || !mesh->indices || !mesh->index_count )
+    {
+        DISPDBG( KE_ERROR, "Invalid mesh!" );
+        return -1;
+    }
+
+    KeStaticBatch* batch = PVT_FindBatch( material_id );
+    uint32_t base_vertex = (uint32_t) batch->vertices.size();
+
+    /* Copy and transform the vertices */
+    batch->vertices.resize( base_vertex + mesh->vertex_count );
+    KeMeshVertex* v = &batch->vertices[base_vertex];
+    memmove( v, mesh->vertices, sizeof( KeMeshVertex ) * mesh->vertex_count );
+
+    if( world )
+    {
+        const float* m = world->_array;
+
+        for( int i = 0; i < mesh->vertex_count; i++ )
+        {
+            float p[3], n[3];
+            memmove( p, v[i].pos, sizeof( float ) * 3 );
+            memmove( n, v[i].normal, sizeof( float ) * 3 );
+
+            v[i].pos[0] = m[0]*p[0] + m[4]*p[1] + m[8]*p[2] + m[12];
+            v[i].pos[1] = m[1]*p[0] + m[5]*p[1] + m[9]*p[2] + m[13];
+            v[i].pos[2] = m[2]*p[0] + m[6]*p[1] + m[10]*p[2] + m[14];
+
+            v[i].normal[0] = m[0]*n[0] + m[4]*n[1] + m[8]*n[2];
+            v[i].normal[1] = m[1]*n[0] + m[5]*n[1] + m[9]*n[2];
+            v[i].normal[2] = m[2]*n[0] + m[6]*n[1] + m[10]*n[2];
+
+            float length = sqrtf( v[i].normal[0]*v[i].normal[0] + v[i].normal[1]*v[i].normal[1] + v[i].normal[2]*v[i].normal[2] );
+            if( length > 0 )
+            {
+                v[i].normal[0] /= length;
+                v[i].normal[1] /= length;
+                v[i].normal[2] /= length;
+            }
+        }
+    }
+
+    /* Append the indices, rebased onto the batch's vertex data */
+    KeStaticSubMesh submesh;
+    submesh.first_index = (uint32_t) batch->indices.size();
+    submesh.index_count = mesh->index_count;
+    submesh.first_vertex = base_vertex;
+    submesh.last_vertex = base_vertex + mesh->vertex_count - 1;
+    submesh.user_id = user_id;
+
+    batch->indices.resize( submesh.first_index + mesh->index_count );
+    for( int i = 0; i < mesh->index_count; i++ )
+        batch->indices[submesh.first_index+i] = mesh->indices[i] + base_vertex;
+
+    /* Calculate the bounds of this sub-mesh so that it can still be culled individually */
+    KeCalculateMeshBounds( &batch->vertices[0], (int) batch->vertices.size(), &batch->indices[submesh.first_index], submesh.index_count, &submesh.bounds );
+
+    batch->submeshes.push_back( submesh );
+
+    return (int) batch->submeshes.size() - 1;
+}
+
+
+/*
+ * Name: KeStaticBatcher::Build
+ * Desc: Creates one geometry buffer per batch out of the merged vertex and index data.  16-bit
+ *       indices are used whenever a batch has few enough vertices.  If no vertex attributes are
+ *       given, the default KeMeshVertex layout is used.
+ */
+bool KeStaticBatcher::Build( IKeRenderDevice* device, KeVertexAttribute* vertex_attributes )
+{
+    if( !device )
+        DISPDBG_RB( KE_ERROR, "Invalid render device!" );
+
+    this->device = device;
+
+    if( !vertex_attributes )
+        vertex_attributes = mesh_vertex_attributes;
+
+    for( size_t i = 0; i < batches.size(); i++ )
+    {
+        KeStaticBatch* batch = batches[i];
+
+        if( batch->vertices.empty() )
+            continue;
+
+        /* Destroy the previous geometry buffer if this batch was built before */
+        if( batch->geometry_buffer )
+        {
+            device->DeleteGeometryBuffer( batch->geometry_buffer );
+            batch->geometry_buffer = NULL;
+        }
+
+        /* Calculate the bounds of the entire batch */
+        KeCalculateMeshBounds( &batch->vertices[0], (int) batch->vertices.size(), NULL, 0, &batch->bounds );
+
+        uint32_t vertex_data_size = (uint32_t) ( sizeof( KeMeshVertex ) * batch->vertices.size() );
+        bool res;
+
+        if( batch->vertices.size() <= 0x10000 )
+        {
+            /* Convert to 16-bit indices */
+            std::vector<uint16_t> indices16( batch->indices.size() );
+            for( size_t j = 0; j < batch->indices.size(); j++ )
+                indices16[j] = (uint16_t) batch->indices[j];
+
+            batch->index_type = KE_UNSIGNED_SHORT;
+            res = device->CreateGeometryBuffer( &batch->vertices[0], vertex_data_size, &indices16[0], (uint32_t) ( sizeof( uint16_t ) * indices16.size() ),
+                                               KE_UNSIGNED_SHORT, KE_USAGE_STATIC_WRITE, vertex_attributes, &batch->geometry_buffer );
+        }
+        else
+        {
+            batch->index_type = KE_UNSIGNED_INT;
+            res = device->CreateGeometryBuffer( &batch->vertices[0], vertex_data_size, &batch->indices[0], (uint32_t) ( sizeof( uint32_t ) * batch->indices.size() ),
+                                               KE_UNSIGNED_INT, KE_USAGE_STATIC_WRITE, vertex_attributes, &batch->geometry_buffer );
+        }
+
+        if( !res )
+            DISPDBG_RB( KE_ERROR, "Error creating geometry buffer for static batch (material: " << batch->material_id << ")!" );
+    }
+
+    return true;
+}
+
+
+/*
+ * Name: KeStaticBatcher::Clear
+ * Desc: Destroys all batches and their geometry buffers.
+ */
+void KeStaticBatcher::Clear()
+{
+    for( size_t i = 0; i < batches.size(); i++ )
+    {
+        /* Go through the device so buffers still used by frames in flight are deleted later */
+        if( batches[i]->geometry_buffer )
+            device->DeleteGeometryBuffer( batches[i]->geometry_buffer );
+
+        delete batches[i];
+    }
+
+    batches.clear();
+}
+
+
+/*
+ * Name: KeStaticBatcher::Save
+ * Desc: Writes the merged (CPU side) batch data to disk so that it can be batched offline and
+ *       loaded later with KeStaticBatcher::Load.
+ */
+bool KeStaticBatcher::Save( const char* filename )
+{
+    FILE* fp = fopen( filename, "wb" );
+    if( !fp )
+        DISPDBG_RB( KE_ERROR, "Could not open file for writing: " << filename );
+
+    KeStaticBatchFileHeader header;
+    header.magic = KE_STATIC_BATCH_MAGIC;
+    header.batch_count = (uint32_t) batches.size();
+    fwrite( &header, sizeof( header ), 1, fp );
+
+    for( size_t i = 0; i < batches.size(); i++ )
+    {
+        KeStaticBatch* batch = batches[i];
+        KeStaticBatchFileEntry entry;
+
+        entry.material_id = batch->material_id;
+        entry.vertex_count = (uint32_t) batch->vertices.size();
+        entry.index_count = (uint32_t) batch->indices.size();
+        entry.submesh_count = (uint32_t) batch->submeshes.size();
+        entry.bounds = batch->bounds;
+
+        fwrite( &entry, sizeof( entry ), 1, fp );
+        if( entry.submesh_count ) fwrite( &batch->submeshes[0], sizeof( KeStaticSubMesh ), entry.submesh_count, fp );
+        if( entry.vertex_count ) fwrite( &batch->vertices[0], sizeof( KeMeshVertex ), entry.vertex_count, fp );
+        if( entry.index_count ) fwrite( &batch->indices[0], sizeof( uint32_t ), entry.index_count, fp );
+    }
+
+    fclose( fp );
+
+    return true;
+}
+
+
+/*
+ * Name: KeStaticBatcher::Load
+ * Desc: Reads batch data previously written by KeStaticBatcher::Save from memory (i.e. read
+ *       from a resource archive).  Any existing batches are discarded.  Call Build afterwards
+ *       to create the geometry buffers.
+ */
+bool KeStaticBatcher::Load( void* ptr, uint32_t size )
+{
+    uint8_t* p = (uint8_t*) ptr;
+    uint8_t* end = p + size;
+
+    Clear();
+
+    if( !ptr || size < sizeof( KeStaticBatchFileHeader ) )
+        DISPDBG_RB( KE_ERROR, "Invalid static batch data!" );
+
+    KeStaticBatchFileHeader header;
+    memmove( &header, p, sizeof( header ) );
+    p += sizeof( header );
+
+    if( header.magic != KE_STATIC_BATCH_MAGIC )
+        DISPDBG_RB( KE_ERROR, "Invalid static batch data (bad magic number)!" );
+
+    for( uint32_t i = 0; i < header.batch_count; i++ )
+    {
+        KeStaticBatchFileEntry entry;
+
+        if( p + sizeof( entry ) > end )
+            DISPDBG_RB( KE_ERROR, "Static batch data is truncated!" );
+        memmove( &entry, p, sizeof( entry ) );
+        p += sizeof( entry );
+
+        size_t data_size = sizeof( KeStaticSubMesh ) * entry.submesh_count +
+                           sizeof( KeMeshVertex ) * entry.vertex_count +
+                           sizeof( uint32_t ) * entry.index_count;
+        if( p + data_size > end )
+            DISPDBG_RB( KE_ERROR, "Static batch data is truncated!" );
+
+        KeStaticBatch* batch = PVT_FindBatch( entry.material_id );
+        batch->bounds = entry.bounds;
+
+        batch->submeshes.resize( entry.submesh_count );
+        if( entry.submesh_count ) memmove( &batch->submeshes[0], p, sizeof( KeStaticSubMesh ) * entry.submesh_count );
+        p += sizeof( KeStaticSubMesh ) * entry.submesh_count;
+
+        batch->vertices.resize( entry.vertex_count );
+        if( entry.vertex_count ) memmove( &batch->vertices[0], p, sizeof( KeMeshVertex ) * entry.vertex_count );
+        p += sizeof( KeMeshVertex ) * entry.vertex_count;
+
+        batch->indices.resize( entry.index_count );
+        if( entry.index_count ) memmove( &batch->indices[0], p, sizeof( uint32_t ) * entry.index_count );
+        p += sizeof( uint32_t ) * entry.index_count;
+    }
+
+    return true;
+}
+
+
+/*
+ * Name: KeStaticBatcher::GetBatchCount
+ * Desc: Returns the number of batches (one per unique material).
+ */
+int KeStaticBatcher::GetBatchCount()
+{
+    return (int) batches.size();
+}
+
+
+/*
+ * Name: KeStaticBatcher::GetBatch
+ * Desc: Returns the batch at the given index.
+ */
+KeStaticBatch* KeStaticBatcher::GetBatch( int index )
+{
+    if( index < 0 || index >= (int) batches.size() )
+        return NULL;
+
+    return batches[index];
+}
+
+
+/*
+ * Name: KeStaticBatcher::BuildDrawCommands
+ * Desc: Fills an array of indirect draw commands (see DrawIndexedVerticesIndirect) for every
+ *       visible sub-mesh within the given batch, and returns the number of commands written.
+ *       The visibility array holds one entry per sub-mesh (non-zero if visible); if it is NULL,
+ *       all sub-meshes are considered visible.  Each command's draw ID is its sub-mesh index.
+ */
+uint32_t KeStaticBatcher::BuildDrawCommands( int index, const uint8_t* visible, KeDrawIndexedIndirectCommand* commands )
+{
+    KeStaticBatch* batch = GetBatch( index );
+    uint32_t count = 0;
+
+    if( !batch || !commands )
+        return 0;
+
+    for( size_t i = 0; i < batch->submeshes.size(); i++ )
+    {
+        if( visible && !visible[i] )
+            continue;
+
+        commands[count].count = batch->submeshes[i].index_count;
+        commands[count].instance_count = 1;
+        commands[count].first_index = batch->submeshes[i].first_index;
+        commands[count].base_vertex = 0;
+        commands[count].base_instance = (uint32_t) i;
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,85 @@
+//
+//  KeMeshBatch.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeMeshBatch__
+#define __KeMeshBatch__
+
+#include <vector>
+#include "KeRenderDevice.h"
+#include "KeMesh.h"
+
+
+/*
+ * Mesh bounding volumes
+ */
+struct KeMeshBounds
+{
+    float min[3];       /* Axis aligned bounding box */
+    float max[3];
+    float centre[3];    /* Bounding sphere */
+    float radius;
+};
+
+/*
+ * Sub-mesh within a static batch
+ */
+struct KeStaticSubMesh
+{
+    uint32_t        first_index;    /* Offset into the batch's index data (in indices) */
+    uint32_t        index_count;    /* Number of indices belonging to this sub-mesh */
+    uint32_t        first_vertex;   /* Lowest vertex referenced by this sub-mesh */
+    uint32_t        last_vertex;    /* Highest vertex referenced by this sub-mesh */
+    int             user_id;        /* Caller supplied identifier for the original mesh */
+    KeMeshBounds    bounds;         /* World space bounds, used for culling */
+};
+
+/*
+ * Static batch; all meshes sharing the same material (program, texture and states)
+ */
+struct KeStaticBatch
+{
+    uint32_t                        material_id;        /* Caller supplied material identifier */
+    uint32_t                        index_type;         /* KE_UNSIGNED_SHORT or KE_UNSIGNED_INT */
+    std::vector<KeMeshVertex>       vertices;           /* Combined, pre-transformed vertex data */
+    std::vector<uint32_t>           indices;            /* Combined index data (rebased per sub-mesh) */
+    std::vector<KeStaticSubMesh>    submeshes;          /* Original meshes making up this batch */
+    KeMeshBounds                    bounds;             /* Bounds of the entire batch */
+    IKeGeometryBuffer*              geometry_buffer;    /* Created by KeStaticBatcher::Build */
+};
+
+
+/* Static mesh batching class */
+class KeStaticBatcher
+{
+public:
+    KeStaticBatcher();
+    virtual ~KeStaticBatcher();
+
+public:
+    int AddMesh( KeMesh* mesh, uint32_t material_id, const nv::matrix4f* world = NULL, int user_id = -1 );
+    bool Build( IKeRenderDevice* device, KeVertexAttribute* vertex_attributes = NULL );
+    void Clear();
+
+    bool Save( const char* filename );
+    bool Load( void* ptr, uint32_t size );
+
+    int GetBatchCount();
+    KeStaticBatch* GetBatch( int index );
+    uint32_t BuildDrawCommands( int index, const uint8_t* visible, KeDrawIndexedIndirectCommand* commands );
+
+protected:
+    KeStaticBatch* PVT_FindBatch( uint32_t material_id );
+
+protected:
+    std::vector<KeStaticBatch*>     batches;    /* One batch per unique material */
+    IKeRenderDevice*                device;     /* Device the geometry buffers were built with */
+};
+
+
+void KeCalculateMeshBounds( const KeMeshVertex* vertices, int vertex_count, const uint32_t* indices, int index_count, KeMeshBounds* bounds );
+
+#endif /* defined(__KeMeshBatch__) */
@@ -0,0 +1,430 @@
+//
+//  KeOcclusionCuller.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeOcclusionCuller.h"
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/*
+ * Name: KeOcclusionCuller::KeOcclusionCuller
+ * Desc: Default constructor.  The proxy program only needs to transform KE_VA_POSITION by the
+ *       world, view and projection matrices; its output colour is masked off.
+ */
+KeOcclusionCuller::KeOcclusionCuller( IKeRenderDevice* device, IKeGpuProgram* proxy_program ) : device(device), proxy_program(proxy_program),
+    proxy_gb(NULL), proxy_states(NULL), restore_states(NULL), frame(0), retest_interval(KE_OCCLUSION_RETEST_INTERVAL)
+{
+    KeRenderDeviceCaps caps;
+
+    ZeroMemory( &caps, sizeof( KeRenderDeviceCaps ) );
+    ZeroMemory( &stats, sizeof( KeOcclusionStats ) );
+    if( device )
+        device->GetDeviceCaps( &caps );
+
+    occlusion_query_supported = caps.occlusion_query_supported;
+    conditional_render_supported = caps.conditional_render_supported;
+
+    /* Without queries (or a proxy), every object is simply reported as visible */
+    if( occlusion_query_supported && !PVT_CreateProxy() )
+        occlusion_query_supported = No;
+}
+
+
+/*
+ * Name: KeOcclusionCuller::~KeOcclusionCuller
+ * Desc: Default deconstructor.  Deletes every query, so all handles become invalid.
+ */
+KeOcclusionCuller::~KeOcclusionCuller()
+{
+    for( size_t i = 0; i < objects.size(); i++ )
+    {
+        if( objects[i].query )
+            objects[i].query->Destroy();
+    }
+
+    for( size_t i = 0; i < free_queries.size(); i++ )
+        free_queries[i]->Destroy();
+
+    if( proxy_gb )
+        device->DeleteGeometryBuffer( proxy_gb );
+    if( proxy_states )
+        proxy_states->Destroy();
+    if( restore_states )
+        restore_states->Destroy();
+}
+
+
+/*
+ * Name: KeOcclusionCuller::AddObject
+ * Desc: Adds an object with the given world space bounding box.  New objects are treated as
+ *       visible until their first query result comes back.  Returns a handle, or
+ *       KE_OCCLUSION_INVALID_HANDLE on failure.
+ */
+int KeOcclusionCuller::AddObject( const float* min, const float* max )
+{
+    if( !min || !max )
+    {
+        DISPDBG( KE_ERROR, "Invalid bounding box!" );
+        return KE_OCCLUSION_INVALID_HANDLE;
+    }
+
+    KeOcclusionObject o;
+    ZeroMemory( &o, sizeof( KeOcclusionObject ) );
+    o.visible = Yes;
+    o.in_use = Yes;
+
+    /* Store the object under a new or recycled handle */
+    int handle;
+    if( !free_handles.empty() )
+    {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        objects[handle] = o;
+    }
+    else
+    {
+        handle = (int) objects.size();
+        objects.push_back( o );
+    }
+
+    SetBounds( handle, min, max );
+
+    return handle;
+}
+
+
+/*
+ * Name: KeOcclusionCuller::RemoveObject
+ * Desc: Removes an object.  Its handle may be reused by a later AddObject.
+ */
+void KeOcclusionCuller::RemoveObject( int handle )
+{
+    if( handle < 0 || handle >= (int) objects.size() || !objects[handle].in_use )
+        DISPDBG_R( KE_WARNING, "Invalid occlusion object handle (" << handle << ")!" );
+
+    KeOcclusionObject* o = &objects[handle];
+
+    /* An outstanding query can still be reused; beginning it again discards the old result */
+    if( o->query )
+        free_queries.push_back( o->query );
+
+    o->query = NULL;
+    o->in_use = No;
+    free_handles.push_back( handle );
+}
+
+
+/*
+ * Name: KeOcclusionCuller::SetBounds
+ * Desc: Updates an object's world space bounding box (i.e. after it moved).
+ */
+void KeOcclusionCuller::SetBounds( int handle, const float* min, const float* max )
+{
+    if( handle < 0 || handle >= (int) objects.size() || !objects[handle].in_use )
+        DISPDBG_R( KE_WARNING, "Invalid occlusion object handle (" << handle << ")!" );
+
+    for( int i = 0; i < 3; i++ )
+    {
+        objects[handle].min[i] = min[i];
+        objects[handle].max[i] = max[i];
+    }
+}
+
+
+/*
+ * Name: KeOcclusionCuller::BeginFrame
+ * Desc: Reads back the results of the queries issued last frame.  Results are never waited
+ *       on; an object whose result isn't ready yet is treated as visible until it is.
+ */
+void KeOcclusionCuller::BeginFrame()
+{
+    frame++;
+
+    ZeroMemory( &stats, sizeof( KeOcclusionStats ) );
+
+    for( size_t i = 0; i < objects.size(); i++ )
+    {
+        KeOcclusionObject* o = &objects[i];
+
+        if( !o->in_use )
+            continue;
+
+        stats.objects++;
+
+        if( o->query )
+        {
+            uint32_t samples = 0;
+
+            if( o->query->GetResult( No, &samples ) )
+            {
+                o->visible = samples ? Yes : No;
+                o->tested_frame = frame;
+                free_queries.push_back( o->query );
+                o->query = NULL;
+            }
+            else
+            {
+                /* Uncertain; drawing it is always correct, culling it might not be */
+                o->visible = Yes;
+                stats.queries_pending++;
+            }
+        }
+
+        if( o->visible )
+            stats.visible++;
+    }
+}
+
+
+/*
+ * Name: KeOcclusionCuller::IsVisible
+ * Desc: Returns true if the object was visible (or uncertain) as of the last results read back.
+ */
+bool KeOcclusionCuller::IsVisible( int handle )
+{
+    if( handle < 0 || handle >= (int) objects.size() || !objects[handle].in_use )
+        return false;
+
+    if( !occlusion_query_supported )
+        return true;
+
+    return objects[handle].visible ? true : false;
+}
+
+
+/*
+ * Name: KeOcclusionCuller::IssueQueries
+ * Desc: Draws a bounding box proxy inside a query for each object needing a test.  Hidden and
+ *       untested objects are queried every frame, while visible objects are only requeried every
+ *       few frames (staggered by handle, so they don't all come due on the same frame).  Objects
+ *       outside the view frustum (in_frustum[handle] == 0, if given) are skipped.
+ * NOTE: Call this after the visible objects have been drawn, so they occlude the proxies.  The
+ *       current program, geometry buffer and render states are changed; depth and colour writes
+ *       are left enabled afterwards.
+ */
+void KeOcclusionCuller::IssueQueries( const float* eye, float near_z, const uint8_t* in_frustum )
+{
+    if( !occlusion_query_supported )
+        return;
+
+    nv::matrix4f world;
+    device->GetWorldMatrix( &world );
+
+    device->SetRenderStateBuffer( proxy_states );
+    device->SetProgram( proxy_program );
+    device->SetGeometryBuffer( proxy_gb );
+
+    for( size_t i = 0; i < objects.size(); i++ )
+    {
+        KeOcclusionObject* o = &objects[i];
+
+        if( !PVT_NeedsQuery( (int) i, o, eye, near_z, in_frustum ) )
+            continue;
+
+        IKeOcclusionQuery* query = PVT_AllocateQuery();
+        if( !query )
+            break;
+
+        /* Scale and move the unit cube onto the bounding box */
+        nv::matrix4f m;
+        m.set_scale( nv::vec3f( o->max[0] - o->min[0], o->max[1] - o->min[1], o->max[2] - o->min[2] ) );
+        m.set_translate( nv::vec3f( o->min[0], o->min[1], o->min[2] ) );
+        device->SetWorldMatrix( &m );
+
+        if( !query->Begin() )
+        {
+            free_queries.push_back( query );
+            continue;
+        }
+
+        device->DrawIndexedVertices( KE_TRIANGLES, sizeof( float ) * 3, 36 );
+        query->End();
+
+        o->query = query;
+        o->query_frame = frame;
+        stats.queries_issued++;
+    }
+
+    device->SetRenderStateBuffer( restore_states );
+    device->SetWorldMatrix( &world );
+}
+
+
+/*
+ * Name: KeOcclusionCuller::BeginConditionalDraw
+ * Desc: Returns true if a hidden object was queried this frame and may be drawn now.  Its draws
+ *       are discarded by the GPU unless the proxy passed, until EndConditionalDraw is called.
+ * NOTE: Without conditional rendering, hidden objects only reappear once the result has been
+ *       read back on the following frame.  Visible objects return false (already drawn).
+ */
+bool KeOcclusionCuller::BeginConditionalDraw( int handle )
+{
+    if( handle < 0 || handle >= (int) objects.size() || !objects[handle].in_use )
+        return false;
+
+    KeOcclusionObject* o = &objects[handle];
+
+    if( !occlusion_query_supported || !conditional_render_supported || o->visible )
+        return false;
+    if( !o->query || o->query_frame != frame )
+        return false;
+
+    device->BeginConditionalRender( o->query, Yes );
+    o->conditional = Yes;
+
+    return true;
+}
+
+
+/*
+ * Name: KeOcclusionCuller::EndConditionalDraw
+ * Desc: Ends the conditional draw started with BeginConditionalDraw.
+ */
+void KeOcclusionCuller::EndConditionalDraw( int handle )
+{
+    if( handle < 0 || handle >= (int) objects.size() || !objects[handle].conditional )
+        return;
+
+    device->EndConditionalRender();
+    objects[handle].conditional = No;
+}
+
+
+/*
+ * Name: KeOcclusionCuller::SetRetestInterval
+ * Desc: Sets how many frames a visible object is trusted to stay visible before being requeried.
+ *       Longer intervals issue fewer queries, but objects take longer to be culled once hidden.
+ */
+void KeOcclusionCuller::SetRetestInterval( int frames )
+{
+    retest_interval = frames < 1 ? 1 : frames;
+}
+
+
+/*
+ * Name: KeOcclusionCuller::GetStats
+ * Desc: Returns this frame's statistics.
+ */
+void KeOcclusionCuller::GetStats( KeOcclusionStats* stats )
+{
+    if( stats )
+        memmove( stats, &this->stats, sizeof( KeOcclusionStats ) );
+}
+
+
+/* Creates the unit cube and render states used to draw the bounding box proxies */
+bool KeOcclusionCuller::PVT_CreateProxy()
+{
+    if( !proxy_program )
+        DISPDBG_RB( KE_WARNING, "No proxy program given; occlusion culling is disabled." );
+
+    KeVertexAttribute va[] =
+    {
+        { KE_VA_POSITION, 3, KE_FLOAT, No, 3*sizeof(float), 0 },
+        { -1, 0, 0, 0, 0, 0 },
+    };
+
+    float vertices[] =
+    {
+        0, 0, 0,    1, 0, 0,    1, 1, 0,    0, 1, 0,
+        0, 0, 1,    1, 0, 1,    1, 1, 1,    0, 1, 1,
+    };
+
+    uint16_t indices[] =
+    {
+        0, 2, 1,    0, 3, 2,    /* -z */
+        4, 5, 6,    4, 6, 7,    /* +z */
+        0, 1, 5,    0, 5, 4,    /* -y */
+        3, 6, 2,    3, 7, 6,    /* +y */
+        0, 4, 7,    0, 7, 3,    /* -x */
+        1, 2, 6,    1, 6, 5,    /* +x */
+    };
+
+    if( !device->CreateGeometryBuffer( vertices, sizeof( vertices ), indices, sizeof( indices ), KE_UNSIGNED_SHORT,
+                                       KE_USAGE_STATIC_WRITE, va, &proxy_gb ) )
+        DISPDBG_RB( KE_ERROR, "Error creating occlusion proxy geometry!" );
+
+    /* Both faces are drawn so the test still works when the camera is close to the box */
+    KeState proxy[] =
+    {
+        { KE_RS_DEPTHTEST, Yes, 0, 0, 0, 0 },
+        { KE_RS_DEPTHFUNC, KE_LEQUAL, 0, 0, 0, 0 },
+        { KE_RS_DEPTHMASK, No, 0, 0, 0, 0 },
+        { KE_RS_COLOURMASK, No, 0, 0, 0, 0 },
+        { KE_RS_CULLMODE, No, 0, 0, 0, 0 },
+    };
+
+    KeState restore[] =
+    {
+        { KE_RS_DEPTHMASK, Yes, 0, 0, 0, 0 },
+        { KE_RS_COLOURMASK, Yes, 0, 0, 0, 0 },
+    };
+
+    if( !device->CreateRenderStateBuffer( proxy, sizeof( proxy ) / sizeof( KeState ), &proxy_states ) ||
+        !device->CreateRenderStateBuffer( restore, sizeof( restore ) / sizeof( KeState ), &restore_states ) )
+        DISPDBG_RB( KE_ERROR, "Error creating occlusion proxy render states!" );
+
+    return true;
+}
+
+/* Takes a query from the pool, creating a new one if it's empty */
+IKeOcclusionQuery* KeOcclusionCuller::PVT_AllocateQuery()
+{
+    IKeOcclusionQuery* query = NULL;
+
+    if( !free_queries.empty() )
+    {
+        query = free_queries.back();
+        free_queries.pop_back();
+        return query;
+    }
+
+    if( !device->CreateOcclusionQuery( KE_QUERY_ANY_SAMPLES, &query ) )
+    {
+        DISPDBG( KE_ERROR, "Error creating occlusion query!" );
+        return NULL;
+    }
+
+    return query;
+}
+
+/* Decides whether an object gets a query this frame (see IssueQueries) */
+bool KeOcclusionCuller::PVT_NeedsQuery( int handle, KeOcclusionObject* o, const float* eye, float near_z, const uint8_t* in_frustum )
+{
+    if( !o->in_use || o->query )
+        return false;
+
+    if( in_frustum && !in_frustum[handle] )
+        return false;
+
+    /* The near plane would clip away the front of a box surrounding the eye, so the
+       query could fail even though the object is right in front of us. */
+    if( eye && eye[0] >= o->min[0] - near_z && eye[0] <= o->max[0] + near_z &&
+               eye[1] >= o->min[1] - near_z && eye[1] <= o->max[1] + near_z &&
+               eye[2] >= o->min[2] - near_z && eye[2] <= o->max[2] + near_z )
+    {
+        o->visible = Yes;
+        return false;
+    }
+
+    /* Hidden and never tested objects are always (re)tested */
+    if( !o->visible || !o->tested_frame )
+        return true;
+
+    if( ( frame + handle ) % retest_interval == 0 )
+        return true;
+
+    stats.queries_skipped++;
+    return false;
+}
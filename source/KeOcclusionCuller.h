@@ -0,0 +1,97 @@
+//
+//  KeOcclusionCuller.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeOcclusionCuller__
+#define __KeOcclusionCuller__
+
+#include <vector>
+#include "KeRenderDevice.h"
+
+
+/*
+ * Occlusion culler defaults
+ */
+#define KE_OCCLUSION_RETEST_INTERVAL    8   /* Frames a visible object is assumed to stay visible */
+#define KE_OCCLUSION_INVALID_HANDLE     -1
+
+
+/*
+ * Occlusion culled object
+ */
+struct KeOcclusionObject
+{
+    float               min[3];         /* World space bounding box */
+    float               max[3];
+    IKeOcclusionQuery*  query;          /* Outstanding query (NULL if none) */
+    uint32_t            query_frame;    /* Frame the outstanding query was issued in */
+    uint32_t            tested_frame;   /* Frame the last result was read back in (0 = never tested) */
+    int                 visible;        /* Last known visibility */
+    int                 conditional;    /* Yes while drawn with conditional rendering */
+    int                 in_use;
+};
+
+/*
+ * Occlusion culler statistics (for the current frame)
+ */
+struct KeOcclusionStats
+{
+    uint32_t    objects;
+    uint32_t    visible;
+    uint32_t    queries_issued;
+    uint32_t    queries_pending;    /* Results that weren't ready one frame later */
+    uint32_t    queries_skipped;    /* Visible objects trusted to still be visible */
+};
+
+
+/* Hardware occlusion culling class.  Each frame:
+   1. BeginFrame reads back the results of last frame's queries (never stalling).
+   2. Draw every object for which IsVisible returns true; these are the occluders.
+   3. IssueQueries draws bounding box proxies for hidden, uncertain and due objects.
+   4. Objects for which BeginConditionalDraw returns true may be drawn; the GPU skips them
+      unless their proxy turned out visible, so they appear without a frame of delay. */
+class KeOcclusionCuller
+{
+public:
+    KeOcclusionCuller( IKeRenderDevice* device, IKeGpuProgram* proxy_program );
+    virtual ~KeOcclusionCuller();
+
+public:
+    int AddObject( const float* min, const float* max );
+    void RemoveObject( int handle );
+    void SetBounds( int handle, const float* min, const float* max );
+
+    void BeginFrame();
+    bool IsVisible( int handle );
+    void IssueQueries( const float* eye, float near_z, const uint8_t* in_frustum = NULL );
+    bool BeginConditionalDraw( int handle );
+    void EndConditionalDraw( int handle );
+
+    void SetRetestInterval( int frames );
+    void GetStats( KeOcclusionStats* stats );
+
+protected:
+    bool PVT_CreateProxy();
+    IKeOcclusionQuery* PVT_AllocateQuery();
+    bool PVT_NeedsQuery( int handle, KeOcclusionObject* o, const float* eye, float near_z, const uint8_t* in_frustum );
+
+protected:
+    IKeRenderDevice*                    device;
+    IKeGpuProgram*                      proxy_program;  /* Transforms positions only (supplied by the caller) */
+    IKeGeometryBuffer*                  proxy_gb;       /* Unit cube */
+    IKeRenderStateBuffer*               proxy_states;   /* Depth test without depth or colour writes */
+    IKeRenderStateBuffer*               restore_states; /* Depth and colour writes back on */
+    std::vector<KeOcclusionObject>      objects;        /* Indexed by handle */
+    std::vector<int>                    free_handles;   /* Recycled handles */
+    std::vector<IKeOcclusionQuery*>     free_queries;   /* Query pool */
+    uint32_t                            frame;
+    int                                 retest_interval;
+    int                                 occlusion_query_supported;
+    int                                 conditional_render_supported;
+    KeOcclusionStats                    stats;
+};
+
+#endif /* defined(__KeOcclusionCuller__) */
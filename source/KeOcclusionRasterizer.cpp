@@ -0,0 +1,865 @@
+//
+//  KeOcclusionRasterizer.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeThread.h"
+#include "KeMutex.h"
+#include "KeOcclusionRasterizer.h"
+#include <float.h>
+#include <algorithm>
+
+
+#define KE_RASTER_TILE_PIXELS   ( KE_RASTER_TILE_WIDTH * KE_RASTER_TILE_HEIGHT )
+#define KE_RASTER_CLEAR_DEPTH   -FLT_MAX    /* Farther than anything, including geometry beyond the far plane */
+#define KE_RASTER_MAX_CLIPPED   9           /* A triangle clipped by 5 planes has at most 8 vertices */
+
+
+/*
+ * Rasterizer thread job
+ */
+struct KeRasterJob
+{
+    KeOcclusionRasterizer*          rasterizer;
+    const KeOcclusionRasterizer*    tester;
+    int                             type;           /* 0 = set up triangles, 1 = rasterize tiles, 2 = test boxes */
+    int                             thread;
+    uint32_t                        first, last;
+    const float*                    min;
+    const float*                    max;
+    int                             stride;
+    uint8_t*                        visible_out;
+    uint32_t                        result;
+};
+
+/*
+ * Worker thread pool
+ */
+struct KeRasterWorker
+{
+    KeRasterWorkerPool*     pool;
+    int                     index;          /* Job index this worker runs (the calling thread runs job 0) */
+    KeThread*               thread;
+};
+
+struct KeRasterWorkerPool
+{
+    KeRasterWorker          workers[KE_RASTER_MAX_THREADS];
+    int                     worker_count;
+    KeMutex                 lock;           /* Guards everything below */
+    pthread_cond_t          work_cond;      /* Signalled when jobs are posted (or the pool is shutting down) */
+    pthread_cond_t          done_cond;      /* Signalled when the last posted job finishes */
+    KeThreadPfn             proc;
+    KeRasterJob*            jobs;
+    int                     job_count;
+    uint32_t                generation;     /* Incremented each time jobs are posted */
+    int                     pending;        /* Posted jobs still running on the workers */
+    bool                    busy;           /* A set of jobs is running */
+    bool                    quit;
+};
+
+/* Worker thread entry point; runs its job each time a set of jobs is posted */
+#ifdef _WIN32
+static uint32_t __stdcall KeRasterWorkerThreadProc( void* context )
+#else
+static void KeRasterWorkerThreadProc( void* context )
+#endif
+{
+    KeRasterWorker* worker = (KeRasterWorker*) context;
+    KeRasterWorkerPool* pool = worker->pool;
+    uint32_t generation = 0;
+
+    while( true )
+    {
+        pool->lock.Enter();
+
+        while( pool->generation == generation && !pool->quit )
+            pthread_cond_wait( &pool->work_cond, &pool->lock.mutex );
+
+        if( pool->quit )
+        {
+            pool->lock.Leave();
+            break;
+        }
+
+        generation = pool->generation;
+        KeThreadPfn proc = pool->proc;
+        KeRasterJob* job = worker->index < pool->job_count ? &pool->jobs[worker->index] : NULL;
+
+        pool->lock.Leave();
+
+        if( !job )
+            continue;
+
+        proc( job );
+
+        pool->lock.Enter();
+        if( --pool->pending == 0 )
+            pthread_cond_signal( &pool->done_cond );
+        pool->lock.Leave();
+    }
+
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+/* Starts thread_count - 1 worker threads (none for a single thread) */
+static KeRasterWorkerPool* KeRasterCreateWorkerPool( int thread_count )
+{
+    if( thread_count < 2 )
+        return NULL;
+
+    KeRasterWorkerPool* pool = new KeRasterWorkerPool;
+
+    pool->worker_count = thread_count;
+    pool->proc = NULL;
+    pool->jobs = NULL;
+    pool->job_count = 0;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->busy = No;
+    pool->quit = No;
+    pthread_cond_init( &pool->work_cond, NULL );
+    pthread_cond_init( &pool->done_cond, NULL );
+
+    for( int i = 1; i < thread_count; i++ )
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].thread = new KeThread( KeRasterWorkerThreadProc, &pool->workers[i] );
+    }
+
+    return pool;
+}
+
+/* Stops the worker threads and frees the pool */
+static void KeRasterDestroyWorkerPool( KeRasterWorkerPool* pool )
+{
+    if( !pool )
+        return;
+
+    pool->lock.Enter();
+    pool->quit = Yes;
+    pthread_cond_broadcast( &pool->work_cond );
+    pool->lock.Leave();
+
+    /* Wait for the worker threads to finish (the destructor joins POSIX threads) */
+    for( int i = 1; i < pool->worker_count; i++ )
+    {
+#ifdef _WIN32
+        pool->workers[i].thread->Wait( INFINITE );
+#endif
+        delete pool->workers[i].thread;
+    }
+
+    pthread_cond_destroy( &pool->work_cond );
+    pthread_cond_destroy( &pool->done_cond );
+    delete pool;
+}
+
+/* Runs count jobs (no more than the pool's thread count), with the calling thread taking the
+   first.  If there is no pool or another thread is already using it, the calling thread runs
+   them all. */
+static void KeRasterRunJobs( KeRasterWorkerPool* pool, KeThreadPfn proc, KeRasterJob* jobs, int count )
+{
+    bool threaded = false;
+
+    if( pool && count > 1 )
+    {
+        pool->lock.Enter();
+        if( !pool->busy )
+        {
+            pool->busy = Yes;
+            pool->proc = proc;
+            pool->jobs = jobs;
+            pool->job_count = count;
+            pool->pending = count - 1;
+            pool->generation++;
+            pthread_cond_broadcast( &pool->work_cond );
+            threaded = true;
+        }
+        pool->lock.Leave();
+    }
+
+    if( !threaded )
+    {
+        for( int i = 0; i < count; i++ )
+            proc( &jobs[i] );
+        return;
+    }
+
+    proc( &jobs[0] );
+
+    pool->lock.Enter();
+    while( pool->pending > 0 )
+        pthread_cond_wait( &pool->done_cond, &pool->lock.mutex );
+    pool->busy = No;
+    pool->lock.Leave();
+}
+
+/* Box test thread entry point */
+#ifdef _WIN32
+static uint32_t __stdcall KeRasterTestThreadProc( void* context )
+#else
+static void KeRasterTestThreadProc( void* context )
+#endif
+{
+    KeRasterJob* job = (KeRasterJob*) context;
+
+    job->result = 0;
+    for( uint32_t i = job->first; i < job->last; i++ )
+    {
+        const float* min = (const float*)( ( (const uint8_t*) job->min ) + i * job->stride );
+        const float* max = (const float*)( ( (const uint8_t*) job->max ) + i * job->stride );
+
+        job->visible_out[i] = job->tester->TestBox( min, max ) ? Yes : No;
+        job->result += job->visible_out[i];
+    }
+
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+/* Clips a polygon in clip space against plane . ( x, y, z, w ) >= 0 and returns the new vertex count */
+static int KeRasterClipPolygon( const float* plane, const float in[][4], int count, float out[][4] )
+{
+    int out_count = 0;
+
+    for( int i = 0; i < count; i++ )
+    {
+        const float* a = in[i];
+        const float* b = in[( i + 1 ) % count];
+        float da = plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2] + plane[3] * a[3];
+        float db = plane[0] * b[0] + plane[1] * b[1] + plane[2] * b[2] + plane[3] * b[3];
+
+        if( da >= 0.0f )
+            memmove( out[out_count++], a, sizeof( float ) * 4 );
+
+        if( ( da >= 0.0f ) != ( db >= 0.0f ) )
+        {
+            float t = da / ( da - db );
+            for( int j = 0; j < 4; j++ )
+                out[out_count][j] = a[j] + ( b[j] - a[j] ) * t;
+            out_count++;
+        }
+    }
+
+    return out_count;
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::KeOcclusionRasterizer
+ * Desc: Creates a depth buffer of the given size (rounded up to whole tiles internally).
+ *       thread_count threads are used to rasterize occluders; the calling thread is one of
+ *       them, and the rest are started here and kept until the rasterizer is deleted.
+ */
+KeOcclusionRasterizer::KeOcclusionRasterizer( int width, int height, int thread_count ) : width(width), height(height), thread_count(thread_count), triangle_count(0), pool(NULL)
+{
+    if( this->thread_count < 1 )
+        this->thread_count = 1;
+    if( this->thread_count > KE_RASTER_MAX_THREADS )
+        this->thread_count = KE_RASTER_MAX_THREADS;
+
+    tiles_x = ( width + KE_RASTER_TILE_WIDTH - 1 ) / KE_RASTER_TILE_WIDTH;
+    tiles_y = ( height + KE_RASTER_TILE_HEIGHT - 1 ) / KE_RASTER_TILE_HEIGHT;
+
+    depth.resize( tiles_x * tiles_y * KE_RASTER_TILE_PIXELS, KE_RASTER_CLEAR_DEPTH );
+    tile_far.resize( tiles_x * tiles_y, KE_RASTER_CLEAR_DEPTH );
+
+    for( int i = 0; i < this->thread_count; i++ )
+        bins[i].resize( tiles_x * tiles_y );
+
+    KeMat4Store( view_projection, KeMat4Identity() );
+    ZeroMemory( &stats, sizeof( KeRasterStats ) );
+
+    pool = KeRasterCreateWorkerPool( this->thread_count );
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::~KeOcclusionRasterizer
+ * Desc:
+ */
+KeOcclusionRasterizer::~KeOcclusionRasterizer()
+{
+    KeRasterDestroyWorkerPool( pool );
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::BeginFrame
+ * Desc: Sets the view projection matrix for this frame's occluders and tests, and clears the
+ *       occluder list.  The depth buffer keeps last frame's contents until RasterizeOccluders.
+ */
+void KeOcclusionRasterizer::BeginFrame( const KeMat4& view_projection )
+{
+    KeMat4Store( this->view_projection, view_projection );
+
+    occluders.clear();
+    first_triangle.clear();
+    triangle_count = 0;
+    ZeroMemory( &stats, sizeof( KeRasterStats ) );
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::AddOccluder
+ * Desc: Adds an occluder mesh (a triangle list of 3 float positions, optionally indexed with
+ *       16 or 32-bit indices) with an optional world matrix.  The vertex and index data must
+ *       stay valid until RasterizeOccluders.  Occluders should lie inside the objects they
+ *       stand in for, since anything they cover is treated as hidden.
+ */
+void KeOcclusionRasterizer::AddOccluder( const float* vertices, int vertex_stride, const void* indices, int index_size, int triangle_count, const KeMat4* world, uint32_t flags )
+{
+    if( !vertices || triangle_count <= 0 )
+        return;
+
+    KeRasterOccluder o;
+    o.vertices = (const uint8_t*) vertices;
+    o.vertex_stride = vertex_stride ? vertex_stride : sizeof( float ) * 3;
+    o.indices = indices;
+    o.index_size = index_size;
+    o.triangle_count = triangle_count;
+    o.flags = flags;
+
+    KeMat4 vp = KeMat4Load( view_projection );
+    KeMat4Store( o.mvp, world ? KeMat4Mul( vp, *world ) : vp );
+
+    occluders.push_back( o );
+    first_triangle.push_back( this->triangle_count );
+    this->triangle_count += triangle_count;
+
+    stats.occluders++;
+    stats.triangles += triangle_count;
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::RasterizeOccluders
+ * Desc: Renders this frame's occluders into the depth buffer.  The triangles are transformed,
+ *       clipped and binned into tiles by all threads, then each thread rasterizes its own
+ *       tiles, so no two threads write to the same pixels.
+ */
+void KeOcclusionRasterizer::RasterizeOccluders()
+{
+    KeRasterJob jobs[KE_RASTER_MAX_THREADS];
+
+    /* Set up and bin the triangles */
+    for( int i = 0; i < thread_count; i++ )
+    {
+        ZeroMemory( &jobs[i], sizeof( KeRasterJob ) );
+        jobs[i].rasterizer = this;
+        jobs[i].type = 0;
+        jobs[i].thread = i;
+        jobs[i].first = (uint32_t)( ( (uint64_t) triangle_count * i ) / thread_count );
+        jobs[i].last = (uint32_t)( ( (uint64_t) triangle_count * ( i + 1 ) ) / thread_count );
+    }
+
+    KeRasterRunJobs( pool, PVT_ThreadProc, jobs, thread_count );
+    for( int i = 0; i < thread_count; i++ )
+        stats.triangles_rasterized += jobs[i].result;
+
+    /* Rasterize the tiles */
+    for( int i = 0; i < thread_count; i++ )
+        jobs[i].type = 1;
+
+    KeRasterRunJobs( pool, PVT_ThreadProc, jobs, thread_count );
+    for( int i = 0; i < thread_count; i++ )
+        stats.tile_triangles += jobs[i].result;
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::TestBox
+ * Desc: Returns false if a world space bounding box is completely hidden behind the occluders
+ *       (or off screen), and true if any of it might be visible.
+ */
+bool KeOcclusionRasterizer::TestBox( const float* min, const float* max ) const
+{
+    KeMat4 vp = KeMat4Load( view_projection );
+    float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+    float nearest = -FLT_MAX;
+
+    /* Project the corners, finding the screen rectangle and nearest depth */
+    for( int i = 0; i < 8; i++ )
+    {
+        KeVec4 corner = KeVec4Make( i & 1 ? max[0] : min[0], i & 2 ? max[1] : min[1], i & 4 ? max[2] : min[2], 1.0f );
+        float c[4];
+        KeVec4Store( c, KeMat4Transform( vp, corner ) );
+
+        /* Boxes crossing the near plane are visible */
+        if( c[3] <= 0.0f || c[2] + c[3] <= 0.0f )
+            return true;
+
+        float inv_w = 1.0f / c[3];
+        float sx = ( c[0] * inv_w * 0.5f + 0.5f ) * width;
+        float sy = ( 0.5f - c[1] * inv_w * 0.5f ) * height;
+        float d = 0.5f - 0.5f * c[2] * inv_w;
+
+        x0 = sx < x0 ? sx : x0;
+        x1 = sx > x1 ? sx : x1;
+        y0 = sy < y0 ? sy : y0;
+        y1 = sy > y1 ? sy : y1;
+        nearest = d > nearest ? d : nearest;
+    }
+
+    /* Every pixel the rectangle touches */
+    int px0 = (int) floorf( x0 ), px1 = (int) ceilf( x1 ) - 1;
+    int py0 = (int) floorf( y0 ), py1 = (int) ceilf( y1 ) - 1;
+    px1 = px1 < px0 ? px0 : px1;
+    py1 = py1 < py0 ? py0 : py1;
+
+    if( px1 < 0 || py1 < 0 || px0 >= width || py0 >= height )
+        return false;
+
+    px0 = px0 < 0 ? 0 : px0;
+    py0 = py0 < 0 ? 0 : py0;
+    px1 = px1 >= width ? width - 1 : px1;
+    py1 = py1 >= height ? height - 1 : py1;
+
+    for( int ty = py0 / KE_RASTER_TILE_HEIGHT; ty <= py1 / KE_RASTER_TILE_HEIGHT; ty++ )
+    {
+        for( int tx = px0 / KE_RASTER_TILE_WIDTH; tx <= px1 / KE_RASTER_TILE_WIDTH; tx++ )
+        {
+            int tile = ty * tiles_x + tx;
+
+            /* Everything in this tile is in front of the box */
+            if( nearest < tile_far[tile] )
+                continue;
+
+            /* Otherwise look for a pixel in the rectangle that is behind the box's nearest point */
+            int tile_x = tx * KE_RASTER_TILE_WIDTH, tile_y = ty * KE_RASTER_TILE_HEIGHT;
+            int rx0 = ( px0 > tile_x ? px0 : tile_x ) - tile_x;
+            int rx1 = ( px1 < tile_x + KE_RASTER_TILE_WIDTH - 1 ? px1 : tile_x + KE_RASTER_TILE_WIDTH - 1 ) - tile_x;
+            int ry0 = ( py0 > tile_y ? py0 : tile_y ) - tile_y;
+            int ry1 = ( py1 < tile_y + KE_RASTER_TILE_HEIGHT - 1 ? py1 : tile_y + KE_RASTER_TILE_HEIGHT - 1 ) - tile_y;
+            const float* tile_depth = &depth[tile * KE_RASTER_TILE_PIXELS];
+
+#if defined(KE_MATH_SSE2)
+            __m128 n = _mm_set1_ps( nearest );
+            __m128 lane = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+            __m128 first = _mm_set1_ps( (float) rx0 ), last = _mm_set1_ps( (float) rx1 );
+
+            for( int y = ry0; y <= ry1; y++ )
+            {
+                const float* row = tile_depth + y * KE_RASTER_TILE_WIDTH;
+                for( int x = rx0 & ~3; x <= rx1; x += 4 )
+                {
+                    __m128 px = _mm_add_ps( _mm_set1_ps( (float) x ), lane );
+                    __m128 in_rect = _mm_and_ps( _mm_cmpge_ps( px, first ), _mm_cmple_ps( px, last ) );
+                    __m128 behind = _mm_cmple_ps( _mm_loadu_ps( row + x ), n );
+
+                    if( _mm_movemask_ps( _mm_and_ps( in_rect, behind ) ) )
+                        return true;
+                }
+            }
+#else
+            for( int y = ry0; y <= ry1; y++ )
+            {
+                const float* row = tile_depth + y * KE_RASTER_TILE_WIDTH;
+                for( int x = rx0; x <= rx1; x++ )
+                {
+                    if( row[x] <= nearest )
+                        return true;
+                }
+            }
+#endif
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::TestBoxes
+ * Desc: Tests count bounding boxes (stride bytes apart) with TestBox, writing 1 to visible_out
+ *       for each box that might be visible and 0 otherwise, and returns the number visible.
+ *       Up to thread_count of the rasterizer's threads are used for KE_RASTER_THREADED_BOXES
+ *       boxes or more (if another thread is using them, the calling thread tests every box).
+ */
+uint32_t KeOcclusionRasterizer::TestBoxes( const float* min, const float* max, int stride, int count, uint8_t* visible_out, int thread_count ) const
+{
+    if( count <= 0 )
+        return 0;
+    if( thread_count > this->thread_count )
+        thread_count = this->thread_count;
+    if( count < KE_RASTER_THREADED_BOXES )
+        thread_count = 1;
+    if( thread_count > ( count + 63 ) / 64 )
+        thread_count = ( count + 63 ) / 64;
+    if( thread_count < 1 )
+        thread_count = 1;
+
+    /* Ranges are multiples of 64 boxes, so no two threads write to the same cache line */
+    KeRasterJob jobs[KE_RASTER_MAX_THREADS];
+    uint32_t boxes_per_job = ( ( ( count + thread_count - 1 ) / thread_count ) + 63 ) & ~63;
+
+    for( int i = 0; i < thread_count; i++ )
+    {
+        ZeroMemory( &jobs[i], sizeof( KeRasterJob ) );
+        jobs[i].tester = this;
+        jobs[i].type = 2;
+        jobs[i].first = i * boxes_per_job < (uint32_t) count ? i * boxes_per_job : count;
+        jobs[i].last = ( i + 1 ) * boxes_per_job < (uint32_t) count ? ( i + 1 ) * boxes_per_job : count;
+        jobs[i].min = min;
+        jobs[i].max = max;
+        jobs[i].stride = stride ? stride : sizeof( float ) * 3;
+        jobs[i].visible_out = visible_out;
+    }
+
+    KeRasterRunJobs( pool, KeRasterTestThreadProc, jobs, thread_count );
+
+    uint32_t visible_count = 0;
+    for( int i = 0; i < thread_count; i++ )
+        visible_count += jobs[i].result;
+
+    return visible_count;
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::GetDepthBuffer
+ * Desc: Copies the depth buffer out row by row (width * height floats), for debugging.
+ */
+void KeOcclusionRasterizer::GetDepthBuffer( float* depth_out ) const
+{
+    for( int y = 0; y < height; y++ )
+    {
+        for( int x = 0; x < width; x++ )
+        {
+            int tile = ( y / KE_RASTER_TILE_HEIGHT ) * tiles_x + ( x / KE_RASTER_TILE_WIDTH );
+            int pixel = ( y % KE_RASTER_TILE_HEIGHT ) * KE_RASTER_TILE_WIDTH + ( x % KE_RASTER_TILE_WIDTH );
+
+            depth_out[y * width + x] = depth[tile * KE_RASTER_TILE_PIXELS + pixel];
+        }
+    }
+}
+
+
+/*
+ * Name: KeOcclusionRasterizer::GetStats
+ * Desc:
+ */
+void KeOcclusionRasterizer::GetStats( KeRasterStats* stats ) const
+{
+    *stats = this->stats;
+}
+
+
+/* Rasterizer thread entry point */
+#ifdef _WIN32
+uint32_t __stdcall KeOcclusionRasterizer::PVT_ThreadProc( void* context )
+#else
+void KeOcclusionRasterizer::PVT_ThreadProc( void* context )
+#endif
+{
+    KeRasterJob* job = (KeRasterJob*) context;
+
+    if( job->type == 0 )
+        job->result = job->rasterizer->PVT_SetupTriangles( job->thread, job->first, job->last );
+    else
+        job->result = job->rasterizer->PVT_RasterizeTiles( job->thread );
+
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+/* Transforms, clips and bins triangles [first, last) of this frame's occluders, and returns
+   how many screen space triangles were binned */
+uint32_t KeOcclusionRasterizer::PVT_SetupTriangles( int thread, uint32_t first, uint32_t last )
+{
+    static const float planes[5][4] =
+    {
+        { 0.0f, 0.0f, 1.0f, 1.0f },                     /* Near (z + w >= 0) */
+        { 1.0f, 0.0f, 0.0f, KE_RASTER_GUARD_BAND },     /* Guard band */
+        { -1.0f, 0.0f, 0.0f, KE_RASTER_GUARD_BAND },
+        { 0.0f, 1.0f, 0.0f, KE_RASTER_GUARD_BAND },
+        { 0.0f, -1.0f, 0.0f, KE_RASTER_GUARD_BAND },
+    };
+    uint32_t count = 0;
+
+    triangles[thread].clear();
+    for( size_t i = 0; i < bins[thread].size(); i++ )
+        bins[thread][i].clear();
+
+    if( first >= last )
+        return 0;
+
+    /* Find the occluder containing the first triangle */
+    int occluder = (int)( std::upper_bound( first_triangle.begin(), first_triangle.end(), first ) - first_triangle.begin() ) - 1;
+    uint32_t t = first;
+
+    while( t < last )
+    {
+        const KeRasterOccluder* o = &occluders[occluder];
+        KeMat4 mvp = KeMat4Load( o->mvp );
+        uint32_t end = first_triangle[occluder] + o->triangle_count;
+        end = end < last ? end : last;
+
+        for( ; t < end; t++ )
+        {
+            uint32_t triangle = t - first_triangle[occluder];
+            float clip[3][4];
+            uint32_t outcode_all = 0x1f, outcode_any = 0;
+
+            for( int j = 0; j < 3; j++ )
+            {
+                uint32_t index = triangle * 3 + j;
+                if( o->indices )
+                    index = o->index_size == 2 ? ( (const uint16_t*) o->indices )[index] : ( (const uint32_t*) o->indices )[index];
+
+                const float* p = (const float*)( o->vertices + index * o->vertex_stride );
+                KeVec4Store( clip[j], KeMat4Transform( mvp, KeVec4Make( p[0], p[1], p[2], 1.0f ) ) );
+
+                uint32_t outcode = 0;
+                for( int k = 0; k < 5; k++ )
+                {
+                    if( planes[k][0] * clip[j][0] + planes[k][1] * clip[j][1] + planes[k][2] * clip[j][2] + planes[k][3] * clip[j][3] < 0.0f )
+                        outcode |= 1 << k;
+                }
+                outcode_all &= outcode;
+                outcode_any |= outcode;
+            }
+
+            /* Completely outside one of the planes */
+            if( outcode_all )
+                continue;
+
+            if( !outcode_any )
+            {
+                count += PVT_AddTriangle( thread, clip[0], clip[1], clip[2], o->flags );
+                continue;
+            }
+
+            /* Clip against the planes it crosses and triangulate the result as a fan */
+            float polygon[2][KE_RASTER_MAX_CLIPPED][4];
+            int vertex_count = 3, current = 0;
+            memmove( polygon[0], clip, sizeof( clip ) );
+
+            for( int k = 0; k < 5 && vertex_count >= 3; k++ )
+            {
+                if( outcode_any & ( 1 << k ) )
+                {
+                    vertex_count = KeRasterClipPolygon( planes[k], polygon[current], vertex_count, polygon[current ^ 1] );
+                    current ^= 1;
+                }
+            }
+
+            for( int j = 2; j < vertex_count; j++ )
+                count += PVT_AddTriangle( thread, polygon[current][0], polygon[current][j-1], polygon[current][j], o->flags );
+        }
+
+        occluder++;
+    }
+
+    return count;
+}
+
+/* Projects a clipped triangle to the screen, sets up its depth plane and bins it into the
+   tiles its bounding rectangle touches */
+bool KeOcclusionRasterizer::PVT_AddTriangle( int thread, const float* clip0, const float* clip1, const float* clip2, uint32_t flags )
+{
+    const float* clip[3] = { clip0, clip1, clip2 };
+    KeRasterTriangle tri;
+    float z[3];
+
+    for( int i = 0; i < 3; i++ )
+    {
+        float inv_w = 1.0f / clip[i][3];
+        tri.x[i] = ( clip[i][0] * inv_w * 0.5f + 0.5f ) * width;
+        tri.y[i] = ( 0.5f - clip[i][1] * inv_w * 0.5f ) * height;
+        z[i] = 0.5f - 0.5f * clip[i][2] * inv_w;
+    }
+
+    /* Front faces (counter clockwise in normalized device coordinates) have a negative area
+       once y points down, and are flipped so the edge functions are positive inside */
+    float area = ( tri.x[1] - tri.x[0] ) * ( tri.y[2] - tri.y[0] ) - ( tri.y[1] - tri.y[0] ) * ( tri.x[2] - tri.x[0] );
+    if( area == 0.0f || ( area > 0.0f && !( flags & KE_RASTER_DOUBLE_SIDED ) ) )
+        return false;
+
+    if( area < 0.0f )
+    {
+        std::swap( tri.x[1], tri.x[2] );
+        std::swap( tri.y[1], tri.y[2] );
+        std::swap( z[1], z[2] );
+        area = -area;
+    }
+
+    /* Pixels whose centres might be inside */
+    float fx0 = std::min( tri.x[0], std::min( tri.x[1], tri.x[2] ) ), fx1 = std::max( tri.x[0], std::max( tri.x[1], tri.x[2] ) );
+    float fy0 = std::min( tri.y[0], std::min( tri.y[1], tri.y[2] ) ), fy1 = std::max( tri.y[0], std::max( tri.y[1], tri.y[2] ) );
+    tri.min_x = std::max( (int) ceilf( fx0 - 0.5f ), 0 );
+    tri.max_x = std::min( (int) floorf( fx1 - 0.5f ), width - 1 );
+    tri.min_y = std::max( (int) ceilf( fy0 - 0.5f ), 0 );
+    tri.max_y = std::min( (int) floorf( fy1 - 0.5f ), height - 1 );
+
+    if( tri.min_x > tri.max_x || tri.min_y > tri.max_y )
+        return false;
+
+    /* Depth is linear in screen space */
+    float dx1 = tri.x[1] - tri.x[0], dy1 = tri.y[1] - tri.y[0], dz1 = z[1] - z[0];
+    float dx2 = tri.x[2] - tri.x[0], dy2 = tri.y[2] - tri.y[0], dz2 = z[2] - z[0];
+    tri.z0 = z[0];
+    tri.zx = ( dz1 * dy2 - dz2 * dy1 ) / area;
+    tri.zy = ( dz2 * dx1 - dz1 * dx2 ) / area;
+
+    uint32_t index = (uint32_t) triangles[thread].size();
+    triangles[thread].push_back( tri );
+
+    for( int ty = tri.min_y / KE_RASTER_TILE_HEIGHT; ty <= tri.max_y / KE_RASTER_TILE_HEIGHT; ty++ )
+    {
+        for( int tx = tri.min_x / KE_RASTER_TILE_WIDTH; tx <= tri.max_x / KE_RASTER_TILE_WIDTH; tx++ )
+            bins[thread][ty * tiles_x + tx].push_back( index );
+    }
+
+    return true;
+}
+
+/* Clears and rasterizes every thread_count'th tile (starting with tile number thread), then
+   finds the farthest depth in each, and returns the number of triangle/tile pairs drawn */
+uint32_t KeOcclusionRasterizer::PVT_RasterizeTiles( int thread )
+{
+    uint32_t count = 0;
+
+    for( int tile = thread; tile < tiles_x * tiles_y; tile += thread_count )
+    {
+        float* tile_depth = &depth[tile * KE_RASTER_TILE_PIXELS];
+
+        for( int i = 0; i < KE_RASTER_TILE_PIXELS; i++ )
+            tile_depth[i] = KE_RASTER_CLEAR_DEPTH;
+
+        /* Triangles are drawn in the order they were submitted, although with depth only
+           rendering the order doesn't change the result */
+        for( int i = 0; i < thread_count; i++ )
+        {
+            const std::vector<uint32_t>& bin = bins[i][tile];
+
+            for( size_t j = 0; j < bin.size(); j++ )
+                PVT_RasterizeTriangle( &triangles[i][bin[j]], tile );
+
+            count += (uint32_t) bin.size();
+        }
+
+        /* Farthest depth in the tile */
+#if defined(KE_MATH_SSE2)
+        __m128 far4 = _mm_loadu_ps( tile_depth );
+        for( int i = 4; i < KE_RASTER_TILE_PIXELS; i += 4 )
+            far4 = _mm_min_ps( far4, _mm_loadu_ps( tile_depth + i ) );
+        far4 = _mm_min_ps( far4, _mm_shuffle_ps( far4, far4, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        far4 = _mm_min_ps( far4, _mm_shuffle_ps( far4, far4, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        tile_far[tile] = _mm_cvtss_f32( far4 );
+#else
+        float far_depth = tile_depth[0];
+        for( int i = 1; i < KE_RASTER_TILE_PIXELS; i++ )
+            far_depth = tile_depth[i] < far_depth ? tile_depth[i] : far_depth;
+        tile_far[tile] = far_depth;
+#endif
+    }
+
+    return count;
+}
+
+/* Rasterizes the part of a triangle inside a tile, keeping the nearest depth in each pixel */
+void KeOcclusionRasterizer::PVT_RasterizeTriangle( const KeRasterTriangle* tri, int tile )
+{
+    int tile_x = ( tile % tiles_x ) * KE_RASTER_TILE_WIDTH;
+    int tile_y = ( tile / tiles_x ) * KE_RASTER_TILE_HEIGHT;
+    int x0 = std::max( tri->min_x, tile_x ), x1 = std::min( tri->max_x, tile_x + KE_RASTER_TILE_WIDTH - 1 );
+    int y0 = std::max( tri->min_y, tile_y ), y1 = std::min( tri->max_y, tile_y + KE_RASTER_TILE_HEIGHT - 1 );
+    float* tile_depth = &depth[tile * KE_RASTER_TILE_PIXELS];
+
+    /* Pixels are done 4 at a time from a multiple of 4 (the extra pixels are outside the
+       triangle or off screen) */
+    x0 &= ~3;
+
+    /* Edge i runs from vertex i to vertex i + 1: e = a * ( x - xi ) + b * ( y - yi ) */
+    float a[3], b[3];
+    for( int i = 0; i < 3; i++ )
+    {
+        int j = ( i + 1 ) % 3;
+        a[i] = -( tri->y[j] - tri->y[i] );
+        b[i] = tri->x[j] - tri->x[i];
+    }
+
+    float px = x0 + 0.5f;
+
+    for( int y = y0; y <= y1; y++ )
+    {
+        float py = y + 0.5f;
+        float e0 = a[0] * ( px - tri->x[0] ) + b[0] * ( py - tri->y[0] );
+        float e1 = a[1] * ( px - tri->x[1] ) + b[1] * ( py - tri->y[1] );
+        float e2 = a[2] * ( px - tri->x[2] ) + b[2] * ( py - tri->y[2] );
+        float z = tri->z0 + tri->zx * ( px - tri->x[0] ) + tri->zy * ( py - tri->y[0] );
+        float* row = tile_depth + ( y - tile_y ) * KE_RASTER_TILE_WIDTH - tile_x;
+
+#if defined(KE_MATH_SSE2)
+        __m128 lane = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+        __m128 zero = _mm_setzero_ps();
+        __m128 ve0 = _mm_add_ps( _mm_set1_ps( e0 ), _mm_mul_ps( _mm_set1_ps( a[0] ), lane ) );
+        __m128 ve1 = _mm_add_ps( _mm_set1_ps( e1 ), _mm_mul_ps( _mm_set1_ps( a[1] ), lane ) );
+        __m128 ve2 = _mm_add_ps( _mm_set1_ps( e2 ), _mm_mul_ps( _mm_set1_ps( a[2] ), lane ) );
+        __m128 vz = _mm_add_ps( _mm_set1_ps( z ), _mm_mul_ps( _mm_set1_ps( tri->zx ), lane ) );
+        __m128 step0 = _mm_set1_ps( a[0] * 4.0f ), step1 = _mm_set1_ps( a[1] * 4.0f ), step2 = _mm_set1_ps( a[2] * 4.0f );
+        __m128 stepz = _mm_set1_ps( tri->zx * 4.0f );
+
+        for( int x = x0; x <= x1; x += 4 )
+        {
+            __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( ve0, zero ), _mm_cmpge_ps( ve1, zero ) ), _mm_cmpge_ps( ve2, zero ) );
+
+            if( _mm_movemask_ps( inside ) )
+            {
+                __m128 old_depth = _mm_loadu_ps( row + x );
+                __m128 new_depth = _mm_max_ps( old_depth, vz );
+                _mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( inside, new_depth ), _mm_andnot_ps( inside, old_depth ) ) );
+            }
+
+            ve0 = _mm_add_ps( ve0, step0 );
+            ve1 = _mm_add_ps( ve1, step1 );
+            ve2 = _mm_add_ps( ve2, step2 );
+            vz = _mm_add_ps( vz, stepz );
+        }
+#elif defined(KE_MATH_NEON)
+        float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        float32x4_t lane = vld1q_f32( lanes );
+        float32x4_t zero = vdupq_n_f32( 0.0f );
+        float32x4_t ve0 = vmlaq_n_f32( vdupq_n_f32( e0 ), lane, a[0] );
+        float32x4_t ve1 = vmlaq_n_f32( vdupq_n_f32( e1 ), lane, a[1] );
+        float32x4_t ve2 = vmlaq_n_f32( vdupq_n_f32( e2 ), lane, a[2] );
+        float32x4_t vz = vmlaq_n_f32( vdupq_n_f32( z ), lane, tri->zx );
+        float32x4_t step0 = vdupq_n_f32( a[0] * 4.0f ), step1 = vdupq_n_f32( a[1] * 4.0f ), step2 = vdupq_n_f32( a[2] * 4.0f );
+        float32x4_t stepz = vdupq_n_f32( tri->zx * 4.0f );
+
+        for( int x = x0; x <= x1; x += 4 )
+        {
+            uint32x4_t inside = vandq_u32( vandq_u32( vcgeq_f32( ve0, zero ), vcgeq_f32( ve1, zero ) ), vcgeq_f32( ve2, zero ) );
+            float32x4_t old_depth = vld1q_f32( row + x );
+            vst1q_f32( row + x, vbslq_f32( inside, vmaxq_f32( old_depth, vz ), old_depth ) );
+
+            ve0 = vaddq_f32( ve0, step0 );
+            ve1 = vaddq_f32( ve1, step1 );
+            ve2 = vaddq_f32( ve2, step2 );
+            vz = vaddq_f32( vz, stepz );
+        }
+#else
+        for( int x = x0; x <= x1; x++ )
+        {
+            if( e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f && z > row[x] )
+                row[x] = z;
+
+            e0 += a[0];
+            e1 += a[1];
+            e2 += a[2];
+            z += tri->zx;
+        }
+#endif
+    }
+}
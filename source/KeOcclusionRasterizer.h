@@ -0,0 +1,130 @@
+//
+//  KeOcclusionRasterizer.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeOcclusionRasterizer__
+#define __KeOcclusionRasterizer__
+
+#include <vector>
+#include "KeMath.h"
+
+
+/*
+ * Occlusion rasterizer defaults
+ */
+#define KE_RASTER_DEFAULT_WIDTH     320
+#define KE_RASTER_DEFAULT_HEIGHT    192
+#define KE_RASTER_TILE_WIDTH        32      /* Multiple of 4 (pixels are shaded 4 at a time) */
+#define KE_RASTER_TILE_HEIGHT       16
+#define KE_RASTER_GUARD_BAND        2.0f    /* Occluders are clipped to this many times the screen's extent */
+#define KE_RASTER_MAX_THREADS       8
+#define KE_RASTER_THREADED_BOXES    1024    /* Fewest boxes TestBoxes splits across threads */
+
+/*
+ * Occluder flags
+ */
+#define KE_RASTER_DOUBLE_SIDED      0x1     /* Don't cull back faces (counter clockwise triangles are front facing) */
+
+
+/*
+ * Occluder (kept until RasterizeOccluders, along with the data it points to)
+ */
+struct KeRasterOccluder
+{
+    const uint8_t*  vertices;           /* Positions (3 floats) */
+    int             vertex_stride;      /* In bytes */
+    const void*     indices;            /* NULL for non-indexed triangle lists */
+    int             index_size;         /* 2 or 4 */
+    int             triangle_count;
+    uint32_t        flags;              /* KE_RASTER_* */
+    float           mvp[16];            /* view_projection * world (column major) */
+};
+
+/*
+ * Worker threads (private to KeOcclusionRasterizer.cpp)
+ */
+struct KeRasterWorkerPool;
+
+/*
+ * Screen space occluder triangle
+ */
+struct KeRasterTriangle
+{
+    float   x[3], y[3];         /* Screen position of each vertex (ordered so the edge functions are positive inside) */
+    float   z0, zx, zy;         /* Depth at vertex 0 and its gradient */
+    int     min_x, min_y;       /* Pixel bounds (inclusive, clamped to the screen) */
+    int     max_x, max_y;
+};
+
+/*
+ * Occlusion rasterizer statistics (for the current frame)
+ */
+struct KeRasterStats
+{
+    uint32_t    occluders;
+    uint32_t    triangles;              /* Occluder triangles submitted */
+    uint32_t    triangles_rasterized;   /* After clipping, back face and off screen culling */
+    uint32_t    tile_triangles;         /* Triangle/tile pairs rasterized */
+};
+
+
+/* Software occlusion culling.  Occluders are rasterized into a small depth buffer on the
+   CPU, split into tiles so several threads can rasterize at once, and each tile keeps the
+   farthest depth in it so most bounding box tests never touch individual pixels.  Depth is
+   stored so that larger values are nearer (0.5 - 0.5 * z / w for OpenGL style projections).
+   Each frame:
+   1. BeginFrame sets the view projection matrix and clears the occluder list.
+   2. AddOccluder for each designated occluder mesh (large, simple, closed geometry).
+   3. RasterizeOccluders renders them into the depth buffer.
+   4. TestBox/TestBoxes return whether bounding boxes might be visible.  Tests are read only,
+      so they can run on any number of threads until the next BeginFrame. */
+class KeOcclusionRasterizer
+{
+public:
+    KeOcclusionRasterizer( int width = KE_RASTER_DEFAULT_WIDTH, int height = KE_RASTER_DEFAULT_HEIGHT, int thread_count = 1 );
+    virtual ~KeOcclusionRasterizer();
+
+public:
+    void BeginFrame( const KeMat4& view_projection );
+    void AddOccluder( const float* vertices, int vertex_stride, const void* indices, int index_size, int triangle_count, const KeMat4* world = NULL, uint32_t flags = 0 );
+    void RasterizeOccluders();
+
+    bool TestBox( const float* min, const float* max ) const;
+    uint32_t TestBoxes( const float* min, const float* max, int stride, int count, uint8_t* visible_out, int thread_count = 1 ) const;
+
+    void GetDepthBuffer( float* depth_out ) const;
+    void GetStats( KeRasterStats* stats ) const;
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+
+protected:
+#ifdef _WIN32
+    static uint32_t __stdcall PVT_ThreadProc( void* context );
+#else
+    static void PVT_ThreadProc( void* context );
+#endif
+    uint32_t PVT_SetupTriangles( int thread, uint32_t first, uint32_t last );
+    bool PVT_AddTriangle( int thread, const float* clip0, const float* clip1, const float* clip2, uint32_t flags );
+    uint32_t PVT_RasterizeTiles( int thread );
+    void PVT_RasterizeTriangle( const KeRasterTriangle* tri, int tile );
+
+protected:
+    int                                         width, height;
+    int                                         tiles_x, tiles_y;
+    int                                         thread_count;
+    std::vector<float>                          depth;          /* Tile by tile, KE_RASTER_TILE_WIDTH * KE_RASTER_TILE_HEIGHT pixels each */
+    std::vector<float>                          tile_far;       /* Farthest depth in each tile */
+    float                                       view_projection[16];
+    std::vector<KeRasterOccluder>               occluders;
+    std::vector<uint32_t>                       first_triangle; /* Index of each occluder's first triangle in the frame */
+    std::vector<KeRasterTriangle>               triangles[KE_RASTER_MAX_THREADS];   /* Set up by each thread */
+    std::vector< std::vector<uint32_t> >        bins[KE_RASTER_MAX_THREADS];        /* Triangles touching each tile, per thread */
+    uint32_t                                    triangle_count;
+    KeRasterStats                               stats;
+    KeRasterWorkerPool*                         pool;           /* thread_count - 1 workers, kept for the rasterizer's lifetime */
+};
+
+#endif /* defined(__KeOcclusionRasterizer__) */
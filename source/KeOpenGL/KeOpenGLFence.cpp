@@ -205,6 +205,11 @@ bool KeOpenGLInsertFenceARB( IKeOpenGLFence** fence )
 #if GL_ARB_sync
     GLenum error = glGetError();
     
+    /* Sync objects can't be reset, so a fence that is inserted again (i.e. a pooled
+       fence) has to release the previous one first. */
+    if( (*fence)->sync )
+        glDeleteSync( (*fence)->sync );
+    
     /* Create sync object.  It will automatically be set in the unsignaled state
      if successful. */
     (*fence)->sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
@@ -224,7 +229,7 @@ bool KeOpenGLTestFenceARB( IKeOpenGLFence* fence )
     /* Test this sync object for it's status and return the result */
     glGetSynciv( fence->sync, GL_SYNC_STATUS, sizeof( int ), NULL, &signaled );
     
-    return signaled ? true : false;
+    return signaled == GL_SIGNALED ? true : false;
 #else
     DISPDBG_RB( KE_ERROR, "GL_ARB_sync not supported!" );
 #endif
@@ -279,6 +284,9 @@ bool KeOpenGLInsertFenceAPPLEiOS( IKeOpenGLFence** fence )
 #if GL_APPLE_sync
     GLenum error = glGetError();
     
+    if( (*fence)->sync )
+        glDeleteSyncAPPLE( (*fence)->sync );
+    
     /* Create sync object.  It will automatically be set in the unsignaled state
      if successful. */
     (*fence)->sync = glFenceSyncAPPLE( GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE, 0 );
@@ -298,7 +306,7 @@ bool KeOpenGLTestFenceAPPLEiOS( IKeOpenGLFence* fence )
     /* Test this sync object for it's status and return the result */
     glGetSyncivAPPLE( fence->sync, GL_SYNC_STATUS_APPLE, sizeof( int ), NULL, &signaled );
     
-    return signaled ? true : false;
+    return signaled == GL_SIGNALED_APPLE ? true : false;
 #else
     DISPDBG_RB( KE_ERROR, "GL_APPLE_sync not supported!" );
 #endif
@@ -362,8 +370,8 @@ void IKeOpenGLFence::Destroy()
  */
 bool IKeOpenGLFence::Insert()
 {
-    /* Sanity check */
-    if( !fence && !sync )
+    /* Sanity check (sync objects don't exist until the first insertion) */
+    if( !fence && !sync && vendor != KE_FENCE_ARB )
         return false;
     
     IKeOpenGLFence* f = this;
@@ -206,6 +206,38 @@ bool IKeOpenGLGeometryBuffer::SetIndexData( uint32_t offset, uint32_t size, void
     return true;
 }
 
+/*
+ * Name: IKeOpenGLGeometryBuffer::CopyVertexData
+ * Desc: Copies a range of vertex data to another location within the same buffer, without
+ *       going through system memory.  The source and destination ranges must not overlap.
+ */
+bool IKeOpenGLGeometryBuffer::CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+    glBindBuffer( GL_COPY_READ_BUFFER, vbo[0] );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, vbo[0] );
+    glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_offset, dst_offset, size );
+    OGL_DISPDBG_RB( KE_ERROR, "Error copying vertex buffer data!", glGetError() );
+    
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLGeometryBuffer::CopyIndexData
+ * Desc: Same as above, but for index data.
+ */
+bool IKeOpenGLGeometryBuffer::CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+    if( !vbo[1] )
+        return false;
+    
+    glBindBuffer( GL_COPY_READ_BUFFER, vbo[1] );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, vbo[1] );
+    glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_offset, dst_offset, size );
+    OGL_DISPDBG_RB( KE_ERROR, "Error copying index buffer data!", glGetError() );
+    
+    return true;
+}
+
 void IKeOpenGLGeometryBuffer::GetDesc( KeGeometryBufferDesc* desc )
 {
 	if( desc )
@@ -16,6 +16,10 @@
  */
 void IKeOpenGLGpuProgram::Destroy()
 {
+    /* Delete the shaders of a program that never finished building */
+    if( shaders[0] ) glDeleteShader( shaders[0] );
+    if( shaders[1] ) glDeleteShader( shaders[1] );
+    
     /* Delete this GLSL program */
     glDeleteProgram( program );
 
@@ -26,6 +30,19 @@ void IKeOpenGLGpuProgram::Destroy()
     delete this;
 }
 
+/*
+ * Name: IKeOpenGLGpuProgram::IsReady
+ * Desc: Returns true once this program has finished compiling and linking.  Programs that
+ *       failed to build never become ready.
+ */
+bool IKeOpenGLGpuProgram::IsReady()
+{
+    if( status == KE_PROGRAM_PENDING )
+        return device->PVT_PollProgram( this, No );
+    
+    return status == KE_PROGRAM_READY;
+}
+
 /*
  * Name: IKeOpenGLGpuProgram::GetVertexAttributes
  * Desc: 
@@ -0,0 +1,107 @@
+//
+//  KeOpenGLIndirectBuffer.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeRenderDevice.h"
+#include "KeOpenGLRenderDevice.h"
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+#define OGL_DISPDBG( a, b, c ) if(c) { DISPDBG( a, b << "\nError code: (" << c << ")" ); }
+#define OGL_DISPDBG_R( a, b, c ) if(c) { DISPDBG( a, b << "\nError code: (" << c << ")" ); return; }
+#define OGL_DISPDBG_RB( a, b, c ) if(c) { DISPDBG( a, b << "\nError code: (" << c << ")" ); return false; }
+
+
+/*
+ * Name: IKeOpenGLIndirectBuffer::Destroy
+ * Desc: Handles destruction of this interface instance.
+ */
+void IKeOpenGLIndirectBuffer::Destroy()
+{
+    /* Delete the draw indirect buffer (if we have one) */
+    if( dibo )
+        glDeleteBuffers( 1, &dibo );
+    
+    /* Delete the system memory copy of the draw commands */
+    delete[] commands;
+    
+    /* Delete this instance */
+    delete this;
+}
+
+/*
+ * Name: IKeOpenGLIndirectBuffer::MapData
+ * Desc: Returns a pointer to the system memory copy of the draw commands.  Changes made to
+ *       the commands are sent to the GPU when the buffer is unmapped.
+ */
+void* IKeOpenGLIndirectBuffer::MapData( uint32_t flags )
+{
+    return commands;
+}
+
+/*
+ * Name: IKeOpenGLIndirectBuffer::UnmapData
+ * Desc: Uploads the entire set of draw commands after they have been modified.
+ */
+void IKeOpenGLIndirectBuffer::UnmapData( void* data_ptr )
+{
+    SetCommands( 0, command_count, commands );
+}
+
+/*
+ * Name: IKeOpenGLIndirectBuffer::SetCommands
+ * Desc: Updates a range of draw commands within this buffer.  When multi-draw indirect is
+ *       supported, the range is also copied into the draw indirect buffer object.
+ */
+bool IKeOpenGLIndirectBuffer::SetCommands( uint32_t first, uint32_t count, KeDrawIndexedIndirectCommand* commands )
+{
+    /* Sanity checks */
+    if( !commands )
+        DISPDBG_RB( KE_ERROR, "Invalid draw command pointer!" );
+    if( first + count > command_count )
+        DISPDBG_RB( KE_ERROR, "Draw command range exceeds the size of this buffer!" );
+    
+    /* Update our copy of the draw commands (unless we were handed our own pointer back) */
+    if( commands != this->commands + first )
+        memmove( this->commands + first, commands, sizeof( KeDrawIndexedIndirectCommand ) * count );
+    
+    /* Keep track of the highest draw ID used so that the device can size its draw ID buffer */
+    for( uint32_t i = first; i < first + count; i++ )
+    {
+        uint32_t last_id = this->commands[i].base_instance + this->commands[i].instance_count;
+        if( last_id > max_draw_id )
+            max_draw_id = last_id;
+    }
+    
+    /* Upload the updated range to the GPU */
+    if( dibo )
+    {
+#ifndef __APPLE__
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, dibo );
+        OGL_DISPDBG_RB( KE_ERROR, "Error binding draw indirect buffer!", glGetError() );
+        glBufferSubData( GL_DRAW_INDIRECT_BUFFER, sizeof( KeDrawIndexedIndirectCommand ) * first,
+                        sizeof( KeDrawIndexedIndirectCommand ) * count, this->commands + first );
+        OGL_DISPDBG_RB( KE_ERROR, "Error setting draw indirect buffer data!", glGetError() );
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+#endif
+    }
+    
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLIndirectBuffer::GetCommandCount
+ * Desc: Returns the number of draw commands this buffer holds.
+ */
+uint32_t IKeOpenGLIndirectBuffer::GetCommandCount()
+{
+    return command_count;
+}
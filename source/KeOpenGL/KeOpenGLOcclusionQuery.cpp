@@ -0,0 +1,102 @@
+//
+//  KeOpenGLOcclusionQuery.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeRenderDevice.h"
+#include "KeOpenGLRenderDevice.h"
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+#define OGL_DISPDBG( a, b, c ) if(c) { DISPDBG( a, b << "\nError code: (" << c << ")" ); }
+#define OGL_DISPDBG_R( a, b, c ) if(c) { DISPDBG( a, b << "\nError code: (" << c << ")" ); return; }
+#define OGL_DISPDBG_RB( a, b, c ) if(c) { DISPDBG( a, b << "\nError code: (" << c << ")" ); return false; }
+
+
+/*
+ * Name: IKeOpenGLOcclusionQuery::Destroy
+ * Desc: Handles destruction of this interface instance.
+ */
+void IKeOpenGLOcclusionQuery::Destroy()
+{
+    /* Delete the query object */
+    if( query )
+        glDeleteQueries( 1, &query );
+
+    /* Delete this instance */
+    delete this;
+}
+
+/*
+ * Name: IKeOpenGLOcclusionQuery::Begin
+ * Desc: Starts counting the samples that pass the depth and stencil tests.  Only one query
+ *       of each type can be active at a time.
+ */
+bool IKeOpenGLOcclusionQuery::Begin()
+{
+    if( active )
+        DISPDBG_RB( KE_WARNING, "Occlusion query is already active!" );
+
+    glBeginQuery( target, query );
+    OGL_DISPDBG_RB( KE_ERROR, "Error beginning occlusion query!", glGetError() );
+
+    active = Yes;
+    issued = No;
+
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLOcclusionQuery::End
+ * Desc: Stops counting samples.  The result becomes available once the GPU has processed
+ *       every draw submitted in between.
+ */
+void IKeOpenGLOcclusionQuery::End()
+{
+    if( !active )
+        DISPDBG_R( KE_WARNING, "Occlusion query is not active!" );
+
+    glEndQuery( target );
+
+    active = No;
+    issued = Yes;
+}
+
+/*
+ * Name: IKeOpenGLOcclusionQuery::GetResult
+ * Desc: Returns the number of samples that passed (or 1/0 for KE_QUERY_ANY_SAMPLES).  If the
+ *       result isn't available yet and wait is No, false is returned instead of stalling.
+ * NOTE: Reading results one frame after they were issued normally avoids any wait.
+ */
+bool IKeOpenGLOcclusionQuery::GetResult( int wait, uint32_t* samples )
+{
+    if( active )
+        DISPDBG_RB( KE_WARNING, "Occlusion query has not been ended!" );
+
+    if( issued )
+    {
+        GLuint available = GL_FALSE;
+
+        if( !wait )
+        {
+            glGetQueryObjectuiv( query, GL_QUERY_RESULT_AVAILABLE, &available );
+            if( !available )
+                return false;
+        }
+
+        glGetQueryObjectuiv( query, GL_QUERY_RESULT, &result );
+        issued = No;
+    }
+
+    if( samples )
+        *samples = result;
+
+    return true;
+}
@@ -6,6 +6,7 @@
 //
 
 #include "KeOpenGLRenderDevice.h"
+#include "KeToolkit.h"
 #include "KeDebug.h"
 #include "KeSystem.h"
 
@@ -75,6 +76,9 @@ typedef NTSTATUS (APIENTRY *PFND3DKMT_OPENADAPTERFROMHDC)(_Inout_ D3DKMT_OPENADA
 #define glClearDepth glClearDepthf
 #endif
 
+/* Index of the world-view-projection product, alongside KE_MATRIX_WORLD, etc. */
+#define KE_MATRIX_WORLD_VIEW_PROJECTION 3
+
 
 /* GPU fencing routines */
 #include "KeOpenGLFence.h"
@@ -101,6 +105,7 @@ struct KeProgramAttribute
     { 10, "in_tex5" },
     { 11, "in_tex6" },
     { 12, "in_tex7" },
+    { 13, "in_drawid" },
 };
 
 /*
@@ -137,10 +142,19 @@ uint32_t data_types[] =
     GL_UNSIGNED_INT,
     GL_FLOAT,
 #ifndef __MOBILE_OS__
-    GL_DOUBLE   /* Not supported on OpenGL ES */
+    GL_DOUBLE,  /* Not supported on OpenGL ES */
 #else
-    0
+    0,
 #endif
+    GL_HALF_FLOAT,
+    GL_INT_2_10_10_10_REV,
+    GL_UNSIGNED_INT_2_10_10_10_REV
+};
+
+/* Size (in bytes) of each of the above data types (the packed types hold all four components) */
+uint32_t data_type_sizes[] =
+{
+    1, 1, 2, 2, 4, 4, 4, 8, 2, 4, 4
 };
 
 /* OpenGL buffer usage types */
@@ -240,6 +254,59 @@ uint32_t internal_texture_formats[] =
 	GL_RGB
 };
 
+/* OpenGL compressed texture formats (not all headers define these) */
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT            0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT            0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT            0x83F3
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1                     0x8DBB
+#define GL_COMPRESSED_RG_RGTC2                      0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM               0x8E8C
+#define GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT       0x8E8F
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2                     0x9274
+#define GL_COMPRESSED_RGBA8_ETC2_EAC                0x9278
+#define GL_COMPRESSED_R11_EAC                       0x9270
+#define GL_COMPRESSED_RG11_EAC                      0x9272
+#endif
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR             0x93B0
+#define GL_COMPRESSED_RGBA_ASTC_6x6_KHR             0x93B4
+#define GL_COMPRESSED_RGBA_ASTC_8x8_KHR             0x93B7
+#endif
+
+uint32_t compressed_texture_formats[] =
+{
+    GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+    GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+    GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    GL_COMPRESSED_RED_RGTC1,
+    GL_COMPRESSED_RG_RGTC2,
+    GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,
+    GL_COMPRESSED_RGBA_BPTC_UNORM,
+    GL_COMPRESSED_RGB8_ETC2,
+    GL_COMPRESSED_RGBA8_ETC2_EAC,
+    GL_COMPRESSED_R11_EAC,
+    GL_COMPRESSED_RG11_EAC,
+    GL_COMPRESSED_RGBA_ASTC_4x4_KHR,
+    GL_COMPRESSED_RGBA_ASTC_6x6_KHR,
+    GL_COMPRESSED_RGBA_ASTC_8x8_KHR
+};
+
+/* GL_KHR_parallel_shader_compile (not defined by all headers) */
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR        0x91B1
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+typedef void (APIENTRY *PFNKEMAXSHADERCOMPILERTHREADSPROC)( GLuint count );
+
 /* OpenGL cull modes */
 uint32_t cull_modes[] =
 {
@@ -438,10 +505,95 @@ bool KeIsPowerOfTwo( int width, int height, int depth )
     return true;
 }
 
-/* Applies sampler states to their respective texture stages */
-/* TODO: Implement dirty states to prevent redundant setting of texture states */
+/* Returns the size (in bytes) of a single texel of the given format and data type */
+uint32_t KeGetTexelSize( uint32_t format, uint32_t data_type )
+{
+    uint32_t components = 4;
+    
+    switch( format )
+    {
+        case GL_RGB:
+#ifndef __MOBILE_OS__
+        case GL_BGR:
+#endif
+            components = 3;
+            break;
+            
+#ifndef __MOBILE_OS__
+        case GL_RED:
+#else
+        case GL_LUMINANCE:
+#endif
+            components = 1;
+            break;
+    }
+    
+    switch( data_type )
+    {
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return components * 2;
+            
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            return components * 4;
+    }
+    
+    return components;
+}
+
+/* Returns true if the given compressed texture format is supported by this device */
+bool IKeOpenGLRenderDevice::PVT_IsCompressedFormatSupported( uint32_t format )
+{
+    switch( format )
+    {
+        case KE_TEXTUREFORMAT_BC1:
+        case KE_TEXTUREFORMAT_BC2:
+        case KE_TEXTUREFORMAT_BC3:
+            return device_caps->texture_compression_s3tc_supported ? true : false;
+            
+        case KE_TEXTUREFORMAT_BC4:
+        case KE_TEXTUREFORMAT_BC5:
+            return device_caps->texture_compression_rgtc_supported ? true : false;
+            
+        case KE_TEXTUREFORMAT_BC6H:
+        case KE_TEXTUREFORMAT_BC7:
+            return device_caps->texture_compression_bptc_supported ? true : false;
+            
+        case KE_TEXTUREFORMAT_ETC2_RGB8:
+        case KE_TEXTUREFORMAT_ETC2_RGBA8:
+        case KE_TEXTUREFORMAT_EAC_R11:
+        case KE_TEXTUREFORMAT_EAC_RG11:
+            return device_caps->texture_compression_etc2_supported ? true : false;
+            
+        case KE_TEXTUREFORMAT_ASTC_4x4:
+        case KE_TEXTUREFORMAT_ASTC_6x6:
+        case KE_TEXTUREFORMAT_ASTC_8x8:
+            return device_caps->texture_compression_astc_supported ? true : false;
+    }
+    
+    return false;
+}
+
+/* Applies sampler states to their respective texture stages.  With sampler objects, this only
+   rebinds the stages whose sampler changed; otherwise every state is set on the bound texture. */
 void IKeOpenGLRenderDevice::PVT_ApplySamplerStates()
 {
+    if( device_caps->sampler_objects_supported )
+    {
+        for( int texture_stage = 0; texture_stage < 8; texture_stage++ )
+        {
+            if( bound_samplers[texture_stage] != stage_samplers[texture_stage] )
+            {
+                glBindSampler( texture_stage, stage_samplers[texture_stage] );
+                bound_samplers[texture_stage] = stage_samplers[texture_stage];
+            }
+        }
+        
+        return;
+    }
+    
     /* Handle texture stages */
     for( int texture_stage = 0; texture_stage < 8; texture_stage++ )
     {
@@ -496,19 +648,332 @@ void IKeOpenGLRenderDevice::PVT_ApplySamplerStates()
     }
 }
 
+/* Bumps a matrix's generation (and that of the world-view-projection product) */
+void IKeOpenGLRenderDevice::PVT_MatrixChanged( int matrix )
+{
+    matrix_generations[matrix] = ++matrix_generation;
+    matrix_generations[KE_MATRIX_WORLD_VIEW_PROJECTION] = matrix_generation;
+    
+    if( matrix != KE_MATRIX_WORLD )
+        frame_constants_dirty = Yes;
+    draw_constants_dirty = Yes;
+}
+
 void IKeOpenGLRenderDevice::PVT_SetWorldViewProjectionMatrices()
 {
     IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     
     GLenum error = glGetError();
     
-    /* Assuming there is already a GPU program bound, attempt to set the current matrices */
-    glUniformMatrix4fv( gp->matrices[0], 1, No, world_matrix._array );
-    OGL_DISPDBG( KE_DBGLVL(1), "Could not set world matrix..." );
-    glUniformMatrix4fv( gp->matrices[1], 1, No, view_matrix._array );
-    OGL_DISPDBG( KE_DBGLVL(1), "Could not set projection matrix..." );
-    glUniformMatrix4fv( gp->matrices[2], 1, No, projection_matrix._array );
-    OGL_DISPDBG( KE_DBGLVL(1), "Could not set projection matrix..." );
+    /* The product is only recomputed after one of its matrices changes */
+    if( world_view_proj_generation != matrix_generations[KE_MATRIX_WORLD_VIEW_PROJECTION] )
+    {
+        world_view_proj = projection_matrix * view_matrix * world_matrix;
+        world_view_proj_generation = matrix_generations[KE_MATRIX_WORLD_VIEW_PROJECTION];
+    }
+    
+    /* View and projection matrices are written to the constant ring once, and stay bound
+       until they change or the frame ends. */
+    if( gp->frame_block && frame_constants_dirty )
+    {
+        KeFrameConstants frame_constants;
+        
+        frame_constants.view = view_matrix;
+        frame_constants.proj = projection_matrix;
+        frame_constants.view_proj = projection_matrix * view_matrix;
+        
+        if( PVT_WriteConstantRing( KE_CB_SLOT_FRAME, &frame_constants, sizeof( KeFrameConstants ) ) )
+            frame_constants_dirty = No;
+    }
+    
+    /* Same for the world matrices, so consecutive draws of the same object share a block */
+    if( gp->draw_block && draw_constants_dirty )
+    {
+        KeDrawConstants draw_constants;
+        
+        draw_constants.world = world_matrix;
+        draw_constants.world_view_proj = world_view_proj;
+        
+        if( PVT_WriteConstantRing( KE_CB_SLOT_DRAW, &draw_constants, sizeof( KeDrawConstants ) ) )
+            draw_constants_dirty = No;
+    }
+    
+    /* Programs still using plain uniforms get them set individually, but only when they
+       changed since the last time this program had them set */
+    if( (GLint) gp->matrices[0] != -1 && gp->matrix_generations[0] != matrix_generations[KE_MATRIX_WORLD] )
+    {
+        glUniformMatrix4fv( gp->matrices[0], 1, No, world_matrix._array );
+        OGL_DISPDBG( KE_DBGLVL(1), "Could not set world matrix..." );
+        gp->matrix_generations[0] = matrix_generations[KE_MATRIX_WORLD];
+    }
+    if( (GLint) gp->matrices[1] != -1 && gp->matrix_generations[1] != matrix_generations[KE_MATRIX_VIEW] )
+    {
+        glUniformMatrix4fv( gp->matrices[1], 1, No, view_matrix._array );
+        OGL_DISPDBG( KE_DBGLVL(1), "Could not set view matrix..." );
+        gp->matrix_generations[1] = matrix_generations[KE_MATRIX_VIEW];
+    }
+    if( (GLint) gp->matrices[2] != -1 && gp->matrix_generations[2] != matrix_generations[KE_MATRIX_PROJECTION] )
+    {
+        glUniformMatrix4fv( gp->matrices[2], 1, No, projection_matrix._array );
+        OGL_DISPDBG( KE_DBGLVL(1), "Could not set projection matrix..." );
+        gp->matrix_generations[2] = matrix_generations[KE_MATRIX_PROJECTION];
+    }
+    if( (GLint) gp->matrices[3] != -1 && gp->matrix_generations[3] != matrix_generations[KE_MATRIX_WORLD_VIEW_PROJECTION] )
+    {
+        glUniformMatrix4fv( gp->matrices[3], 1, No, world_view_proj._array );
+        OGL_DISPDBG( KE_DBGLVL(1), "Could not set world-view-projection matrix..." );
+        gp->matrix_generations[3] = matrix_generations[KE_MATRIX_WORLD_VIEW_PROJECTION];
+    }
+}
+
+/* Copies a finished readback out of its pack buffer and into a pooled buffer, freeing the pack buffer */
+bool IKeOpenGLRenderDevice::PVT_ResolveReadback( KeOpenGLReadbackBuffer* rb, int wait )
+{
+    GLenum result = glClientWaitSync( rb->sync, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0 );
+    
+    if( result == GL_TIMEOUT_EXPIRED )
+        return false;
+    if( result == GL_WAIT_FAILED )
+        DISPDBG( KE_WARNING, "Error waiting on readback fence!" );
+    
+    glDeleteSync( rb->sync );
+    rb->sync = NULL;
+    
+    KeOpenGLReadbackResult r;
+    r.ticket = rb->ticket;
+    r.bpp = rb->bpp;
+    r.pixels = PVT_AllocateReadbackPixels( rb->data_size, &r.size );
+    
+    /* The fence has signalled, so mapping won't stall */
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, rb->pbo );
+    void* ptr = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, rb->data_size, GL_MAP_READ_BIT );
+    if( ptr )
+    {
+        memmove( r.pixels, ptr, rb->data_size );
+        glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+    }
+    else
+    {
+        DISPDBG( KE_ERROR, "Error mapping pixel pack buffer!" );
+        ZeroMemory( r.pixels, rb->data_size );
+    }
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    
+    readback_results.push_back( r );
+    rb->ticket = 0;
+    
+    return true;
+}
+
+/* Returns a pooled buffer of at least the requested size, or allocates a new one */
+uint8_t* IKeOpenGLRenderDevice::PVT_AllocateReadbackPixels( uint32_t size, uint32_t* capacity )
+{
+    for( size_t i = 0; i < readback_pool.size(); i++ )
+    {
+        if( readback_pool[i].size >= size )
+        {
+            uint8_t* pixels = readback_pool[i].pixels;
+            *capacity = readback_pool[i].size;
+            readback_pool.erase( readback_pool.begin() + i );
+            
+            return pixels;
+        }
+    }
+    
+    *capacity = size;
+    
+    return new uint8_t[size];
+}
+
+/* Allocates the transient constant ring, persistently mapping it where supported */
+bool IKeOpenGLRenderDevice::PVT_CreateConstantRing()
+{
+    GLint alignment = 0;
+    GLenum error = glGetError();
+    
+    glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+    constant_ring.alignment = alignment > 0 ? alignment : 256;
+    constant_ring.segment_size = ( KE_CONSTANT_RING_SIZE / KE_CONSTANT_RING_FRAMES ) & ~( constant_ring.alignment - 1 );
+    
+    glGenBuffers( 1, &constant_ring.ubo );
+    glBindBuffer( GL_UNIFORM_BUFFER, constant_ring.ubo );
+    
+    /* Immutable storage (OpenGL 4.4 or GL_ARB_buffer_storage) lets us keep the buffer mapped
+       for its entire lifetime and write constants straight into it. */
+#if !defined(__APPLE__) && !defined(__MOBILE_OS__)
+    int real_major_version = 0, real_minor_version = 0;
+    glGetIntegerv( GL_MAJOR_VERSION, &real_major_version );
+    glGetIntegerv( GL_MINOR_VERSION, &real_minor_version );
+    
+    if( real_major_version > 4 || ( real_major_version == 4 && real_minor_version >= 4 ) || GLEW_ARB_buffer_storage )
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        
+        glBufferStorage( GL_UNIFORM_BUFFER, constant_ring.segment_size * KE_CONSTANT_RING_FRAMES, NULL, flags );
+        constant_ring.mapped = (uint8_t*) glMapBufferRange( GL_UNIFORM_BUFFER, 0, constant_ring.segment_size * KE_CONSTANT_RING_FRAMES, flags );
+        
+        error = glGetError();
+        if( error || !constant_ring.mapped )
+        {
+            DISPDBG( KE_WARNING, "Unable to persistently map the constant ring; falling back to buffer updates.\nError code: (" << error << ")" );
+            glDeleteBuffers( 1, &constant_ring.ubo );
+            glGenBuffers( 1, &constant_ring.ubo );
+            glBindBuffer( GL_UNIFORM_BUFFER, constant_ring.ubo );
+            constant_ring.mapped = NULL;
+        }
+    }
+#endif
+    
+    if( !constant_ring.mapped )
+        glBufferData( GL_UNIFORM_BUFFER, constant_ring.segment_size * KE_CONSTANT_RING_FRAMES, NULL, GL_STREAM_DRAW );
+    
+    glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+    
+    error = glGetError();
+    if( error )
+    {
+        glDeleteBuffers( 1, &constant_ring.ubo );
+        ZeroMemory( &constant_ring, sizeof( constant_ring ) );
+        DISPDBG_RB( KE_ERROR, "Error creating the constant ring!\nError code: (" << error << ")" );
+    }
+    
+    device_caps->constant_buffers_supported = Yes;
+    device_caps->constant_buffer_offset_alignment = constant_ring.alignment;
+    device_caps->persistent_mapping_supported = constant_ring.mapped ? Yes : No;
+    
+    return true;
+}
+
+/* Moves on to the segment owned by the current frame slot.  Swap has already waited on that
+   slot's fence, so nothing the GPU still needs lives in it. */
+void IKeOpenGLRenderDevice::PVT_AdvanceConstantRing()
+{
+    if( !constant_ring.ubo )
+        return;
+    
+    constant_ring.segment = frame_count % max_frame_latency;
+    constant_ring.offset = 0;
+    
+    /* The previous frame's blocks live in a segment that will eventually be reused */
+    frame_constants_dirty = Yes;
+    draw_constants_dirty = Yes;
+}
+
+/* Fences the frame being presented so its slot can be safely reused later on */
+void IKeOpenGLRenderDevice::PVT_EndFrame()
+{
+    KeOpenGLFrame* f = &frames[frame_count % max_frame_latency];
+    
+    if( f->fence && f->fence->Insert() )
+    {
+        f->frame = frame_count + 1;
+        f->pending = Yes;
+    }
+    else
+    {
+        /* No fence to wait on; let the driver deal with anything still in use */
+        f->frame = frame_count + 1;
+        PVT_RetireFrame( f, Yes );
+    }
+}
+
+/* Waits for (or polls) a frame slot's fence and destroys the resources queued against it */
+void IKeOpenGLRenderDevice::PVT_RetireFrame( KeOpenGLFrame* f, int wait )
+{
+    if( f->pending )
+    {
+        if( !f->fence->Test() )
+        {
+            if( !wait )
+                return;
+            
+            f->fence->Block();
+        }
+        
+        f->pending = No;
+    }
+    
+    if( f->frame > completed_frame )
+        completed_frame = f->frame;
+    
+    for( size_t i = 0; i < f->deletions.size(); i++ )
+        f->deletions[i]->Destroy();
+    f->deletions.clear();
+}
+
+/* Copies constants into this frame's segment of the ring and binds that range to a slot */
+bool IKeOpenGLRenderDevice::PVT_WriteConstantRing( int slot, void* data, uint32_t size, uint32_t bind_size )
+{
+    if( !constant_ring.ubo )
+        return false;
+    
+    /* Blocks may be bound larger than the data written to them (i.e. partially filled arrays) */
+    if( bind_size < size )
+        bind_size = size;
+    
+    uint32_t offset = ( constant_ring.offset + constant_ring.alignment - 1 ) & ~( constant_ring.alignment - 1 );
+    
+    if( offset + bind_size > constant_ring.segment_size )
+    {
+        static bool warning_issued = false;
+        
+        if( !warning_issued )
+        {
+            DISPDBG( KE_WARNING, "Constant ring segment is full (" << constant_ring.segment_size << " bytes per frame)!" );
+            warning_issued = true;
+        }
+        
+        return false;
+    }
+    
+    uint32_t position = constant_ring.segment * constant_ring.segment_size + offset;
+    
+    if( constant_ring.mapped )
+        memcpy( constant_ring.mapped + position, data, size );
+    else
+    {
+        glBindBuffer( GL_UNIFORM_BUFFER, constant_ring.ubo );
+        glBufferSubData( GL_UNIFORM_BUFFER, position, size, data );
+    }
+    
+    glBindBufferRange( GL_UNIFORM_BUFFER, slot, constant_ring.ubo, position, bind_size );
+    constant_ring.offset = offset + bind_size;
+    
+    return true;
+}
+
+/* Grows the draw ID buffer so that it contains at least the requested number of sequential IDs */
+bool IKeOpenGLRenderDevice::PVT_ReserveDrawIds( uint32_t count )
+{
+    if( count <= drawid_count && drawid_vbo )
+        return true;
+    
+    /* Round up to avoid resizing the buffer every time a few draws are added */
+    uint32_t new_count = drawid_count ? drawid_count : 1024;
+    while( new_count < count )
+        new_count *= 2;
+    
+    uint32_t* ids = new uint32_t[new_count];
+    for( uint32_t i = 0; i < new_count; i++ )
+        ids[i] = i;
+    
+    if( !drawid_vbo )
+        glGenBuffers( 1, &drawid_vbo );
+    
+    glBindBuffer( GL_ARRAY_BUFFER, drawid_vbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( uint32_t ) * new_count, ids, GL_STATIC_DRAW );
+    delete[] ids;
+    
+    GLenum error = glGetError();
+    if( error )
+    {
+        DISPDBG( KE_ERROR, "Error allocating draw ID buffer!\nError code: (" << error << ")" );
+        return false;
+    }
+    
+    drawid_count = new_count;
+    
+    return true;
 }
 
 bool IKeOpenGLRenderDevice::PVT_InititalizeDriverHooks()
@@ -607,10 +1072,36 @@ IKeOpenGLRenderDevice::IKeOpenGLRenderDevice()
  * Name: IKeOpenGLRenderDevice::IKeOpenGLRenderDevice
  * Desc: Appropriate constructor used for initialization of OpenGL via SDL.
  */
-IKeOpenGLRenderDevice::IKeOpenGLRenderDevice( KeRenderDeviceDesc* renderdevice_desc ) : fence_vendor( KE_FENCE_ARB ), im_gb(NULL), im_cache_size(0)
+IKeOpenGLRenderDevice::IKeOpenGLRenderDevice( KeRenderDeviceDesc* renderdevice_desc ) : fence_vendor( KE_FENCE_ARB ), im_gb(NULL), im_cache_size(0), drawid_vbo(0), drawid_count(0), next_staging_buffer(0)
 {
     /* Until we are finished initializing, mark this flag as false */
     initialized = false;
+    device_caps = NULL;
+    ZeroMemory( staging_buffers, sizeof( staging_buffers ) );
+    ZeroMemory( &program_cache_stats, sizeof( program_cache_stats ) );
+    fallback_gpu_program = NULL;
+    program_ready = Yes;
+    frame_count = 0;
+    max_frame_latency = KE_DEFAULT_FRAME_LATENCY;
+    completed_frame = 0;
+    for( int i = 0; i < KE_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+        frames[i].fence = NULL;
+        frames[i].frame = 0;
+        frames[i].pending = No;
+    }
+    ZeroMemory( &constant_ring, sizeof( constant_ring ) );
+    frame_constants_dirty = Yes;
+    ZeroMemory( readback_buffers, sizeof( readback_buffers ) );
+    ZeroMemory( stage_samplers, sizeof( stage_samplers ) );
+    ZeroMemory( bound_samplers, sizeof( bound_samplers ) );
+    bound_fbo = 0;
+    draw_constants_dirty = Yes;
+    matrix_generation = 1;
+    for( int i = 0; i < 4; i++ )
+        matrix_generations[i] = 1;
+    world_view_proj_generation = 0;
+    next_readback_ticket = 1;
     
     /* Sanity checks */
     if( !renderdevice_desc )
@@ -778,6 +1269,141 @@ IKeOpenGLRenderDevice::IKeOpenGLRenderDevice( KeRenderDeviceDesc* renderdevice_d
 	glDisable( GL_CULL_FACE );
     glDisable( GL_TEXTURE_2D );
     
+    /* Fill out the device capabilities we currently check for */
+    device_caps = new KeRenderDeviceCaps;
+    ZeroMemory( device_caps, sizeof( KeRenderDeviceCaps ) );
+    device_caps->default_fence_type = fence_vendor;
+    device_caps->instancing_supported = major_version >= 3 ? Yes : No;
+    
+    /* Multi-draw indirect requires OpenGL 4.3, or GL_ARB_multi_draw_indirect along with
+       GL_ARB_base_instance (we use the base instance to supply each draw's ID). */
+#ifndef __APPLE__
+    if( real_major_version > 4 || ( real_major_version == 4 && real_minor_version >= 3 ) ||
+        ( GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance ) )
+        device_caps->multi_draw_indirect_supported = Yes;
+#endif
+    
+    /* Base vertex draws require OpenGL 3.2 (or GL_ARB_draw_elements_base_vertex) */
+#if defined(__APPLE__) && !defined(__MOBILE_OS__)
+    device_caps->base_vertex_supported = Yes;
+#elif !defined(__MOBILE_OS__)
+    if( real_major_version > 3 || ( real_major_version == 3 && real_minor_version >= 2 ) || GLEW_ARB_draw_elements_base_vertex )
+        device_caps->base_vertex_supported = Yes;
+#endif
+    
+    /* Occlusion queries are core in OpenGL 1.5 and OpenGL ES 3.0.  Boolean queries require OpenGL 3.3
+       (or GL_ARB_occlusion_query2), and conditional rendering OpenGL 3.0. */
+#ifdef __MOBILE_OS__
+    if( major_version >= 3 )
+    {
+        device_caps->occlusion_query_supported = Yes;
+        device_caps->any_samples_query_supported = Yes;
+    }
+#elif defined(__APPLE__)
+    device_caps->occlusion_query_supported = Yes;
+    device_caps->any_samples_query_supported = Yes;
+    device_caps->conditional_render_supported = Yes;
+#else
+    device_caps->occlusion_query_supported = Yes;
+    if( real_major_version > 3 || ( real_major_version == 3 && real_minor_version >= 3 ) || GLEW_ARB_occlusion_query2 )
+        device_caps->any_samples_query_supported = Yes;
+    if( real_major_version >= 3 )
+        device_caps->conditional_render_supported = Yes;
+#endif
+    
+    /* Sampler objects require OpenGL 3.3 (or GL_ARB_sampler_objects) or OpenGL ES 3.0 */
+#ifdef __MOBILE_OS__
+    if( major_version >= 3 )
+        device_caps->sampler_objects_supported = Yes;
+#elif defined(__APPLE__)
+    device_caps->sampler_objects_supported = Yes;
+#else
+    if( real_major_version > 3 || ( real_major_version == 3 && real_minor_version >= 3 ) || GLEW_ARB_sampler_objects )
+        device_caps->sampler_objects_supported = Yes;
+#endif
+    
+    /* Half float vertices require OpenGL 3.0 (or GL_ARB_half_float_vertex), and packed 2:10:10:10
+       vertices OpenGL 3.3 (or GL_ARB_vertex_type_2_10_10_10_rev); both are core in OpenGL ES 3.0 */
+#ifdef __MOBILE_OS__
+    if( major_version >= 3 )
+    {
+        device_caps->half_float_vertices_supported = Yes;
+        device_caps->packed_vertices_supported = Yes;
+    }
+#elif defined(__APPLE__)
+    device_caps->half_float_vertices_supported = Yes;
+    device_caps->packed_vertices_supported = Yes;
+#else
+    if( real_major_version >= 3 || GLEW_ARB_half_float_vertex )
+        device_caps->half_float_vertices_supported = Yes;
+    if( real_major_version > 3 || ( real_major_version == 3 && real_minor_version >= 3 ) || GLEW_ARB_vertex_type_2_10_10_10_rev )
+        device_caps->packed_vertices_supported = Yes;
+#endif
+    
+    /* Program binaries require OpenGL 4.1 (or GL_ARB_get_program_binary), and at least one
+       binary format; some drivers expose the entry points but no formats. */
+    GLint binary_formats = 0;
+#ifdef __MOBILE_OS__
+    if( major_version >= 3 )
+#elif !defined(__APPLE__)
+    if( real_major_version > 4 || ( real_major_version == 4 && real_minor_version >= 1 ) || GLEW_ARB_get_program_binary )
+#endif
+        glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &binary_formats );
+    device_caps->program_binaries_supported = binary_formats > 0 ? Yes : No;
+    
+    /* Let the driver compile shaders on its own threads if it can */
+#ifndef __APPLE__
+    PFNKEMAXSHADERCOMPILERTHREADSPROC pfnMaxShaderCompilerThreads = NULL;
+    
+    if( SDL_GL_ExtensionSupported( "GL_KHR_parallel_shader_compile" ) )
+        pfnMaxShaderCompilerThreads = (PFNKEMAXSHADERCOMPILERTHREADSPROC) SDL_GL_GetProcAddress( "glMaxShaderCompilerThreadsKHR" );
+    else if( SDL_GL_ExtensionSupported( "GL_ARB_parallel_shader_compile" ) )
+        pfnMaxShaderCompilerThreads = (PFNKEMAXSHADERCOMPILERTHREADSPROC) SDL_GL_GetProcAddress( "glMaxShaderCompilerThreadsARB" );
+    
+    if( pfnMaxShaderCompilerThreads )
+    {
+        pfnMaxShaderCompilerThreads( 0xFFFFFFFF );  /* Implementation defined number of threads */
+        device_caps->parallel_shader_compile_supported = Yes;
+    }
+#endif
+    
+    /* Block compressed texture support.  S3TC and RGTC are always available on OSX. */
+#ifdef __MOBILE_OS__
+    device_caps->texture_compression_etc2_supported = major_version >= 3 ? Yes : No;
+#elif defined(__APPLE__)
+    device_caps->texture_compression_s3tc_supported = Yes;
+    device_caps->texture_compression_rgtc_supported = Yes;
+#else
+    device_caps->texture_compression_s3tc_supported = GLEW_EXT_texture_compression_s3tc ? Yes : No;
+    device_caps->texture_compression_rgtc_supported = ( real_major_version >= 3 || GLEW_ARB_texture_compression_rgtc ) ? Yes : No;
+    device_caps->texture_compression_bptc_supported = ( real_major_version > 4 || ( real_major_version == 4 && real_minor_version >= 2 ) ||
+                                                        GLEW_ARB_texture_compression_bptc ) ? Yes : No;
+    device_caps->texture_compression_etc2_supported = ( real_major_version > 4 || ( real_major_version == 4 && real_minor_version >= 3 ) ||
+                                                        GLEW_ARB_ES3_compatibility ) ? Yes : No;
+    device_caps->texture_compression_astc_supported = GLEW_KHR_texture_compression_astc_ldr ? Yes : No;
+#endif
+    
+    /* Create the transient constant ring (uniform buffers require OpenGL 3.1 or OpenGL ES 3.0) */
+    if( major_version >= 3 )
+        PVT_CreateConstantRing();
+    
+    /* Create one pooled fence per frame in flight.  Without them, frames aren't throttled and
+       deferred deletions happen at the end of the frame instead. */
+    for( int i = 0; i < KE_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+        if( !CreateFence( &frames[i].fence, KE_FENCE_DEFAULT ) )
+        {
+            DISPDBG( KE_WARNING, "Unable to create frame fences; frame latency will not be limited." );
+            frames[i].fence = NULL;
+            for( int j = 0; j < i; j++ )
+            {
+                frames[j].fence->Destroy();
+                frames[j].fence = NULL;
+            }
+            break;
+        }
+    }
+    
     /* Set vertex attributes to their defaults */
     ZeroMemory( current_vertexattribute, sizeof( KeVertexAttribute ) * 32 );
     current_vertexattribute[0].index = 0;
@@ -909,6 +1535,57 @@ IKeOpenGLRenderDevice::IKeOpenGLRenderDevice( KeRenderDeviceDesc* renderdevice_d
 IKeOpenGLRenderDevice::~IKeOpenGLRenderDevice()
 {
     delete device_desc;
+    delete device_caps;
+    
+    /* Wait for every frame in flight, run any deferred deletions and release the frame fences */
+    glFinish();
+    for( int i = 0; i < KE_MAX_FRAMES_IN_FLIGHT; i++ )
+    {
+        PVT_RetireFrame( &frames[i], Yes );
+        if( frames[i].fence )
+            frames[i].fence->Destroy();
+    }
+    
+    /* Delete the draw ID buffer if it exists */
+    if( drawid_vbo )
+        glDeleteBuffers( 1, &drawid_vbo );
+    
+    /* Delete the readback buffers and any pixels still held by them */
+    for( int i = 0; i < KE_MAX_READBACK_BUFFERS; i++ )
+    {
+        if( readback_buffers[i].sync )
+            glDeleteSync( readback_buffers[i].sync );
+        if( readback_buffers[i].pbo )
+            glDeleteBuffers( 1, &readback_buffers[i].pbo );
+    }
+    for( size_t i = 0; i < readback_results.size(); i++ )
+        delete[] readback_results[i].pixels;
+    for( size_t i = 0; i < readback_pool.size(); i++ )
+        delete[] readback_pool[i].pixels;
+    
+    /* Delete the transient constant ring */
+    if( constant_ring.ubo )
+    {
+        if( constant_ring.mapped )
+        {
+            glBindBuffer( GL_UNIFORM_BUFFER, constant_ring.ubo );
+            glUnmapBuffer( GL_UNIFORM_BUFFER );
+        }
+        glDeleteBuffers( 1, &constant_ring.ubo );
+    }
+    
+    /* Delete the cached sampler objects */
+    for( size_t i = 0; i < sampler_cache.size(); i++ )
+        glDeleteSamplers( 1, &sampler_cache[i].sampler );
+    
+    /* Delete the texture upload staging buffers */
+    for( int i = 0; i < KE_MAX_STAGING_BUFFERS; i++ )
+    {
+        if( staging_buffers[i].sync )
+            glDeleteSync( staging_buffers[i].sync );
+        if( staging_buffers[i].pbo )
+            glDeleteBuffers( 1, &staging_buffers[i].pbo );
+    }
      
     /* Destroy the immediate mode geometry buffer if it exists */
     if( im_gb )
@@ -1076,6 +1753,15 @@ void IKeOpenGLRenderDevice::ClearState()
 void IKeOpenGLRenderDevice::Swap()
 {
     SDL_GL_SwapWindow( window );
+    
+    /* Fence this frame, then wait until the GPU has finished with the frame that last used the
+       next slot.  This is what keeps the CPU at most max_frame_latency frames ahead. */
+    PVT_EndFrame();
+    frame_count++;
+    PVT_RetireFrame( &frames[frame_count % max_frame_latency], Yes );
+    
+    /* Move on to the next segment of the constant ring */
+    PVT_AdvanceConstantRing();
 }
 
 /*
@@ -1208,17 +1894,12 @@ bool IKeOpenGLRenderDevice::CreateGeometryBuffer( void* vertex_data, uint32_t ve
 
 /*
  * Name: IKeOpenGLRenderDevice::delete_geometry_buffer
- * Desc:
+ * Desc: Deletes the VBOs and VAO once every frame in flight that may reference them has completed.
  */
 void IKeOpenGLRenderDevice::DeleteGeometryBuffer( IKeGeometryBuffer* geometry_buffer )
 {
-    IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( geometry_buffer );
-    
-    /* Delete the VBO and VAO */
-    glDeleteBuffers( 2, gb->vbo );
-    glDeleteVertexArrays( 1, &gb->vao );
-    
-    delete geometry_buffer;
+    if( geometry_buffer )
+        DestroyDeferred( geometry_buffer );
 }
 
 /*
@@ -1285,89 +1966,27 @@ void IKeOpenGLRenderDevice::RestoreImmediateContext()
 	DISPDBG( KE_WARNING, "Not yet implemented!" );
 }
 
-/*
- * Name: IKeOpenGLRenderDevice::create_program
- * Desc: Creates a complete OpenGL program out of shaders in text form. The minimum requirements
- *       are one valid vertex and fragment shader, while geometry and tesselation shaders are
- *       optional.  Obviously, tesselation shaders require OpenGL 4.1+, and cannot be used with
- *       OpenGL 3.2.  This function will automatically search for specific attribute locations
- *       before linking it and search for pre-determined uniform names for textures and matrices
- *       (see code below).
- *       TODO: Allow user defined constants.
- */
-bool IKeOpenGLRenderDevice::CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+/* Issues the commands to compile and link a program from source, without waiting on the results.
+   The shaders remain attached until PVT_EndProgram is called. */
+void IKeOpenGLRenderDevice::PVT_BeginProgram( const char* vertex_shader, const char* fragment_shader, KeVertexAttribute* vertex_attributes, uint32_t* program, uint32_t* shaders )
 {
-    GLuint p, f, v, t = 0, g;
-    *gpu_program = new IKeOpenGLGpuProgram;
-    IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>( *gpu_program );
     GLenum error = glGetError();
-	int Fail = No;
-    
-    /* Nullify vertex attribute list */
-    gp->va = NULL;
+    GLuint p, f, v;
     
 	v = glCreateShader( GL_VERTEX_SHADER );
 	f = glCreateShader( GL_FRAGMENT_SHADER );
     
-#ifndef __MOBILE_OS__
-    g = glCreateShader( GL_GEOMETRY_SHADER );
-#endif
-    
 	glShaderSource( v, 1, &vertex_shader, NULL );
 	glShaderSource( f, 1, &fragment_shader, NULL );
     
-	GLint compiled;
-    
 	glCompileShader(v);
-	glGetShaderiv( v, GL_COMPILE_STATUS, &compiled );
-	if( !compiled )
-	{
-        char str[2048];
-        int len = 0;
-        
-        glGetShaderInfoLog( v, 2048, &len, str );
-		DISPDBG( KE_ERROR, "Vertex shader not compiled.\n" << str );
-		Fail = Yes;
-	}
-    
 	glCompileShader(f);
-	glGetShaderiv( f, GL_COMPILE_STATUS, &compiled );
-	if( !compiled )
-	{
-        char str[2048];
-        int len = 0;
-        
-        glGetShaderInfoLog( f, 2048, &len, str );
-		DISPDBG( KE_ERROR, "Fragment shader not compiled.\n" << str );
-		Fail = Yes;
-	}
-    
-	if( Fail )
-	{
-		glDeleteShader(v);
-		glDeleteShader(f);
-		glDeleteShader(g);
-		gp->Destroy();
-		gp = NULL;
-
-		DISPDBG_RB( KE_ERROR, "An error occured building this GPU program!" );
-	}
 
 	p = glCreateProgram();
     
-    /*glBindAttribLocation( p, 0, "in_pos" );
-    glBindAttribLocation( p, 1, "in_normal" );
-    glBindAttribLocation( p, 2, "in_tangent" );
-    glBindAttribLocation( p, 3, "in_bitangent" );
-    glBindAttribLocation( p, 4, "in_colour" );
-    glBindAttribLocation( p, 5, "in_tex0" );
-    glBindAttribLocation( p, 6, "in_tex1" );
-    glBindAttribLocation( p, 7, "in_tex2" );
-    glBindAttribLocation( p, 8, "in_tex3" );
-	glBindAttribLocation( p, 9, "in_tex4" );
-    glBindAttribLocation( p, 10, "in_tex5" );
-    glBindAttribLocation( p, 11, "in_tex6" );
-    glBindAttribLocation( p, 12, "in_tex7" );*/
+    /* Let the driver know that we want to retrieve the binary for the program cache */
+    if( !program_cache_path.empty() && device_caps->program_binaries_supported )
+        glProgramParameteri( p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
     
     /* Bind all attributes found within the list of vertex attributes */
     int index = 0;
@@ -1385,39 +2004,96 @@ bool IKeOpenGLRenderDevice::CreateProgram( const char* vertex_shader, const char
         index++;
     }
     
+    /* The draw ID attribute is supplied by the device itself for indirect draws */
+    glBindAttribLocation( p, program_attributes[KE_VA_DRAWID].location, program_attributes[KE_VA_DRAWID].name );
+    
 	glAttachShader( p, v );
 	glAttachShader( p, f );
-    
-	GLint status = 0;
 	glLinkProgram(p);
-	glGetProgramiv( p, GL_LINK_STATUS, &status );
-	if (status == GL_FALSE)
+    
+    (*program) = p;
+    shaders[0] = v;
+    shaders[1] = f;
+}
+
+/* Collects the results of a program started with PVT_BeginProgram (blocking if the driver
+   hasn't finished yet), and deletes the program on failure. */
+bool IKeOpenGLRenderDevice::PVT_EndProgram( uint32_t program, uint32_t* shaders )
+{
+    const char* shader_names[] = { "Vertex", "Fragment" };
+    GLint compiled, status = 0;
+	int Fail = No;
+    
+    for( int i = 0; i < 2; i++ )
+    {
+        glGetShaderiv( shaders[i], GL_COMPILE_STATUS, &compiled );
+        if( !compiled )
+        {
+            char str[2048];
+            int len = 0;
+            
+            glGetShaderInfoLog( shaders[i], 2048, &len, str );
+            DISPDBG( KE_ERROR, shader_names[i] << " shader not compiled.\n" << str );
+            Fail = Yes;
+        }
+    }
+    
+	glGetProgramiv( program, GL_LINK_STATUS, &status );
+	if( !Fail && status == GL_FALSE )
 	{
 		char str[2048];
 		int len = 0;
 
-		glGetProgramInfoLog( p, 2048, &len, str );
+		glGetProgramInfoLog( program, 2048, &len, str );
 		DISPDBG( KE_ERROR, "Error linking program.\n" << str << "\n" );
+        Fail = Yes;
 	}
+    
+    glDetachShader( program, shaders[0] );
+    glDetachShader( program, shaders[1] );
+    glDeleteShader( shaders[0] );
+    glDeleteShader( shaders[1] );
+    shaders[0] = shaders[1] = 0;
+    
+    if( Fail )
+    {
+        glDeleteProgram( program );
+        DISPDBG_RB( KE_ERROR, "An error occured building this GPU program!" );
+    }
 
-	glValidateProgram( p );
-	glGetProgramiv( p, GL_VALIDATE_STATUS, &status );
+	glValidateProgram( program );
+	glGetProgramiv( program, GL_VALIDATE_STATUS, &status );
 	if (status == GL_FALSE)
 	{
 		char str[2048];
 		int len = 0;
 
-		glGetProgramInfoLog( p, 2048, &len, str );
+		glGetProgramInfoLog( program, 2048, &len, str );
 		DISPDBG( KE_ERROR, "Error validating program.\n" << str << "\n" );
 	}
     
-	glUseProgram(p);
+    return true;
+}
+
+/* Compiles and links a program from source */
+bool IKeOpenGLRenderDevice::PVT_CompileProgram( const char* vertex_shader, const char* fragment_shader, KeVertexAttribute* vertex_attributes, uint32_t* program )
+{
+    uint32_t shaders[2];
     
-    glDeleteShader(v);
-    glDeleteShader(f);
-#ifndef __MOBILE_OS__
-    glDeleteShader(g);
-#endif
+    PVT_BeginProgram( vertex_shader, fragment_shader, vertex_attributes, program, shaders );
+    
+    return PVT_EndProgram( *program, shaders );
+}
+
+/* Looks up the standard uniforms of a newly linked program and binds its samplers */
+void IKeOpenGLRenderDevice::PVT_InitializeProgram( IKeOpenGLGpuProgram* gp )
+{
+    GLuint p = gp->program;
+    GLint previous_program = 0;
+    GLenum error;
+    
+    glGetIntegerv( GL_CURRENT_PROGRAM, &previous_program );
+	glUseProgram(p);
     
     GLuint uniform_tex0 = glGetUniformLocation( p, "tex0" );
     GLuint uniform_tex1 = glGetUniformLocation( p, "tex1" );
@@ -1436,6 +2112,33 @@ bool IKeOpenGLRenderDevice::CreateProgram( const char* vertex_shader, const char
 	OGL_DISPDBG( KE_WARNING, "Could not find the view matrix uniform location..." );
     gp->matrices[2] = glGetUniformLocation( p, "proj" );
 	OGL_DISPDBG( KE_WARNING, "Could not find the projection matrix uniform location..." );
+    gp->matrices[3] = glGetUniformLocation( p, "world_view_proj" );
+	OGL_DISPDBG( KE_WARNING, "Could not find the world-view-projection matrix uniform location..." );
+    ZeroMemory( gp->matrix_generations, sizeof( gp->matrix_generations ) );
+    
+    /* Attach the constant ring's blocks to their fixed binding slots, if this program uses them */
+    gp->frame_block = No;
+    gp->draw_block = No;
+    
+    if( constant_ring.ubo )
+    {
+        GLuint frame_block = glGetUniformBlockIndex( p, "KeFrameConstants" );
+        GLuint draw_block = glGetUniformBlockIndex( p, "KeDrawConstants" );
+        GLuint object_block = glGetUniformBlockIndex( p, "KeObjectConstants" );
+        
+        if( frame_block != GL_INVALID_INDEX )
+        {
+            glUniformBlockBinding( p, frame_block, KE_CB_SLOT_FRAME );
+            gp->frame_block = Yes;
+        }
+        if( draw_block != GL_INVALID_INDEX )
+        {
+            glUniformBlockBinding( p, draw_block, KE_CB_SLOT_DRAW );
+            gp->draw_block = Yes;
+        }
+        if( object_block != GL_INVALID_INDEX )
+            glUniformBlockBinding( p, object_block, KE_CB_SLOT_OBJECTS );
+    }
     
     glUniform1i( uniform_tex0, 0 );
     glUniform1i( uniform_tex1, 1 );
@@ -1446,10 +2149,283 @@ bool IKeOpenGLRenderDevice::CreateProgram( const char* vertex_shader, const char
     glUniform1i( uniform_tex6, 6 );
     glUniform1i( uniform_tex7, 7 );
 
-    glUseProgram(0);
+    glUseProgram( previous_program );
+}
+
+/* Returns a 64-bit FNV-1a hash of the given data, continuing from a previous hash */
+uint64_t KeHashFNV1a( const void* data, size_t size, uint64_t hash = 0xCBF29CE484222325ULL )
+{
+    const uint8_t* ptr = (const uint8_t*) data;
+    
+    for( size_t i = 0; i < size; i++ )
+    {
+        hash ^= ptr[i];
+        hash *= 0x100000001B3ULL;
+    }
+    
+    return hash;
+}
+
+/* Returns the sampler object for a list of texture states, creating it the first time those
+   states are seen.  States that aren't given use nearest filtering and repeat wrapping. */
+uint32_t IKeOpenGLRenderDevice::PVT_GetSamplerObject( KeState* states, int state_count )
+{
+    KeOpenGLSamplerObject so;
+    GLenum error = glGetError();
+    
+    /* Reduce the states to one parameter per state type, so the order they were given in
+       doesn't matter */
+    ZeroMemory( &so, sizeof( KeOpenGLSamplerObject ) );
+    so.params[KE_TS_MAGFILTER] = KE_TEXTUREFILTER_NEAREST;
+    so.params[KE_TS_MINFILTER] = KE_TEXTUREFILTER_NEAREST;
+    so.params[KE_TS_WRAPU] = KE_REPEAT;
+    so.params[KE_TS_WRAPV] = KE_REPEAT;
+    so.params[KE_TS_WRAPW] = KE_REPEAT;
+    
+    for( int i = 0; i < state_count; i++ )
+    {
+        if( states[i].state >= KE_SAMPLER_PARAM_COUNT )
+        {
+            DISPDBG( KE_WARNING, "Bad texture state!\nstate: " << states[i].state << "\n" );
+            continue;
+        }
+        
+        so.params[states[i].state] = states[i].param1;
+    }
+    
+    so.hash = KeHashFNV1a( so.params, sizeof( so.params ) );
+    
+    for( size_t i = 0; i < sampler_cache.size(); i++ )
+    {
+        if( sampler_cache[i].hash == so.hash && !memcmp( sampler_cache[i].params, so.params, sizeof( so.params ) ) )
+            return sampler_cache[i].sampler;
+    }
+    
+    /* GL_CLAMP isn't a valid sampler wrap mode, so it's treated as clamp to edge */
+    const GLenum wrap_params[] = { GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R };
+    
+    glGenSamplers( 1, &so.sampler );
+    glSamplerParameteri( so.sampler, GL_TEXTURE_MAG_FILTER, texture_filter_modes[so.params[KE_TS_MAGFILTER]] );
+    glSamplerParameteri( so.sampler, GL_TEXTURE_MIN_FILTER, texture_filter_modes[so.params[KE_TS_MINFILTER]] );
+    for( int i = 0; i < 3; i++ )
+    {
+        uint32_t wrap = so.params[KE_TS_WRAPU+i];
+        glSamplerParameteri( so.sampler, wrap_params[i], wrap == KE_CLAMP ? GL_CLAMP_TO_EDGE : texture_wrap_modes[wrap] );
+    }
+    
+    error = glGetError();
+    if( error )
+    {
+        DISPDBG( KE_ERROR, "Error creating sampler object!\nError code: (" << error << ")" );
+        glDeleteSamplers( 1, &so.sampler );
+        return 0;
+    }
+    
+    sampler_cache.push_back( so );
+    
+    return so.sampler;
+}
+
+/* Hashes a program's source and vertex attribute bindings, along with the driver it is built with */
+uint64_t IKeOpenGLRenderDevice::PVT_HashProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, uint64_t* driver_hash )
+{
+    const char* sources[] = { vertex_shader, fragment_shader, geometry_shader, tesselation_shader };
+    const GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    uint64_t hash = KeHashFNV1a( NULL, 0 );
+    
+    /* Any change in the driver invalidates the binary */
+    (*driver_hash) = KeHashFNV1a( NULL, 0 );
+    for( int i = 0; i < 4; i++ )
+    {
+        const char* str = (const char*) glGetString( driver_strings[i] );
+        if( str )
+            (*driver_hash) = KeHashFNV1a( str, strlen( str ) + 1, *driver_hash );
+    }
+    
+    /* Shader source (which includes any defines) */
+    for( int i = 0; i < 4; i++ )
+    {
+        if( sources[i] )
+            hash = KeHashFNV1a( sources[i], strlen( sources[i] ) + 1, hash );
+        else
+            hash = KeHashFNV1a( "", 1, hash );
+    }
+    
+    /* Attribute bindings are baked into the binary as well */
+    for( int i = 0; vertex_attributes[i].index != -1; i++ )
+        hash = KeHashFNV1a( &vertex_attributes[i].index, sizeof( vertex_attributes[i].index ), hash );
+    
+    return hash;
+}
+
+/*
+ * Program binary file header
+ */
+#define KE_PROGRAM_BINARY_MAGIC     0x3142504B  /* 'KPB1' */
+
+struct KeProgramBinaryHeader
+{
+    uint32_t magic;
+    uint32_t binary_format;
+    uint32_t binary_size;
+    uint32_t reserved;
+    uint64_t hash;
+    uint64_t driver_hash;
+};
+
+/* Returns the file name used to cache the given program */
+std::string KeProgramBinaryFilename( std::string path, uint64_t hash )
+{
+    char filename[32];
+    
+    sprintf( filename, "%08x%08x.kpb", uint32_t( hash >> 32 ), uint32_t( hash ) );
+    
+    if( !path.empty() && path[path.length()-1] != '/' && path[path.length()-1] != '\\' )
+        path += "/";
+    
+    return path + filename;
+}
+
+/* Loads a program from the program cache, returns false if there's no valid binary */
+bool IKeOpenGLRenderDevice::PVT_LoadProgramBinary( uint64_t hash, uint64_t driver_hash, uint32_t* program )
+{
+    KeProgramBinaryHeader header;
+    std::string filename = KeProgramBinaryFilename( program_cache_path, hash );
+    
+    FILE* file = fopen( filename.c_str(), "rb" );
+    if( !file )
+        return false;
+    
+    /* Make sure that this binary was built from the same source by the same driver */
+    if( fread( &header, sizeof( header ), 1, file ) != 1 || header.magic != KE_PROGRAM_BINARY_MAGIC ||
+        header.hash != hash || header.driver_hash != driver_hash )
+    {
+        fclose( file );
+        program_cache_stats.invalidated++;
+        return false;
+    }
+    
+    std::vector<uint8_t> binary( header.binary_size );
+    size_t read = binary.empty() ? 0 : fread( &binary[0], binary.size(), 1, file );
+    fclose( file );
+    
+    if( read != 1 )
+    {
+        program_cache_stats.invalidated++;
+        return false;
+    }
+    
+    /* The driver may still reject the binary (i.e. after an update without a version change) */
+    GLint status = 0;
+    GLuint p = glCreateProgram();
+    
+    glProgramBinary( p, header.binary_format, &binary[0], header.binary_size );
+    glGetProgramiv( p, GL_LINK_STATUS, &status );
+    if( status == GL_FALSE )
+    {
+        glDeleteProgram( p );
+        program_cache_stats.invalidated++;
+        DISPDBG_RB( KE_DBGLVL(3), "Cached program binary rejected by driver (" << filename << ")." );
+    }
+    
+    (*program) = p;
+    
+    return true;
+}
+
+/* Stores a linked program's binary in the program cache */
+void IKeOpenGLRenderDevice::PVT_SaveProgramBinary( uint64_t hash, uint64_t driver_hash, uint32_t program )
+{
+    KeProgramBinaryHeader header;
+    GLint length = 0;
+    GLenum error = glGetError();
+    
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if( length <= 0 )
+        return;
+    
+    std::vector<uint8_t> binary( length );
+    GLenum binary_format = 0;
+    
+    glGetProgramBinary( program, length, NULL, &binary_format, &binary[0] );
+    OGL_DISPDBG_R( KE_WARNING, "Error retrieving program binary!" );
+    
+    ZeroMemory( &header, sizeof( header ) );
+    header.magic = KE_PROGRAM_BINARY_MAGIC;
+    header.binary_format = binary_format;
+    header.binary_size = length;
+    header.hash = hash;
+    header.driver_hash = driver_hash;
+    
+    std::string filename = KeProgramBinaryFilename( program_cache_path, hash );
+    FILE* file = fopen( filename.c_str(), "wb" );
+    if( !file )
+        DISPDBG_R( KE_WARNING, "Could not open program cache file for writing (" << filename << ")!" );
+    
+    fwrite( &header, sizeof( header ), 1, file );
+    fwrite( &binary[0], length, 1, file );
+    fclose( file );
+    
+    program_cache_stats.stores++;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::create_program
+ * Desc: Creates a complete OpenGL program out of shaders in text form. The minimum requirements
+ *       are one valid vertex and fragment shader, while geometry and tesselation shaders are
+ *       optional.  Obviously, tesselation shaders require OpenGL 4.1+, and cannot be used with
+ *       OpenGL 3.2.  This function will automatically search for specific attribute locations
+ *       before linking it and search for pre-determined uniform names for textures and matrices
+ *       (see code below).
+ *       TODO: Allow user defined constants.
+ */
+bool IKeOpenGLRenderDevice::CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+{
+    GLuint p = 0;
+    *gpu_program = new IKeOpenGLGpuProgram;
+    IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>( *gpu_program );
+    uint64_t hash = 0, driver_hash = 0;
+    
+    /* Nullify vertex attribute list */
+    gp->va = NULL;
+    gp->program = 0;
+    gp->device = this;
+    gp->status = KE_PROGRAM_PENDING;
+    gp->shaders[0] = gp->shaders[1] = 0;
+    gp->hash = gp->driver_hash = 0;
+    
+    /* Try the program cache first, then fall back to compiling from source */
+    if( !program_cache_path.empty() && device_caps->program_binaries_supported )
+    {
+        hash = PVT_HashProgram( vertex_shader, fragment_shader, geometry_shader, tesselation_shader, vertex_attributes, &driver_hash );
+        
+        if( PVT_LoadProgramBinary( hash, driver_hash, &p ) )
+            program_cache_stats.hits++;
+        else
+        {
+            program_cache_stats.misses++;
+            p = 0;
+        }
+    }
+    
+    if( !p )
+    {
+        if( !PVT_CompileProgram( vertex_shader, fragment_shader, vertex_attributes, &p ) )
+        {
+            gp->Destroy();
+            (*gpu_program) = NULL;
+            
+            return false;
+        }
+        
+        if( hash )
+            PVT_SaveProgramBinary( hash, driver_hash, p );
+    }
     
     /* Save the handle to this newly created program */
     gp->program = p;
+    gp->status = KE_PROGRAM_READY;
+    PVT_InitializeProgram( gp );
 
 #if 1
 	/* Copy vertex attributes */
@@ -1464,6 +2440,108 @@ bool IKeOpenGLRenderDevice::CreateProgram( const char* vertex_shader, const char
     return true;
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::CreateProgramAsync
+ * Desc: Same as CreateProgram, except that it does not wait for the driver to finish compiling
+ *       and linking.  The program can be set right away; until IKeGpuProgram::IsReady returns
+ *       true, draws use the fallback program (see SetFallbackProgram) or are skipped.  With
+ *       GL_KHR_parallel_shader_compile the driver builds programs on its own threads; otherwise
+ *       the results are collected no sooner than the next frame, which gives drivers with
+ *       threaded compilers the chance to finish in the background.
+ * NOTE: Compile errors are reported once the program has finished building.
+ */
+bool IKeOpenGLRenderDevice::CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+{
+    GLuint p = 0;
+    *gpu_program = new IKeOpenGLGpuProgram;
+    IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>( *gpu_program );
+    
+    gp->va = NULL;
+    gp->program = 0;
+    gp->device = this;
+    gp->status = KE_PROGRAM_PENDING;
+    gp->shaders[0] = gp->shaders[1] = 0;
+    gp->submit_frame = frame_count;
+    gp->hash = gp->driver_hash = 0;
+    
+    /* Cached programs are ready right away */
+    if( !program_cache_path.empty() && device_caps->program_binaries_supported )
+    {
+        gp->hash = PVT_HashProgram( vertex_shader, fragment_shader, geometry_shader, tesselation_shader, vertex_attributes, &gp->driver_hash );
+        
+        if( PVT_LoadProgramBinary( gp->hash, gp->driver_hash, &p ) )
+        {
+            program_cache_stats.hits++;
+            gp->hash = 0;   /* No need to store it again */
+            gp->program = p;
+            gp->status = KE_PROGRAM_READY;
+            PVT_InitializeProgram( gp );
+        }
+        else
+            program_cache_stats.misses++;
+    }
+    
+    /* Start building this program */
+    if( gp->status == KE_PROGRAM_PENDING )
+        PVT_BeginProgram( vertex_shader, fragment_shader, vertex_attributes, &gp->program, gp->shaders );
+    
+    /* Copy vertex attributes */
+    int va_size = 0;
+    while( vertex_attributes[va_size].index != -1 )
+        va_size++;
+    
+    gp->va = new KeVertexAttribute[va_size+1];
+    memmove( gp->va, vertex_attributes, sizeof( KeVertexAttribute ) * (va_size+1) );
+    
+    return true;
+}
+
+/* Checks whether a pending program has finished building, and finishes setting it up if so.
+   If wait is set, this blocks until the driver is done. */
+bool IKeOpenGLRenderDevice::PVT_PollProgram( IKeOpenGLGpuProgram* gp, bool wait )
+{
+    if( gp->status != KE_PROGRAM_PENDING )
+        return gp->status == KE_PROGRAM_READY;
+    
+    if( !wait )
+    {
+        if( device_caps->parallel_shader_compile_supported )
+        {
+            GLint completed = GL_FALSE;
+            glGetProgramiv( gp->program, GL_COMPLETION_STATUS_KHR, &completed );
+            if( !completed )
+                return false;
+        }
+        else if( gp->submit_frame == frame_count )
+            return false;   /* Give the driver at least one frame */
+    }
+    
+    if( !PVT_EndProgram( gp->program, gp->shaders ) )
+    {
+        gp->program = 0;
+        gp->status = KE_PROGRAM_FAILED;
+        return false;
+    }
+    
+    if( gp->hash )
+        PVT_SaveProgramBinary( gp->hash, gp->driver_hash, gp->program );
+    
+    gp->status = KE_PROGRAM_READY;
+    PVT_InitializeProgram( gp );
+    
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::SetFallbackProgram
+ * Desc: Sets the program used in place of programs created with CreateProgramAsync that are
+ *       not ready yet.  If NULL, draws using such programs are skipped instead.
+ */
+void IKeOpenGLRenderDevice::SetFallbackProgram( IKeGpuProgram* gpu_program )
+{
+    fallback_gpu_program = gpu_program;
+}
+
 /*
  * Name: IKeOpenGLRenderDevice::delete_program
  * Desc: Deletes the GPU program.
@@ -1473,12 +2551,42 @@ void IKeOpenGLRenderDevice::DeleteProgram( IKeGpuProgram* gpu_program )
     /* Deletes the GPU program */
     if( gpu_program )
     {
-        glDeleteProgram( static_cast<IKeOpenGLGpuProgram*>(gpu_program)->program );
+        IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>(gpu_program);
+        
+        /* Delete the shaders of a program that never finished building */
+        if( gp->shaders[0] ) glDeleteShader( gp->shaders[0] );
+        if( gp->shaders[1] ) glDeleteShader( gp->shaders[1] );
+        
+        glDeleteProgram( gp->program );
 		//delete[] static_cast<IKeOpenGLGpuProgram*>(gpu_program)->va;
         delete gpu_program;
     }
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::SetProgramCachePath
+ * Desc: Enables the on-disk program binary cache, storing binaries in the given directory
+ *       (which must already exist).  Programs created afterwards are loaded from the cache
+ *       when the source, attribute bindings and driver all match, and compiled (then cached)
+ *       otherwise.  Pass NULL to disable the cache.
+ */
+void IKeOpenGLRenderDevice::SetProgramCachePath( const char* path )
+{
+    if( path && !device_caps->program_binaries_supported )
+        DISPDBG( KE_WARNING, "Program binaries are not supported by this driver; the program cache will not be used." );
+    
+    program_cache_path = path ? path : "";
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::GetProgramCacheStats
+ * Desc: Returns the program cache's hit/miss statistics.
+ */
+void IKeOpenGLRenderDevice::GetProgramCacheStats( KeProgramCacheStats* stats )
+{
+    memmove( stats, &program_cache_stats, sizeof( KeProgramCacheStats ) );
+}
+
 /*
  * Name: IKeOpenGLRenderDevice::set_program
  * Desc: Sets the GPU program.  If NULL, the GPU program is set to 0.
@@ -1489,12 +2597,29 @@ void IKeOpenGLRenderDevice::SetProgram( IKeGpuProgram* gpu_program )
     
     /* Save a copy of this program */
     current_gpu_program = gpu_program;
+    program_ready = Yes;
 
     /* Check for a valid pointer. If NULL, then we set the current program to 0. */
     if( gpu_program )
     {
         IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>(gpu_program);
         
+        /* If this program isn't ready yet, use the fallback program or skip drawing */
+        if( !PVT_PollProgram( gp, No ) )
+        {
+            IKeOpenGLGpuProgram* fallback = static_cast<IKeOpenGLGpuProgram*>( fallback_gpu_program );
+            
+            if( !fallback || !PVT_PollProgram( fallback, No ) )
+            {
+                program_ready = No;
+                glUseProgram(0);
+                return;
+            }
+            
+            current_gpu_program = fallback;
+            gp = fallback;
+        }
+        
         glUseProgram( gp->program );
 		OGL_DISPDBG_R( KE_ERROR, "Invalid GPU program!" );
     }
@@ -1508,6 +2633,9 @@ void IKeOpenGLRenderDevice::SetProgram( IKeGpuProgram* gpu_program )
  */
 void IKeOpenGLRenderDevice::SetProgramConstant1FV( const char* location, int count, float* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1522,6 +2650,9 @@ void IKeOpenGLRenderDevice::SetProgramConstant1FV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant2FV( const char* location, int count, float* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1536,6 +2667,9 @@ void IKeOpenGLRenderDevice::SetProgramConstant2FV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant3FV( const char* location, int count, float* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1550,7 +2684,10 @@ void IKeOpenGLRenderDevice::SetProgramConstant3FV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant4FV( const char* location, int count, float* value )
 {
-	GLenum error = glGetError();
+    if( !program_ready )
+        return;
+    
+    GLenum error = glGetError();
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     
     int loc = glGetUniformLocation( p->program, location );
@@ -1564,6 +2701,9 @@ void IKeOpenGLRenderDevice::SetProgramConstant4FV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant1IV( const char* location, int count, int* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1578,6 +2718,9 @@ void IKeOpenGLRenderDevice::SetProgramConstant1IV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant2IV( const char* location, int count, int* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1592,6 +2735,9 @@ void IKeOpenGLRenderDevice::SetProgramConstant2IV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant3IV( const char* location, int count, int* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1606,6 +2752,9 @@ void IKeOpenGLRenderDevice::SetProgramConstant3IV( const char* location, int cou
  */
 void IKeOpenGLRenderDevice::SetProgramConstant4IV( const char* location, int count, int* value )
 {
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* p = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     GLenum error = glGetError();
     
@@ -1686,7 +2835,8 @@ bool IKeOpenGLRenderDevice::CreateConstantBuffer( KeConstantBufferDesc* desc, IK
  */
 void IKeOpenGLRenderDevice::DeleteConstantBuffer( IKeConstantBuffer* constant_buffer )
 {
-
+    if( constant_buffer )
+        DestroyDeferred( constant_buffer );
 }
 
 /*
@@ -1721,10 +2871,40 @@ void IKeOpenGLRenderDevice::SetConstantBuffer( int slot, int shader_type, IKeCon
     glBindBufferBase( GL_UNIFORM_BUFFER, slot, cb->ubo );
     OGL_DISPDBG_R( KE_ERROR, "Error binding UBO to index #" << slot << "!" );
     
+    /* The automatic blocks must be rewritten if their bindings are replaced */
+    if( slot == KE_CB_SLOT_FRAME )
+        frame_constants_dirty = Yes;
+    if( slot == KE_CB_SLOT_DRAW )
+        draw_constants_dirty = Yes;
+    
     /* Bind the uniform block */
     glUniformBlockBinding( p->program, block_index, slot );
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::SetTransientConstants
+ * Desc: Writes a block of constants into this frame's region of the constant ring, and binds
+ *       it to the desired uniform buffer binding.
+ * NOTE: The data is only valid until the end of the frame, so it must be set again for every
+ *       frame it's used in.  Blocks are laid out by the caller (std140).
+ */
+bool IKeOpenGLRenderDevice::SetTransientConstants( int slot, void* data, uint32_t size )
+{
+    if( !data || !size )
+        return false;
+    
+    if( !constant_ring.ubo )
+        DISPDBG_RB( KE_ERROR, "The constant ring is not available on this device!" );
+    
+    /* The automatic blocks must be rewritten if their bindings are replaced */
+    if( slot == KE_CB_SLOT_FRAME )
+        frame_constants_dirty = Yes;
+    if( slot == KE_CB_SLOT_DRAW )
+        draw_constants_dirty = Yes;
+    
+    return PVT_WriteConstantRing( slot, data, size );
+}
+
 
 /*
  * Name: IKeOpenGLRenderDevice::create_texture_1d
@@ -1754,7 +2934,7 @@ bool IKeOpenGLRenderDevice::CreateTexture1D( uint32_t target, int width, int mip
     OGL_DISPDBG_RB( KE_ERROR, "Error binding texture!" );
     
     /* Set the initial texture attributes */
-    glTexImage1D( t->target, 0, internal_texture_formats[format], width, mipmaps, texture_formats[format], data_types[data_type], pixels );
+    glTexImage1D( t->target, 0, internal_texture_formats[format], width, 0, texture_formats[format], data_types[data_type], pixels );
     OGL_DISPDBG_RB( KE_ERROR, "Error initializing texture attributes!" );
     
     /* Set texture parameters */
@@ -1769,7 +2949,9 @@ bool IKeOpenGLRenderDevice::CreateTexture1D( uint32_t target, int width, int mip
 
 /*
  * Name: IKeOpenGLRenderDevice::create_texture_2d
- * Desc: Creates a blank 2D texture.
+ * Desc: Creates a blank 2D texture.  mipmaps is the number of mip levels to allocate (0 or 1
+ *       for none, KE_MIPMAPS_FULL_CHAIN for all of them).  If pixels are supplied for an 8-bit
+ *       per component format, the rest of the mip chain is generated from them and uploaded.
  */
 bool IKeOpenGLRenderDevice::CreateTexture2D( uint32_t target, int width, int height, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels )
 {
@@ -1779,6 +2961,13 @@ bool IKeOpenGLRenderDevice::CreateTexture2D( uint32_t target, int width, int hei
     (*texture) = new IKeOpenGLTexture;
     IKeOpenGLTexture* t = static_cast<IKeOpenGLTexture*>( *texture );
     
+    /* Determine how many mip levels we need */
+    int full_chain = KeImageCalculateMipLevelCount( width, height );
+    if( mipmaps < 0 || mipmaps > full_chain )
+        mipmaps = full_chain;
+    if( mipmaps < 1 )
+        mipmaps = 1;
+    
     /* Set texture attributes */
     t->width = width;
     t->height = height;
@@ -1795,13 +2984,50 @@ bool IKeOpenGLRenderDevice::CreateTexture2D( uint32_t target, int width, int hei
     OGL_DISPDBG_RB( KE_ERROR, "Error binding texture!" );
     
     /* Set the initial texture attributes */
-    glTexImage2D( t->target, 0, internal_texture_formats[format], width, height, mipmaps, texture_formats[format], data_types[data_type], pixels );
+    glTexImage2D( t->target, 0, internal_texture_formats[format], width, height, 0, texture_formats[format], data_types[data_type], pixels );
     //glTexImage2D( GL_TEXTURE_2D, 0, GL_LUMINANCE, 1024, 1024, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels );
     OGL_DISPDBG_RB( KE_ERROR, "Error initializing texture attributes!" );
     
-    /* Set texture parameters */
-    glTexParameteri( t->target, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-    glTexParameteri( t->target, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    /* Allocate the remaining mip levels, generating their contents if we can */
+    int max_level = 0;
+    if( mipmaps > 1 )
+    {
+        KeImageMipChain chain;
+        bool generated = false;
+        
+        if( pixels && ( data_type == KE_UNSIGNED_BYTE || data_type == KE_BYTE ) )
+            generated = KeImageGenerateMipChain( pixels, width, height, format, mipmaps, &chain );
+        
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+        for( int i = 1; i < mipmaps; i++ )
+        {
+            int w = width >> i;
+            int h = height >> i;
+            
+            glTexImage2D( t->target, i, internal_texture_formats[format], w ? w : 1, h ? h : 1, 0, texture_formats[format], data_types[data_type], generated ? chain.levels[i] : NULL );
+        }
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+        OGL_DISPDBG( KE_ERROR, "Error initializing texture mip levels!" );
+        
+        if( generated )
+            KeImageCloseMipChain( &chain );
+        
+        /* Blank textures keep every level for the caller to fill in, but if the chain for the
+           given pixels couldn't be generated (only 8-bit data can be), levels 1+ are undefined,
+           so sampling is limited to the base level. */
+        max_level = mipmaps-1;
+        if( pixels && !generated )
+        {
+            DISPDBG( KE_WARNING, "Unable to generate mip levels for this data type; only the base level will be sampled." );
+            max_level = 0;
+        }
+        
+        glTexParameteri( t->target, GL_TEXTURE_MAX_LEVEL, max_level );
+    }
+    
+    /* Set texture parameters (filter across the mip chain if there is one) */
+    glTexParameteri( t->target, GL_TEXTURE_MIN_FILTER, max_level > 0 ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST );
+    glTexParameteri( t->target, GL_TEXTURE_MAG_FILTER, max_level > 0 ? GL_LINEAR : GL_NEAREST );
     
 #ifdef GL_ES_VERSION_2_0
     /* For OpenGL ES, textures need to have GL_CLAMP_TO_EDGE set if they are not power of two. 
@@ -1853,7 +3079,7 @@ bool IKeOpenGLRenderDevice::CreateTexture3D( uint32_t target, int width, int hei
     OGL_DISPDBG_RB( KE_ERROR, "Error binding texture!" );
     
     /* Set the initial texture attributes */
-    glTexImage3D( t->target, 0, internal_texture_formats[format], width, height, depth, mipmaps, texture_formats[format], data_types[data_type], pixels );
+    glTexImage3D( t->target, 0, internal_texture_formats[format], width, height, depth, 0, texture_formats[format], data_types[data_type], pixels );
     OGL_DISPDBG_RB( KE_ERROR, "Error initializing texture attributes!" );
     
     /* Set texture parameters */
@@ -1878,19 +3104,74 @@ bool IKeOpenGLRenderDevice::CreateTexture3D( uint32_t target, int width, int hei
     return true;
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::CreateCompressedTexture2D
+ * Desc: Creates a 2D texture from pre-compressed block data (BC, ETC2/EAC or ASTC).  The data
+ *       for every mip level is uploaded as is, finest level first, without any CPU decoding.
+ * NOTE: Check KeRenderDeviceCaps for the formats supported by the current driver.
+ */
+bool IKeOpenGLRenderDevice::CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture )
+{
+    GLenum error = glGetError();
+    
+    /* Sanity checks */
+    if( format < KE_TEXTUREFORMAT_BC1 || format > KE_TEXTUREFORMAT_ASTC_8x8 )
+        DISPDBG_RB( KE_ERROR, "Invalid compressed texture format (" << format << ")!" );
+    
+    if( !PVT_IsCompressedFormatSupported( format ) )
+        DISPDBG_RB( KE_ERROR, "Compressed texture format (" << format << ") is not supported by this device!" );
+    
+    if( !mip_data || !mip_sizes || mip_count < 1 )
+        DISPDBG_RB( KE_ERROR, "Invalid parameter(s)!" );
+    
+    /* Allocate a new texture */
+    (*texture) = new IKeOpenGLTexture;
+    IKeOpenGLTexture* t = static_cast<IKeOpenGLTexture*>( *texture );
+    
+    /* Set texture attributes */
+    t->width = width;
+    t->height = height;
+    t->depth = 0;
+    t->mipmap = mip_count;
+    t->target = texture_targets[target];
+    t->data_type = 0;
+    t->internal_format = compressed_texture_formats[format - KE_TEXTUREFORMAT_BC1];
+    t->depth_format = t->internal_format;
+    
+    /* Use OpenGL to create a new 2D texture */
+    glGenTextures( 1, &t->handle );
+    OGL_DISPDBG_RB( KE_ERROR, "Error generating texture!" );
+    glBindTexture( t->target, t->handle );
+    OGL_DISPDBG_RB( KE_ERROR, "Error binding texture!" );
+    
+    /* Upload each mip level's compressed blocks */
+    for( int i = 0; i < mip_count; i++ )
+    {
+        int w = width >> i;
+        int h = height >> i;
+        
+        glCompressedTexImage2D( t->target, i, t->internal_format, w ? w : 1, h ? h : 1, 0, mip_sizes[i], mip_data[i] );
+        OGL_DISPDBG_RB( KE_ERROR, "Error uploading compressed texture data (mip level " << i << ")!" );
+    }
+    
+    /* Set texture parameters */
+    glTexParameteri( t->target, GL_TEXTURE_MAX_LEVEL, mip_count-1 );
+    glTexParameteri( t->target, GL_TEXTURE_MIN_FILTER, mip_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+    glTexParameteri( t->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glBindTexture( t->target, 0 );
+    
+    return true;
+}
+
 /*
  * Name: IKeOpenGLRenderDevice::delete_texture
  * Desc: Deletes a texture from memory.
+ * NOTE: The texture is destroyed once every frame in flight that may reference it has completed.
  */
 void IKeOpenGLRenderDevice::DeleteTexture( IKeTexture* texture )
 {
-    IKeOpenGLTexture* t = static_cast<IKeOpenGLTexture*>( texture );
-    
     if( texture )
-    {
-        glDeleteTextures( 1, &t->handle );
-        delete texture;
-    }
+        DestroyDeferred( texture );
 }
 
 
@@ -1944,6 +3225,115 @@ void IKeOpenGLRenderDevice::SetTextureData3D( int offsetx, int offsety, int offs
     glBindTexture( t->target, 0 );
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::SetTextureData2DAsync
+ * Desc: Uploads 2D texture data through a ring of pixel unpack buffers so that the transfer
+ *       happens asynchronously instead of stalling the calling thread.  If the next staging
+ *       buffer is still in use by the GPU, nothing is uploaded and false is returned; try again
+ *       on a later frame.  If the region covers an entire mip level, the level is (re)defined,
+ *       which allows mip levels to be made resident one at a time.
+ * NOTE: Pixel data is expected to be tightly packed.
+ */
+bool IKeOpenGLRenderDevice::SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture )
+{
+    IKeOpenGLTexture* t = static_cast<IKeOpenGLTexture*>( texture );
+    KeOpenGLStagingBuffer* sb = &staging_buffers[next_staging_buffer];
+    GLenum error = glGetError();
+    
+    /* Sanity checks */
+    if( !t || !pixels )
+        DISPDBG_RB( KE_ERROR, "Invalid texture or pixel data!" );
+    
+    /* Is the GPU still reading from this staging buffer? */
+    if( sb->sync )
+    {
+        if( glClientWaitSync( sb->sync, 0, 0 ) == GL_TIMEOUT_EXPIRED )
+            return false;
+        
+        glDeleteSync( sb->sync );
+        sb->sync = NULL;
+    }
+    
+    uint32_t size = width * height * KeGetTexelSize( t->depth_format, t->data_type );
+    
+    /* Create or grow the staging buffer as necessary */
+    if( !sb->pbo )
+    {
+        glGenBuffers( 1, &sb->pbo );
+        OGL_DISPDBG_RB( KE_ERROR, "Error creating pixel unpack buffer!" );
+    }
+    
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, sb->pbo );
+    
+    if( size > sb->size )
+    {
+        glBufferData( GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW );
+        error = glGetError();
+        if( error )
+        {
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+            DISPDBG_RB( KE_ERROR, "Error allocating pixel unpack buffer!\nError code: (" << error << ")" );
+        }
+        sb->size = size;
+    }
+    
+    /* Copy the pixels into the staging buffer; the fence guarantees that it is no longer in use */
+    void* ptr = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+    if( !ptr )
+    {
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+        DISPDBG_RB( KE_ERROR, "Error mapping pixel unpack buffer!" );
+    }
+    
+    memmove( ptr, pixels, size );
+    glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+    
+    /* Start the transfer from the staging buffer to the texture */
+    int level_width = t->width >> miplevel;
+    int level_height = t->height >> miplevel;
+    if( !level_width ) level_width = 1;
+    if( !level_height ) level_height = 1;
+    
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glBindTexture( t->target, t->handle );
+    
+    if( offsetx == 0 && offsety == 0 && width == level_width && height == level_height )
+        glTexImage2D( t->target, miplevel, t->internal_format, width, height, 0, t->depth_format, t->data_type, BUFFER_OFFSET(0) );
+    else
+        glTexSubImage2D( t->target, miplevel, offsetx, offsety, width, height, t->depth_format, t->data_type, BUFFER_OFFSET(0) );
+    OGL_DISPDBG( KE_ERROR, "Error setting texture data asynchronously!" );
+    
+    glBindTexture( t->target, 0 );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    
+    /* Fence this staging buffer and move on to the next one */
+    sb->sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+    next_staging_buffer = ( next_staging_buffer + 1 ) % KE_MAX_STAGING_BUFFERS;
+    
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::SetTextureMipRange
+ * Desc: Limits sampling of a texture to the given range of mipmap levels.  Used to restrict
+ *       a texture to the levels that are currently resident while the rest are streamed in.
+ */
+void IKeOpenGLRenderDevice::SetTextureMipRange( IKeTexture* texture, int base_level, int max_level )
+{
+    IKeOpenGLTexture* t = static_cast<IKeOpenGLTexture*>( texture );
+    GLenum error = glGetError();
+    
+    if( !t )
+        return;
+    
+    glBindTexture( t->target, t->handle );
+    glTexParameteri( t->target, GL_TEXTURE_BASE_LEVEL, base_level );
+    glTexParameteri( t->target, GL_TEXTURE_MAX_LEVEL, max_level );
+    OGL_DISPDBG( KE_ERROR, "Error setting texture mip range!" );
+    glBindTexture( t->target, 0 );
+}
+
 /*
  * Name: IKeOpenGLRenderDevice::create_render_target
  * Desc: Creates a seperate render target (FBO), typically used for rendering to a texture.
@@ -1985,8 +3375,8 @@ bool IKeOpenGLRenderDevice::CreateRenderTarget( int width, int height, int depth
 		return 0;
 	}
 
-	/* Unbind the fbo */
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	/* Put the previously bound fbo back */
+	glBindFramebuffer( GL_FRAMEBUFFER, bound_fbo );
 #else
     /* Generate frame buffer object */
     glGenFramebuffers( 1, &rt->frame_buffer_object );
@@ -2040,7 +3430,9 @@ void IKeOpenGLRenderDevice::DeleteRenderTarget( IKeRenderTarget* rendertarget )
     /* Delete the texture */
     this->DeleteTexture( static_cast<IKeOpenGLTexture*>( rt->texture ) );
     
-    /* Delete the render target */
+    /* Delete the render target (deleting the bound fbo reverts to the default framebuffer) */
+    if( rt->fbo == bound_fbo )
+        bound_fbo = 0;
     glDeleteRenderbuffers( 1, &rt->depth_buffer );
     glDeleteFramebuffers( 1, &rt->fbo );
 
@@ -2051,11 +3443,16 @@ void IKeOpenGLRenderDevice::DeleteRenderTarget( IKeRenderTarget* rendertarget )
  * Name: IKeOpenGLRenderDevice::bind_render_target
  * Desc: Binds the render target to OpenGL.  You set the texture to the appropriate  texture
  *       stage yourself using ::set_texture().
+ * NOTE: Binding the render target that is already bound is skipped.
  */
 void IKeOpenGLRenderDevice::BindRenderTarget( IKeRenderTarget* rendertarget )
 {
     GLenum error = glGetError();
     IKeOpenGLRenderTarget* rt = static_cast<IKeOpenGLRenderTarget*>( rendertarget );
+    uint32_t fbo = rt ? rt->fbo : 0;
+    
+    if( fbo == bound_fbo )
+        return;
     
     /* Bind the FBO */
 	if( rt )
@@ -2063,10 +3460,12 @@ void IKeOpenGLRenderDevice::BindRenderTarget( IKeRenderTarget* rendertarget )
 		glBindFramebuffer( GL_FRAMEBUFFER, rt->fbo );
 		error = glGetError();
 		if( error != GL_NO_ERROR )
-			DISPDBG( 1, "Error binding rendertarget! (error=0x" << error << ")\n" );
+			DISPDBG_R( 1, "Error binding rendertarget! (error=0x" << error << ")\n" );
 	}
 	else
 		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+    
+    bound_fbo = fbo;
 }
 
 /*
@@ -2152,6 +3551,9 @@ bool IKeOpenGLRenderDevice::CreateTextureSamplerBuffer( KeState* state_params, i
 	memmove( sb->states, state_params, sizeof( KeState ) * state_count );
 	sb->state_count = state_count;
 
+	/* Where supported, the states are compiled into a (shared) sampler object up front */
+	sb->sampler = device_caps->sampler_objects_supported ? PVT_GetSamplerObject( state_params, state_count ) : 0;
+
 	return true;
 }
 
@@ -2182,10 +3584,12 @@ bool IKeOpenGLRenderDevice::SetRenderStateBuffer( IKeRenderStateBuffer* state_bu
                 break;
                 
             case KE_RS_DEPTHMASK:
-                if( sb->states[i].param1 )
-                    glEnable( GL_DEPTH_WRITEMASK );
-                else
-                    glDisable( GL_DEPTH_WRITEMASK );
+                glDepthMask( sb->states[i].param1 ? GL_TRUE : GL_FALSE );
+                break;
+                
+            case KE_RS_COLOURMASK:
+                glColorMask( sb->states[i].param1 ? GL_TRUE : GL_FALSE, sb->states[i].param1 ? GL_TRUE : GL_FALSE,
+                             sb->states[i].param1 ? GL_TRUE : GL_FALSE, sb->states[i].param1 ? GL_TRUE : GL_FALSE );
                 break;
                 
             /*case KE_RS_CLEARDEPTH:
@@ -2279,6 +3683,13 @@ bool IKeOpenGLRenderDevice::SetTextureSamplerBuffer( int stage, IKeTextureSample
 #else
 	KeState empty = { static_cast<uint32_t>(-1), 0, 0, 0, 0, 0 };
 
+	/* Select the sampler object; it is bound at the next draw if it changed */
+	if( device_caps->sampler_objects_supported )
+	{
+		stage_samplers[stage] = sb->sampler;
+		return true;
+	}
+
 	/* Copy this sampler state to the texture unit slot */
 	memcpy( &samplers[stage], sb->states, sizeof( KeState ) * sb->state_count );
 	memcpy( &samplers[stage][sb->state_count], &empty, sizeof( KeState ) );
@@ -2313,10 +3724,12 @@ void IKeOpenGLRenderDevice::SetRenderStates( KeState* states )
                 break;
                 
             case KE_RS_DEPTHMASK:
-                if( states[i].param1 )
-                    glEnable( GL_DEPTH_WRITEMASK );
-                else
-                    glDisable( GL_DEPTH_WRITEMASK );
+                glDepthMask( states[i].param1 ? GL_TRUE : GL_FALSE );
+                break;
+                
+            case KE_RS_COLOURMASK:
+                glColorMask( states[i].param1 ? GL_TRUE : GL_FALSE, states[i].param1 ? GL_TRUE : GL_FALSE,
+                             states[i].param1 ? GL_TRUE : GL_FALSE, states[i].param1 ? GL_TRUE : GL_FALSE );
                 break;
                 
             /*case KE_RS_CLEARDEPTH:
@@ -2410,6 +3823,15 @@ void IKeOpenGLRenderDevice::SetSamplerStates( int stage, KeState* states )
 	/* Restore the previous texture unit */
 	glGetIntegerv( GL_ACTIVE_TEXTURE, &previous_texture_unit );
 #else
+	if( device_caps->sampler_objects_supported )
+	{
+		while( states[i].state != (uint32_t) -1 )
+			i++;
+		
+		stage_samplers[stage] = PVT_GetSamplerObject( states, i );
+		return;
+	}
+
 	while( states[i].state != -1 )
 	{
 		memmove( &samplers[stage][i], &states[i], sizeof( KeState ) );
@@ -2425,6 +3847,10 @@ void IKeOpenGLRenderDevice::SetSamplerStates( int stage, KeState* states )
  */
 void IKeOpenGLRenderDevice::DrawVerticesIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int first, int count, void* vertex_data )
 {
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGpuProgram* gp = static_cast<IKeOpenGLGpuProgram*>( current_gpu_program );
     IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
     GLenum error = glGetError();
@@ -2495,6 +3921,10 @@ void IKeOpenGLRenderDevice::DrawVerticesIM( uint32_t primtype, uint32_t stride,
  */
 void IKeOpenGLRenderDevice::DrawIndexedVerticesIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int count, void* vertex_data, void* index_data )
 {
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
     GLenum error = glGetError();
     
@@ -2553,6 +3983,10 @@ void IKeOpenGLRenderDevice::DrawIndexedVerticesIM( uint32_t primtype, uint32_t s
  */
 void IKeOpenGLRenderDevice::DrawIndexedVerticesRangeIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int start, int end, int count, void* vertex_data, void* index_data )
 {
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
     GLenum error = glGetError();
     
@@ -2612,6 +4046,10 @@ void IKeOpenGLRenderDevice::DrawIndexedVerticesRangeIM( uint32_t primtype, uint3
  */
 void IKeOpenGLRenderDevice::DrawVertices( uint32_t primtype, uint32_t stride, int first, int count )
 {
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
     GLenum error = glGetError();
    
@@ -2627,16 +4065,84 @@ void IKeOpenGLRenderDevice::DrawVertices( uint32_t primtype, uint32_t stride, in
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
     
     /* Draw the vertices */
-    glDrawArrays( primitive_types[primtype], first, count );
-    OGL_DISPDBG_R( KE_ERROR, "Vertex buffer rendering error (glDrawArrays)!" );
+    glDrawArrays( primitive_types[primtype], first, count );
+    OGL_DISPDBG_R( KE_ERROR, "Vertex buffer rendering error (glDrawArrays)!" );
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::draw_indexed_vertices
+ * Desc: Draws vertices from the current vertex and index buffer.
+ */
+void IKeOpenGLRenderDevice::DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count )
+{
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
+    IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
+    GLenum error = glGetError();
+    
+    /* Apply sampler states */
+    PVT_ApplySamplerStates();
+    
+    /* Assuming there is already a GPU program bound, attempt to set the current matrices */
+    PVT_SetWorldViewProjectionMatrices();
+    
+    /* Bind the vertex and index buffer objects */
+    glBindBuffer( GL_ARRAY_BUFFER, gb->vbo[0] );
+	OGL_DISPDBG_R( KE_ERROR, "Error binding vertex buffer!" );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, gb->vbo[1] );
+    OGL_DISPDBG_R( KE_ERROR, "Error binding index buffer!" );
+   
+    /* Draw the vertices */
+    glDrawElements( primitive_types[primtype], count, data_types[gb->index_type], NULL );
+    OGL_DISPDBG_R( KE_ERROR, "Indexed geometry rendering error (glDrawElements)!" );
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::draw_indexed_vertices_range
+ * Desc: Same as above, but allows the user to specify the start/end vertex.
+ */
+void IKeOpenGLRenderDevice::DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count )
+{
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
+    IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
+    GLenum error = glGetError();
+   
+    /* Apply sampler states */
+    PVT_ApplySamplerStates();
+    
+    /* Assuming there is already a GPU program bound, attempt to set the current matrices */
+    PVT_SetWorldViewProjectionMatrices();
+    
+    /* Bind the vertex buffer object, but not the index buffer object */
+    glBindBuffer( GL_ARRAY_BUFFER, gb->vbo[0] );
+	OGL_DISPDBG_R( KE_ERROR, "Error binding vertex buffer!" );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, gb->vbo[1] );
+    OGL_DISPDBG_R( KE_ERROR, "Error binding index buffer!" );
+    
+    /* Draw the vertices */
+    glDrawRangeElements( primitive_types[primtype], start, end, count, data_types[gb->index_type], NULL );
+    OGL_DISPDBG_R( KE_ERROR, "Indexed geometry rendering error (glDrawRangeElements)!" );
 }
 
 /*
- * Name: IKeOpenGLRenderDevice::draw_indexed_vertices
- * Desc: Draws vertices from the current vertex and index buffer.
+ * Name: IKeOpenGLRenderDevice::DrawIndexedVerticesBaseVertex
+ * Desc: Draws a range of indices from the current geometry buffer, adding base_vertex to each
+ *       index before fetching vertices.  This allows many meshes to share the same buffers
+ *       while keeping their index data relative to their own first vertex.
+ * NOTE: OpenGL ES 3.0 has no base vertex support, so base_vertex must be 0 there (see the
+ *       base_vertex_supported device cap).
  */
-void IKeOpenGLRenderDevice::DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count )
+void IKeOpenGLRenderDevice::DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex )
 {
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
     GLenum error = glGetError();
     
@@ -2651,36 +4157,246 @@ void IKeOpenGLRenderDevice::DrawIndexedVertices( uint32_t primtype, uint32_t str
 	OGL_DISPDBG_R( KE_ERROR, "Error binding vertex buffer!" );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, gb->vbo[1] );
     OGL_DISPDBG_R( KE_ERROR, "Error binding index buffer!" );
-   
+    
+    void* indices = BUFFER_OFFSET( data_type_sizes[gb->index_type] * first_index );
+    
     /* Draw the vertices */
-    glDrawElements( primitive_types[primtype], count, data_types[gb->index_type], NULL );
+#ifndef __MOBILE_OS__
+    glDrawElementsBaseVertex( primitive_types[primtype], count, data_types[gb->index_type], indices, base_vertex );
+    OGL_DISPDBG_R( KE_ERROR, "Indexed geometry rendering error (glDrawElementsBaseVertex)!" );
+#else
+    if( base_vertex )
+        DISPDBG_R( KE_ERROR, "Base vertex is not supported on this device!" );
+    
+    glDrawElements( primitive_types[primtype], count, data_types[gb->index_type], indices );
     OGL_DISPDBG_R( KE_ERROR, "Indexed geometry rendering error (glDrawElements)!" );
+#endif
 }
 
 /*
- * Name: IKeOpenGLRenderDevice::draw_indexed_vertices_range
- * Desc: Same as above, but allows the user to specify the start/end vertex.
+ * Name: IKeOpenGLRenderDevice::CreateIndirectBuffer
+ * Desc: Creates a buffer of indexed draw commands to be used with DrawIndexedVerticesIndirect.
+ *       When multi-draw indirect is supported, the commands are stored in a GPU side draw
+ *       indirect buffer, otherwise only a system memory copy is kept for the CPU fallback.
+ * NOTE: Each command's base_instance is used as its draw ID, which the GPU program receives
+ *       through the "in_drawid" attribute (KE_VA_DRAWID).  Use it to index per-draw data
+ *       (world matrices, material parameters, etc.) from a shared constant buffer.
  */
-void IKeOpenGLRenderDevice::DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count )
+bool IKeOpenGLRenderDevice::CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer )
+{
+    GLenum error = glGetError();
+    
+    /* Sanity checks */
+    if( !indirect_buffer )
+        DISPDBG_RB( KE_ERROR, "Invalid interface pointer!" );
+    if( !command_count )
+        DISPDBG_RB( KE_ERROR, "(command_count == 0) condition is not allowed..." );
+    
+    *indirect_buffer = new IKeOpenGLIndirectBuffer;
+    IKeOpenGLIndirectBuffer* ib = static_cast<IKeOpenGLIndirectBuffer*>( *indirect_buffer );
+    
+    ib->dibo = 0;
+    ib->max_draw_id = 0;
+    ib->command_count = command_count;
+    ib->commands = new KeDrawIndexedIndirectCommand[command_count];
+    ZeroMemory( ib->commands, sizeof( KeDrawIndexedIndirectCommand ) * command_count );
+    
+#ifndef __APPLE__
+    /* Create the draw indirect buffer object */
+    if( device_caps->multi_draw_indirect_supported )
+    {
+        glGenBuffers( 1, &ib->dibo );
+        OGL_DISPDBG( KE_ERROR, "Error generating draw indirect buffer object!" );
+        if( error )
+        {
+            ib->Destroy();
+            *indirect_buffer = NULL;
+            return false;
+        }
+        
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, ib->dibo );
+        glBufferData( GL_DRAW_INDIRECT_BUFFER, sizeof( KeDrawIndexedIndirectCommand ) * command_count, NULL, buffer_usage_types[flags] );
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+        OGL_DISPDBG( KE_ERROR, "Error allocating draw indirect buffer data!" );
+    }
+#endif
+    
+    /* Set the initial draw commands, if any */
+    if( commands )
+        return ib->SetCommands( 0, command_count, commands );
+    
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::DeleteIndirectBuffer
+ * Desc: Deletes an indirect draw buffer.
+ */
+void IKeOpenGLRenderDevice::DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer )
+{
+    if( indirect_buffer )
+        DestroyDeferred( indirect_buffer );
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::DrawIndexedVerticesIndirect
+ * Desc: Draws a range of commands from an indirect draw buffer using the current geometry
+ *       buffer.  Uses a single glMultiDrawElementsIndirect call where supported, otherwise
+ *       falls back to issuing each command from the CPU.  In both cases, each draw's ID is
+ *       taken from the command's base_instance and fed through the KE_VA_DRAWID attribute.
+ * NOTE: The world matrix is not changed per draw; read it from the per-draw data instead.
+ */
+void IKeOpenGLRenderDevice::DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count )
 {
+    /* Skip this draw if the current program is still being built */
+    if( !program_ready )
+        return;
+    
     IKeOpenGLGeometryBuffer* gb = static_cast<IKeOpenGLGeometryBuffer*>( current_geometrybuffer );
+    IKeOpenGLIndirectBuffer* ib = static_cast<IKeOpenGLIndirectBuffer*>( indirect_buffer );
     GLenum error = glGetError();
-   
+    
+    /* Sanity checks */
+    if( !gb || !ib )
+        DISPDBG_R( KE_ERROR, "No geometry or indirect buffer set!" );
+    if( first + count > ib->command_count )
+        DISPDBG_R( KE_ERROR, "Draw command range exceeds the size of the indirect buffer!" );
+    
+    /* Make sure our draw ID buffer covers every draw ID referenced */
+    if( !PVT_ReserveDrawIds( ib->max_draw_id ) )
+        return;
+    
     /* Apply sampler states */
     PVT_ApplySamplerStates();
     
     /* Assuming there is already a GPU program bound, attempt to set the current matrices */
     PVT_SetWorldViewProjectionMatrices();
     
-    /* Bind the vertex buffer object, but not the index buffer object */
+    /* Bind the vertex and index buffer objects */
     glBindBuffer( GL_ARRAY_BUFFER, gb->vbo[0] );
 	OGL_DISPDBG_R( KE_ERROR, "Error binding vertex buffer!" );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, gb->vbo[1] );
     OGL_DISPDBG_R( KE_ERROR, "Error binding index buffer!" );
     
-    /* Draw the vertices */
-    glDrawRangeElements( primitive_types[primtype], start, end, count, data_types[gb->index_type], NULL );
-    OGL_DISPDBG_R( KE_ERROR, "Indexed geometry rendering error (glDrawRangeElements)!" );
+    /* Feed draw IDs as a per-instance attribute */
+    glBindBuffer( GL_ARRAY_BUFFER, drawid_vbo );
+    glVertexAttribIPointer( KE_VA_DRAWID, 1, GL_UNSIGNED_INT, 0, BUFFER_OFFSET(0) );
+    glVertexAttribDivisor( KE_VA_DRAWID, 1 );
+    glEnableVertexAttribArray( KE_VA_DRAWID );
+    
+    uint32_t index_type = data_types[gb->index_type];
+    uint32_t index_size = data_type_sizes[gb->index_type];
+    
+#ifndef __APPLE__
+    if( ib->dibo )
+    {
+        /* Submit every draw in one call; the base instance selects each draw's ID */
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, ib->dibo );
+        glMultiDrawElementsIndirect( primitive_types[primtype], index_type,
+                                    BUFFER_OFFSET( sizeof( KeDrawIndexedIndirectCommand ) * first ),
+                                    count, sizeof( KeDrawIndexedIndirectCommand ) );
+        OGL_DISPDBG( KE_ERROR, "Indirect geometry rendering error (glMultiDrawElementsIndirect)!" );
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+    }
+    else
+#endif
+    {
+        /* CPU fallback: without base instance support, offset the draw ID attribute instead */
+        for( uint32_t i = first; i < first + count; i++ )
+        {
+            KeDrawIndexedIndirectCommand* cmd = &ib->commands[i];
+            
+            if( !cmd->count || !cmd->instance_count )
+                continue;
+            
+            glVertexAttribIPointer( KE_VA_DRAWID, 1, GL_UNSIGNED_INT, 0, BUFFER_OFFSET( sizeof( uint32_t ) * cmd->base_instance ) );
+#ifndef __MOBILE_OS__
+            glDrawElementsInstancedBaseVertex( primitive_types[primtype], cmd->count, index_type,
+                                              BUFFER_OFFSET( index_size * cmd->first_index ), cmd->instance_count, cmd->base_vertex );
+#else
+            /* No base vertex on OpenGL ES 3.0, so indices must already be absolute */
+            glDrawElementsInstanced( primitive_types[primtype], cmd->count, index_type,
+                                    BUFFER_OFFSET( index_size * cmd->first_index ), cmd->instance_count );
+#endif
+        }
+        OGL_DISPDBG( KE_ERROR, "Indirect geometry rendering error (CPU fallback)!" );
+    }
+    
+    /* Disable the draw ID attribute so it doesn't leak into regular draws */
+    glDisableVertexAttribArray( KE_VA_DRAWID );
+    glBindBuffer( GL_ARRAY_BUFFER, gb->vbo[0] );
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::CreateOcclusionQuery
+ * Desc: Creates an occlusion query.  KE_QUERY_ANY_SAMPLES uses GL_ANY_SAMPLES_PASSED where
+ *       supported, which lets the GPU stop counting at the first sample; otherwise it falls
+ *       back to GL_SAMPLES_PASSED (any non-zero count means visible).
+ */
+bool IKeOpenGLRenderDevice::CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query )
+{
+    GLenum error = glGetError();
+    
+    /* Sanity checks */
+    if( !query )
+        return false;
+    if( !device_caps->occlusion_query_supported )
+        DISPDBG_RB( KE_ERROR, "Occlusion queries are not supported!" );
+    
+    (*query) = new IKeOpenGLOcclusionQuery();
+    IKeOpenGLOcclusionQuery* q = static_cast<IKeOpenGLOcclusionQuery*>( *query );
+    
+#ifdef __MOBILE_OS__
+    /* OpenGL ES only has boolean queries */
+    q->target = GL_ANY_SAMPLES_PASSED;
+#else
+    q->target = ( type == KE_QUERY_ANY_SAMPLES && device_caps->any_samples_query_supported ) ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED;
+#endif
+    
+    glGenQueries( 1, &q->query );
+    OGL_DISPDBG( KE_ERROR, "Error creating occlusion query!" );
+    if( error )
+    {
+        q->query = 0;
+        q->Destroy();
+        *query = NULL;
+        return false;
+    }
+    
+    return true;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::BeginConditionalRender
+ * Desc: Discards the following draws if the given query found no samples visible.  The GPU
+ *       evaluates the query itself, so the CPU never waits for the result.  If wait is No,
+ *       the GPU may draw anyway instead of waiting for an unfinished query.
+ * NOTE: Without conditional rendering, this does nothing and everything is drawn.
+ */
+void IKeOpenGLRenderDevice::BeginConditionalRender( IKeOcclusionQuery* query, int wait )
+{
+    IKeOpenGLOcclusionQuery* q = static_cast<IKeOpenGLOcclusionQuery*>( query );
+    
+    if( !q || !device_caps->conditional_render_supported )
+        return;
+    
+#ifndef __MOBILE_OS__
+    glBeginConditionalRender( q->query, wait ? GL_QUERY_WAIT : GL_QUERY_NO_WAIT );
+#endif
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::EndConditionalRender
+ * Desc: Ends the conditional rendering started with BeginConditionalRender.
+ */
+void IKeOpenGLRenderDevice::EndConditionalRender()
+{
+    if( !device_caps->conditional_render_supported )
+        return;
+    
+#ifndef __MOBILE_OS__
+    glEndConditionalRender();
+#endif
 }
 
 /*
@@ -2706,6 +4422,187 @@ bool IKeOpenGLRenderDevice::GetFramebufferRegion( int x, int y, int width, int h
     return true;
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::RequestFramebufferRegion
+ * Desc: Starts reading a region of the current framebuffer into one of the pixel pack buffers
+ *       without waiting for the GPU.  Returns a ticket to pass to ReadFramebufferRegion, or 0
+ *       if every readback buffer is still busy (try again on a later frame).
+ * NOTE: flags selects the buffer to read from: KE_COLOUR_BUFFER (32-bit RGBA) or
+ *       KE_DEPTH_BUFFER (32-bit float).
+ */
+uint32_t IKeOpenGLRenderDevice::RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags )
+{
+    KeOpenGLReadbackBuffer* rb = NULL;
+    GLenum error = glGetError();
+    
+    /* Sanity checks */
+    if( width < 1 || height < 1 )
+    {
+        DISPDBG( KE_ERROR, "Invalid framebuffer region!" );
+        return 0;
+    }
+    
+    GLenum format, type;
+    if( flags & KE_COLOUR_BUFFER )
+    {
+        format = GL_RGBA;
+        type = GL_UNSIGNED_BYTE;
+    }
+    else if( flags & KE_DEPTH_BUFFER )
+    {
+        format = GL_DEPTH_COMPONENT;
+        type = GL_FLOAT;
+    }
+    else
+    {
+        DISPDBG( KE_ERROR, "Only colour and depth buffers can be read back!" );
+        return 0;
+    }
+    
+    /* Find a buffer that isn't servicing a request */
+    for( int i = 0; i < KE_MAX_READBACK_BUFFERS && !rb; i++ )
+    {
+        if( !readback_buffers[i].ticket )
+            rb = &readback_buffers[i];
+    }
+    
+    if( !rb )
+    {
+        DISPDBG( KE_DBGLVL(3), "All readback buffers are busy..." );
+        return 0;
+    }
+    
+    uint32_t size = width * height * 4;
+    
+    /* Create or grow the pixel pack buffer as necessary */
+    if( !rb->pbo )
+    {
+        glGenBuffers( 1, &rb->pbo );
+        error = glGetError();
+        if( error )
+        {
+            DISPDBG( KE_ERROR, "Error creating pixel pack buffer!\nError code: (" << error << ")" );
+            return 0;
+        }
+    }
+    
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, rb->pbo );
+    
+    if( size > rb->size )
+    {
+        glBufferData( GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ );
+        error = glGetError();
+        if( error )
+        {
+            glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+            DISPDBG( KE_ERROR, "Error allocating pixel pack buffer!\nError code: (" << error << ")" );
+            return 0;
+        }
+        rb->size = size;
+    }
+    
+    /* Queue the read; with a pack buffer bound, glReadPixels returns without waiting */
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    glReadPixels( x, y, width, height, format, type, BUFFER_OFFSET(0) );
+    error = glGetError();
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    
+    if( error )
+    {
+        DISPDBG( KE_ERROR, "Error reading framebuffer region!\nError code: (" << error << ")" );
+        return 0;
+    }
+    
+    rb->sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+    rb->bpp = 32;
+    rb->data_size = size;
+    rb->ticket = next_readback_ticket++;
+    if( !next_readback_ticket )
+        next_readback_ticket = 1;
+    
+    return rb->ticket;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::ReadFramebufferRegion
+ * Desc: Checks whether a framebuffer read requested with RequestFramebufferRegion is finished.
+ *       Once it is, KE_READBACK_READY is returned and pixels points to a buffer owned by the
+ *       device, which stays valid until ReleaseFramebufferRegion is called with the ticket.
+ *       If wait is set, blocks until the read is complete.
+ */
+int IKeOpenGLRenderDevice::ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels )
+{
+    if( !ticket )
+        return KE_READBACK_FAILED;
+    
+    /* Already copied out of its pack buffer? */
+    for( size_t i = 0; i < readback_results.size(); i++ )
+    {
+        if( readback_results[i].ticket == ticket )
+        {
+            if( bpp ) *bpp = readback_results[i].bpp;
+            if( pixels ) *pixels = readback_results[i].pixels;
+            
+            return KE_READBACK_READY;
+        }
+    }
+    
+    for( int i = 0; i < KE_MAX_READBACK_BUFFERS; i++ )
+    {
+        if( readback_buffers[i].ticket != ticket )
+            continue;
+        
+        KeOpenGLReadbackBuffer* rb = &readback_buffers[i];
+        
+        if( !PVT_ResolveReadback( rb, wait ) )
+            return KE_READBACK_PENDING;
+        
+        /* The pixels are now in the most recent result */
+        if( bpp ) *bpp = readback_results.back().bpp;
+        if( pixels ) *pixels = readback_results.back().pixels;
+        
+        return KE_READBACK_READY;
+    }
+    
+    return KE_READBACK_FAILED;
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::ReleaseFramebufferRegion
+ * Desc: Returns a readback's pixel buffer to the pool.  Pending requests are cancelled.
+ */
+void IKeOpenGLRenderDevice::ReleaseFramebufferRegion( uint32_t ticket )
+{
+    if( !ticket )
+        return;
+    
+    for( size_t i = 0; i < readback_results.size(); i++ )
+    {
+        if( readback_results[i].ticket == ticket )
+        {
+            /* Keep a few buffers around so that regular screenshots don't reallocate */
+            if( readback_pool.size() < KE_MAX_READBACK_BUFFERS )
+                readback_pool.push_back( readback_results[i] );
+            else
+                delete[] readback_results[i].pixels;
+            
+            readback_results.erase( readback_results.begin() + i );
+            return;
+        }
+    }
+    
+    for( int i = 0; i < KE_MAX_READBACK_BUFFERS; i++ )
+    {
+        if( readback_buffers[i].ticket == ticket )
+        {
+            if( readback_buffers[i].sync )
+                glDeleteSync( readback_buffers[i].sync );
+            readback_buffers[i].sync = NULL;
+            readback_buffers[i].ticket = 0;
+        }
+    }
+}
+
 /*
  * Name: IKeOpenGLRenderDevice::set_viewport
  * Desc: Sets the viewport.
@@ -2769,28 +4666,37 @@ void IKeOpenGLRenderDevice::SetPerspectiveMatrix( float fov, float aspect, float
     /* Set up projection matrix using the perspective method */
 //    projection_matrix = M4MakePerspective( fov, aspect, near_z, far_z );
     nv::perspective( projection_matrix, fov, aspect, near_z, far_z );
+    PVT_MatrixChanged( KE_MATRIX_PROJECTION );
 }
 
 
 /*
  * Name: IKeOpenGLRenderDevice::set_view_matrix
- * Desc:
+ * Desc: Sets the view matrix.  Setting the same matrix again is ignored.
  */
 void IKeOpenGLRenderDevice::SetViewMatrix( const nv::matrix4f* view )
 {
+    if( !memcmp( view_matrix._array, view->_array, sizeof( float ) * 16 ) )
+        return;
+    
     /* Copy over the incoming view matrix */
     memmove( view_matrix._array, view->_array, sizeof( float ) * 16 );
+    PVT_MatrixChanged( KE_MATRIX_VIEW );
 }
 
 
 /*
  * Name: IKeOpenGLRenderDevice::set_world_matrix
- * Desc:
+ * Desc: Sets the world matrix.  Setting the same matrix again is ignored.
  */
 void IKeOpenGLRenderDevice::SetWorldMatrix( const nv::matrix4f* world )
 {
+    if( !memcmp( world_matrix._array, world->_array, sizeof( float ) * 16 ) )
+        return;
+    
     /* Copy over the incoming world matrix */
     memmove( world_matrix._array, world->_array, sizeof( float ) * 16 );
+    PVT_MatrixChanged( KE_MATRIX_WORLD );
 }
 
 
@@ -2807,12 +4713,16 @@ void IKeOpenGLRenderDevice::SetModelviewMatrix( const nv::matrix4f* modelview )
 
 /*
  * Name: IKeOpenGLRenderDevice::set_projection_matrix
- * Desc:
+ * Desc: Sets the projection matrix.  Setting the same matrix again is ignored.
  */
 void IKeOpenGLRenderDevice::SetProjectionMatrix( const nv::matrix4f* projection )
 {
+    if( !memcmp( projection_matrix._array, projection->_array, sizeof( float ) * 16 ) )
+        return;
+    
     /* Copy over the incoming projection matrix */
     memmove( projection_matrix._array, projection->_array, sizeof( float ) * 16 );
+    PVT_MatrixChanged( KE_MATRIX_PROJECTION );
 }
 
 /*
@@ -2858,6 +4768,40 @@ void IKeOpenGLRenderDevice::GetProjectionMatrix( nv::matrix4f* projection )
     memmove( projection->_array, projection_matrix._array, sizeof( float ) * 16 );
 }
 
+/*
+ * Name: IKeOpenGLRenderDevice::SetWorldMatrixBatch
+ * Desc: Writes up to KE_MAX_BATCHED_WORLD_MATRICES world matrices into this frame's region of
+ *       the constant ring and binds them as the "KeObjectConstants" block.  Programs pick their
+ *       matrix with the draw ID, so many objects can be drawn without setting a world matrix
+ *       for each one.
+ * NOTE: Like SetTransientConstants, the batch is only valid until the end of the frame.
+ */
+bool IKeOpenGLRenderDevice::SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count )
+{
+    if( !world || !count )
+        return false;
+    
+    if( count > KE_MAX_BATCHED_WORLD_MATRICES )
+        DISPDBG_RB( KE_ERROR, "Too many world matrices in one batch (" << count << ", the limit is " << KE_MAX_BATCHED_WORLD_MATRICES << ")!" );
+    
+    if( !constant_ring.ubo )
+        DISPDBG_RB( KE_ERROR, "The constant ring is not available on this device!" );
+    
+    /* The block is declared at its full size, so bind that much even if fewer are used */
+    return PVT_WriteConstantRing( KE_CB_SLOT_OBJECTS, (void*) world, sizeof( nv::matrix4f ) * count, sizeof( KeObjectConstants ) );
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::SetDrawIndex
+ * Desc: Sets the draw ID (KE_VA_DRAWID) seen by the following non-indirect draws, normally to
+ *       select a matrix from the batch set with SetWorldMatrixBatch.
+ * NOTE: Indirect draws supply their own draw IDs (see DrawIndexedVerticesIndirect).
+ */
+void IKeOpenGLRenderDevice::SetDrawIndex( uint32_t index )
+{
+    glVertexAttribI4ui( KE_VA_DRAWID, index, 0, 0, 0 );
+}
+
 
 /*
  * Name: IKeOpenGLRenderDevice::block_until_vertical_blank
@@ -2948,12 +4892,103 @@ bool IKeOpenGLRenderDevice::CreateFence( IKeFence** fence, uint32_t flags )
     if( !KeOpenGLCreateFence[f->vendor]( &f ) )
     {
         f->Destroy();
+        (*fence) = NULL;
         return false;
     }
     
     return true;
 }
 
+
+/*
+ * Name: IKeOpenGLRenderDevice::SetMaxFrameLatency
+ * Desc: Sets the number of frames the CPU may queue ahead of the GPU (1 to KE_MAX_FRAMES_IN_FLIGHT).
+ * NOTE: Changing the latency drains every frame in flight first, since the slots are remapped.
+ */
+void IKeOpenGLRenderDevice::SetMaxFrameLatency( int latency )
+{
+    if( latency < 1 || latency > KE_MAX_FRAMES_IN_FLIGHT )
+    {
+        DISPDBG( KE_WARNING, "Invalid frame latency (" << latency << ")!" );
+        return;
+    }
+    
+    if( latency == max_frame_latency )
+        return;
+    
+    /* Deletions queued during the current frame are moved to the slot it will map to */
+    KeOpenGLFrame* current = &frames[frame_count % max_frame_latency];
+    std::vector<IKeUnknown*> deletions;
+    deletions.swap( current->deletions );
+    
+    for( int i = 0; i < KE_MAX_FRAMES_IN_FLIGHT; i++ )
+        PVT_RetireFrame( &frames[i], Yes );
+    
+    max_frame_latency = latency;
+    frames[frame_count % max_frame_latency].deletions.swap( deletions );
+    
+    /* Constants already written this frame may still be read by submitted draws, so only switch
+       segments if the slot changed; the new one is idle now that everything has been retired. */
+    if( constant_ring.segment != (int) ( frame_count % max_frame_latency ) )
+        PVT_AdvanceConstantRing();
+}
+
+
+/*
+ * Name: IKeOpenGLRenderDevice::GetMaxFrameLatency
+ * Desc: Returns the number of frames the CPU may queue ahead of the GPU.
+ */
+int IKeOpenGLRenderDevice::GetMaxFrameLatency()
+{
+    return max_frame_latency;
+}
+
+
+/*
+ * Name: IKeOpenGLRenderDevice::GetCompletedFrame
+ * Desc: Returns the number of frames the GPU is known to have finished.  Frames still in flight
+ *       are polled (never waited on) first.
+ */
+uint32_t IKeOpenGLRenderDevice::GetCompletedFrame()
+{
+    for( int i = 0; i < max_frame_latency; i++ )
+    {
+        if( frames[i].pending )
+            PVT_RetireFrame( &frames[i], No );
+    }
+    
+    return completed_frame;
+}
+
+
+/*
+ * Name: IKeOpenGLRenderDevice::DestroyDeferred
+ * Desc: Queues a resource to be destroyed once the GPU has finished the current frame.  Until
+ *       then, the resource may still be referenced by commands that have been submitted.
+ * NOTE: The resource must not be used again after calling this.
+ */
+void IKeOpenGLRenderDevice::DestroyDeferred( IKeUnknown* resource )
+{
+    if( !resource )
+        return;
+    
+    frames[frame_count % max_frame_latency].deletions.push_back( resource );
+}
+
+/*
+ * Name: IKeOpenGLRenderDevice::MakeCurrent
+ * Desc: Makes this device's context current on the calling thread, or releases it from the
+ *       calling thread so that another thread can take it.
+ * NOTE: A context can only be current on one thread at a time.
+ */
+bool IKeOpenGLRenderDevice::MakeCurrent( int current )
+{
+    if( SDL_GL_MakeCurrent( window, current ? context : NULL ) != 0 )
+        DISPDBG_RB( KE_ERROR, "Error making the OpenGL context " << ( current ? "current" : "non-current" ) << "!\n" << SDL_GetError() );
+    
+    return true;
+}
+
 #if 0
 /*
  * Name: IKeOpenGLRenderDevice::insert_fence
@@ -29,10 +29,99 @@
 #include <GL/wglew.h>
 #endif
 
+/*
+ * GPU program build status
+ */
+#define KE_PROGRAM_READY        0
+#define KE_PROGRAM_PENDING      1   /* Still being compiled/linked by the driver */
+#define KE_PROGRAM_FAILED       2
+
+class IKeOpenGLRenderDevice;
+
 #ifndef BUFFER_OFFSET
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 #endif
 
+/* Number of pixel unpack buffers used to stage asynchronous texture uploads */
+#define KE_MAX_STAGING_BUFFERS  8
+
+/* Number of pixel pack buffers used for asynchronous framebuffer reads */
+#define KE_MAX_READBACK_BUFFERS 4
+
+
+/*
+ * Texture upload staging buffer
+ */
+struct KeOpenGLStagingBuffer
+{
+    uint32_t    pbo;        /* Pixel unpack buffer object */
+    uint32_t    size;       /* Size of the buffer (in bytes) */
+    GLsync      sync;       /* Signalled once the GPU has finished reading from this buffer */
+};
+
+/*
+ * Framebuffer readback buffer
+ */
+struct KeOpenGLReadbackBuffer
+{
+    uint32_t    pbo;        /* Pixel pack buffer object */
+    uint32_t    size;       /* Size of the buffer (in bytes) */
+    GLsync      sync;       /* Signalled once glReadPixels has finished writing to this buffer */
+    uint32_t    ticket;     /* Request being serviced by this buffer (0 = available) */
+    int         bpp;        /* Bits per pixel of the request */
+    uint32_t    data_size;  /* Size of the request (in bytes) */
+};
+
+/*
+ * Completed framebuffer readback; pixels are held in a pooled buffer until released
+ */
+struct KeOpenGLReadbackResult
+{
+    uint32_t    ticket;
+    int         bpp;
+    uint8_t*    pixels;
+    uint32_t    size;       /* Capacity of the pixel buffer (in bytes) */
+};
+
+/*
+ * Cached sampler object.  Every sampler buffer or sampler state list with the same states
+ * shares one of these; they live as long as the device does.
+ */
+#define KE_SAMPLER_PARAM_COUNT  7   /* Indexed by KE_TS_* */
+
+struct KeOpenGLSamplerObject
+{
+    uint64_t    hash;                               /* Hash of the parameters below */
+    uint32_t    params[KE_SAMPLER_PARAM_COUNT];     /* Parameter for each texture state */
+    uint32_t    sampler;                            /* Sampler object */
+};
+
+/*
+ * Frame in flight
+ */
+struct KeOpenGLFrame
+{
+    IKeFence*   fence;          /* Pooled fence, re-inserted each time this slot is presented */
+    uint32_t    frame;          /* Frame number that last used this slot */
+    int         pending;        /* Yes if the fence was inserted and hasn't been waited on yet */
+    std::vector<IKeUnknown*> deletions;    /* Resources to destroy once the fence signals */
+};
+
+/*
+ * Transient constant ring.  One uniform buffer split into KE_CONSTANT_RING_FRAMES segments;
+ * each frame writes linearly into the segment matching its frame slot, so a segment becomes
+ * writable again once that slot's fence has signalled.
+ */
+struct KeOpenGLConstantRing
+{
+    uint32_t    ubo;            /* Uniform buffer object */
+    uint8_t*    mapped;         /* Persistently mapped pointer (NULL if using glBufferSubData) */
+    uint32_t    segment_size;   /* Size of each frame's segment (in bytes) */
+    uint32_t    alignment;      /* GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT */
+    int         segment;        /* Segment being written this frame */
+    uint32_t    offset;         /* Next free byte within the current segment */
+};
+
 
 /*
  * Constant buffer structure
@@ -68,6 +157,8 @@ struct IKeOpenGLGeometryBuffer : public IKeGeometryBuffer
 
     _KEMETHOD(bool) SetVertexData( uint32_t offset, uint32_t size, void* ptr );
     _KEMETHOD(bool) SetIndexData( uint32_t offset, uint32_t size, void* ptr );
+    _KEMETHOD(bool) CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size );
+    _KEMETHOD(bool) CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size );
 	KEMETHOD GetDesc( KeGeometryBufferDesc* desc );
     
     uint32_t vbo[2];		/* Vertex and index buffer */
@@ -79,6 +170,43 @@ struct IKeOpenGLGeometryBuffer : public IKeGeometryBuffer
     uint32_t lock_flags;	/* Buffer lock flags */
 };
 
+/*
+ * Indirect draw buffer structure
+ */
+struct IKeOpenGLIndirectBuffer : public IKeIndirectBuffer
+{
+    KEMETHOD Destroy();
+    
+    _KEMETHOD(void*) MapData( uint32_t flags );
+    KEMETHOD UnmapData( void* );
+    
+    _KEMETHOD(bool) SetCommands( uint32_t first, uint32_t count, KeDrawIndexedIndirectCommand* commands );
+    _KEMETHOD(uint32_t) GetCommandCount();
+    
+    uint32_t dibo;                          /* Draw indirect buffer object (0 when multi-draw indirect is unsupported) */
+    uint32_t command_count;                 /* Number of draw commands in this buffer */
+    uint32_t max_draw_id;                   /* Highest draw ID referenced by any command (plus one) */
+    KeDrawIndexedIndirectCommand* commands; /* System memory copy of the commands (used for CPU fallback) */
+};
+
+/*
+ * Occlusion query structure
+ */
+struct IKeOpenGLOcclusionQuery : public IKeOcclusionQuery
+{
+    KEMETHOD Destroy();
+    
+    _KEMETHOD(bool) Begin();
+    KEMETHOD End();
+    _KEMETHOD(bool) GetResult( int wait, uint32_t* samples );
+    
+    uint32_t query;     /* Query object */
+    uint32_t target;    /* GL_ANY_SAMPLES_PASSED or GL_SAMPLES_PASSED */
+    int      active;    /* Yes between Begin and End */
+    int      issued;    /* Yes once ended, until the result has been read back */
+    uint32_t result;    /* Last result read back */
+};
+
 /*
  * Command list structure
  */
@@ -94,10 +222,21 @@ struct IKeOpenGLGpuProgram : public IKeGpuProgram
 {
     KEMETHOD Destroy();
 	KEMETHOD GetVertexAttributes( KeVertexAttribute* vertex_attributes );
+	_KEMETHOD(bool) IsReady();
     
     uint32_t program;       /* GPU program handle */
-    uint32_t matrices[3];   /* Handles to the world, view, and projection matrices (respectively) */
+    uint32_t matrices[4];   /* Handles to the world, view, projection and world-view-projection matrices (respectively) */
+    uint32_t matrix_generations[4]; /* Generation of each of the above last set in this program (0 = never) */
+    int      frame_block;   /* Yes if the program declares the KeFrameConstants block */
+    int      draw_block;    /* Yes if the program declares the KeDrawConstants block */
 	KeVertexAttribute* va;	/* Vertex attributes */
+    
+    IKeOpenGLRenderDevice* device;  /* Device that is building this program */
+    int      status;        /* KE_PROGRAM_READY, KE_PROGRAM_PENDING or KE_PROGRAM_FAILED */
+    uint32_t shaders[2];    /* Vertex and fragment shaders of a pending program */
+    uint32_t submit_frame;  /* Frame the build was started on */
+    uint64_t hash;          /* Program cache keys (0 if not cached) */
+    uint64_t driver_hash;
 };
 
 /*
@@ -185,6 +324,7 @@ struct IKeOpenGLTextureSamplerBuffer : public IKeTextureSamplerBuffer
 
 	KeState*    states;         /* OpenGL state values */
 	int         state_count;    /* The number of states in this buffer */
+	uint32_t    sampler;        /* Shared sampler object (0 if sampler objects are unsupported) */
 };
 
 
@@ -227,7 +367,11 @@ public:
 	_KEMETHOD(bool) ExecuteCommandList( IKeCommandList* command_list, int restore_state );
 	KEMETHOD RestoreImmediateContext();
     _KEMETHOD(bool) CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
+    _KEMETHOD(bool) CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
     KEMETHOD DeleteProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetFallbackProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetProgramCachePath( const char* path );
+    KEMETHOD GetProgramCacheStats( KeProgramCacheStats* stats );
     KEMETHOD SetProgram( IKeGpuProgram* gpu_program );
     KEMETHOD SetProgramConstant1FV( const char* location, int count, float* value );
     KEMETHOD SetProgramConstant2FV( const char* location, int count, float* value );
@@ -243,13 +387,17 @@ public:
 	KEMETHOD DeleteConstantBuffer( IKeConstantBuffer* constant_buffer );
 	_KEMETHOD(bool) SetConstantBufferData( void* data, IKeConstantBuffer* constant_buffer );
 	KEMETHOD SetConstantBuffer( int slot, int shader_type, IKeConstantBuffer* constant_buffer );
+	_KEMETHOD(bool) SetTransientConstants( int slot, void* data, uint32_t size );
     _KEMETHOD(bool) CreateTexture1D( uint32_t target, int width, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
     _KEMETHOD(bool) CreateTexture2D( uint32_t target, int width, int height, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
     _KEMETHOD(bool) CreateTexture3D( uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
+    _KEMETHOD(bool) CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture );
     KEMETHOD DeleteTexture( IKeTexture* texture );
     KEMETHOD SetTextureData1D( int offsetx, int width, int miplevel, void* pixels, IKeTexture* texture );
     KEMETHOD SetTextureData2D( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture );
     KEMETHOD SetTextureData3D( int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture );
+    _KEMETHOD(bool) SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture );
+    KEMETHOD SetTextureMipRange( IKeTexture* texture, int base_level, int max_level );
     _KEMETHOD(bool) CreateRenderTarget( int width, int height, int depth, uint32_t flags, IKeRenderTarget** rendertarget );
     KEMETHOD DeleteRenderTarget( IKeRenderTarget* rendertarget );
     KEMETHOD BindRenderTarget( IKeRenderTarget* rendertarget );
@@ -266,8 +414,18 @@ public:
     KEMETHOD DrawVertices( uint32_t primtype, uint32_t stride, int first, int count );
     KEMETHOD DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count );
     KEMETHOD DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count );
+    KEMETHOD DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex );
+    _KEMETHOD(bool) CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer );
+    KEMETHOD DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer );
+    KEMETHOD DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count );
+    _KEMETHOD(bool) CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query );
+    KEMETHOD BeginConditionalRender( IKeOcclusionQuery* query, int wait );
+    KEMETHOD EndConditionalRender();
     
     _KEMETHOD(bool) GetFramebufferRegion( int x, int y, int width, int height, uint32_t flags, int* bpp, void** pixels );
+    _KEMETHOD(uint32_t) RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags );
+    _KEMETHOD(int) ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels );
+    KEMETHOD ReleaseFramebufferRegion( uint32_t ticket );
     
     /* Matrix/viewport related */
     KEMETHOD SetViewport( int x, int y, int width, int height );
@@ -283,6 +441,8 @@ public:
     KEMETHOD GetWorldMatrix( nv::matrix4f* world );
     KEMETHOD GetModelviewMatrix( nv::matrix4f* modelview );
     KEMETHOD GetProjectionMatrix( nv::matrix4f* projection );
+    _KEMETHOD(bool) SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count );
+    KEMETHOD SetDrawIndex( uint32_t index );
     
     /* Synchronization */
     KEMETHOD BlockUntilVerticalBlank();
@@ -291,6 +451,11 @@ public:
 	KEMETHOD BlockUntilIdle();
 	KEMETHOD Kick();
     _KEMETHOD(bool) CreateFence( IKeFence** fence, uint32_t flags );
+    KEMETHOD SetMaxFrameLatency( int latency );
+    _KEMETHOD(int) GetMaxFrameLatency();
+    _KEMETHOD(uint32_t) GetCompletedFrame();
+    KEMETHOD DestroyDeferred( IKeUnknown* resource );
+    _KEMETHOD(bool) MakeCurrent( int current );
 #if 0
 	_KEMETHOD(bool) InsertFence( IKeFence** fence );
 	_KEMETHOD(bool) TestFence( IKeFence* fence );
@@ -305,7 +470,26 @@ public:
     
 private:    /* Private, internal use only */
     void PVT_ApplySamplerStates();
+    uint32_t PVT_GetSamplerObject( KeState* states, int state_count );
     void PVT_SetWorldViewProjectionMatrices();
+    bool PVT_ReserveDrawIds( uint32_t count );
+    bool PVT_CreateConstantRing();
+    bool PVT_ResolveReadback( KeOpenGLReadbackBuffer* rb, int wait );
+    uint8_t* PVT_AllocateReadbackPixels( uint32_t size, uint32_t* capacity );
+    void PVT_AdvanceConstantRing();
+    void PVT_EndFrame();
+    void PVT_RetireFrame( KeOpenGLFrame* f, int wait );
+    bool PVT_WriteConstantRing( int slot, void* data, uint32_t size, uint32_t bind_size = 0 );
+    void PVT_MatrixChanged( int matrix );
+    bool PVT_IsCompressedFormatSupported( uint32_t format );
+    void PVT_BeginProgram( const char* vertex_shader, const char* fragment_shader, KeVertexAttribute* vertex_attributes, uint32_t* program, uint32_t* shaders );
+    bool PVT_EndProgram( uint32_t program, uint32_t* shaders );
+    bool PVT_CompileProgram( const char* vertex_shader, const char* fragment_shader, KeVertexAttribute* vertex_attributes, uint32_t* program );
+    void PVT_InitializeProgram( IKeOpenGLGpuProgram* gp );
+    bool PVT_PollProgram( IKeOpenGLGpuProgram* gp, bool wait );
+    uint64_t PVT_HashProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, uint64_t* driver_hash );
+    bool PVT_LoadProgramBinary( uint64_t hash, uint64_t driver_hash, uint32_t* program );
+    void PVT_SaveProgramBinary( uint64_t hash, uint64_t driver_hash, uint32_t program );
 	bool PVT_InititalizeDriverHooks();
 	void PVT_BlockUntilVerticalBlankDDraw();
 	void PVT_BlockUntilVerticalBlankD3DKMT();
@@ -319,8 +503,37 @@ protected:
 	int			fence_vendor;
 	KeState		samplers[8][16];
 	int			dirty_samplers[8][16];
+    std::vector<KeOpenGLSamplerObject> sampler_cache;  /* Deduplicated sampler objects */
+    uint32_t    stage_samplers[8];          /* Sampler object requested for each texture stage */
+    uint32_t    bound_samplers[8];          /* Sampler object currently bound to each texture unit */
+    uint32_t    bound_fbo;                  /* Frame buffer object currently bound (0 = default) */
     uint32_t    im_cache_size;
     IKeGeometryBuffer* im_gb;
+    uint32_t    drawid_vbo;     /* Instanced vertex buffer of sequential draw IDs (see KE_VA_DRAWID) */
+    uint32_t    drawid_count;   /* Number of draw IDs currently stored in the above buffer */
+    KeOpenGLStagingBuffer staging_buffers[KE_MAX_STAGING_BUFFERS];  /* Ring of texture upload buffers */
+    int         next_staging_buffer;
+    std::string program_cache_path;             /* Directory holding cached program binaries (empty = disabled) */
+    KeProgramCacheStats program_cache_stats;
+    IKeGpuProgram* fallback_gpu_program;    /* Used in place of programs that aren't ready yet */
+    int         program_ready;              /* No if draws must be skipped (current program isn't ready) */
+    uint32_t    frame_count;                /* Number of frames presented so far */
+    KeOpenGLFrame frames[KE_MAX_FRAMES_IN_FLIGHT]; /* One slot per frame the CPU may run ahead */
+    int         max_frame_latency;          /* Number of slots in use */
+    uint32_t    completed_frame;            /* Most recent frame known to be finished on the GPU */
+    KeOpenGLConstantRing constant_ring;     /* Per-frame streaming buffer for uniform blocks */
+    int         frame_constants_dirty;      /* Yes if the KeFrameConstants block must be rewritten */
+    int         draw_constants_dirty;       /* Yes if the KeDrawConstants block must be rewritten */
+    uint32_t    matrix_generation;          /* Incremented whenever a matrix changes */
+    uint32_t    matrix_generations[4];      /* Generation of the world, view, projection and world-view-projection matrices */
+    uint32_t    world_view_proj_generation; /* Generation the cached product below was computed at */
+    nv::matrix4f world_view_proj;           /* projection * view * world */
+    KeOpenGLReadbackBuffer readback_buffers[KE_MAX_READBACK_BUFFERS];  /* Ring of framebuffer read buffers */
+    std::vector<KeOpenGLReadbackResult> readback_results;   /* Completed reads, until released */
+    std::vector<KeOpenGLReadbackResult> readback_pool;      /* Released pixel buffers, for reuse */
+    uint32_t    next_readback_ticket;
+    
+    friend struct IKeOpenGLGpuProgram;
 };
 
 
@@ -11,11 +11,35 @@
 
 
 
+/*
+ * Queued simulator commands (asynchronous mode)
+ */
+enum
+{
+    KE_PCMD_SET_GRAVITY = 0,
+    KE_PCMD_SET_TIMESTEP,
+    KE_PCMD_ADD_RIGID_BOX,
+    KE_PCMD_ADD_RIGID_SPHERE,
+    KE_PCMD_ADD_ANIMATED_BOX,
+    KE_PCMD_REMOVE_RIGID,
+    KE_PCMD_REMOVE_ANIMATED,
+    KE_PCMD_SET_ANIMATED_POSITION,
+    KE_PCMD_SET_ANIMATED_ROTATION,
+    KE_PCMD_REMOVE_ALL_RIGID,
+    KE_PCMD_REMOVE_ALL_ANIMATED,
+    KE_PCMD_APPLY_IMPULSE,
+    KE_PCMD_SET_FORCE,
+};
+
+
+
 /*
  * Name: KePhysicsSimulator::
  * Desc: 
  */
-KePhysicsSimulator::KePhysicsSimulator() : time_since_last_update(0), start_time(KeGetPerformanceCounter()), rigid_bodies(NULL), animated_bodies(NULL)
+KePhysicsSimulator::KePhysicsSimulator() : time_since_last_update(0), start_time(KeGetPerformanceCounter()), rigid_bodies(NULL), animated_bodies(NULL),
+    fixed_step(KE_PHYSICS_DEFAULT_STEP), max_steps(KE_PHYSICS_DEFAULT_MAX_STEPS), interpolation(0), export_view_valid(false),
+    thread(NULL), step_pending(No), step_elapsed(0), step_count(0), stepped_interpolation(0), quit(No), applying_commands(No), next_rb_id(0), next_ab_id(0)
 {
     /* Default gravity setting */
     neV3 gravity;
@@ -29,7 +53,9 @@ KePhysicsSimulator::KePhysicsSimulator() : time_since_last_update(0), start_time
  * Name: KePhysicsSimulator::
  * Desc:
  */
-KePhysicsSimulator::KePhysicsSimulator( int max_rigid_bodies, int max_animated_bodies, neV3 gravity ) : time_since_last_update(0), start_time(KeGetPerformanceCounter()), rigid_bodies(NULL), animated_bodies(NULL)
+KePhysicsSimulator::KePhysicsSimulator( int max_rigid_bodies, int max_animated_bodies, neV3 gravity ) : time_since_last_update(0), start_time(KeGetPerformanceCounter()), rigid_bodies(NULL), animated_bodies(NULL),
+    fixed_step(KE_PHYSICS_DEFAULT_STEP), max_steps(KE_PHYSICS_DEFAULT_MAX_STEPS), interpolation(0), export_view_valid(false),
+    thread(NULL), step_pending(No), step_elapsed(0), step_count(0), stepped_interpolation(0), quit(No), applying_commands(No), next_rb_id(0), next_ab_id(0)
 {
     /* Manually calculate the simulator size requirements */
     size_info.rigidBodiesCount = max_rigid_bodies;
@@ -55,6 +81,9 @@ KePhysicsSimulator::KePhysicsSimulator( int max_rigid_bodies, int max_animated_b
  */
 KePhysicsSimulator::~KePhysicsSimulator()
 {
+    /* Stop the physics thread */
+    SetAsync( false );
+    
     /* Delete the simulator */
     neSimulator::DestroySimulator( simulator );
 }
@@ -65,6 +94,9 @@ KePhysicsSimulator::~KePhysicsSimulator()
  */
 void KePhysicsSimulator::SetGravity( neV3 gravity )
 {
+    if( PVT_QueueCommand( KE_PCMD_SET_GRAVITY, 0, &gravity ) )
+        return;
+    
     simulator->Gravity( gravity );
 }
 
@@ -74,75 +106,88 @@ void KePhysicsSimulator::SetGravity( neV3 gravity )
  */
 uint32_t KePhysicsSimulator::AddRigidBodyBox( neV3 position, neV3 size, float mass )
 {
-    static uint32_t rb_id = 0;
-    
-    /* Add a new rigid body box to the simulator */
-    KeRigidBody rigid_body;
-    rigid_body.rigid_body = simulator->CreateRigidBody();
-    
-    /* Create box geometry */
-    rigid_body.geometry = rigid_body.rigid_body->AddGeometry();
-    rigid_body.geometry->SetBoxSize( size );
-    rigid_body.rigid_body->UpdateBoundingInfo();
-    
-    /* Set mass and intertia tensor */
-    rigid_body.rigid_body->SetInertiaTensor( neBoxInertiaTensor( size, mass ) );
-    rigid_body.rigid_body->SetMass( mass );
+    /* Give this rigid body a unique ID number */
+    uint32_t rb_id = ++next_rb_id;
     
-    /* Set position */
-    rigid_body.rigid_body->SetPos( position );
+    if( !PVT_QueueCommand( KE_PCMD_ADD_RIGID_BOX, rb_id, &position, &size, mass ) )
+        PVT_AddRigidBody( rb_id, No, position, size, mass );
     
+    return rb_id;
+}
+
+/*
+ * Name: KePhysicsSimulator::AddRigidBodySphere
+ * Desc:
+ */
+uint32_t KePhysicsSimulator::AddRigidBodySphere( neV3 position, float radius, float mass )
+{
     /* Give this rigid body a unique ID number */
-    rigid_body.rb_id = ++rb_id;
+    uint32_t rb_id = ++next_rb_id;
     
-    /* Add this to the list of rigit bodies */
-//    list_add_end<KeRigidBody*>( &rigid_bodies, rigid_body );
-    rigid_bodies.push_back( rigid_body );
+    neV3 size;
+    size.Set( radius * 2, radius * 2, radius * 2 );
+    
+    if( !PVT_QueueCommand( KE_PCMD_ADD_RIGID_SPHERE, rb_id, &position, &size, mass ) )
+        PVT_AddRigidBody( rb_id, Yes, position, size, mass );
     
     return rb_id;
 }
 
 /*
- * Name: KePhysicsSimulator::AddRigidBodyBox
+ * Name: KePhysicsSimulator::AddAnimatedBodyBox
  * Desc:
  */
-uint32_t KePhysicsSimulator::AddRigidBodySphere( neV3 position, float radius, float mass )
+uint32_t KePhysicsSimulator::AddAnimatedBodyBox( neV3 position, neV3 size )
 {
-    static uint32_t rb_id = 0;
+    /* Give this animated body a unique ID */
+    uint32_t ab_id = ++next_ab_id;
+    
+    if( !PVT_QueueCommand( KE_PCMD_ADD_ANIMATED_BOX, ab_id, &position, &size ) )
+        PVT_AddAnimatedBody( ab_id, position, size );
     
-    /* Add a new rigid body box to the simulator */
+    return ab_id;
+}
+
+/* Creates a rigid box or sphere (size is the sphere's diameter) */
+void KePhysicsSimulator::PVT_AddRigidBody( uint32_t rb_id, bool sphere, neV3 position, neV3 size, float mass )
+{
+    /* Add a new rigid body to the simulator */
     KeRigidBody rigid_body;
     rigid_body.rigid_body = simulator->CreateRigidBody();
     
-    /* Create box geometry */
+    /* Create box or sphere geometry */
     rigid_body.geometry = rigid_body.rigid_body->AddGeometry();
-    rigid_body.geometry->SetSphereDiameter( radius * 2 );
+    if( sphere )
+        rigid_body.geometry->SetSphereDiameter( size[0] );
+    else
+        rigid_body.geometry->SetBoxSize( size );
     rigid_body.rigid_body->UpdateBoundingInfo();
     
     /* Set mass and intertia tensor */
-    rigid_body.rigid_body->SetInertiaTensor( neSphereInertiaTensor( radius * 2, mass ) );
+    rigid_body.rigid_body->SetInertiaTensor( sphere ? neSphereInertiaTensor( size[0], mass ) : neBoxInertiaTensor( size, mass ) );
     rigid_body.rigid_body->SetMass( mass );
     
     /* Set position */
     rigid_body.rigid_body->SetPos( position );
     
-    /* Give this rigid body a unique ID number */
-    rigid_body.rb_id = ++rb_id;
+    rigid_body.rb_id = rb_id;
+    rigid_body.exported = false;
+    rigid_body.exported_idle = false;
+    
+    /* Start all of the interpolation states at the initial position */
+    float state[7] = { position[0], position[1], position[2], 0.0f, 0.0f, 0.0f, 1.0f };
+    memmove( rigid_body.previous_state, state, sizeof( state ) );
+    memmove( rigid_body.current_state, state, sizeof( state ) );
+    memmove( rigid_body.stepped_state[0], state, sizeof( state ) );
+    memmove( rigid_body.stepped_state[1], state, sizeof( state ) );
     
     /* Add this to the list of rigit bodies */
     rigid_bodies.push_back( rigid_body );
-    
-    return rb_id;
 }
 
-/*
- * Name: KePhysicsSimulator::AddAnimatedBodyBox
- * Desc:
- */
-uint32_t KePhysicsSimulator::AddAnimatedBodyBox( neV3 position, neV3 size )
+/* Creates an animated box */
+void KePhysicsSimulator::PVT_AddAnimatedBody( uint32_t ab_id, neV3 position, neV3 size )
 {
-    static uint32_t ab_id = 0;
-    
     /* Create a new animated body box */
     KeAnimatedBody animated_body;
     animated_body.animated_body = simulator->CreateAnimatedBody();
@@ -155,14 +200,10 @@ uint32_t KePhysicsSimulator::AddAnimatedBodyBox( neV3 position, neV3 size )
     /* Set animated body position */
     animated_body.animated_body->SetPos( position );
     
-    /* Give this animated body a unique ID */
-    animated_body.ab_id = ++ab_id;
+    animated_body.ab_id = ab_id;
     
     /* Add this animated body to the list */
-//    list_add_end<KeAnimatedBody*>( &animated_bodies, animated_body );
     animated_bodies.push_back( animated_body );
-    
-    return ab_id;
 }
 
 /*
@@ -171,6 +212,9 @@ uint32_t KePhysicsSimulator::AddAnimatedBodyBox( neV3 position, neV3 size )
  */
 void KePhysicsSimulator::RemoveRigidBody( uint32_t rb_id )
 {
+    if( PVT_QueueCommand( KE_PCMD_REMOVE_RIGID, rb_id ) )
+        return;
+    
 #if 0
     node_t<KeRigidBody*>* n = rigid_bodies;
     
@@ -207,8 +251,11 @@ void KePhysicsSimulator::RemoveRigidBody( uint32_t rb_id )
             i->rigid_body->RemoveGeometry( i->geometry );
             simulator->FreeRigidBody( i->rigid_body );
             
-            /* Now remove it from the list */
-            rigid_bodies.erase(i);
+            /* Now remove it from the list.  The bodies after it move down a slot, so their
+               exported transforms need to be rewritten. */
+            i = rigid_bodies.erase(i);
+            for( ; i != rigid_bodies.end(); ++i )
+                i->exported = false;
             break;
         }
         
@@ -223,6 +270,9 @@ void KePhysicsSimulator::RemoveRigidBody( uint32_t rb_id )
  */
 void KePhysicsSimulator::RemoveAnimatedBody( uint32_t ab_id )
 {
+    if( PVT_QueueCommand( KE_PCMD_REMOVE_ANIMATED, ab_id ) )
+        return;
+    
 #if 0
     node_t<KeAnimatedBody*>* n = animated_bodies;
     
@@ -275,6 +325,9 @@ void KePhysicsSimulator::RemoveAnimatedBody( uint32_t ab_id )
  */
 bool KePhysicsSimulator::SetAnimatedBodyPosition( uint32_t id, neV3 position )
 {
+    if( PVT_QueueCommand( KE_PCMD_SET_ANIMATED_POSITION, id, &position ) )
+        return true;
+    
 #if 0
     node_t<KeAnimatedBody*>* n = animated_bodies;
     
@@ -322,6 +375,9 @@ bool KePhysicsSimulator::SetAnimatedBodyPosition( uint32_t id, neV3 position )
  */
 bool KePhysicsSimulator::SetAnimatedBodyRotation( uint32_t id, neV3 rotation )
 {
+    if( PVT_QueueCommand( KE_PCMD_SET_ANIMATED_ROTATION, id, &rotation ) )
+        return true;
+    
 #if 0
     node_t<KeAnimatedBody*>* n = animated_bodies;
     
@@ -431,6 +487,9 @@ bool KePhysicsSimulator::GetAnimatedBody( uint32_t id, KeAnimatedBody** animated
 
 void KePhysicsSimulator::RemoveAllRigidBodies()
 {
+    if( PVT_QueueCommand( KE_PCMD_REMOVE_ALL_RIGID, 0 ) )
+        return;
+    
 #if 0
     node_t<KeRigidBody*>* n = rigid_bodies;
     
@@ -461,12 +520,15 @@ void KePhysicsSimulator::RemoveAllRigidBodies()
 		++i;
 	}
 
-	animated_bodies.clear();
+	rigid_bodies.clear();
 #endif
 }
 
 void KePhysicsSimulator::RemoveAllAnimatedBodies()
 {
+    if( PVT_QueueCommand( KE_PCMD_REMOVE_ALL_ANIMATED, 0 ) )
+        return;
+    
 #if 0
     node_t<KeAnimatedBody*>* n = animated_bodies;
     
@@ -501,28 +563,469 @@ void KePhysicsSimulator::RemoveAllAnimatedBodies()
 #endif
 }
 
+/*
+ * Name: KePhysicsSimulator::SetFixedTimestep
+ * Desc: Sets the length of each simulation step, and the most steps UpdateSimulator may take
+ *       at once.
+ */
+void KePhysicsSimulator::SetFixedTimestep( float step, int max_steps )
+{
+    neV3 v;
+    v.Set( float( max_steps ), 0.0f, 0.0f );
+    
+    if( PVT_QueueCommand( KE_PCMD_SET_TIMESTEP, 0, &v, NULL, step ) )
+        return;
+    
+    fixed_step = step > 0.0f ? step : KE_PHYSICS_DEFAULT_STEP;
+    this->max_steps = max_steps > 0 ? max_steps : 1;
+}
+
+/*
+ * Name: KePhysicsSimulator::ApplyRigidBodyImpulse
+ * Desc: Applies an impulse to a rigid body's centre of mass.
+ */
+bool KePhysicsSimulator::ApplyRigidBodyImpulse( uint32_t id, neV3 impulse )
+{
+    KeRigidBody* rb;
+    
+    if( PVT_QueueCommand( KE_PCMD_APPLY_IMPULSE, id, &impulse ) )
+        return true;
+    
+    if( !GetRigidBody( id, &rb ) )
+        return false;
+    
+    rb->rigid_body->ApplyImpulse( impulse );
+    return true;
+}
+
+/*
+ * Name: KePhysicsSimulator::SetRigidBodyForce
+ * Desc: Sets the force acting on a rigid body's centre of mass (until it is set again).
+ */
+bool KePhysicsSimulator::SetRigidBodyForce( uint32_t id, neV3 force )
+{
+    KeRigidBody* rb;
+    
+    if( PVT_QueueCommand( KE_PCMD_SET_FORCE, id, &force ) )
+        return true;
+    
+    if( !GetRigidBody( id, &rb ) )
+        return false;
+    
+    rb->rigid_body->SetForce( force );
+    return true;
+}
+
 /*
  * Name: KePhysicsSimulator::UpdateSimulator
- * Desc:
+ * Desc: Advances the simulation by whole fixed steps to catch up with the time elapsed since
+ *       the last update (measured with the performance counter unless elapsed is given), and
+ *       returns the number of steps taken.  The time left over is kept for the next update,
+ *       and sets how far to interpolate between the last two steps when rendering.
+ *
+ *       In asynchronous mode this publishes the results of the steps posted by the previous
+ *       update (waiting for them if necessary), applies the queued commands, and posts this
+ *       update's steps to the physics thread, so they run while the game carries on.
  */
-void KePhysicsSimulator::UpdateSimulator( float frame_interval )
+int KePhysicsSimulator::UpdateSimulator( float elapsed )
 {
     /* Get the end time */
     end_time = KeGetPerformanceCounter();
     
     /* Calculate the elapsed time since the physics engine was last updated */
-    float frame_time = float( end_time - start_time ) / float(KeGetPerformanceFrequency());
-    time_since_last_update += frame_time;
+    if( elapsed < 0.0f )
+        elapsed = float( end_time - start_time ) / float(KeGetPerformanceFrequency());
+    
+    /* Reset start time */
+    start_time = end_time;
     
-    /* If the time is greater than the desired frame interval (i.e. 1/60th of a second), update the physics. */
-    /* By default, the time interval is 0.01667f.  This is calculated with the following formula: vblank/1000 where
-       vblank = 1000/refreshrate. */
-    if( time_since_last_update > frame_interval )
+    if( !thread )
     {
-        simulator->Advance( frame_interval, 1, 0 );
-        time_since_last_update -= frame_interval;
+        int steps = PVT_Step( elapsed );
+        PVT_Publish( steps );
+        return steps;
     }
     
-    /* Reset start time */
-    start_time = KeGetPerformanceCounter();
+    /* The simulator is idle between waiting for last frame's steps and posting the next ones */
+    PVT_WaitForSteps();
+    
+    int steps = step_count;
+    step_count = 0;
+    PVT_Publish( steps );
+    PVT_ApplyCommands();
+    
+    lock.Enter();
+    step_elapsed = elapsed;
+    step_pending = Yes;
+    pthread_cond_signal( &step_cond );
+    lock.Leave();
+    
+    return steps;
+}
+
+/*
+ * Name: KePhysicsThreadProc
+ * Desc: Entry point of the physics thread.
+ */
+#ifdef _WIN32
+uint32_t __stdcall KePhysicsThreadProc( void* context )
+#else
+void KePhysicsThreadProc( void* context )
+#endif
+{
+    static_cast<KePhysicsSimulator*>( context )->PVT_PhysicsThread();
+    
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+/*
+ * Name: KePhysicsSimulator::SetAsync
+ * Desc: Starts or stops stepping the simulation on its own thread, one frame ahead of the game.
+ *       While asynchronous, every call that changes the simulation is queued and applied by the
+ *       next UpdateSimulator, exported and interpolated transforms come from the states the
+ *       last finished steps published, and the Tokamak bodies (see GetRigidBody) must not be
+ *       used directly.
+ */
+void KePhysicsSimulator::SetAsync( bool async )
+{
+    if( async && !thread )
+    {
+        quit = No;
+        step_pending = No;
+        step_count = 0;
+        
+        pthread_cond_init( &step_cond, NULL );
+        pthread_cond_init( &done_cond, NULL );
+        
+        thread = new KeThread( KePhysicsThreadProc, this );
+    }
+    else if( !async && thread )
+    {
+        /* Finish the steps in flight, then stop the physics thread */
+        PVT_WaitForSteps();
+        
+        lock.Enter();
+        quit = Yes;
+        pthread_cond_signal( &step_cond );
+        lock.Leave();
+        
+#ifdef _WIN32
+        thread->Wait( INFINITE );
+#endif
+        delete thread;
+        thread = NULL;
+        
+        pthread_cond_destroy( &step_cond );
+        pthread_cond_destroy( &done_cond );
+        
+        /* Publish the last results and catch up with the queued commands */
+        PVT_Publish( step_count );
+        step_count = 0;
+        PVT_ApplyCommands();
+    }
+}
+
+/*
+ * Name: KePhysicsSimulator::PVT_PhysicsThread
+ * Desc: Runs the steps posted by UpdateSimulator until asynchronous mode is turned off.
+ */
+void KePhysicsSimulator::PVT_PhysicsThread()
+{
+    while( true )
+    {
+        lock.Enter();
+        
+        while( !step_pending && !quit )
+            pthread_cond_wait( &step_cond, &lock.mutex );
+        
+        if( !step_pending )
+        {
+            lock.Leave();
+            break;
+        }
+        
+        float elapsed = step_elapsed;
+        
+        lock.Leave();
+        
+        int steps = PVT_Step( elapsed );
+        
+        lock.Enter();
+        step_count += steps;
+        step_pending = No;
+        pthread_cond_broadcast( &done_cond );
+        lock.Leave();
+    }
+}
+
+/* Blocks until the physics thread has finished the steps that were posted */
+void KePhysicsSimulator::PVT_WaitForSteps()
+{
+    lock.Enter();
+    
+    while( step_pending )
+        pthread_cond_wait( &done_cond, &lock.mutex );
+    
+    lock.Leave();
+}
+
+/* Takes as many fixed steps as the elapsed time allows, saving the states before and after the
+   last one for PVT_Publish, and returns the number of steps taken */
+int KePhysicsSimulator::PVT_Step( float elapsed )
+{
+    time_since_last_update += elapsed;
+    
+    /* Drop the time beyond max_steps steps, so a slow frame (or a breakpoint) can't make the next
+       update take longer still */
+    if( time_since_last_update > fixed_step * max_steps )
+        time_since_last_update = fixed_step * max_steps;
+    
+    int steps = int( time_since_last_update / fixed_step );
+    steps = steps < max_steps ? steps : max_steps;
+    
+    for( int i = 0; i < steps; i++ )
+    {
+        /* Only the last step's start and end states are needed for interpolation */
+        if( i == steps - 1 )
+            PVT_SaveState( true );
+        
+        simulator->Advance( fixed_step, 1, 0 );
+        time_since_last_update -= fixed_step;
+    }
+    
+    if( steps )
+        PVT_SaveState( false );
+    
+    if( time_since_last_update < 0.0f )
+        time_since_last_update = 0.0f;
+    
+    stepped_interpolation = time_since_last_update / fixed_step;
+    stepped_interpolation = stepped_interpolation < 1.0f ? stepped_interpolation : 1.0f;
+    
+    return steps;
+}
+
+/* Makes the states saved by the last steps the ones used for exporting and interpolation */
+void KePhysicsSimulator::PVT_Publish( int steps )
+{
+    if( steps )
+    {
+        std::vector<KeRigidBody>::iterator i = rigid_bodies.begin();
+        
+        while( i != rigid_bodies.end() )
+        {
+            memmove( i->previous_state, i->stepped_state[0], sizeof( i->previous_state ) );
+            memmove( i->current_state, i->stepped_state[1], sizeof( i->current_state ) );
+            ++i;
+        }
+    }
+    
+    interpolation = stepped_interpolation;
+}
+
+/* Queues a command while the physics thread owns the simulator (returns false to run it now) */
+bool KePhysicsSimulator::PVT_QueueCommand( uint32_t type, uint32_t id, const neV3* v0, const neV3* v1, float f )
+{
+    if( !thread || applying_commands )
+        return false;
+    
+    KePhysicsCommand command;
+    ZeroMemory( &command, sizeof( KePhysicsCommand ) );
+    command.type = type;
+    command.id = id;
+    if( v0 )
+        command.v[0] = *v0;
+    if( v1 )
+        command.v[1] = *v1;
+    command.f = f;
+    
+    commands.push_back( command );
+    return true;
+}
+
+/* Runs the queued commands in the order they were issued */
+void KePhysicsSimulator::PVT_ApplyCommands()
+{
+    applying_commands = Yes;
+    
+    for( size_t i = 0; i < commands.size(); i++ )
+    {
+        KePhysicsCommand* c = &commands[i];
+        
+        switch( c->type )
+        {
+            case KE_PCMD_SET_GRAVITY:           SetGravity( c->v[0] ); break;
+            case KE_PCMD_SET_TIMESTEP:          SetFixedTimestep( c->f, int( c->v[0][0] ) ); break;
+            case KE_PCMD_ADD_RIGID_BOX:         PVT_AddRigidBody( c->id, No, c->v[0], c->v[1], c->f ); break;
+            case KE_PCMD_ADD_RIGID_SPHERE:      PVT_AddRigidBody( c->id, Yes, c->v[0], c->v[1], c->f ); break;
+            case KE_PCMD_ADD_ANIMATED_BOX:      PVT_AddAnimatedBody( c->id, c->v[0], c->v[1] ); break;
+            case KE_PCMD_REMOVE_RIGID:          RemoveRigidBody( c->id ); break;
+            case KE_PCMD_REMOVE_ANIMATED:       RemoveAnimatedBody( c->id ); break;
+            case KE_PCMD_SET_ANIMATED_POSITION: SetAnimatedBodyPosition( c->id, c->v[0] ); break;
+            case KE_PCMD_SET_ANIMATED_ROTATION: SetAnimatedBodyRotation( c->id, c->v[0] ); break;
+            case KE_PCMD_REMOVE_ALL_RIGID:      RemoveAllRigidBodies(); break;
+            case KE_PCMD_REMOVE_ALL_ANIMATED:   RemoveAllAnimatedBodies(); break;
+            case KE_PCMD_APPLY_IMPULSE:         ApplyRigidBodyImpulse( c->id, c->v[0] ); break;
+            case KE_PCMD_SET_FORCE:             SetRigidBodyForce( c->id, c->v[0] ); break;
+        }
+    }
+    
+    commands.clear();
+    applying_commands = No;
+}
+
+/*
+ * Name: KePhysicsSimulator::GetInterpolatedTransform
+ * Desc: Returns a rigid body's transform interpolated between the last two steps.
+ */
+bool KePhysicsSimulator::GetInterpolatedTransform( uint32_t id, KeMat4* transform )
+{
+    KeRigidBody* rb;
+    
+    if( !GetRigidBody( id, &rb ) )
+        return false;
+    
+    PVT_GetInterpolatedTransform( rb, interpolation, transform );
+    return true;
+}
+
+/* Records every rigid body's position and rotation as the state before or after a step */
+void KePhysicsSimulator::PVT_SaveState( bool previous )
+{
+    std::vector<KeRigidBody>::iterator i = rigid_bodies.begin();
+    
+    while( i != rigid_bodies.end() )
+    {
+        float* state = i->stepped_state[previous ? 0 : 1];
+        neV3 pos = i->rigid_body->GetPos();
+        neQ rot = i->rigid_body->GetRotationQ();
+        
+        state[0] = pos[0];
+        state[1] = pos[1];
+        state[2] = pos[2];
+        state[3] = rot.X;
+        state[4] = rot.Y;
+        state[5] = rot.Z;
+        state[6] = rot.W;
+        
+        ++i;
+    }
+}
+
+/* Blends a rigid body's last two published states (0 = before the last step, 1 = after it) */
+void KePhysicsSimulator::PVT_GetInterpolatedTransform( const KeRigidBody* rb, float t, KeMat4* transform )
+{
+    const float* a = rb->previous_state;
+    const float* b = rb->current_state;
+    
+    KeVec3 pos = KeVec3Lerp( KeVec3Load( a ), KeVec3Load( b ), t );
+    KeQuat rot = KeQuatNlerp( KeQuatMake( a[3], a[4], a[5], a[6] ), KeQuatMake( b[3], b[4], b[5], b[6] ), t );
+    
+    *transform = KeMat4FromRotationTranslation( rot, pos );
+}
+
+/*
+ * Name: KePhysicsSimulator::ExportRigidBodyTransforms
+ * Desc: Writes the transforms of the rigid bodies that moved since the last export (and
+ *       optionally their world-view and normal matrices) into the caller's arrays, one slot
+ *       per rigid body.  Idle bodies are skipped without fetching their transforms, and with
+ *       KE_PHYSICS_EXPORT_INTERPOLATE the transforms are blended between the last two steps.
+ *       Returns the number of slots written.
+ */
+uint32_t KePhysicsSimulator::ExportRigidBodyTransforms( KePhysicsExportDesc* desc )
+{
+    uint32_t written = 0;
+    bool write_all = ( desc->flags & KE_PHYSICS_EXPORT_ALL ) ? true : false;
+    KeMat4 view;
+    
+    if( !desc->world )
+        return 0;
+    
+    /* A different view matrix changes every world-view and normal matrix */
+    if( desc->view && ( desc->world_view || desc->normal ) )
+    {
+        float v[16];
+        view = *desc->view;
+        KeMat4Store( v, view );
+        
+        if( !export_view_valid || memcmp( v, export_view, sizeof( v ) ) )
+        {
+            memmove( export_view, v, sizeof( v ) );
+            export_view_valid = true;
+            write_all = true;
+        }
+    }
+    
+    uint32_t count = (uint32_t) rigid_bodies.size();
+    if( count > desc->capacity )
+        count = desc->capacity;
+    
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        KeRigidBody* rb = &rigid_bodies[i];
+        
+        KeMat4 world;
+        float current[16];
+        bool idle = false;
+        
+        if( desc->flags & KE_PHYSICS_EXPORT_INTERPOLATE )
+            PVT_GetInterpolatedTransform( rb, interpolation, &world );
+        else if( thread )
+            PVT_GetInterpolatedTransform( rb, 1.0f, &world );   /* Tokamak belongs to the physics thread */
+        else
+        {
+            /* Bodies that were already at rest when they were exported can't have moved since (the
+               step that puts a body to sleep can still move it, so that one is always checked) */
+            idle = rb->rigid_body->IsIdle() ? true : false;
+            if( !write_all && rb->exported && rb->exported_idle && idle )
+                continue;
+            
+            neT3 t = rb->rigid_body->GetTransform();
+            world = KeMat4FromNeT3( &t );
+        }
+        
+        /* Skip the bodies whose transform hasn't changed */
+        KeMat4Store( current, world );
+        memmove( current + 3, current + 4, sizeof( float ) * 3 );
+        memmove( current + 6, current + 8, sizeof( float ) * 3 );
+        memmove( current + 9, current + 12, sizeof( float ) * 3 );
+        
+        if( !write_all && rb->exported && !memcmp( current, rb->exported_transform, sizeof( rb->exported_transform ) ) )
+        {
+            rb->exported_idle = idle;
+            continue;
+        }
+        
+        memmove( rb->exported_transform, current, sizeof( rb->exported_transform ) );
+        rb->exported = true;
+        rb->exported_idle = idle;
+        
+        /* Tokamak bodies are rigid (no scale), so the normal matrix is just the rotation part */
+        desc->world[i] = world;
+        
+        if( desc->world_view || desc->normal )
+        {
+            KeMat4 world_view = desc->view ? KeMat4Mul( view, world ) : world;
+            
+            if( desc->view && desc->world_view )
+                desc->world_view[i] = world_view;
+            
+            if( desc->normal )
+            {
+                world_view.col[3] = KeMat4Identity().col[3];
+                desc->normal[i] = world_view;
+            }
+        }
+        
+        if( desc->ids )
+            desc->ids[i] = rb->rb_id;
+        if( desc->written )
+            desc->written[written] = i;
+        
+        written++;
+    }
+    
+    return written;
 }
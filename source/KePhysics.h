@@ -13,6 +13,9 @@
 #include <map>
 #include <unordered_map>
 #include <tokamak.h>
+#include "KeMath.h"
+#include "KeThread.h"
+#include "KeMutex.h"
 //#include "linkedlist.h"
 
 
@@ -28,6 +31,12 @@ struct KeRigidBody
     neGeometry*     geometry;
     neSimulator*    parent_simulator;
     uint32_t        rb_id;
+    float           previous_state[7];      /* Position and rotation quaternion before the last step */
+    float           current_state[7];       /* ... and after it (interpolated between for rendering) */
+    float           stepped_state[2][7];    /* Both states as saved while stepping (published by UpdateSimulator) */
+    float           exported_transform[12]; /* Rotation columns and position last written by ExportRigidBodyTransforms */
+    bool            exported;               /* exported_transform is valid (and the slot holds it) */
+    bool            exported_idle;          /* The body was already at rest when exported_transform was taken */
 };
 
 /* Animated body */
@@ -45,6 +54,43 @@ struct KeAnimatedBody
 };
 
 
+/* Fixed timestep defaults */
+#define KE_PHYSICS_DEFAULT_STEP         ( 1.0f / 60.0f )
+#define KE_PHYSICS_DEFAULT_MAX_STEPS    4       /* Time beyond this many steps per update is dropped */
+
+/* Transform export flags */
+#define KE_PHYSICS_EXPORT_ALL           0x1     /* Write every slot, not just the bodies that moved */
+#define KE_PHYSICS_EXPORT_INTERPOLATE   0x2     /* Interpolate between the last two steps (see UpdateSimulator) */
+
+/*
+ * Transform export description.  Each array has a slot per rigid body, in the order the bodies
+ * were added (removing a body moves the ones after it down a slot, and they are rewritten on
+ * the next export).  Slots whose body hasn't moved since the last export are left untouched,
+ * so the arrays should be kept between frames (e.g. mapped instance data).
+ */
+struct KePhysicsExportDesc
+{
+    KeMat4*         world;          /* World matrices (required) */
+    KeMat4*         world_view;     /* view * world (optional, requires view) */
+    KeMat4*         normal;         /* Normal matrices for world_view, or world without a view (optional) */
+    const KeMat4*   view;           /* View matrix (a new view matrix rewrites every slot) */
+    uint32_t*       ids;            /* Rigid body id of each slot (optional) */
+    uint32_t*       written;        /* Slots written by this export (optional, up to capacity entries) */
+    uint32_t        capacity;       /* Number of slots in the arrays */
+    uint32_t        flags;          /* KE_PHYSICS_EXPORT_* */
+};
+
+/*
+ * Simulator command, queued while the simulator is stepping on its own thread
+ */
+struct KePhysicsCommand
+{
+    uint32_t        type;           /* KE_PCMD_* */
+    uint32_t        id;
+    neV3            v[2];
+    float           f;
+};
+
 /* Physics simulation class */
 class KePhysicsSimulator
 {
@@ -69,7 +115,32 @@ public:
     void RemoveAllRigidBodies();
     void RemoveAllAnimatedBodies();
     
-    void UpdateSimulator( float frame_interval = 0.01667f );
+    void SetFixedTimestep( float step, int max_steps = KE_PHYSICS_DEFAULT_MAX_STEPS );
+    int UpdateSimulator( float elapsed = -1.0f );
+    float GetInterpolationFactor() { return interpolation; }
+    bool GetInterpolatedTransform( uint32_t id, KeMat4* transform );
+    void SetAsync( bool async );
+    bool IsAsync() { return thread != NULL; }
+    
+    bool ApplyRigidBodyImpulse( uint32_t id, neV3 impulse );
+    bool SetRigidBodyForce( uint32_t id, neV3 force );
+    
+    uint32_t GetRigidBodyCount() { return (uint32_t) rigid_bodies.size(); }
+    uint32_t ExportRigidBodyTransforms( KePhysicsExportDesc* desc );
+    
+    /* Physics thread */
+    void PVT_PhysicsThread();
+    
+protected:
+    void PVT_AddRigidBody( uint32_t rb_id, bool sphere, neV3 position, neV3 size, float mass );
+    void PVT_AddAnimatedBody( uint32_t ab_id, neV3 position, neV3 size );
+    int PVT_Step( float elapsed );
+    void PVT_SaveState( bool previous );
+    void PVT_Publish( int steps );
+    void PVT_WaitForSteps();
+    bool PVT_QueueCommand( uint32_t type, uint32_t id, const neV3* v0 = NULL, const neV3* v1 = NULL, float f = 0 );
+    void PVT_ApplyCommands();
+    void PVT_GetInterpolatedTransform( const KeRigidBody* rb, float t, KeMat4* transform );
     
 protected:
     neSimulator*                    simulator;          /* Tokamak physics simualtor */
@@ -79,7 +150,24 @@ protected:
 //    std::unordered_map<uint32_t, std::unique_ptr<KeAnimatedBody>> ab_map;
     neSimulatorSizeInfo             size_info;          /* Information about this physics simulator */
     uint64_t                        start_time, end_time; /* Start and end time */
-    float                           time_since_last_update;
+    float                           time_since_last_update; /* Time not yet simulated */
+    float                           fixed_step;         /* Simulation step */
+    int                             max_steps;          /* Maximum steps per update */
+    float                           interpolation;      /* How far between the last two steps the current time is (0 to 1) */
+    float                           export_view[16];    /* View matrix used by the last export */
+    bool                            export_view_valid;
+    KeThread*                       thread;             /* Physics thread (NULL unless asynchronous) */
+    KeMutex                         lock;               /* Guards the step job shared with the physics thread */
+    pthread_cond_t                  step_cond;          /* Signalled when steps are posted */
+    pthread_cond_t                  done_cond;          /* Signalled when they are finished */
+    int                             step_pending;
+    float                           step_elapsed;       /* Time to simulate for the posted steps */
+    int                             step_count;         /* Steps taken and not yet published */
+    float                           stepped_interpolation;
+    int                             quit;
+    int                             applying_commands;
+    std::vector<KePhysicsCommand>   commands;           /* Queued by the game thread */
+    uint32_t                        next_rb_id, next_ab_id;
 };
 
 #endif /* defined(__ke_physics__) */
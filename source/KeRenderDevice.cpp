@@ -15,6 +15,8 @@
 #include "KeDirect3D11/KeDirect3D11RenderDevice.h"
 #endif
 
+#include "KeThreadedRenderDevice.h"
+
 
 
 /*
@@ -23,15 +25,21 @@
  */
 IKeRenderDevice* KeCreateRenderDevice( KeRenderDeviceDesc* renderdevice_desc )
 {
+    IKeRenderDevice* device = NULL;
+    
 #ifndef _UWP
     if( renderdevice_desc->device_type == KE_RENDERDEVICE_OGL3 || renderdevice_desc->device_type == KE_RENDERDEVICE_OGL4 || renderdevice_desc->device_type == KE_RENDERDEVICE_OGLES2 || renderdevice_desc->device_type == KE_RENDERDEVICE_OGLES3 )
-        return new IKeOpenGLRenderDevice( renderdevice_desc );
+        device = new IKeOpenGLRenderDevice( renderdevice_desc );
 #endif
     
 #ifdef _WIN32
 	if( renderdevice_desc->device_type == KE_RENDERDEVICE_D3D11 )
-		return new IKeDirect3D11RenderDevice( renderdevice_desc );
+		device = new IKeDirect3D11RenderDevice( renderdevice_desc );
 #endif
+    
+    /* Record frames ahead of a dedicated render thread if requested */
+    if( device && renderdevice_desc->render_thread_depth > 0 && device->ConfirmDevice() )
+        device = new IKeThreadedRenderDevice( device, renderdevice_desc->render_thread_depth );
 
-    return NULL;
+    return device;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "KeUnknown.h"
 #include "NvFoundationMath.h"
 #include "NV/NvMath.h"
+#include "KeMath.h"
 
 
 /*
@@ -52,6 +53,7 @@
 #define KE_VA_TEXTURE5          10
 #define KE_VA_TEXTURE6          11
 #define KE_VA_TEXTURE7          12
+#define KE_VA_DRAWID            13  /* Per-draw index for indirect draws (see DrawIndexedVerticesIndirect) */
 
 
 /*
@@ -76,6 +78,9 @@
 #define KE_UNSIGNED_INT     5
 #define KE_FLOAT            6
 #define KE_DOUBLE           7
+#define KE_HALF_FLOAT       8   /* See half_float_vertices_supported */
+#define KE_INT_2_10_10_10_REV           9   /* Packed, size must be 4 (see packed_vertices_supported) */
+#define KE_UNSIGNED_INT_2_10_10_10_REV  10
 
 
 /*
@@ -109,6 +114,19 @@
 #define KE_DEPTH_BUFFER		0x2
 #define KE_STENCIL_BUFFER	0x4
 
+/*
+ * Asynchronous readback status
+ */
+#define KE_READBACK_PENDING     0   /* GPU hasn't finished writing the pixels yet */
+#define KE_READBACK_READY       1
+#define KE_READBACK_FAILED      2   /* Invalid or released ticket */
+
+/*
+ * Occlusion query types
+ */
+#define KE_QUERY_ANY_SAMPLES        0   /* Only whether any samples passed (cheaper on most GPUs) */
+#define KE_QUERY_SAMPLES_PASSED     1   /* Number of samples that passed */
+
 
 /*
  * Renderstate types 
@@ -122,6 +140,7 @@
 #define KE_RS_CULLMODE      7
 #define KE_RS_POLYGONMODE   8
 #define KE_RS_BLENDFUNC     9
+#define KE_RS_COLOURMASK    10
 
 /*
  * Texturestate types
@@ -200,6 +219,11 @@
 #define KE_TEXTURE_3D       4
 #define KE_TEXTURE_RECT     5
 
+/*
+ * Mip level count for a full chain (see CreateTexture2D)
+ */
+#define KE_MIPMAPS_FULL_CHAIN   -1
+
 /*
  * Texture formats
  */
@@ -209,6 +233,24 @@
 #define KE_TEXTUREFORMAT_RGB	3
 #define KE_TEXTUREFORMAT_BGR	4
 
+/*
+ * Compressed texture formats
+ */
+#define KE_TEXTUREFORMAT_BC1            5   /* DXT1 */
+#define KE_TEXTUREFORMAT_BC2            6   /* DXT3 */
+#define KE_TEXTUREFORMAT_BC3            7   /* DXT5 */
+#define KE_TEXTUREFORMAT_BC4            8   /* RGTC1 */
+#define KE_TEXTUREFORMAT_BC5            9   /* RGTC2 */
+#define KE_TEXTUREFORMAT_BC6H           10  /* BPTC (unsigned float) */
+#define KE_TEXTUREFORMAT_BC7            11  /* BPTC */
+#define KE_TEXTUREFORMAT_ETC2_RGB8      12
+#define KE_TEXTUREFORMAT_ETC2_RGBA8     13
+#define KE_TEXTUREFORMAT_EAC_R11        14
+#define KE_TEXTUREFORMAT_EAC_RG11       15
+#define KE_TEXTUREFORMAT_ASTC_4x4       16
+#define KE_TEXTUREFORMAT_ASTC_6x6       17
+#define KE_TEXTUREFORMAT_ASTC_8x8       18
+
 /*
  * Texture filtering modes
  */
@@ -252,6 +294,18 @@
 #define KE_DEFAULT_BATCH_SIZE (32*1024*1024)
 
 
+/*
+ * GPU program binary cache statistics
+ */
+struct KeProgramCacheStats
+{
+    uint32_t hits;          /* Programs loaded from a cached binary */
+    uint32_t misses;        /* Programs compiled from source (no usable binary) */
+    uint32_t invalidated;   /* Cached binaries rejected due to a source/driver mismatch or load failure */
+    uint32_t stores;        /* Binaries written to the cache */
+};
+
+
 /*
  * Render device description
  */
@@ -267,6 +321,7 @@ struct KeRenderDeviceDesc
     int refresh_rate;
     int device_type;
     int fullscreen;
+    int render_thread_depth;    /* Frames recorded ahead of a dedicated render thread (0 = no render thread) */
 };
 
 /*
@@ -279,13 +334,30 @@ struct KeRenderDeviceCaps
     int hardware_command_buffers_supported;
     int gpu_fencing_supported;
     int instancing_supported;
+    int multi_draw_indirect_supported;
+    int base_vertex_supported;
+    int occlusion_query_supported;
+    int any_samples_query_supported;            /* KE_QUERY_ANY_SAMPLES isn't emulated with a sample count */
+    int conditional_render_supported;
+    int sampler_objects_supported;
     int default_fence_type;
     
+    /* Vertex capabilities */
+    int half_float_vertices_supported;          /* KE_HALF_FLOAT */
+    int packed_vertices_supported;              /* KE_INT_2_10_10_10_REV and KE_UNSIGNED_INT_2_10_10_10_REV */
+    
     /* Texture capabilities */
     int texture_rectangles_supported;
+    int texture_compression_s3tc_supported;     /* BC1-BC3 */
+    int texture_compression_rgtc_supported;     /* BC4-BC5 */
+    int texture_compression_bptc_supported;     /* BC6H-BC7 */
+    int texture_compression_etc2_supported;     /* ETC2/EAC */
+    int texture_compression_astc_supported;     /* ASTC (LDR) */
     
     /* Shader capabilities */
     int compute_shaders_supported;
+    int program_binaries_supported;
+    int parallel_shader_compile_supported;
     int constant_buffers_supported;
     int uniform_constants_supported;
     int max_constant_buffer_size;
@@ -294,6 +366,8 @@ struct KeRenderDeviceCaps
     int max_pixel_constant_buffer_blocks;
     int max_geometry_constant_buffer_blocks;
     int max_tesselation_constant_buffer_blocks;
+    int constant_buffer_offset_alignment;       /* Required alignment of constant buffer ranges */
+    int persistent_mapping_supported;           /* Constant ring is written directly (no uploads) */
 };
 
 /*
@@ -360,6 +434,21 @@ struct KeTextureDesc
     uint32_t data_type;         /* Internal data type */
 };
 
+/*
+ * Indexed indirect draw command
+ * NOTE: The layout of this structure matches the one expected by glMultiDrawElementsIndirect
+ *       and ID3D11DeviceContext::DrawIndexedInstancedIndirect, so arrays of these can be copied
+ *       directly into a GPU side indirect buffer.
+ */
+struct KeDrawIndexedIndirectCommand
+{
+    uint32_t count;             /* Number of indices to draw */
+    uint32_t instance_count;    /* Number of instances (usually 1) */
+    uint32_t first_index;       /* Offset into the index buffer (in indices) */
+    int32_t  base_vertex;       /* Value added to each index before fetching vertices */
+    uint32_t base_instance;     /* Draw ID; index of this draw's data within the per-draw buffer */
+};
+
 /*
  * Constant buffer data description
  */
@@ -370,6 +459,56 @@ struct KeConstantBufferDesc
     uint32_t    data_size;
 };
 
+/*
+ * Frames in flight.  Each frame the CPU may run ahead of the GPU owns a pooled fence; resources
+ * passed to DestroyDeferred are only destroyed once that frame's fence has signalled.
+ */
+#define KE_MAX_FRAMES_IN_FLIGHT     4   /* Upper limit for SetMaxFrameLatency */
+#define KE_DEFAULT_FRAME_LATENCY    2
+
+/*
+ * Constant ring bindings.  Programs declaring the "KeFrameConstants" and "KeDrawConstants"
+ * uniform blocks have them bound to these slots automatically, so they shouldn't be used
+ * with SetConstantBuffer.
+ */
+#define KE_CB_SLOT_FRAME            0   /* Per-frame block (see KeFrameConstants) */
+#define KE_CB_SLOT_DRAW             1   /* Per-draw block (see KeDrawConstants) */
+#define KE_CB_SLOT_OBJECTS          2   /* Batched world matrices (see KeObjectConstants) */
+#define KE_CB_SLOT_USER             3   /* First slot free for application use */
+
+#define KE_MAX_BATCHED_WORLD_MATRICES   256 /* World matrices per KeObjectConstants block (16kb) */
+
+#define KE_CONSTANT_RING_SIZE       (4*1024*1024)   /* Size of the transient constant ring (in bytes) */
+#define KE_CONSTANT_RING_FRAMES     KE_MAX_FRAMES_IN_FLIGHT /* Number of frames the ring is split across */
+
+/*
+ * Per-frame constant block (std140 layout)
+ */
+struct KeFrameConstants
+{
+    nv::matrix4f    view;
+    nv::matrix4f    proj;
+    nv::matrix4f    view_proj;
+};
+
+/*
+ * Per-draw constant block (std140 layout)
+ */
+struct KeDrawConstants
+{
+    nv::matrix4f    world;
+    nv::matrix4f    world_view_proj;
+};
+
+/*
+ * Batched world matrix block (std140 layout).  Programs index it with the draw ID (see
+ * SetWorldMatrixBatch and SetDrawIndex).
+ */
+struct KeObjectConstants
+{
+    nv::matrix4f    world[KE_MAX_BATCHED_WORLD_MATRICES];
+};
+
 
 /*
  * Resource base structure
@@ -411,9 +550,25 @@ struct IKeGeometryBuffer : public IKeResourceBuffer
     
     _KEMETHOD(bool) SetVertexData( uint32_t offset, uint32_t size, void* ptr ) PURE;
     _KEMETHOD(bool) SetIndexData( uint32_t offset, uint32_t size, void* ptr ) PURE;
+    _KEMETHOD(bool) CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size ) PURE;
+    _KEMETHOD(bool) CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size ) PURE;
 	KEMETHOD GetDesc( KeGeometryBufferDesc* desc ) PURE;
 };
 
+/*
+ * Indirect draw buffer base structure
+ */
+struct IKeIndirectBuffer : public IKeResourceBuffer
+{
+    KEMETHOD Destroy() PURE;
+    
+    _KEMETHOD(void*) MapData( uint32_t flags ) PURE;
+    KEMETHOD UnmapData( void* ) PURE;
+    
+    _KEMETHOD(bool) SetCommands( uint32_t first, uint32_t count, KeDrawIndexedIndirectCommand* commands ) PURE;
+    _KEMETHOD(uint32_t) GetCommandCount() PURE;
+};
+
 /*
  * Command list base structure
  */
@@ -429,6 +584,7 @@ struct IKeGpuProgram : public IKeUnknown
 {
     KEMETHOD Destroy() PURE;
 	KEMETHOD GetVertexAttributes( KeVertexAttribute* vertex_attributes ) PURE;
+    _KEMETHOD(bool) IsReady() PURE;
 };
 
 /*
@@ -500,6 +656,10 @@ struct IKeTextureSamplerBuffer : public IKeUnknown
 struct IKeOcclusionQuery : public IKeUnknown
 {
     KEMETHOD Destroy() PURE;
+    
+    _KEMETHOD(bool) Begin() PURE;
+    KEMETHOD End() PURE;
+    _KEMETHOD(bool) GetResult( int wait, uint32_t* samples ) PURE;
 };
 
 
@@ -542,7 +702,11 @@ public:
 	_KEMETHOD(bool) ExecuteCommandList( IKeCommandList* command_list, int restore_state ) PURE;
 	KEMETHOD RestoreImmediateContext() PURE;
     _KEMETHOD(bool) CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program ) PURE;
+    _KEMETHOD(bool) CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program ) PURE;
     KEMETHOD DeleteProgram( IKeGpuProgram* gpu_program ) PURE;
+    KEMETHOD SetFallbackProgram( IKeGpuProgram* gpu_program ) PURE;
+    KEMETHOD SetProgramCachePath( const char* path ) PURE;
+    KEMETHOD GetProgramCacheStats( KeProgramCacheStats* stats ) PURE;
     KEMETHOD SetProgram( IKeGpuProgram* gpu_program ) PURE;
     KEMETHOD SetProgramConstant1FV( const char* location, int count, float* value ) PURE;
     KEMETHOD SetProgramConstant2FV( const char* location, int count, float* value ) PURE;
@@ -558,13 +722,17 @@ public:
 	KEMETHOD DeleteConstantBuffer( IKeConstantBuffer* constant_buffer ) PURE;
 	_KEMETHOD(bool) SetConstantBufferData( void* data, IKeConstantBuffer* constant_buffer ) PURE;
 	KEMETHOD SetConstantBuffer( int slot, int shader_type, IKeConstantBuffer* constant_buffer ) PURE;
+	_KEMETHOD(bool) SetTransientConstants( int slot, void* data, uint32_t size ) PURE;
     _KEMETHOD(bool) CreateTexture1D( uint32_t target, int width, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL ) PURE;
     _KEMETHOD(bool) CreateTexture2D( uint32_t target, int width, int height, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL ) PURE;
     _KEMETHOD(bool) CreateTexture3D( uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL ) PURE;
+    _KEMETHOD(bool) CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture ) PURE;
     KEMETHOD DeleteTexture( IKeTexture* texture ) PURE;
     KEMETHOD SetTextureData1D( int offsetx, int width, int miplevel, void* pixels, IKeTexture* texture ) PURE;
     KEMETHOD SetTextureData2D( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture ) PURE;
     KEMETHOD SetTextureData3D( int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture ) PURE;
+    _KEMETHOD(bool) SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture ) PURE;
+    KEMETHOD SetTextureMipRange( IKeTexture* texture, int base_level, int max_level ) PURE;
     _KEMETHOD(bool) CreateRenderTarget( int width, int height, int depth, uint32_t flags, IKeRenderTarget** rendertarget ) PURE;
     KEMETHOD DeleteRenderTarget( IKeRenderTarget* rendertarget ) PURE;
     KEMETHOD BindRenderTarget( IKeRenderTarget* rendertarget ) PURE;
@@ -581,8 +749,18 @@ public:
     KEMETHOD DrawVertices( uint32_t primtype, uint32_t stride, int first, int count ) PURE;
     KEMETHOD DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count ) PURE;
     KEMETHOD DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count ) PURE;
+    KEMETHOD DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex ) PURE;
+    _KEMETHOD(bool) CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer ) PURE;
+    KEMETHOD DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer ) PURE;
+    KEMETHOD DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count ) PURE;
+    _KEMETHOD(bool) CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query ) PURE;
+    KEMETHOD BeginConditionalRender( IKeOcclusionQuery* query, int wait ) PURE;
+    KEMETHOD EndConditionalRender() PURE;
     
     _KEMETHOD(bool) GetFramebufferRegion( int x, int y, int width, int height, uint32_t flags, int* bpp, void** pixels ) PURE;
+    _KEMETHOD(uint32_t) RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags ) PURE;
+    _KEMETHOD(int) ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels ) PURE;
+    KEMETHOD ReleaseFramebufferRegion( uint32_t ticket ) PURE;
     
     /* Matrix/viewport related */
     KEMETHOD SetViewport( int x, int y, int width, int height ) PURE;
@@ -598,6 +776,20 @@ public:
     KEMETHOD GetWorldMatrix( nv::matrix4f* world ) PURE;
     KEMETHOD GetModelviewMatrix( nv::matrix4f* modelview ) PURE;
     KEMETHOD GetProjectionMatrix( nv::matrix4f* projection ) PURE;
+    _KEMETHOD(bool) SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count ) PURE;
+    KEMETHOD SetDrawIndex( uint32_t index ) PURE;
+    
+    /* KeMath overloads (KeMat4 has the same column major layout as nv::matrix4f, so these just
+       forward the pointer and nothing is copied or converted) */
+    void SetViewMatrix( const KeMat4* view )                { SetViewMatrix( KeMat4AsNv( view ) ); }
+    void SetWorldMatrix( const KeMat4* world )              { SetWorldMatrix( KeMat4AsNv( world ) ); }
+    void SetModelviewMatrix( const KeMat4* modelview )      { SetModelviewMatrix( KeMat4AsNv( modelview ) ); }
+    void SetProjectionMatrix( const KeMat4* projection )    { SetProjectionMatrix( KeMat4AsNv( projection ) ); }
+    void GetViewMatrix( KeMat4* view )                      { GetViewMatrix( KeMat4AsNv( view ) ); }
+    void GetWorldMatrix( KeMat4* world )                    { GetWorldMatrix( KeMat4AsNv( world ) ); }
+    void GetModelviewMatrix( KeMat4* modelview )            { GetModelviewMatrix( KeMat4AsNv( modelview ) ); }
+    void GetProjectionMatrix( KeMat4* projection )          { GetProjectionMatrix( KeMat4AsNv( projection ) ); }
+    bool SetWorldMatrixBatch( const KeMat4* world, uint32_t count ) { return SetWorldMatrixBatch( KeMat4AsNv( world ), count ); }
     
     /* Synchronization */
     KEMETHOD BlockUntilVerticalBlank() PURE;
@@ -606,6 +798,11 @@ public:
 	KEMETHOD BlockUntilIdle() PURE;
 	KEMETHOD Kick() PURE;
     _KEMETHOD(bool) CreateFence( IKeFence** fence, uint32_t flags ) PURE;
+    KEMETHOD SetMaxFrameLatency( int latency ) PURE;
+    _KEMETHOD(int) GetMaxFrameLatency() PURE;
+    _KEMETHOD(uint32_t) GetCompletedFrame() PURE;
+    KEMETHOD DestroyDeferred( IKeUnknown* resource ) PURE;
+    _KEMETHOD(bool) MakeCurrent( int current ) PURE;
 #if 0
 	_KEMETHOD(bool) InsertFence( IKeFence** fence ) PURE;
 	_KEMETHOD(bool) TestFence( IKeFence* fence ) PURE;
@@ -86,10 +86,54 @@ bool KeZipResourceArchive::ReadTexture( std::string filename, uint32_t desired_t
     
     if( Read( filename, &buffer, &size ) )
     {
+        /* Pre-compressed textures (DDS/KTX) are uploaded as is */
+        if( KeImageIsCompressed( buffer, size ) )
+        {
+            KeCompressedImageData cimg;
+            bool ret = false;
+            
+            if( KeImageReadCompressedFromMemory( buffer, size, &cimg ) )
+            {
+                ret = KeGetRenderDevice()->CreateCompressedTexture2D( desired_target, cimg.width, cimg.height, cimg.mip_count,
+                                                                      cimg.format, cimg.mip_data, cimg.mip_sizes, texture );
+                KeImageCloseCompressed( &cimg );
+            }
+            
+            free(buffer);
+            return ret;
+        }
+        
+        /* Baked mip chains (see KeImageSaveMipChain) are uploaded level by level */
+        if( KeImageIsMipChain( buffer, size ) )
+        {
+            KeImageMipChain chain;
+            bool ret = false;
+            
+            if( KeImageReadMipChainFromMemory( buffer, size, &chain ) )
+            {
+                ret = KeGetRenderDevice()->CreateTexture2D( desired_target, chain.width, chain.height, chain.level_count, chain.format, KE_UNSIGNED_BYTE, texture );
+                if( ret )
+                {
+                    for( uint32_t i = 0; i < chain.level_count; i++ )
+                    {
+                        int w = chain.width >> i;
+                        int h = chain.height >> i;
+                        
+                        KeGetRenderDevice()->SetTextureData2D( 0, 0, w ? w : 1, h ? h : 1, i, chain.levels[i], *texture );
+                    }
+                }
+                
+                KeImageCloseMipChain( &chain );
+            }
+            
+            free(buffer);
+            return ret;
+        }
+        
         if( KeImageReadFromMemory( buffer, size, &img ) )
         {
             /* TODO: Auto-determine texture format */
-            KeGetRenderDevice()->CreateTexture2D( desired_target, img.width, img.height, 0, KE_TEXTUREFORMAT_BGRA, KE_UNSIGNED_BYTE, texture, img.pixels );
+            KeGetRenderDevice()->CreateTexture2D( desired_target, img.width, img.height, KE_MIPMAPS_FULL_CHAIN, KE_TEXTUREFORMAT_BGRA, KE_UNSIGNED_BYTE, texture, img.pixels );
         
             KeImageClose( &img );
             free(buffer);
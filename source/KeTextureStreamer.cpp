@@ -0,0 +1,303 @@
+//
+//  KeTextureStreamer.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeTextureStreamer.h"
+#include "KeToolkit.h"
+#include <math.h>
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/*
+ * Name: KeTextureStreamer::KeTextureStreamer
+ * Desc: Default constructor.  The frame budget is the maximum number of bytes uploaded per
+ *       call to KeTextureStreamer::Update.
+ */
+KeTextureStreamer::KeTextureStreamer( IKeRenderDevice* device, uint32_t frame_budget ) : device(device), frame_budget(frame_budget), uploaded_bytes(0)
+{
+}
+
+
+/*
+ * Name: KeTextureStreamer::~KeTextureStreamer
+ * Desc: Default deconstructor.
+ * NOTE: Textures created by the streamer belong to the caller and are not deleted here.
+ */
+KeTextureStreamer::~KeTextureStreamer()
+{
+    while( !textures.empty() )
+        RemoveTexture( textures.back()->texture );
+}
+
+
+/*
+ * Name: KeTextureStreamer::AddTexture
+ * Desc: Creates an empty 2D texture and queues its mip levels for streaming.  mip_pixels must
+ *       contain mip_count pointers to tightly packed level data, finest level first.  If
+ *       free_pixels is set, each level's data is deleted (as uint8_t[]) once it is uploaded.
+ * NOTE: The texture cannot be sampled until at least its coarsest level is resident (see
+ *       KeTextureStreamer::IsResident).
+ */
+bool KeTextureStreamer::AddTexture( int width, int height, int mip_count, uint32_t format, uint32_t data_type, void** mip_pixels, bool free_pixels, IKeTexture** texture )
+{
+    /* Sanity checks */
+    if( !device || !mip_pixels || mip_count < 1 )
+        DISPDBG_RB( KE_ERROR, "Invalid parameter(s)!" );
+    
+    if( format > KE_TEXTUREFORMAT_BGR || data_type > KE_DOUBLE )
+        DISPDBG_RB( KE_ERROR, "Unsupported texture format or data type!" );
+    
+    for( int i = 0; i < mip_count; i++ )
+    {
+        if( !mip_pixels[i] )
+            DISPDBG_RB( KE_ERROR, "Missing pixel data for mip level " << i << "!" );
+    }
+    
+    /* Create the texture without any data; the levels are supplied by Update */
+    if( !device->CreateTexture2D( KE_TEXTURE_2D, width, height, 0, format, data_type, texture ) )
+        DISPDBG_RB( KE_ERROR, "Error creating streamed texture!" );
+    
+    KeStreamedTexture* st = new KeStreamedTexture;
+    
+    st->texture = *texture;
+    st->width = width;
+    st->height = height;
+    st->mip_count = mip_count;
+    st->texel_size = KeImageTexelSize( format, data_type );
+    st->mip_pixels.assign( mip_pixels, mip_pixels + mip_count );
+    st->free_pixels = free_pixels;
+    st->resident_level = mip_count;
+    st->desired_level = mip_count - 1;
+    
+    textures.push_back( st );
+    
+    return true;
+}
+
+
+/*
+ * Name: KeTextureStreamer::RemoveTexture
+ * Desc: Stops streaming the given texture and releases any source data that has not been
+ *       uploaded yet.  The texture itself is not deleted.
+ */
+void KeTextureStreamer::RemoveTexture( IKeTexture* texture )
+{
+    for( std::vector<KeStreamedTexture*>::iterator it = textures.begin(); it != textures.end(); ++it )
+    {
+        if( (*it)->texture == texture )
+        {
+            for( int i = 0; i < (*it)->mip_count; i++ )
+                PVT_ReleasePixels( *it, i );
+            
+            delete (*it);
+            textures.erase( it );
+            return;
+        }
+    }
+}
+
+
+/*
+ * Name: KeTextureStreamer::RequestMipLevel
+ * Desc: Requests that the given texture be streamed in down to the given (finest) mip level.
+ *       Textures that are not requested only receive their coarsest level.
+ */
+void KeTextureStreamer::RequestMipLevel( IKeTexture* texture, int mip_level )
+{
+    KeStreamedTexture* st = PVT_FindTexture( texture );
+    if( !st )
+        return;
+    
+    if( mip_level < 0 )
+        mip_level = 0;
+    if( mip_level > st->mip_count - 1 )
+        mip_level = st->mip_count - 1;
+    
+    st->desired_level = mip_level;
+}
+
+
+/*
+ * Name: KeTextureStreamer::Update
+ * Desc: Uploads pending mip levels until this frame's budget is spent.  Every texture receives
+ *       its coarsest level first, so that something can be drawn as soon as possible; the
+ *       finer levels that have been requested are then uploaded one level per texture in turn.
+ * NOTE: Call once per frame.  Uploading stops early if all staging buffers are busy.
+ */
+void KeTextureStreamer::Update()
+{
+    uint32_t bytes = 0;
+    
+    /* Make the coarsest level of every new texture resident */
+    for( std::vector<KeStreamedTexture*>::iterator it = textures.begin(); it != textures.end(); ++it )
+    {
+        if( (*it)->resident_level < (*it)->mip_count )
+            continue;
+        
+        if( bytes >= frame_budget || !PVT_UploadNextLevel( *it, &bytes ) )
+            return;
+    }
+    
+    /* Refine the textures that want more detail, one level at a time */
+    bool progress = true;
+    
+    while( progress )
+    {
+        progress = false;
+        
+        for( std::vector<KeStreamedTexture*>::iterator it = textures.begin(); it != textures.end(); ++it )
+        {
+            if( (*it)->resident_level <= (*it)->desired_level )
+                continue;
+            
+            if( bytes >= frame_budget || !PVT_UploadNextLevel( *it, &bytes ) )
+                return;
+            
+            progress = true;
+        }
+    }
+}
+
+
+/*
+ * Name: KeTextureStreamer::SetFrameBudget
+ * Desc: Sets the maximum number of bytes uploaded per call to KeTextureStreamer::Update.
+ */
+void KeTextureStreamer::SetFrameBudget( uint32_t frame_budget )
+{
+    this->frame_budget = frame_budget;
+}
+
+
+/*
+ * Name: KeTextureStreamer::GetPendingBytes
+ * Desc: Returns the number of bytes that are requested but not yet resident.
+ */
+uint32_t KeTextureStreamer::GetPendingBytes()
+{
+    uint32_t pending = 0;
+    
+    for( std::vector<KeStreamedTexture*>::iterator it = textures.begin(); it != textures.end(); ++it )
+    {
+        KeStreamedTexture* st = (*it);
+        int finest = st->desired_level < st->mip_count - 1 ? st->desired_level : st->mip_count - 1;
+        
+        for( int level = finest; level < st->resident_level; level++ )
+        {
+            int w = st->width >> level;
+            int h = st->height >> level;
+            
+            pending += ( w ? w : 1 ) * ( h ? h : 1 ) * st->texel_size;
+        }
+    }
+    
+    return pending;
+}
+
+
+/*
+ * Name: KeTextureStreamer::GetUploadedBytes
+ * Desc: Returns the total number of bytes uploaded by this streamer.
+ */
+uint32_t KeTextureStreamer::GetUploadedBytes()
+{
+    return uploaded_bytes;
+}
+
+
+/*
+ * Name: KeTextureStreamer::IsResident
+ * Desc: Returns true if the given mip level (and all coarser levels) of a texture are resident.
+ */
+bool KeTextureStreamer::IsResident( IKeTexture* texture, int mip_level )
+{
+    KeStreamedTexture* st = PVT_FindTexture( texture );
+    if( !st )
+        return true;    /* Not streamed, so it's assumed to be fully resident */
+    
+    if( mip_level > st->mip_count - 1 )
+        mip_level = st->mip_count - 1;
+    
+    return st->resident_level <= mip_level;
+}
+
+
+/* Returns the streaming entry for the given texture */
+KeStreamedTexture* KeTextureStreamer::PVT_FindTexture( IKeTexture* texture )
+{
+    for( std::vector<KeStreamedTexture*>::iterator it = textures.begin(); it != textures.end(); ++it )
+    {
+        if( (*it)->texture == texture )
+            return (*it);
+    }
+    
+    return NULL;
+}
+
+
+/* Uploads the next finer mip level of a texture and widens its sampled mip range to include it */
+bool KeTextureStreamer::PVT_UploadNextLevel( KeStreamedTexture* st, uint32_t* bytes )
+{
+    int level = st->resident_level - 1;
+    int w = st->width >> level;
+    int h = st->height >> level;
+    
+    if( !w ) w = 1;
+    if( !h ) h = 1;
+    
+    if( !device->SetTextureData2DAsync( 0, 0, w, h, level, st->mip_pixels[level], st->texture ) )
+        return false;
+    
+    st->resident_level = level;
+    device->SetTextureMipRange( st->texture, level, st->mip_count - 1 );
+    
+    (*bytes) += w * h * st->texel_size;
+    uploaded_bytes += w * h * st->texel_size;
+    
+    PVT_ReleasePixels( st, level );
+    
+    return true;
+}
+
+
+/* Releases the source data of a mip level if the streamer owns it */
+void KeTextureStreamer::PVT_ReleasePixels( KeStreamedTexture* st, int mip_level )
+{
+    if( !st->free_pixels || !st->mip_pixels[mip_level] )
+        return;
+    
+    delete[] (uint8_t*) st->mip_pixels[mip_level];
+    st->mip_pixels[mip_level] = NULL;
+}
+
+
+/*
+ * Name: KeCalculateDesiredMipLevel
+ * Desc: Returns the finest mip level worth streaming for a texture of the given size when
+ *       it covers roughly screen_width x screen_height pixels on screen.
+ */
+int KeCalculateDesiredMipLevel( int width, int height, float screen_width, float screen_height )
+{
+    if( screen_width < 1.0f ) screen_width = 1.0f;
+    if( screen_height < 1.0f ) screen_height = 1.0f;
+    
+    float ratio_x = float( width ) / screen_width;
+    float ratio_y = float( height ) / screen_height;
+    float ratio = ratio_x > ratio_y ? ratio_x : ratio_y;
+    
+    if( ratio <= 1.0f )
+        return 0;
+    
+    return int( floorf( logf( ratio ) / logf( 2.0f ) ) );
+}
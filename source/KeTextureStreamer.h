@@ -0,0 +1,64 @@
+//
+//  KeTextureStreamer.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeTextureStreamer__
+#define __KeTextureStreamer__
+
+#include <vector>
+#include "KeRenderDevice.h"
+
+
+/*
+ * Streamed texture entry
+ */
+struct KeStreamedTexture
+{
+    IKeTexture*         texture;        /* Texture created by the streamer */
+    int                 width, height;  /* Dimensions of the base (finest) mip level */
+    int                 mip_count;      /* Number of mip levels supplied */
+    uint32_t            texel_size;     /* Size of a single texel in bytes */
+    std::vector<void*>  mip_pixels;     /* Source data for each mip level (0 = finest) */
+    bool                free_pixels;    /* Delete the source data once uploaded? */
+    int                 resident_level; /* Finest mip level uploaded so far (mip_count = none) */
+    int                 desired_level;  /* Finest mip level requested for rendering */
+};
+
+
+/* Texture streaming class; uploads mip levels coarsest first within a per-frame byte budget */
+class KeTextureStreamer
+{
+public:
+    KeTextureStreamer( IKeRenderDevice* device, uint32_t frame_budget );
+    virtual ~KeTextureStreamer();
+
+public:
+    bool AddTexture( int width, int height, int mip_count, uint32_t format, uint32_t data_type, void** mip_pixels, bool free_pixels, IKeTexture** texture );
+    void RemoveTexture( IKeTexture* texture );
+    void RequestMipLevel( IKeTexture* texture, int mip_level );
+    void Update();
+
+    void SetFrameBudget( uint32_t frame_budget );
+    uint32_t GetPendingBytes();
+    uint32_t GetUploadedBytes();
+    bool IsResident( IKeTexture* texture, int mip_level );
+
+protected:
+    KeStreamedTexture* PVT_FindTexture( IKeTexture* texture );
+    bool PVT_UploadNextLevel( KeStreamedTexture* st, uint32_t* bytes );
+    void PVT_ReleasePixels( KeStreamedTexture* st, int mip_level );
+
+protected:
+    IKeRenderDevice*                    device;         /* Device used to create and upload textures */
+    std::vector<KeStreamedTexture*>     textures;       /* Textures being streamed */
+    uint32_t                            frame_budget;   /* Maximum bytes uploaded per call to Update */
+    uint32_t                            uploaded_bytes; /* Total bytes uploaded so far */
+};
+
+
+int KeCalculateDesiredMipLevel( int width, int height, float screen_width, float screen_height );
+
+#endif /* defined(__KeTextureStreamer__) */
@@ -0,0 +1,3534 @@
+//
+//  KeThreadedRenderDevice.cpp
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#include "Ke.h"
+#include "KeDebug.h"
+#include "KeToolkit.h"
+#include "KeThreadedRenderDevice.h"
+
+
+/*
+ * Debugging macros
+ */
+#define DISPDBG_R( a, b ) { DISPDBG( a, b ); return; }
+#define DISPDBG_RB( a, b ) { DISPDBG( a, b ); return false; }
+
+
+/*
+ * Render thread commands
+ */
+enum
+{
+    KE_RCMD_RELEASE_CONTEXT = 0,
+    KE_RCMD_SET_CLEAR_COLOUR,
+    KE_RCMD_SET_CLEAR_DEPTH,
+    KE_RCMD_SET_CLEAR_STENCIL,
+    KE_RCMD_CLEAR,
+    KE_RCMD_CLEAR_STATE,
+    KE_RCMD_SWAP,
+    KE_RCMD_SET_IM_CACHE_SIZE,
+    KE_RCMD_CREATE_GEOMETRY_BUFFER,
+    KE_RCMD_SET_GEOMETRY_BUFFER,
+    KE_RCMD_GEOMETRY_BUFFER_SET_DATA,
+    KE_RCMD_GEOMETRY_BUFFER_COPY_DATA,
+    KE_RCMD_RESTORE_IMMEDIATE_CONTEXT,
+    KE_RCMD_CREATE_PROGRAM,
+    KE_RCMD_POLL_PROGRAM,
+    KE_RCMD_SET_FALLBACK_PROGRAM,
+    KE_RCMD_SET_PROGRAM_CACHE_PATH,
+    KE_RCMD_SET_PROGRAM,
+    KE_RCMD_SET_PROGRAM_CONSTANT,
+    KE_RCMD_CREATE_CONSTANT_BUFFER,
+    KE_RCMD_SET_CONSTANT_BUFFER_DATA,
+    KE_RCMD_SET_CONSTANT_BUFFER,
+    KE_RCMD_SET_TRANSIENT_CONSTANTS,
+    KE_RCMD_CREATE_TEXTURE,
+    KE_RCMD_CREATE_COMPRESSED_TEXTURE,
+    KE_RCMD_SET_TEXTURE_DATA,
+    KE_RCMD_TEXTURE_SET_DATA,
+    KE_RCMD_SET_TEXTURE_MIP_RANGE,
+    KE_RCMD_CREATE_RENDER_TARGET,
+    KE_RCMD_BIND_RENDER_TARGET,
+    KE_RCMD_SET_TEXTURE,
+    KE_RCMD_CREATE_STATE_BUFFER,
+    KE_RCMD_SET_RENDER_STATE_BUFFER,
+    KE_RCMD_SET_TEXTURE_SAMPLER_BUFFER,
+    KE_RCMD_SET_RENDER_STATES,
+    KE_RCMD_SET_SAMPLER_STATES,
+    KE_RCMD_DRAW_IM,
+    KE_RCMD_DRAW,
+    KE_RCMD_CREATE_INDIRECT_BUFFER,
+    KE_RCMD_SET_INDIRECT_COMMANDS,
+    KE_RCMD_DRAW_INDIRECT,
+    KE_RCMD_CREATE_OCCLUSION_QUERY,
+    KE_RCMD_BEGIN_QUERY,
+    KE_RCMD_END_QUERY,
+    KE_RCMD_POLL_QUERY,
+    KE_RCMD_BEGIN_CONDITIONAL_RENDER,
+    KE_RCMD_END_CONDITIONAL_RENDER,
+    KE_RCMD_REQUEST_FRAMEBUFFER_REGION,
+    KE_RCMD_POLL_FRAMEBUFFER_REGION,
+    KE_RCMD_RELEASE_FRAMEBUFFER_REGION,
+    KE_RCMD_SET_VIEWPORT,
+    KE_RCMD_SET_PERSPECTIVE_MATRIX,
+    KE_RCMD_SET_MATRIX,
+    KE_RCMD_SET_WORLD_MATRIX_BATCH,
+    KE_RCMD_SET_DRAW_INDEX,
+    KE_RCMD_SET_SWAP_INTERVAL,
+    KE_RCMD_KICK,
+    KE_RCMD_CREATE_FENCE,
+    KE_RCMD_INSERT_FENCE,
+    KE_RCMD_POLL_FENCE,
+    KE_RCMD_SET_MAX_FRAME_LATENCY,
+    KE_RCMD_UNMAP,
+    KE_RCMD_DELETE,
+    KE_RCMD_DESTROY,
+    KE_RCMD_TRIM,
+};
+
+/*
+ * Resource wrapper types (for KE_RCMD_UNMAP, KE_RCMD_DELETE and KE_RCMD_DESTROY)
+ */
+enum
+{
+    KE_THREADED_GEOMETRY_BUFFER = 0,
+    KE_THREADED_CONSTANT_BUFFER,
+    KE_THREADED_INDIRECT_BUFFER,
+    KE_THREADED_GPU_PROGRAM,
+    KE_THREADED_TEXTURE,
+    KE_THREADED_RENDER_TARGET,
+    KE_THREADED_FENCE,
+    KE_THREADED_RENDER_STATE_BUFFER,
+    KE_THREADED_TEXTURE_SAMPLER_BUFFER,
+    KE_THREADED_OCCLUSION_QUERY,
+};
+
+/*
+ * Variants of the grouped commands
+ */
+#define KE_MATRIX_MODELVIEW     3   /* Alongside the matrix types in KeRenderDevice.h */
+
+enum
+{
+    KE_DRAW_VERTICES = 0,
+    KE_DRAW_INDEXED_VERTICES,
+    KE_DRAW_INDEXED_VERTICES_RANGE,
+    KE_DRAW_INDEXED_VERTICES_BASE_VERTEX,
+};
+
+enum
+{
+    KE_TEXTURE_DATA_1D = 0,
+    KE_TEXTURE_DATA_2D,
+    KE_TEXTURE_DATA_3D,
+    KE_TEXTURE_DATA_2D_ASYNC,
+};
+
+#define KE_RCMD_ALIGNMENT   16  /* Alignment of data blocks within a command buffer */
+
+
+/* Reads a value from a command buffer */
+template <class T> static inline T KeRead( uint8_t** p )
+{
+    T value;
+
+    memcpy( &value, *p, sizeof( T ) );
+    (*p) += sizeof( T );
+
+    return value;
+}
+
+/* Reads a data block written with PVT_PutData.  Returns NULL for empty blocks. */
+static inline void* KeReadData( uint8_t** p, uint8_t* base, uint32_t* size = NULL )
+{
+    uint32_t data_size = KeRead<uint32_t>( p );
+
+    if( size )
+        *size = data_size;
+    if( !data_size )
+        return NULL;
+
+    (*p) = base + ( ( ( (*p) - base ) + KE_RCMD_ALIGNMENT - 1 ) & ~( KE_RCMD_ALIGNMENT - 1 ) );
+    void* data = (*p);
+    (*p) += data_size;
+
+    return data;
+}
+
+/* Returns the number of vertex attributes in a list, including the -1 terminator */
+static uint32_t KeVertexAttributeCount( KeVertexAttribute* va )
+{
+    uint32_t count = 0;
+
+    if( !va )
+        return 0;
+
+    while( va[count].index != -1 )
+        count++;
+
+    return count+1;
+}
+
+/* Returns the number of states in a list, including the -1 terminator */
+static uint32_t KeStateCount( KeState* states )
+{
+    uint32_t count = 0;
+
+    if( !states )
+        return 0;
+
+    while( states[count].state != (uint32_t) -1 )
+        count++;
+
+    return count+1;
+}
+
+/* Returns the wrapped resource behind a resource wrapper (NULL stays NULL) */
+static inline IKeGeometryBuffer* KeReal( IKeGeometryBuffer* gb ) { return gb ? static_cast<IKeThreadedGeometryBuffer*>( gb )->real : NULL; }
+static inline IKeConstantBuffer* KeReal( IKeConstantBuffer* cb ) { return cb ? static_cast<IKeThreadedConstantBuffer*>( cb )->real : NULL; }
+static inline IKeIndirectBuffer* KeReal( IKeIndirectBuffer* ib ) { return ib ? static_cast<IKeThreadedIndirectBuffer*>( ib )->real : NULL; }
+static inline IKeGpuProgram* KeReal( IKeGpuProgram* gp ) { return gp ? static_cast<IKeThreadedGpuProgram*>( gp )->real : NULL; }
+static inline IKeTexture* KeReal( IKeTexture* t ) { return t ? static_cast<IKeThreadedTexture*>( t )->real : NULL; }
+static inline IKeRenderTarget* KeReal( IKeRenderTarget* rt ) { return rt ? static_cast<IKeThreadedRenderTarget*>( rt )->real : NULL; }
+static inline IKeRenderStateBuffer* KeReal( IKeRenderStateBuffer* rs ) { return rs ? static_cast<IKeThreadedRenderStateBuffer*>( rs )->real : NULL; }
+static inline IKeTextureSamplerBuffer* KeReal( IKeTextureSamplerBuffer* ts ) { return ts ? static_cast<IKeThreadedTextureSamplerBuffer*>( ts )->real : NULL; }
+static inline IKeOcclusionQuery* KeReal( IKeOcclusionQuery* q ) { return q ? static_cast<IKeThreadedOcclusionQuery*>( q )->real : NULL; }
+
+/* Returns the readback entry for a ticket (call with the device lock held) */
+static KeThreadedReadback* KeFindReadback( std::vector<KeThreadedReadback>& readbacks, uint32_t ticket )
+{
+    for( size_t i = 0; i < readbacks.size(); i++ )
+    {
+        if( readbacks[i].ticket == ticket )
+            return &readbacks[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Name: KeRenderThreadProc
+ * Desc: Entry point of the render thread.
+ */
+#ifdef _WIN32
+uint32_t __stdcall KeRenderThreadProc( void* context )
+#else
+void KeRenderThreadProc( void* context )
+#endif
+{
+    static_cast<IKeThreadedRenderDevice*>( context )->PVT_RenderThread();
+
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+
+/*
+ * Name: IKeThreadedRenderDevice::IKeThreadedRenderDevice
+ * Desc: Wraps an existing render device and starts the render thread.  The wrapped device
+ *       must have been created (and confirmed) on the calling thread; its context is handed
+ *       over to the render thread, and the device is deleted along with this one.
+ */
+IKeThreadedRenderDevice::IKeThreadedRenderDevice( IKeRenderDevice* renderdevice, int pipeline_depth ) : device(renderdevice),
+    thread(NULL), submitted(0), executed(0), quit(No), context_acquired(0), render_current(No), next_ticket(0)
+{
+    /* Clamp the pipeline depth */
+    depth = pipeline_depth;
+    if( depth < 1 )
+        depth = 1;
+    if( depth > KE_RENDER_THREAD_MAX_DEPTH )
+        depth = KE_RENDER_THREAD_MAX_DEPTH;
+
+    recording = &buffers[0];
+
+    /* Keep copies of everything the game thread may ask for without a round trip */
+    device_desc = new KeRenderDeviceDesc;
+    device_caps = new KeRenderDeviceCaps;
+
+    confirmed = device->ConfirmDevice();
+    device->GetDeviceDesc( device_desc );
+    device->GetDeviceCaps( device_caps );
+    device->GetViewportV( viewport );
+    device->GetViewMatrix( &view_matrix );
+    device->GetWorldMatrix( &world_matrix );
+    device->GetModelviewMatrix( &modelview_matrix );
+    device->GetProjectionMatrix( &projection_matrix );
+    swap_interval = device->GetSwapInterval();
+    max_frame_latency = device->GetMaxFrameLatency();
+    completed_frame = device->GetCompletedFrame();
+
+    current_geometrybuffer = NULL;
+    current_gpu_program = NULL;
+    ZeroMemory( current_texture, sizeof( current_texture ) );
+
+    pthread_cond_init( &submitted_cond, NULL );
+    pthread_cond_init( &executed_cond, NULL );
+
+    /* Hand the context over to the render thread */
+    device->MakeCurrent( No );
+    thread = new KeThread( KeRenderThreadProc, this );
+
+    initialized = confirmed ? true : false;
+}
+
+
+/*
+ * Name: IKeThreadedRenderDevice::~IKeThreadedRenderDevice
+ * Desc: Finishes the recorded commands, stops the render thread and deletes the wrapped device.
+ */
+IKeThreadedRenderDevice::~IKeThreadedRenderDevice()
+{
+    /* Execute everything that was recorded, then take the context back */
+    context_acquired = 0;
+    PVT_Command( KE_RCMD_RELEASE_CONTEXT );
+    PVT_Submit();
+    PVT_Drain();
+
+    /* Stop the render thread */
+    lock.Enter();
+    quit = Yes;
+    pthread_cond_signal( &submitted_cond );
+    lock.Leave();
+
+#ifdef _WIN32
+    thread->Wait( INFINITE );
+#endif
+    delete thread;
+
+    pthread_cond_destroy( &submitted_cond );
+    pthread_cond_destroy( &executed_cond );
+
+    /* Delete the wrapped device on this thread */
+    device->MakeCurrent( Yes );
+    delete device;
+
+    delete device_desc;
+    delete device_caps;
+}
+
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_Command
+ * Desc: Starts recording a command.  Its arguments follow with PVT_Put/PVT_PutData.
+ */
+void IKeThreadedRenderDevice::PVT_Command( uint32_t command )
+{
+    PVT_Put( &command, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_Put
+ * Desc: Appends a command argument to the command buffer being recorded.
+ */
+void IKeThreadedRenderDevice::PVT_Put( const void* data, uint32_t size )
+{
+    recording->insert( recording->end(), (const uint8_t*) data, (const uint8_t*) data + size );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_PutData
+ * Desc: Copies a block of caller data into the command buffer being recorded, so the caller is
+ *       free to reuse it as soon as the call returns.  A NULL pointer is recorded as NULL.
+ */
+void IKeThreadedRenderDevice::PVT_PutData( const void* data, uint32_t size )
+{
+    if( !data )
+        size = 0;
+
+    PVT_Put( &size, sizeof( uint32_t ) );
+    if( !size )
+        return;
+
+    /* Align the data so that matrices and state lists can be used in place */
+    size_t offset = ( recording->size() + KE_RCMD_ALIGNMENT - 1 ) & ~( KE_RCMD_ALIGNMENT - 1 );
+    recording->resize( offset );
+    PVT_Put( data, size );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_PutString
+ * Desc: Copies a string (which may be NULL) into the command buffer being recorded.
+ */
+void IKeThreadedRenderDevice::PVT_PutString( const char* string )
+{
+    PVT_PutData( string, string ? uint32_t( strlen( string ) + 1 ) : 0 );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_Submit
+ * Desc: Hands the command buffer being recorded over to the render thread and moves on to the
+ *       next one.  Blocks while the render thread is more than depth buffers behind.
+ */
+void IKeThreadedRenderDevice::PVT_Submit()
+{
+    /* The render thread needs the context back before it can execute anything */
+    if( context_acquired )
+    {
+        DISPDBG( KE_WARNING, "Submitting commands while the context is still acquired!" );
+        context_acquired = 1;
+        PVT_ReleaseContext();
+    }
+
+    lock.Enter();
+
+    submitted++;
+    pthread_cond_signal( &submitted_cond );
+
+    /* The next buffer in the ring is free once the render thread is at most depth buffers behind */
+    while( submitted - executed > uint32_t( depth ) )
+        pthread_cond_wait( &executed_cond, &lock.mutex );
+
+    recording = &buffers[submitted % ( depth+1 )];
+
+    lock.Leave();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_Drain
+ * Desc: Blocks until the render thread has executed every submitted command buffer.
+ */
+void IKeThreadedRenderDevice::PVT_Drain()
+{
+    lock.Enter();
+
+    while( executed != submitted )
+        pthread_cond_wait( &executed_cond, &lock.mutex );
+
+    lock.Leave();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_AcquireContext
+ * Desc: Executes everything recorded so far and borrows the context, so the wrapped device can
+ *       be called directly on this thread.  Needed by calls that must return an answer right
+ *       away.  Calls can be nested; each one must be matched with PVT_ReleaseContext.
+ * NOTE: This stalls until the render thread is idle, so it should be kept out of the frame loop.
+ */
+bool IKeThreadedRenderDevice::PVT_AcquireContext()
+{
+    if( context_acquired )
+    {
+        context_acquired++;
+        return true;
+    }
+
+    PVT_Command( KE_RCMD_RELEASE_CONTEXT );
+    PVT_Submit();
+    PVT_Drain();
+
+    if( !device->MakeCurrent( Yes ) )
+        DISPDBG_RB( KE_ERROR, "Unable to borrow the context from the render thread!" );
+
+    context_acquired = 1;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_ReleaseContext
+ * Desc: Hands a context borrowed with PVT_AcquireContext back to the render thread.
+ */
+void IKeThreadedRenderDevice::PVT_ReleaseContext()
+{
+    if( !context_acquired )
+        return;
+
+    if( --context_acquired )
+        return;
+
+    /* The render thread makes it current again before executing its next buffer */
+    device->MakeCurrent( No );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_RenderThread
+ * Desc: Render thread loop; executes submitted command buffers in order until told to quit.
+ */
+void IKeThreadedRenderDevice::PVT_RenderThread()
+{
+    while( true )
+    {
+        lock.Enter();
+
+        while( executed == submitted && !quit )
+            pthread_cond_wait( &submitted_cond, &lock.mutex );
+
+        if( executed == submitted )
+        {
+            lock.Leave();
+            break;
+        }
+
+        std::vector<uint8_t>* buffer = &buffers[executed % ( depth+1 )];
+
+        lock.Leave();
+
+        if( !render_current )
+        {
+            device->MakeCurrent( Yes );
+            render_current = Yes;
+        }
+
+        PVT_Execute( buffer );
+        buffer->clear();
+
+        lock.Enter();
+        executed++;
+        pthread_cond_broadcast( &executed_cond );
+        lock.Leave();
+    }
+
+    if( render_current )
+        device->MakeCurrent( No );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::PVT_Execute
+ * Desc: Plays back a command buffer on the wrapped device (render thread only).
+ */
+void IKeThreadedRenderDevice::PVT_Execute( std::vector<uint8_t>* buffer )
+{
+    if( buffer->empty() )
+        return;
+
+    uint8_t* base = &(*buffer)[0];
+    uint8_t* p = base;
+    uint8_t* end = base + buffer->size();
+
+    while( p < end )
+    {
+        uint32_t command = KeRead<uint32_t>( &p );
+
+        switch( command )
+        {
+            case KE_RCMD_RELEASE_CONTEXT:
+                device->MakeCurrent( No );
+                render_current = No;
+                break;
+
+            case KE_RCMD_SET_CLEAR_COLOUR:
+            {
+                float colour[4];
+                memcpy( colour, p, sizeof( colour ) );
+                p += sizeof( colour );
+                device->SetClearColourFV( colour );
+            }
+            break;
+
+            case KE_RCMD_SET_CLEAR_DEPTH:
+                device->SetClearDepth( KeRead<float>( &p ) );
+                break;
+
+            case KE_RCMD_SET_CLEAR_STENCIL:
+                device->SetClearStencil( KeRead<uint32_t>( &p ) );
+                break;
+
+            case KE_RCMD_CLEAR:
+                device->Clear( KeRead<uint32_t>( &p ) );
+                break;
+
+            case KE_RCMD_CLEAR_STATE:
+                device->ClearState();
+                break;
+
+            case KE_RCMD_SWAP:
+            {
+                device->Swap();
+
+                uint32_t completed = device->GetCompletedFrame();
+                lock.Enter();
+                completed_frame = completed;
+                lock.Leave();
+            }
+            break;
+
+            case KE_RCMD_SET_IM_CACHE_SIZE:
+                device->SetIMCacheSize( KeRead<uint32_t>( &p ) );
+                break;
+
+            case KE_RCMD_CREATE_GEOMETRY_BUFFER:
+            {
+                IKeThreadedGeometryBuffer* gb = KeRead<IKeThreadedGeometryBuffer*>( &p );
+                void* vertex_data = KeReadData( &p, base );
+                uint32_t vertex_data_size = KeRead<uint32_t>( &p );
+                void* index_data = KeReadData( &p, base );
+                uint32_t index_data_size = KeRead<uint32_t>( &p );
+                uint32_t index_data_type = KeRead<uint32_t>( &p );
+                uint32_t flags = KeRead<uint32_t>( &p );
+                KeVertexAttribute* va = (KeVertexAttribute*) KeReadData( &p, base );
+
+                if( !device->CreateGeometryBuffer( vertex_data, vertex_data_size, index_data, index_data_size, index_data_type, flags, va, &gb->real ) )
+                    gb->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_SET_GEOMETRY_BUFFER:
+                device->SetGeometryBuffer( KeReal( KeRead<IKeGeometryBuffer*>( &p ) ) );
+                break;
+
+            case KE_RCMD_GEOMETRY_BUFFER_SET_DATA:
+            {
+                IKeGeometryBuffer* gb = KeReal( KeRead<IKeGeometryBuffer*>( &p ) );
+                int indices = KeRead<int>( &p );
+                uint32_t offset = KeRead<uint32_t>( &p );
+                uint32_t size = 0;
+                void* data = KeReadData( &p, base, &size );
+
+                if( gb && indices )
+                    gb->SetIndexData( offset, size, data );
+                else if( gb )
+                    gb->SetVertexData( offset, size, data );
+            }
+            break;
+
+            case KE_RCMD_GEOMETRY_BUFFER_COPY_DATA:
+            {
+                IKeGeometryBuffer* gb = KeReal( KeRead<IKeGeometryBuffer*>( &p ) );
+                int indices = KeRead<int>( &p );
+                uint32_t dst_offset = KeRead<uint32_t>( &p );
+                uint32_t src_offset = KeRead<uint32_t>( &p );
+                uint32_t size = KeRead<uint32_t>( &p );
+
+                if( gb && indices )
+                    gb->CopyIndexData( dst_offset, src_offset, size );
+                else if( gb )
+                    gb->CopyVertexData( dst_offset, src_offset, size );
+            }
+            break;
+
+            case KE_RCMD_RESTORE_IMMEDIATE_CONTEXT:
+                device->RestoreImmediateContext();
+                break;
+
+            case KE_RCMD_CREATE_PROGRAM:
+            {
+                IKeThreadedGpuProgram* gp = KeRead<IKeThreadedGpuProgram*>( &p );
+                int async = KeRead<int>( &p );
+                const char* vertex_shader = (const char*) KeReadData( &p, base );
+                const char* fragment_shader = (const char*) KeReadData( &p, base );
+                const char* geometry_shader = (const char*) KeReadData( &p, base );
+                const char* tesselation_shader = (const char*) KeReadData( &p, base );
+                KeVertexAttribute* va = (KeVertexAttribute*) KeReadData( &p, base );
+                bool ret;
+
+                if( async )
+                    ret = device->CreateProgramAsync( vertex_shader, fragment_shader, geometry_shader, tesselation_shader, va, &gp->real );
+                else
+                    ret = device->CreateProgram( vertex_shader, fragment_shader, geometry_shader, tesselation_shader, va, &gp->real );
+
+                if( !ret )
+                    gp->real = NULL;
+                else if( gp->real->IsReady() )
+                {
+                    lock.Enter();
+                    gp->ready = Yes;
+                    lock.Leave();
+                }
+            }
+            break;
+
+            case KE_RCMD_POLL_PROGRAM:
+            {
+                IKeThreadedGpuProgram* gp = KeRead<IKeThreadedGpuProgram*>( &p );
+
+                if( gp->real && gp->real->IsReady() )
+                {
+                    lock.Enter();
+                    gp->ready = Yes;
+                    lock.Leave();
+                }
+            }
+            break;
+
+            case KE_RCMD_SET_FALLBACK_PROGRAM:
+                device->SetFallbackProgram( KeReal( KeRead<IKeGpuProgram*>( &p ) ) );
+                break;
+
+            case KE_RCMD_SET_PROGRAM_CACHE_PATH:
+                device->SetProgramCachePath( (const char*) KeReadData( &p, base ) );
+                break;
+
+            case KE_RCMD_SET_PROGRAM:
+                device->SetProgram( KeReal( KeRead<IKeGpuProgram*>( &p ) ) );
+                break;
+
+            case KE_RCMD_SET_PROGRAM_CONSTANT:
+            {
+                uint32_t type = KeRead<uint32_t>( &p );
+                const char* location = (const char*) KeReadData( &p, base );
+                int count = KeRead<int>( &p );
+                void* value = KeReadData( &p, base );
+
+                switch( type )
+                {
+                    case 0: device->SetProgramConstant1FV( location, count, (float*) value ); break;
+                    case 1: device->SetProgramConstant2FV( location, count, (float*) value ); break;
+                    case 2: device->SetProgramConstant3FV( location, count, (float*) value ); break;
+                    case 3: device->SetProgramConstant4FV( location, count, (float*) value ); break;
+                    case 4: device->SetProgramConstant1IV( location, count, (int*) value ); break;
+                    case 5: device->SetProgramConstant2IV( location, count, (int*) value ); break;
+                    case 6: device->SetProgramConstant3IV( location, count, (int*) value ); break;
+                    case 7: device->SetProgramConstant4IV( location, count, (int*) value ); break;
+                }
+            }
+            break;
+
+            case KE_RCMD_CREATE_CONSTANT_BUFFER:
+            {
+                IKeThreadedConstantBuffer* cb = KeRead<IKeThreadedConstantBuffer*>( &p );
+                void* data = KeReadData( &p, base );
+
+                if( !device->CreateConstantBuffer( &cb->desc, &cb->real, data ) )
+                    cb->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_SET_CONSTANT_BUFFER_DATA:
+            {
+                IKeConstantBuffer* cb = KeReal( KeRead<IKeConstantBuffer*>( &p ) );
+                int whole = KeRead<int>( &p );
+                uint32_t offset = KeRead<uint32_t>( &p );
+                uint32_t size = 0;
+                void* data = KeReadData( &p, base, &size );
+
+                if( cb && whole )
+                    device->SetConstantBufferData( data, cb );
+                else if( cb )
+                    cb->SetConstantData( offset, size, data );
+            }
+            break;
+
+            case KE_RCMD_SET_CONSTANT_BUFFER:
+            {
+                int slot = KeRead<int>( &p );
+                int shader_type = KeRead<int>( &p );
+                IKeConstantBuffer* cb = KeReal( KeRead<IKeConstantBuffer*>( &p ) );
+
+                device->SetConstantBuffer( slot, shader_type, cb );
+            }
+            break;
+
+            case KE_RCMD_SET_TRANSIENT_CONSTANTS:
+            {
+                int slot = KeRead<int>( &p );
+                uint32_t size = 0;
+                void* data = KeReadData( &p, base, &size );
+
+                device->SetTransientConstants( slot, data, size );
+            }
+            break;
+
+            case KE_RCMD_CREATE_TEXTURE:
+            {
+                IKeThreadedTexture* t = KeRead<IKeThreadedTexture*>( &p );
+                int dimensions = KeRead<int>( &p );
+                uint32_t target = KeRead<uint32_t>( &p );
+                int width = KeRead<int>( &p );
+                int height = KeRead<int>( &p );
+                int depth = KeRead<int>( &p );
+                int mipmaps = KeRead<int>( &p );
+                uint32_t format = KeRead<uint32_t>( &p );
+                uint32_t data_type = KeRead<uint32_t>( &p );
+                void* pixels = KeReadData( &p, base );
+                bool ret;
+
+                if( dimensions == 1 )
+                    ret = device->CreateTexture1D( target, width, mipmaps, format, data_type, &t->real, pixels );
+                else if( dimensions == 2 )
+                    ret = device->CreateTexture2D( target, width, height, mipmaps, format, data_type, &t->real, pixels );
+                else
+                    ret = device->CreateTexture3D( target, width, height, depth, mipmaps, format, data_type, &t->real, pixels );
+
+                if( !ret )
+                    t->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_CREATE_COMPRESSED_TEXTURE:
+            {
+                IKeThreadedTexture* t = KeRead<IKeThreadedTexture*>( &p );
+                uint32_t target = KeRead<uint32_t>( &p );
+                int width = KeRead<int>( &p );
+                int height = KeRead<int>( &p );
+                int mip_count = KeRead<int>( &p );
+                uint32_t format = KeRead<uint32_t>( &p );
+                std::vector<void*> mip_data( mip_count );
+                std::vector<uint32_t> mip_sizes( mip_count );
+
+                for( int i = 0; i < mip_count; i++ )
+                    mip_data[i] = KeReadData( &p, base, &mip_sizes[i] );
+
+                if( !mip_count || !device->CreateCompressedTexture2D( target, width, height, mip_count, format, &mip_data[0], &mip_sizes[0], &t->real ) )
+                    t->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_SET_TEXTURE_DATA:
+            {
+                int type = KeRead<int>( &p );
+                IKeTexture* t = KeReal( KeRead<IKeTexture*>( &p ) );
+                int offset[3], size[3];
+
+                memcpy( offset, p, sizeof( offset ) );
+                p += sizeof( offset );
+                memcpy( size, p, sizeof( size ) );
+                p += sizeof( size );
+                int miplevel = KeRead<int>( &p );
+                void* pixels = KeReadData( &p, base );
+
+                if( !t )
+                    break;
+
+                switch( type )
+                {
+                    case KE_TEXTURE_DATA_1D: device->SetTextureData1D( offset[0], size[0], miplevel, pixels, t ); break;
+                    case KE_TEXTURE_DATA_2D: device->SetTextureData2D( offset[0], offset[1], size[0], size[1], miplevel, pixels, t ); break;
+                    case KE_TEXTURE_DATA_3D: device->SetTextureData3D( offset[0], offset[1], offset[2], size[0], size[1], size[2], miplevel, pixels, t ); break;
+                    case KE_TEXTURE_DATA_2D_ASYNC: device->SetTextureData2DAsync( offset[0], offset[1], size[0], size[1], miplevel, pixels, t ); break;
+                }
+            }
+            break;
+
+            case KE_RCMD_TEXTURE_SET_DATA:
+            {
+                IKeTexture* t = KeReal( KeRead<IKeTexture*>( &p ) );
+                KeTextureDesc desc = KeRead<KeTextureDesc>( &p );
+                void* pixels = KeReadData( &p, base );
+
+                if( t )
+                    t->SetTextureData( &desc, pixels );
+            }
+            break;
+
+            case KE_RCMD_SET_TEXTURE_MIP_RANGE:
+            {
+                IKeTexture* t = KeReal( KeRead<IKeTexture*>( &p ) );
+                int base_level = KeRead<int>( &p );
+                int max_level = KeRead<int>( &p );
+
+                if( t )
+                    device->SetTextureMipRange( t, base_level, max_level );
+            }
+            break;
+
+            case KE_RCMD_CREATE_RENDER_TARGET:
+            {
+                IKeThreadedRenderTarget* rt = KeRead<IKeThreadedRenderTarget*>( &p );
+                int width = KeRead<int>( &p );
+                int height = KeRead<int>( &p );
+                int depth = KeRead<int>( &p );
+                uint32_t flags = KeRead<uint32_t>( &p );
+
+                if( !device->CreateRenderTarget( width, height, depth, flags, &rt->real ) )
+                    rt->real = NULL;
+                else
+                    rt->texture->real = rt->real->GetTexture2();
+            }
+            break;
+
+            case KE_RCMD_BIND_RENDER_TARGET:
+                device->BindRenderTarget( KeReal( KeRead<IKeRenderTarget*>( &p ) ) );
+                break;
+
+            case KE_RCMD_SET_TEXTURE:
+            {
+                int stage = KeRead<int>( &p );
+                IKeTexture* t = KeReal( KeRead<IKeTexture*>( &p ) );
+
+                device->SetTexture( stage, t );
+            }
+            break;
+
+            case KE_RCMD_CREATE_STATE_BUFFER:
+            {
+                int type = KeRead<int>( &p );
+                IKeUnknown* sb = KeRead<IKeUnknown*>( &p );
+                int state_count = KeRead<int>( &p );
+                KeState* states = (KeState*) KeReadData( &p, base );
+
+                if( type == KE_THREADED_RENDER_STATE_BUFFER )
+                {
+                    IKeThreadedRenderStateBuffer* rs = static_cast<IKeThreadedRenderStateBuffer*>( sb );
+                    if( !device->CreateRenderStateBuffer( states, state_count, &rs->real ) )
+                        rs->real = NULL;
+                }
+                else
+                {
+                    IKeThreadedTextureSamplerBuffer* ts = static_cast<IKeThreadedTextureSamplerBuffer*>( sb );
+                    if( !device->CreateTextureSamplerBuffer( states, state_count, &ts->real ) )
+                        ts->real = NULL;
+                }
+            }
+            break;
+
+            case KE_RCMD_SET_RENDER_STATE_BUFFER:
+            {
+                IKeRenderStateBuffer* rs = KeReal( KeRead<IKeRenderStateBuffer*>( &p ) );
+
+                if( rs )
+                    device->SetRenderStateBuffer( rs );
+            }
+            break;
+
+            case KE_RCMD_SET_TEXTURE_SAMPLER_BUFFER:
+            {
+                int stage = KeRead<int>( &p );
+                IKeTextureSamplerBuffer* ts = KeReal( KeRead<IKeTextureSamplerBuffer*>( &p ) );
+
+                if( ts )
+                    device->SetTextureSamplerBuffer( stage, ts );
+            }
+            break;
+
+            case KE_RCMD_SET_RENDER_STATES:
+                device->SetRenderStates( (KeState*) KeReadData( &p, base ) );
+                break;
+
+            case KE_RCMD_SET_SAMPLER_STATES:
+            {
+                int stage = KeRead<int>( &p );
+                KeState* states = (KeState*) KeReadData( &p, base );
+
+                device->SetSamplerStates( stage, states );
+            }
+            break;
+
+            case KE_RCMD_DRAW_IM:
+            {
+                int type = KeRead<int>( &p );
+                uint32_t primtype = KeRead<uint32_t>( &p );
+                uint32_t stride = KeRead<uint32_t>( &p );
+                int first = KeRead<int>( &p );
+                int start = KeRead<int>( &p );
+                int end = KeRead<int>( &p );
+                int count = KeRead<int>( &p );
+                KeVertexAttribute* va = (KeVertexAttribute*) KeReadData( &p, base );
+                void* vertex_data = KeReadData( &p, base );
+                void* index_data = KeReadData( &p, base );
+
+                if( type == KE_DRAW_VERTICES )
+                    device->DrawVerticesIM( primtype, stride, va, first, count, vertex_data );
+                else if( type == KE_DRAW_INDEXED_VERTICES )
+                    device->DrawIndexedVerticesIM( primtype, stride, va, count, vertex_data, index_data );
+                else
+                    device->DrawIndexedVerticesRangeIM( primtype, stride, va, start, end, count, vertex_data, index_data );
+            }
+            break;
+
+            case KE_RCMD_DRAW:
+            {
+                int type = KeRead<int>( &p );
+                uint32_t primtype = KeRead<uint32_t>( &p );
+                uint32_t stride = KeRead<uint32_t>( &p );
+                int first = KeRead<int>( &p );
+                int end = KeRead<int>( &p );
+                int count = KeRead<int>( &p );
+                int base_vertex = KeRead<int>( &p );
+
+                switch( type )
+                {
+                    case KE_DRAW_VERTICES: device->DrawVertices( primtype, stride, first, count ); break;
+                    case KE_DRAW_INDEXED_VERTICES: device->DrawIndexedVertices( primtype, stride, count ); break;
+                    case KE_DRAW_INDEXED_VERTICES_RANGE: device->DrawIndexedVerticesRange( primtype, stride, first, end, count ); break;
+                    case KE_DRAW_INDEXED_VERTICES_BASE_VERTEX: device->DrawIndexedVerticesBaseVertex( primtype, stride, first, count, base_vertex ); break;
+                }
+            }
+            break;
+
+            case KE_RCMD_CREATE_INDIRECT_BUFFER:
+            {
+                IKeThreadedIndirectBuffer* ib = KeRead<IKeThreadedIndirectBuffer*>( &p );
+                KeDrawIndexedIndirectCommand* commands = (KeDrawIndexedIndirectCommand*) KeReadData( &p, base );
+                uint32_t flags = KeRead<uint32_t>( &p );
+
+                if( !device->CreateIndirectBuffer( commands, ib->command_count, flags, &ib->real ) )
+                    ib->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_SET_INDIRECT_COMMANDS:
+            {
+                IKeIndirectBuffer* ib = KeReal( KeRead<IKeIndirectBuffer*>( &p ) );
+                uint32_t first = KeRead<uint32_t>( &p );
+                uint32_t count = KeRead<uint32_t>( &p );
+                KeDrawIndexedIndirectCommand* commands = (KeDrawIndexedIndirectCommand*) KeReadData( &p, base );
+
+                if( ib )
+                    ib->SetCommands( first, count, commands );
+            }
+            break;
+
+            case KE_RCMD_DRAW_INDIRECT:
+            {
+                uint32_t primtype = KeRead<uint32_t>( &p );
+                IKeIndirectBuffer* ib = KeReal( KeRead<IKeIndirectBuffer*>( &p ) );
+                uint32_t first = KeRead<uint32_t>( &p );
+                uint32_t count = KeRead<uint32_t>( &p );
+
+                if( ib )
+                    device->DrawIndexedVerticesIndirect( primtype, ib, first, count );
+            }
+            break;
+
+            case KE_RCMD_CREATE_OCCLUSION_QUERY:
+            {
+                IKeThreadedOcclusionQuery* q = KeRead<IKeThreadedOcclusionQuery*>( &p );
+                uint32_t type = KeRead<uint32_t>( &p );
+
+                if( !device->CreateOcclusionQuery( type, &q->real ) )
+                    q->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_BEGIN_QUERY:
+            {
+                IKeOcclusionQuery* q = KeReal( KeRead<IKeOcclusionQuery*>( &p ) );
+
+                if( q )
+                    q->Begin();
+            }
+            break;
+
+            case KE_RCMD_END_QUERY:
+            {
+                IKeThreadedOcclusionQuery* q = KeRead<IKeThreadedOcclusionQuery*>( &p );
+
+                q->executed = KeRead<uint32_t>( &p );
+                if( q->real )
+                    q->real->End();
+            }
+            break;
+
+            case KE_RCMD_POLL_QUERY:
+            {
+                IKeThreadedOcclusionQuery* q = KeRead<IKeThreadedOcclusionQuery*>( &p );
+                uint32_t samples = 0;
+
+                /* Only the render thread writes resolved, so it can be read without the lock */
+                if( q->real && q->resolved != q->executed && q->real->GetResult( No, &samples ) )
+                {
+                    lock.Enter();
+                    q->result = samples;
+                    q->resolved = q->executed;
+                    lock.Leave();
+                }
+            }
+            break;
+
+            case KE_RCMD_BEGIN_CONDITIONAL_RENDER:
+            {
+                IKeOcclusionQuery* q = KeReal( KeRead<IKeOcclusionQuery*>( &p ) );
+                int wait = KeRead<int>( &p );
+
+                device->BeginConditionalRender( q, wait );
+            }
+            break;
+
+            case KE_RCMD_END_CONDITIONAL_RENDER:
+                device->EndConditionalRender();
+                break;
+
+            case KE_RCMD_REQUEST_FRAMEBUFFER_REGION:
+            {
+                uint32_t ticket = KeRead<uint32_t>( &p );
+                int region[4];
+
+                memcpy( region, p, sizeof( region ) );
+                p += sizeof( region );
+                uint32_t flags = KeRead<uint32_t>( &p );
+                uint32_t device_ticket = device->RequestFramebufferRegion( region[0], region[1], region[2], region[3], flags );
+
+                lock.Enter();
+                KeThreadedReadback* rb = KeFindReadback( readbacks, ticket );
+                if( rb )
+                {
+                    rb->device_ticket = device_ticket;
+                    if( !device_ticket )
+                        rb->status = KE_READBACK_FAILED;
+                }
+                lock.Leave();
+            }
+            break;
+
+            case KE_RCMD_POLL_FRAMEBUFFER_REGION:
+            {
+                uint32_t ticket = KeRead<uint32_t>( &p );
+                uint32_t device_ticket = 0;
+                int bpp = 0;
+                void* pixels = NULL;
+
+                lock.Enter();
+                KeThreadedReadback* rb = KeFindReadback( readbacks, ticket );
+                if( rb && rb->status == KE_READBACK_PENDING )
+                    device_ticket = rb->device_ticket;
+                lock.Leave();
+
+                if( !device_ticket )
+                    break;
+
+                int status = device->ReadFramebufferRegion( device_ticket, No, &bpp, &pixels );
+                if( status == KE_READBACK_PENDING )
+                    break;
+
+                lock.Enter();
+                rb = KeFindReadback( readbacks, ticket );
+                if( rb )
+                {
+                    rb->status = status;
+                    rb->bpp = bpp;
+                    rb->pixels = pixels;
+                }
+                lock.Leave();
+            }
+            break;
+
+            case KE_RCMD_RELEASE_FRAMEBUFFER_REGION:
+            {
+                uint32_t ticket = KeRead<uint32_t>( &p );
+                uint32_t device_ticket = 0;
+
+                lock.Enter();
+                for( size_t i = 0; i < readbacks.size(); i++ )
+                {
+                    if( readbacks[i].ticket == ticket )
+                    {
+                        device_ticket = readbacks[i].device_ticket;
+                        readbacks.erase( readbacks.begin() + i );
+                        break;
+                    }
+                }
+                lock.Leave();
+
+                if( device_ticket )
+                    device->ReleaseFramebufferRegion( device_ticket );
+            }
+            break;
+
+            case KE_RCMD_SET_VIEWPORT:
+            {
+                int vp[4];
+
+                memcpy( vp, p, sizeof( vp ) );
+                p += sizeof( vp );
+                device->SetViewportV( vp );
+            }
+            break;
+
+            case KE_RCMD_SET_PERSPECTIVE_MATRIX:
+            {
+                float fov = KeRead<float>( &p );
+                float aspect = KeRead<float>( &p );
+                float near_z = KeRead<float>( &p );
+                float far_z = KeRead<float>( &p );
+
+                device->SetPerspectiveMatrix( fov, aspect, near_z, far_z );
+            }
+            break;
+
+            case KE_RCMD_SET_MATRIX:
+            {
+                int type = KeRead<int>( &p );
+                nv::matrix4f* m = (nv::matrix4f*) KeReadData( &p, base );
+
+                switch( type )
+                {
+                    case KE_MATRIX_VIEW: device->SetViewMatrix( m ); break;
+                    case KE_MATRIX_WORLD: device->SetWorldMatrix( m ); break;
+                    case KE_MATRIX_MODELVIEW: device->SetModelviewMatrix( m ); break;
+                    case KE_MATRIX_PROJECTION: device->SetProjectionMatrix( m ); break;
+                }
+            }
+            break;
+
+            case KE_RCMD_SET_WORLD_MATRIX_BATCH:
+            {
+                uint32_t count = KeRead<uint32_t>( &p );
+                nv::matrix4f* m = (nv::matrix4f*) KeReadData( &p, base );
+
+                device->SetWorldMatrixBatch( m, count );
+            }
+            break;
+
+            case KE_RCMD_SET_DRAW_INDEX:
+                device->SetDrawIndex( KeRead<uint32_t>( &p ) );
+                break;
+
+            case KE_RCMD_SET_SWAP_INTERVAL:
+                device->SetSwapInterval( KeRead<int>( &p ) );
+                break;
+
+            case KE_RCMD_KICK:
+                device->Kick();
+                break;
+
+            case KE_RCMD_CREATE_FENCE:
+            {
+                IKeThreadedFence* f = KeRead<IKeThreadedFence*>( &p );
+                uint32_t flags = KeRead<uint32_t>( &p );
+
+                if( !device->CreateFence( &f->real, flags ) )
+                    f->real = NULL;
+            }
+            break;
+
+            case KE_RCMD_INSERT_FENCE:
+            {
+                IKeThreadedFence* f = KeRead<IKeThreadedFence*>( &p );
+
+                f->executed = KeRead<uint32_t>( &p );
+                if( f->real )
+                    f->real->Insert();
+            }
+            break;
+
+            case KE_RCMD_POLL_FENCE:
+            {
+                IKeThreadedFence* f = KeRead<IKeThreadedFence*>( &p );
+
+                /* Only the render thread writes signalled, so it can be read without the lock */
+                if( f->real && f->signalled != f->executed && f->real->Test() )
+                {
+                    lock.Enter();
+                    f->signalled = f->executed;
+                    lock.Leave();
+                }
+            }
+            break;
+
+            case KE_RCMD_SET_MAX_FRAME_LATENCY:
+                device->SetMaxFrameLatency( KeRead<int>( &p ) );
+                break;
+
+            case KE_RCMD_UNMAP:
+            {
+                int type = KeRead<int>( &p );
+                IKeUnknown* r = KeRead<IKeUnknown*>( &p );
+                void* ptr = KeRead<void*>( &p );
+                int async = KeRead<int>( &p );
+
+                switch( type )
+                {
+                    case KE_THREADED_GEOMETRY_BUFFER:
+                    {
+                        IKeGeometryBuffer* gb = static_cast<IKeThreadedGeometryBuffer*>( r )->real;
+                        if( gb && async )
+                            gb->UnmapDataAsync( ptr );
+                        else if( gb )
+                            gb->UnmapData( ptr );
+                    }
+                    break;
+                    case KE_THREADED_CONSTANT_BUFFER:
+                        if( static_cast<IKeThreadedConstantBuffer*>( r )->real )
+                            static_cast<IKeThreadedConstantBuffer*>( r )->real->UnmapData( ptr );
+                        break;
+                    case KE_THREADED_INDIRECT_BUFFER:
+                        if( static_cast<IKeThreadedIndirectBuffer*>( r )->real )
+                            static_cast<IKeThreadedIndirectBuffer*>( r )->real->UnmapData( ptr );
+                        break;
+                    case KE_THREADED_TEXTURE:
+                        if( static_cast<IKeThreadedTexture*>( r )->real )
+                            static_cast<IKeThreadedTexture*>( r )->real->UnmapData( ptr );
+                        break;
+                    case KE_THREADED_RENDER_TARGET:
+                        if( static_cast<IKeThreadedRenderTarget*>( r )->real )
+                            static_cast<IKeThreadedRenderTarget*>( r )->real->UnmapData( ptr );
+                        break;
+                }
+            }
+            break;
+
+            case KE_RCMD_DELETE:
+            {
+                int type = KeRead<int>( &p );
+                IKeUnknown* r = KeRead<IKeUnknown*>( &p );
+
+                switch( type )
+                {
+                    case KE_THREADED_GEOMETRY_BUFFER:
+                    {
+                        IKeThreadedGeometryBuffer* gb = static_cast<IKeThreadedGeometryBuffer*>( r );
+                        if( gb->real )
+                            device->DeleteGeometryBuffer( gb->real );
+                        delete gb;
+                    }
+                    break;
+                    case KE_THREADED_CONSTANT_BUFFER:
+                    {
+                        IKeThreadedConstantBuffer* cb = static_cast<IKeThreadedConstantBuffer*>( r );
+                        if( cb->real )
+                            device->DeleteConstantBuffer( cb->real );
+                        delete cb;
+                    }
+                    break;
+                    case KE_THREADED_INDIRECT_BUFFER:
+                    {
+                        IKeThreadedIndirectBuffer* ib = static_cast<IKeThreadedIndirectBuffer*>( r );
+                        if( ib->real )
+                            device->DeleteIndirectBuffer( ib->real );
+                        delete ib;
+                    }
+                    break;
+                    case KE_THREADED_GPU_PROGRAM:
+                    {
+                        IKeThreadedGpuProgram* gp = static_cast<IKeThreadedGpuProgram*>( r );
+                        if( gp->real )
+                            device->DeleteProgram( gp->real );
+                        delete gp;
+                    }
+                    break;
+                    case KE_THREADED_TEXTURE:
+                    {
+                        IKeThreadedTexture* t = static_cast<IKeThreadedTexture*>( r );
+                        if( t->real )
+                            device->DeleteTexture( t->real );
+                        delete t;
+                    }
+                    break;
+                    case KE_THREADED_RENDER_TARGET:
+                    {
+                        IKeThreadedRenderTarget* rt = static_cast<IKeThreadedRenderTarget*>( r );
+                        if( rt->real )
+                            device->DeleteRenderTarget( rt->real );
+                        delete rt->texture;
+                        delete rt;
+                    }
+                    break;
+                }
+            }
+            break;
+
+            case KE_RCMD_DESTROY:
+            {
+                int type = KeRead<int>( &p );
+                IKeUnknown* r = KeRead<IKeUnknown*>( &p );
+                IKeUnknown* real = NULL;
+
+                /* The wrapped resource may still be used by frames in flight, so let the
+                   wrapped device decide when it is safe to destroy */
+                switch( type )
+                {
+                    case KE_THREADED_GEOMETRY_BUFFER:
+                        real = static_cast<IKeThreadedGeometryBuffer*>( r )->real;
+                        delete static_cast<IKeThreadedGeometryBuffer*>( r );
+                        break;
+                    case KE_THREADED_CONSTANT_BUFFER:
+                        real = static_cast<IKeThreadedConstantBuffer*>( r )->real;
+                        delete static_cast<IKeThreadedConstantBuffer*>( r );
+                        break;
+                    case KE_THREADED_INDIRECT_BUFFER:
+                        real = static_cast<IKeThreadedIndirectBuffer*>( r )->real;
+                        delete static_cast<IKeThreadedIndirectBuffer*>( r );
+                        break;
+                    case KE_THREADED_GPU_PROGRAM:
+                        real = static_cast<IKeThreadedGpuProgram*>( r )->real;
+                        delete static_cast<IKeThreadedGpuProgram*>( r );
+                        break;
+                    case KE_THREADED_TEXTURE:
+                        real = static_cast<IKeThreadedTexture*>( r )->real;
+                        delete static_cast<IKeThreadedTexture*>( r );
+                        break;
+                    case KE_THREADED_RENDER_TARGET:
+                        real = static_cast<IKeThreadedRenderTarget*>( r )->real;
+                        delete static_cast<IKeThreadedRenderTarget*>( r )->texture;
+                        delete static_cast<IKeThreadedRenderTarget*>( r );
+                        break;
+                    case KE_THREADED_FENCE:
+                        real = static_cast<IKeThreadedFence*>( r )->real;
+                        delete static_cast<IKeThreadedFence*>( r );
+                        break;
+                    case KE_THREADED_RENDER_STATE_BUFFER:
+                        real = static_cast<IKeThreadedRenderStateBuffer*>( r )->real;
+                        delete static_cast<IKeThreadedRenderStateBuffer*>( r );
+                        break;
+                    case KE_THREADED_TEXTURE_SAMPLER_BUFFER:
+                        real = static_cast<IKeThreadedTextureSamplerBuffer*>( r )->real;
+                        delete static_cast<IKeThreadedTextureSamplerBuffer*>( r );
+                        break;
+                    case KE_THREADED_OCCLUSION_QUERY:
+                        real = static_cast<IKeThreadedOcclusionQuery*>( r )->real;
+                        delete static_cast<IKeThreadedOcclusionQuery*>( r );
+                        break;
+                }
+
+                if( real )
+                    device->DestroyDeferred( real );
+            }
+            break;
+
+            case KE_RCMD_TRIM:
+                device->Trim();
+                break;
+
+            default:
+                DISPDBG_R( KE_ERROR, "Invalid render thread command!\ncommand: " << command << "\n" );
+        }
+    }
+}
+
+
+/*
+ * Name: IKeThreadedRenderDevice::ConfirmDevice
+ * Desc: Returns true if the wrapped device was successfully initialized.
+ */
+bool IKeThreadedRenderDevice::ConfirmDevice()
+{
+    return confirmed ? true : false;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetDeviceDesc
+ * Desc: Returns a copy of the wrapped device's description.
+ */
+void IKeThreadedRenderDevice::GetDeviceDesc( KeRenderDeviceDesc* device_desc )
+{
+    memmove( device_desc, this->device_desc, sizeof( KeRenderDeviceDesc ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetDeviceCaps
+ * Desc: Returns a copy of the wrapped device's capabilities.
+ */
+void IKeThreadedRenderDevice::GetDeviceCaps( KeRenderDeviceCaps* device_caps )
+{
+    memmove( device_caps, this->device_caps, sizeof( KeRenderDeviceCaps ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetClearColourFV
+ * Desc: Sets the clear colour (recorded).
+ */
+void IKeThreadedRenderDevice::SetClearColourFV( float* colour )
+{
+    memmove( clear_colour, colour, sizeof( float ) * 4 );
+
+    PVT_Command( KE_RCMD_SET_CLEAR_COLOUR );
+    PVT_Put( colour, sizeof( float ) * 4 );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetClearColourUBV
+ * Desc: Sets the clear colour from 8-bit components (recorded).
+ */
+void IKeThreadedRenderDevice::SetClearColourUBV( uint8_t* colour )
+{
+    float fcolour[4];
+
+    for( int i = 0; i < 4; i++ )
+        fcolour[i] = float( colour[i] ) / 255.0f;
+
+    SetClearColourFV( fcolour );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetClearDepth
+ * Desc: Sets the clear depth (recorded).
+ */
+void IKeThreadedRenderDevice::SetClearDepth( float depth )
+{
+    clear_depth = depth;
+
+    PVT_Command( KE_RCMD_SET_CLEAR_DEPTH );
+    PVT_Put( &depth, sizeof( float ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetClearStencil
+ * Desc: Sets the clear stencil value (recorded).
+ */
+void IKeThreadedRenderDevice::SetClearStencil( uint32_t stencil )
+{
+    clear_stencil = stencil;
+
+    PVT_Command( KE_RCMD_SET_CLEAR_STENCIL );
+    PVT_Put( &stencil, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ClearColourBuffer
+ * Desc: Clears the colour buffer (recorded).
+ */
+void IKeThreadedRenderDevice::ClearColourBuffer()
+{
+    Clear( KE_COLOUR_BUFFER );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ClearDepthBuffer
+ * Desc: Clears the depth buffer (recorded).
+ */
+void IKeThreadedRenderDevice::ClearDepthBuffer()
+{
+    Clear( KE_DEPTH_BUFFER );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ClearStencilBuffer
+ * Desc: Clears the stencil buffer (recorded).
+ */
+void IKeThreadedRenderDevice::ClearStencilBuffer()
+{
+    Clear( KE_STENCIL_BUFFER );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Clear
+ * Desc: Clears the selected buffers (recorded).
+ */
+void IKeThreadedRenderDevice::Clear( uint32_t buffers )
+{
+    PVT_Command( KE_RCMD_CLEAR );
+    PVT_Put( &buffers, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ClearState
+ * Desc: Resets the device state (recorded).
+ */
+void IKeThreadedRenderDevice::ClearState()
+{
+    current_geometrybuffer = NULL;
+    current_gpu_program = NULL;
+    ZeroMemory( current_texture, sizeof( current_texture ) );
+
+    PVT_Command( KE_RCMD_CLEAR_STATE );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Swap
+ * Desc: Ends the frame being recorded and hands it to the render thread, which presents it
+ *       once every command before it has executed.  Only blocks when the game thread is more
+ *       than the pipeline depth ahead of the render thread.
+ */
+void IKeThreadedRenderDevice::Swap()
+{
+    PVT_Command( KE_RCMD_SWAP );
+    PVT_Submit();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ResizeRenderTargetAndDepthStencil
+ * Desc: Resizes the back buffers.  Waits for the render thread to go idle.
+ */
+bool IKeThreadedRenderDevice::ResizeRenderTargetAndDepthStencil( int width, int height )
+{
+    if( !PVT_AcquireContext() )
+        return false;
+
+    bool ret = device->ResizeRenderTargetAndDepthStencil( width, height );
+    device->GetViewportV( viewport );
+
+    PVT_ReleaseContext();
+
+    return ret;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetIMCacheSize
+ * Desc: Sets the size of the immediate mode vertex cache (recorded).
+ */
+void IKeThreadedRenderDevice::SetIMCacheSize( uint32_t cache_size )
+{
+    PVT_Command( KE_RCMD_SET_IM_CACHE_SIZE );
+    PVT_Put( &cache_size, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateGeometryBuffer
+ * Desc: Returns a geometry buffer right away; it is created on the render thread with a copy
+ *       of the supplied data.
+ * NOTE: Creation errors are reported when the command executes; the buffer is then ignored.
+ */
+bool IKeThreadedRenderDevice::CreateGeometryBuffer( void* vertex_data, uint32_t vertex_data_size, void* index_data, uint32_t index_data_size, uint32_t index_data_type, uint32_t flags, KeVertexAttribute* va, IKeGeometryBuffer** geometry_buffer )
+{
+    IKeThreadedGeometryBuffer* gb = new IKeThreadedGeometryBuffer;
+
+    gb->device = this;
+    gb->real = NULL;
+
+    PVT_Command( KE_RCMD_CREATE_GEOMETRY_BUFFER );
+    PVT_Put( &gb, sizeof( gb ) );
+    PVT_PutData( vertex_data, vertex_data_size );
+    PVT_Put( &vertex_data_size, sizeof( uint32_t ) );
+    PVT_PutData( index_data, index_data_size );
+    PVT_Put( &index_data_size, sizeof( uint32_t ) );
+    PVT_Put( &index_data_type, sizeof( uint32_t ) );
+    PVT_Put( &flags, sizeof( uint32_t ) );
+    PVT_PutData( va, KeVertexAttributeCount( va ) * sizeof( KeVertexAttribute ) );
+
+    *geometry_buffer = gb;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DeleteGeometryBuffer
+ * Desc: Deletes a geometry buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderDevice::DeleteGeometryBuffer( IKeGeometryBuffer* geometry_buffer )
+{
+    int type = KE_THREADED_GEOMETRY_BUFFER;
+
+    if( !geometry_buffer )
+        return;
+    if( current_geometrybuffer == geometry_buffer )
+        current_geometrybuffer = NULL;
+
+    PVT_Command( KE_RCMD_DELETE );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &geometry_buffer, sizeof( IKeUnknown* ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetGeometryBuffer
+ * Desc: Sets the current geometry buffer (recorded).
+ */
+void IKeThreadedRenderDevice::SetGeometryBuffer( IKeGeometryBuffer* geometry_buffer )
+{
+    current_geometrybuffer = geometry_buffer;
+
+    PVT_Command( KE_RCMD_SET_GEOMETRY_BUFFER );
+    PVT_Put( &geometry_buffer, sizeof( geometry_buffer ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateCommandList
+ * Desc: Command lists can't be recorded through the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateCommandList( IKeCommandList** /*command_list*/ )
+{
+    DISPDBG_RB( KE_WARNING, "Command lists are not supported with a render thread!" );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::BeginCommandList
+ * Desc: Command lists can't be recorded through the render thread.
+ */
+bool IKeThreadedRenderDevice::BeginCommandList( IKeCommandList* /*command_list*/ )
+{
+    DISPDBG_RB( KE_WARNING, "Command lists are not supported with a render thread!" );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::EndCommandList
+ * Desc: Command lists can't be recorded through the render thread.
+ */
+bool IKeThreadedRenderDevice::EndCommandList( IKeCommandList** /*command_list*/, int /*restore_state*/ )
+{
+    DISPDBG_RB( KE_WARNING, "Command lists are not supported with a render thread!" );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ExecuteCommandList
+ * Desc: Command lists can't be recorded through the render thread.
+ */
+bool IKeThreadedRenderDevice::ExecuteCommandList( IKeCommandList* /*command_list*/, int /*restore_state*/ )
+{
+    DISPDBG_RB( KE_WARNING, "Command lists are not supported with a render thread!" );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::RestoreImmediateContext
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::RestoreImmediateContext()
+{
+    PVT_Command( KE_RCMD_RESTORE_IMMEDIATE_CONTEXT );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateProgram
+ * Desc: Returns a GPU program right away; it is compiled on the render thread, and IsReady
+ *       reports false until that has happened.
+ */
+bool IKeThreadedRenderDevice::CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+{
+    return PVT_CreateProgram( No, vertex_shader, fragment_shader, geometry_shader, tesselation_shader, vertex_attributes, gpu_program );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateProgramAsync
+ * Desc: Same as CreateProgram, but uses the wrapped device's asynchronous compilation.
+ */
+bool IKeThreadedRenderDevice::CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+{
+    return PVT_CreateProgram( Yes, vertex_shader, fragment_shader, geometry_shader, tesselation_shader, vertex_attributes, gpu_program );
+}
+
+/* Records the creation of a GPU program */
+bool IKeThreadedRenderDevice::PVT_CreateProgram( int async, const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program )
+{
+    IKeThreadedGpuProgram* gp = new IKeThreadedGpuProgram;
+    uint32_t va_count = KeVertexAttributeCount( vertex_attributes );
+
+    gp->device = this;
+    gp->real = NULL;
+    gp->ready = No;
+    if( va_count )
+        gp->va.assign( vertex_attributes, vertex_attributes + va_count );
+
+    PVT_Command( KE_RCMD_CREATE_PROGRAM );
+    PVT_Put( &gp, sizeof( gp ) );
+    PVT_Put( &async, sizeof( int ) );
+    PVT_PutString( vertex_shader );
+    PVT_PutString( fragment_shader );
+    PVT_PutString( geometry_shader );
+    PVT_PutString( tesselation_shader );
+    PVT_PutData( vertex_attributes, va_count * sizeof( KeVertexAttribute ) );
+
+    *gpu_program = gp;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DeleteProgram
+ * Desc: Deletes a GPU program once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderDevice::DeleteProgram( IKeGpuProgram* gpu_program )
+{
+    int type = KE_THREADED_GPU_PROGRAM;
+
+    if( !gpu_program )
+        return;
+    if( current_gpu_program == gpu_program )
+        current_gpu_program = NULL;
+
+    PVT_Command( KE_RCMD_DELETE );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &gpu_program, sizeof( IKeUnknown* ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetFallbackProgram
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetFallbackProgram( IKeGpuProgram* gpu_program )
+{
+    PVT_Command( KE_RCMD_SET_FALLBACK_PROGRAM );
+    PVT_Put( &gpu_program, sizeof( gpu_program ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetProgramCachePath
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetProgramCachePath( const char* path )
+{
+    PVT_Command( KE_RCMD_SET_PROGRAM_CACHE_PATH );
+    PVT_PutString( path );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetProgramCacheStats
+ * Desc: Waits for the render thread to go idle.
+ */
+void IKeThreadedRenderDevice::GetProgramCacheStats( KeProgramCacheStats* stats )
+{
+    if( !PVT_AcquireContext() )
+        return;
+
+    device->GetProgramCacheStats( stats );
+
+    PVT_ReleaseContext();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetProgram
+ * Desc: Sets the current GPU program (recorded).
+ */
+void IKeThreadedRenderDevice::SetProgram( IKeGpuProgram* gpu_program )
+{
+    current_gpu_program = gpu_program;
+
+    PVT_Command( KE_RCMD_SET_PROGRAM );
+    PVT_Put( &gpu_program, sizeof( gpu_program ) );
+}
+
+/* Records a program constant; type selects the SetProgramConstant* variant (1FV..4FV, 1IV..4IV) */
+void IKeThreadedRenderDevice::PVT_SetProgramConstant( uint32_t type, const char* location, int count, void* value, uint32_t size )
+{
+    PVT_Command( KE_RCMD_SET_PROGRAM_CONSTANT );
+    PVT_Put( &type, sizeof( uint32_t ) );
+    PVT_PutString( location );
+    PVT_Put( &count, sizeof( int ) );
+    PVT_PutData( value, size );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetProgramConstant*
+ * Desc: Recorded; the values are copied.
+ */
+void IKeThreadedRenderDevice::SetProgramConstant1FV( const char* location, int count, float* value )
+{
+    PVT_SetProgramConstant( 0, location, count, value, sizeof( float ) * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant2FV( const char* location, int count, float* value )
+{
+    PVT_SetProgramConstant( 1, location, count, value, sizeof( float ) * 2 * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant3FV( const char* location, int count, float* value )
+{
+    PVT_SetProgramConstant( 2, location, count, value, sizeof( float ) * 3 * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant4FV( const char* location, int count, float* value )
+{
+    PVT_SetProgramConstant( 3, location, count, value, sizeof( float ) * 4 * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant1IV( const char* location, int count, int* value )
+{
+    PVT_SetProgramConstant( 4, location, count, value, sizeof( int ) * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant2IV( const char* location, int count, int* value )
+{
+    PVT_SetProgramConstant( 5, location, count, value, sizeof( int ) * 2 * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant3IV( const char* location, int count, int* value )
+{
+    PVT_SetProgramConstant( 6, location, count, value, sizeof( int ) * 3 * count );
+}
+
+void IKeThreadedRenderDevice::SetProgramConstant4IV( const char* location, int count, int* value )
+{
+    PVT_SetProgramConstant( 7, location, count, value, sizeof( int ) * 4 * count );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetProgramConstantFV
+ * Desc: Waits for the render thread to go idle.
+ */
+void IKeThreadedRenderDevice::GetProgramConstantFV( const char* location, float* value )
+{
+    if( !PVT_AcquireContext() )
+        return;
+
+    device->GetProgramConstantFV( location, value );
+
+    PVT_ReleaseContext();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetProgramConstantIV
+ * Desc: Waits for the render thread to go idle.
+ */
+void IKeThreadedRenderDevice::GetProgramConstantIV( const char* location, int* value )
+{
+    if( !PVT_AcquireContext() )
+        return;
+
+    device->GetProgramConstantIV( location, value );
+
+    PVT_ReleaseContext();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateConstantBuffer
+ * Desc: Returns a constant buffer right away; it is created on the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateConstantBuffer( KeConstantBufferDesc* desc, IKeConstantBuffer** constant_buffer, void* data )
+{
+    IKeThreadedConstantBuffer* cb = new IKeThreadedConstantBuffer;
+
+    cb->device = this;
+    cb->real = NULL;
+    memmove( &cb->desc, desc, sizeof( KeConstantBufferDesc ) );
+
+    PVT_Command( KE_RCMD_CREATE_CONSTANT_BUFFER );
+    PVT_Put( &cb, sizeof( cb ) );
+    PVT_PutData( data, desc->data_size );
+
+    *constant_buffer = cb;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DeleteConstantBuffer
+ * Desc: Deletes a constant buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderDevice::DeleteConstantBuffer( IKeConstantBuffer* constant_buffer )
+{
+    int type = KE_THREADED_CONSTANT_BUFFER;
+
+    if( !constant_buffer )
+        return;
+
+    PVT_Command( KE_RCMD_DELETE );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &constant_buffer, sizeof( IKeUnknown* ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetConstantBufferData
+ * Desc: Recorded; the whole buffer's worth of data is copied.
+ */
+bool IKeThreadedRenderDevice::SetConstantBufferData( void* data, IKeConstantBuffer* constant_buffer )
+{
+    int whole = Yes;
+    uint32_t offset = 0;
+
+    if( !constant_buffer )
+        return false;
+
+    PVT_Command( KE_RCMD_SET_CONSTANT_BUFFER_DATA );
+    PVT_Put( &constant_buffer, sizeof( constant_buffer ) );
+    PVT_Put( &whole, sizeof( int ) );
+    PVT_Put( &offset, sizeof( uint32_t ) );
+    PVT_PutData( data, static_cast<IKeThreadedConstantBuffer*>( constant_buffer )->desc.data_size );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetConstantBuffer
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetConstantBuffer( int slot, int shader_type, IKeConstantBuffer* constant_buffer )
+{
+    PVT_Command( KE_RCMD_SET_CONSTANT_BUFFER );
+    PVT_Put( &slot, sizeof( int ) );
+    PVT_Put( &shader_type, sizeof( int ) );
+    PVT_Put( &constant_buffer, sizeof( constant_buffer ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetTransientConstants
+ * Desc: Recorded; the data is copied.  Ring overflows are reported by the render thread.
+ */
+bool IKeThreadedRenderDevice::SetTransientConstants( int slot, void* data, uint32_t size )
+{
+    if( size > KE_CONSTANT_RING_SIZE / KE_CONSTANT_RING_FRAMES )
+        DISPDBG_RB( KE_ERROR, "Transient constants are too large for the constant ring!" );
+
+    PVT_Command( KE_RCMD_SET_TRANSIENT_CONSTANTS );
+    PVT_Put( &slot, sizeof( int ) );
+    PVT_PutData( data, size );
+
+    return true;
+}
+
+/* Records the creation of an uncompressed texture */
+bool IKeThreadedRenderDevice::PVT_CreateTexture( int dimensions, uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels )
+{
+    IKeThreadedTexture* t = new IKeThreadedTexture;
+
+    t->device = this;
+    t->real = NULL;
+    t->format = format;
+    t->texel_size = KeImageTexelSize( format, data_type );
+
+    PVT_Command( KE_RCMD_CREATE_TEXTURE );
+    PVT_Put( &t, sizeof( t ) );
+    PVT_Put( &dimensions, sizeof( int ) );
+    PVT_Put( &target, sizeof( uint32_t ) );
+    PVT_Put( &width, sizeof( int ) );
+    PVT_Put( &height, sizeof( int ) );
+    PVT_Put( &depth, sizeof( int ) );
+    PVT_Put( &mipmaps, sizeof( int ) );
+    PVT_Put( &format, sizeof( uint32_t ) );
+    PVT_Put( &data_type, sizeof( uint32_t ) );
+    PVT_PutData( pixels, t->texel_size * width * height * depth );
+
+    *texture = t;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateTexture1D/2D/3D
+ * Desc: Return a texture right away; it is created on the render thread with a copy of the
+ *       base level's pixels.
+ */
+bool IKeThreadedRenderDevice::CreateTexture1D( uint32_t target, int width, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels )
+{
+    return PVT_CreateTexture( 1, target, width, 1, 1, mipmaps, format, data_type, texture, pixels );
+}
+
+bool IKeThreadedRenderDevice::CreateTexture2D( uint32_t target, int width, int height, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels )
+{
+    return PVT_CreateTexture( 2, target, width, height, 1, mipmaps, format, data_type, texture, pixels );
+}
+
+bool IKeThreadedRenderDevice::CreateTexture3D( uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels )
+{
+    return PVT_CreateTexture( 3, target, width, height, depth, mipmaps, format, data_type, texture, pixels );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateCompressedTexture2D
+ * Desc: Returns a texture right away; it is created on the render thread with a copy of every
+ *       mip level.
+ */
+bool IKeThreadedRenderDevice::CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture )
+{
+    IKeThreadedTexture* t = new IKeThreadedTexture;
+
+    t->device = this;
+    t->real = NULL;
+    t->format = format;
+    t->texel_size = 0;
+
+    PVT_Command( KE_RCMD_CREATE_COMPRESSED_TEXTURE );
+    PVT_Put( &t, sizeof( t ) );
+    PVT_Put( &target, sizeof( uint32_t ) );
+    PVT_Put( &width, sizeof( int ) );
+    PVT_Put( &height, sizeof( int ) );
+    PVT_Put( &mip_count, sizeof( int ) );
+    PVT_Put( &format, sizeof( uint32_t ) );
+    for( int i = 0; i < mip_count; i++ )
+        PVT_PutData( mip_data[i], mip_sizes[i] );
+
+    *texture = t;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DeleteTexture
+ * Desc: Deletes a texture once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderDevice::DeleteTexture( IKeTexture* texture )
+{
+    int type = KE_THREADED_TEXTURE;
+
+    if( !texture )
+        return;
+    for( int i = 0; i < 8; i++ )
+    {
+        if( current_texture[i] == texture )
+            current_texture[i] = NULL;
+    }
+
+    PVT_Command( KE_RCMD_DELETE );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &texture, sizeof( IKeUnknown* ) );
+}
+
+/* Records a texture update; type selects the SetTextureData* variant */
+void IKeThreadedRenderDevice::PVT_SetTextureData( int type, int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture )
+{
+    IKeThreadedTexture* t = static_cast<IKeThreadedTexture*>( texture );
+    int offset[3] = { offsetx, offsety, offsetz };
+    int size[3] = { width, height, depth };
+    uint32_t data_size = t->texel_size * width * height * depth;
+
+    if( !t->texel_size )
+        data_size = KeCompressedImageSize( t->format, width, height ) * depth;
+
+    PVT_Command( KE_RCMD_SET_TEXTURE_DATA );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &texture, sizeof( texture ) );
+    PVT_Put( offset, sizeof( offset ) );
+    PVT_Put( size, sizeof( size ) );
+    PVT_Put( &miplevel, sizeof( int ) );
+    PVT_PutData( pixels, data_size );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetTextureData1D/2D/3D
+ * Desc: Recorded; the pixels are copied.
+ */
+void IKeThreadedRenderDevice::SetTextureData1D( int offsetx, int width, int miplevel, void* pixels, IKeTexture* texture )
+{
+    if( texture )
+        PVT_SetTextureData( KE_TEXTURE_DATA_1D, offsetx, 0, 0, width, 1, 1, miplevel, pixels, texture );
+}
+
+void IKeThreadedRenderDevice::SetTextureData2D( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture )
+{
+    if( texture )
+        PVT_SetTextureData( KE_TEXTURE_DATA_2D, offsetx, offsety, 0, width, height, 1, miplevel, pixels, texture );
+}
+
+void IKeThreadedRenderDevice::SetTextureData3D( int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture )
+{
+    if( texture )
+        PVT_SetTextureData( KE_TEXTURE_DATA_3D, offsetx, offsety, offsetz, width, height, depth, miplevel, pixels, texture );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetTextureData2DAsync
+ * Desc: Recorded; the pixels are copied, so the caller's buffer can be reused right away.
+ */
+bool IKeThreadedRenderDevice::SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture )
+{
+    if( !texture )
+        return false;
+
+    PVT_SetTextureData( KE_TEXTURE_DATA_2D_ASYNC, offsetx, offsety, 0, width, height, 1, miplevel, pixels, texture );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetTextureMipRange
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetTextureMipRange( IKeTexture* texture, int base_level, int max_level )
+{
+    PVT_Command( KE_RCMD_SET_TEXTURE_MIP_RANGE );
+    PVT_Put( &texture, sizeof( texture ) );
+    PVT_Put( &base_level, sizeof( int ) );
+    PVT_Put( &max_level, sizeof( int ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateRenderTarget
+ * Desc: Returns a render target right away; it is created on the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateRenderTarget( int width, int height, int depth, uint32_t flags, IKeRenderTarget** rendertarget )
+{
+    IKeThreadedRenderTarget* rt = new IKeThreadedRenderTarget;
+
+    rt->device = this;
+    rt->real = NULL;
+    rt->texture = new IKeThreadedTexture;
+    rt->texture->device = this;
+    rt->texture->real = NULL;
+    rt->texture->format = KE_TEXTUREFORMAT_RGBA;
+    rt->texture->texel_size = 4;
+
+    PVT_Command( KE_RCMD_CREATE_RENDER_TARGET );
+    PVT_Put( &rt, sizeof( rt ) );
+    PVT_Put( &width, sizeof( int ) );
+    PVT_Put( &height, sizeof( int ) );
+    PVT_Put( &depth, sizeof( int ) );
+    PVT_Put( &flags, sizeof( uint32_t ) );
+
+    *rendertarget = rt;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DeleteRenderTarget
+ * Desc: Deletes a render target once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderDevice::DeleteRenderTarget( IKeRenderTarget* rendertarget )
+{
+    int type = KE_THREADED_RENDER_TARGET;
+
+    if( !rendertarget )
+        return;
+
+    PVT_Command( KE_RCMD_DELETE );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &rendertarget, sizeof( IKeUnknown* ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::BindRenderTarget
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::BindRenderTarget( IKeRenderTarget* rendertarget )
+{
+    PVT_Command( KE_RCMD_BIND_RENDER_TARGET );
+    PVT_Put( &rendertarget, sizeof( rendertarget ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetTexture
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetTexture( int stage, IKeTexture* texture )
+{
+    if( stage >= 0 && stage < 8 )
+        current_texture[stage] = texture;
+
+    PVT_Command( KE_RCMD_SET_TEXTURE );
+    PVT_Put( &stage, sizeof( int ) );
+    PVT_Put( &texture, sizeof( texture ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateRenderStateBuffer
+ * Desc: Returns a render state buffer right away; it is created on the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateRenderStateBuffer( KeState* state_params, int state_count, IKeRenderStateBuffer** state_buffer )
+{
+    IKeThreadedRenderStateBuffer* rs = new IKeThreadedRenderStateBuffer;
+    int type = KE_THREADED_RENDER_STATE_BUFFER;
+
+    rs->device = this;
+    rs->real = NULL;
+
+    PVT_Command( KE_RCMD_CREATE_STATE_BUFFER );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &rs, sizeof( IKeUnknown* ) );
+    PVT_Put( &state_count, sizeof( int ) );
+    PVT_PutData( state_params, sizeof( KeState ) * state_count );
+
+    *state_buffer = rs;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateTextureSamplerBuffer
+ * Desc: Returns a texture sampler buffer right away; it is created on the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateTextureSamplerBuffer( KeState* state_params, int state_count, IKeTextureSamplerBuffer** state_buffer )
+{
+    IKeThreadedTextureSamplerBuffer* ts = new IKeThreadedTextureSamplerBuffer;
+    int type = KE_THREADED_TEXTURE_SAMPLER_BUFFER;
+
+    ts->device = this;
+    ts->real = NULL;
+
+    PVT_Command( KE_RCMD_CREATE_STATE_BUFFER );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &ts, sizeof( IKeUnknown* ) );
+    PVT_Put( &state_count, sizeof( int ) );
+    PVT_PutData( state_params, sizeof( KeState ) * state_count );
+
+    *state_buffer = ts;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetRenderStateBuffer
+ * Desc: Recorded.
+ */
+bool IKeThreadedRenderDevice::SetRenderStateBuffer( IKeRenderStateBuffer* state_buffer )
+{
+    if( !state_buffer )
+        return false;
+
+    PVT_Command( KE_RCMD_SET_RENDER_STATE_BUFFER );
+    PVT_Put( &state_buffer, sizeof( state_buffer ) );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetTextureSamplerBuffer
+ * Desc: Recorded.
+ */
+bool IKeThreadedRenderDevice::SetTextureSamplerBuffer( int stage, IKeTextureSamplerBuffer* state_buffer )
+{
+    if( !state_buffer )
+        return false;
+
+    PVT_Command( KE_RCMD_SET_TEXTURE_SAMPLER_BUFFER );
+    PVT_Put( &stage, sizeof( int ) );
+    PVT_Put( &state_buffer, sizeof( state_buffer ) );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetRenderStates
+ * Desc: Recorded; the state list (up to its -1 terminator) is copied.
+ */
+void IKeThreadedRenderDevice::SetRenderStates( KeState* states )
+{
+    PVT_Command( KE_RCMD_SET_RENDER_STATES );
+    PVT_PutData( states, KeStateCount( states ) * sizeof( KeState ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetSamplerStates
+ * Desc: Recorded; the state list (up to its -1 terminator) is copied.
+ */
+void IKeThreadedRenderDevice::SetSamplerStates( int stage, KeState* states )
+{
+    PVT_Command( KE_RCMD_SET_SAMPLER_STATES );
+    PVT_Put( &stage, sizeof( int ) );
+    PVT_PutData( states, KeStateCount( states ) * sizeof( KeState ) );
+}
+
+/* Records an immediate mode draw; the vertices (and 16-bit indices) are copied */
+void IKeThreadedRenderDevice::PVT_DrawIM( int type, uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int first, int start, int end, int count, uint32_t vertex_count, void* vertex_data, void* index_data )
+{
+    PVT_Command( KE_RCMD_DRAW_IM );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &primtype, sizeof( uint32_t ) );
+    PVT_Put( &stride, sizeof( uint32_t ) );
+    PVT_Put( &first, sizeof( int ) );
+    PVT_Put( &start, sizeof( int ) );
+    PVT_Put( &end, sizeof( int ) );
+    PVT_Put( &count, sizeof( int ) );
+    PVT_PutData( vertex_attributes, KeVertexAttributeCount( vertex_attributes ) * sizeof( KeVertexAttribute ) );
+    PVT_PutData( vertex_data, stride * vertex_count );
+    PVT_PutData( index_data, type == KE_DRAW_VERTICES ? 0 : count * sizeof( uint16_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DrawVerticesIM
+ * Desc: Recorded; the vertices are copied.
+ */
+void IKeThreadedRenderDevice::DrawVerticesIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int first, int count, void* vertex_data )
+{
+    PVT_DrawIM( KE_DRAW_VERTICES, primtype, stride, vertex_attributes, first, 0, 0, count, first + count, vertex_data, NULL );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DrawIndexedVerticesIM
+ * Desc: Recorded; the vertices and indices are copied.
+ */
+void IKeThreadedRenderDevice::DrawIndexedVerticesIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int count, void* vertex_data, void* index_data )
+{
+    PVT_DrawIM( KE_DRAW_INDEXED_VERTICES, primtype, stride, vertex_attributes, 0, 0, 0, count, count, vertex_data, index_data );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DrawIndexedVerticesRangeIM
+ * Desc: Recorded; the vertices and indices are copied.
+ */
+void IKeThreadedRenderDevice::DrawIndexedVerticesRangeIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int start, int end, int count, void* vertex_data, void* index_data )
+{
+    int vertex_count = end + 1 > count ? end + 1 : count;
+
+    PVT_DrawIM( KE_DRAW_INDEXED_VERTICES_RANGE, primtype, stride, vertex_attributes, 0, start, end, count, vertex_count, vertex_data, index_data );
+}
+
+/* Records a draw from the current geometry buffer */
+void IKeThreadedRenderDevice::PVT_Draw( int type, uint32_t primtype, uint32_t stride, int first, int end, int count, int base_vertex )
+{
+    PVT_Command( KE_RCMD_DRAW );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &primtype, sizeof( uint32_t ) );
+    PVT_Put( &stride, sizeof( uint32_t ) );
+    PVT_Put( &first, sizeof( int ) );
+    PVT_Put( &end, sizeof( int ) );
+    PVT_Put( &count, sizeof( int ) );
+    PVT_Put( &base_vertex, sizeof( int ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Draw*
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::DrawVertices( uint32_t primtype, uint32_t stride, int first, int count )
+{
+    PVT_Draw( KE_DRAW_VERTICES, primtype, stride, first, 0, count, 0 );
+}
+
+void IKeThreadedRenderDevice::DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count )
+{
+    PVT_Draw( KE_DRAW_INDEXED_VERTICES, primtype, stride, 0, 0, count, 0 );
+}
+
+void IKeThreadedRenderDevice::DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count )
+{
+    PVT_Draw( KE_DRAW_INDEXED_VERTICES_RANGE, primtype, stride, start, end, count, 0 );
+}
+
+void IKeThreadedRenderDevice::DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex )
+{
+    PVT_Draw( KE_DRAW_INDEXED_VERTICES_BASE_VERTEX, primtype, stride, first_index, 0, count, base_vertex );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateIndirectBuffer
+ * Desc: Returns an indirect buffer right away; it is created on the render thread with a copy
+ *       of the supplied commands.
+ */
+bool IKeThreadedRenderDevice::CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer )
+{
+    IKeThreadedIndirectBuffer* ib = new IKeThreadedIndirectBuffer;
+
+    ib->device = this;
+    ib->real = NULL;
+    ib->command_count = command_count;
+
+    PVT_Command( KE_RCMD_CREATE_INDIRECT_BUFFER );
+    PVT_Put( &ib, sizeof( ib ) );
+    PVT_PutData( commands, sizeof( KeDrawIndexedIndirectCommand ) * command_count );
+    PVT_Put( &flags, sizeof( uint32_t ) );
+
+    *indirect_buffer = ib;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DeleteIndirectBuffer
+ * Desc: Deletes an indirect buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderDevice::DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer )
+{
+    int type = KE_THREADED_INDIRECT_BUFFER;
+
+    if( !indirect_buffer )
+        return;
+
+    PVT_Command( KE_RCMD_DELETE );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_Put( &indirect_buffer, sizeof( IKeUnknown* ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DrawIndexedVerticesIndirect
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count )
+{
+    PVT_Command( KE_RCMD_DRAW_INDIRECT );
+    PVT_Put( &primtype, sizeof( uint32_t ) );
+    PVT_Put( &indirect_buffer, sizeof( indirect_buffer ) );
+    PVT_Put( &first, sizeof( uint32_t ) );
+    PVT_Put( &count, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateOcclusionQuery
+ * Desc: Returns an occlusion query right away; it is created on the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query )
+{
+    if( !device_caps->occlusion_query_supported )
+        DISPDBG_RB( KE_WARNING, "Occlusion queries are not supported!" );
+
+    IKeThreadedOcclusionQuery* q = new IKeThreadedOcclusionQuery;
+
+    q->device = this;
+    q->real = NULL;
+    q->active = No;
+    q->ended = q->executed = q->resolved = 0;
+    q->result = 0;
+
+    PVT_Command( KE_RCMD_CREATE_OCCLUSION_QUERY );
+    PVT_Put( &q, sizeof( q ) );
+    PVT_Put( &type, sizeof( uint32_t ) );
+
+    *query = q;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::BeginConditionalRender
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::BeginConditionalRender( IKeOcclusionQuery* query, int wait )
+{
+    PVT_Command( KE_RCMD_BEGIN_CONDITIONAL_RENDER );
+    PVT_Put( &query, sizeof( query ) );
+    PVT_Put( &wait, sizeof( int ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::EndConditionalRender
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::EndConditionalRender()
+{
+    PVT_Command( KE_RCMD_END_CONDITIONAL_RENDER );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetFramebufferRegion
+ * Desc: Waits for the render thread to go idle; use RequestFramebufferRegion in the frame loop.
+ */
+bool IKeThreadedRenderDevice::GetFramebufferRegion( int x, int y, int width, int height, uint32_t flags, int* bpp, void** pixels )
+{
+    if( !PVT_AcquireContext() )
+        return false;
+
+    bool ret = device->GetFramebufferRegion( x, y, width, height, flags, bpp, pixels );
+
+    PVT_ReleaseContext();
+
+    return ret;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::RequestFramebufferRegion
+ * Desc: Returns a ticket right away; the read is started once the render thread reaches this
+ *       point of the frame.  If the wrapped device has no free readback buffer at that time,
+ *       ReadFramebufferRegion reports KE_READBACK_FAILED for the ticket.
+ */
+uint32_t IKeThreadedRenderDevice::RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags )
+{
+    KeThreadedReadback rb;
+    int region[4] = { x, y, width, height };
+
+    ZeroMemory( &rb, sizeof( KeThreadedReadback ) );
+    rb.status = KE_READBACK_PENDING;
+
+    lock.Enter();
+    if( !++next_ticket )
+        next_ticket++;
+    rb.ticket = next_ticket;
+    readbacks.push_back( rb );
+    lock.Leave();
+
+    PVT_Command( KE_RCMD_REQUEST_FRAMEBUFFER_REGION );
+    PVT_Put( &rb.ticket, sizeof( uint32_t ) );
+    PVT_Put( region, sizeof( region ) );
+    PVT_Put( &flags, sizeof( uint32_t ) );
+
+    return rb.ticket;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ReadFramebufferRegion
+ * Desc: Returns the status of a readback.  Without wait, the render thread is asked to check
+ *       on it and KE_READBACK_PENDING is returned until it has seen the read complete; with
+ *       wait, the render thread is drained first.  As with the wrapped device, the pixels stay
+ *       valid until ReleaseFramebufferRegion is called.
+ */
+int IKeThreadedRenderDevice::ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels )
+{
+    KeThreadedReadback copy;
+
+    lock.Enter();
+    KeThreadedReadback* rb = KeFindReadback( readbacks, ticket );
+    if( rb )
+        copy = *rb;
+    lock.Leave();
+
+    if( !rb )
+        return KE_READBACK_FAILED;
+
+    if( copy.status == KE_READBACK_PENDING )
+    {
+        if( !wait )
+        {
+            PVT_Command( KE_RCMD_POLL_FRAMEBUFFER_REGION );
+            PVT_Put( &ticket, sizeof( uint32_t ) );
+            return KE_READBACK_PENDING;
+        }
+
+        if( !PVT_AcquireContext() )
+            return KE_READBACK_FAILED;
+
+        /* The render thread is idle, so the entry can be updated without the lock */
+        rb = KeFindReadback( readbacks, ticket );
+        if( rb && rb->device_ticket )
+            rb->status = device->ReadFramebufferRegion( rb->device_ticket, Yes, &rb->bpp, &rb->pixels );
+        else if( rb )
+            rb->status = KE_READBACK_FAILED;
+        if( rb )
+            copy = *rb;
+
+        PVT_ReleaseContext();
+    }
+
+    if( copy.status == KE_READBACK_READY )
+    {
+        if( bpp )
+            *bpp = copy.bpp;
+        if( pixels )
+            *pixels = copy.pixels;
+    }
+
+    return copy.status;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::ReleaseFramebufferRegion
+ * Desc: Returns a readback's pixels to the wrapped device once the render thread reaches this
+ *       point.  The ticket must not be used afterwards.
+ */
+void IKeThreadedRenderDevice::ReleaseFramebufferRegion( uint32_t ticket )
+{
+    if( !ticket )
+        return;
+
+    PVT_Command( KE_RCMD_RELEASE_FRAMEBUFFER_REGION );
+    PVT_Put( &ticket, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetViewport
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetViewport( int x, int y, int width, int height )
+{
+    int vp[4] = { x, y, width, height };
+
+    SetViewportV( vp );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetViewportV
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetViewportV( int* viewport )
+{
+    memmove( this->viewport, viewport, sizeof( int ) * 4 );
+
+    PVT_Command( KE_RCMD_SET_VIEWPORT );
+    PVT_Put( viewport, sizeof( int ) * 4 );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetViewport
+ * Desc: Returns the last viewport set on this thread.
+ */
+void IKeThreadedRenderDevice::GetViewport( int* x, int* y, int* width, int* height )
+{
+    if( x ) *x = viewport[0];
+    if( y ) *y = viewport[1];
+    if( width ) *width = viewport[2];
+    if( height ) *height = viewport[3];
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetViewportV
+ * Desc: Returns the last viewport set on this thread.
+ */
+void IKeThreadedRenderDevice::GetViewportV( int* viewport )
+{
+    memmove( viewport, this->viewport, sizeof( int ) * 4 );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetPerspectiveMatrix
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetPerspectiveMatrix( float fov, float aspect, float near_z, float far_z )
+{
+    float params[4] = { fov, aspect, near_z, far_z };
+
+    nv::perspective( projection_matrix, fov, aspect, near_z, far_z );
+
+    PVT_Command( KE_RCMD_SET_PERSPECTIVE_MATRIX );
+    PVT_Put( params, sizeof( params ) );
+}
+
+/* Records one of the transformation matrices */
+void IKeThreadedRenderDevice::PVT_SetMatrix( int type, const nv::matrix4f* m )
+{
+    PVT_Command( KE_RCMD_SET_MATRIX );
+    PVT_Put( &type, sizeof( int ) );
+    PVT_PutData( m->_array, sizeof( float ) * 16 );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Set*Matrix
+ * Desc: Recorded; a copy is kept for the matching Get*Matrix call.
+ */
+void IKeThreadedRenderDevice::SetViewMatrix( const nv::matrix4f* view )
+{
+    memmove( view_matrix._array, view->_array, sizeof( float ) * 16 );
+    PVT_SetMatrix( KE_MATRIX_VIEW, view );
+}
+
+void IKeThreadedRenderDevice::SetWorldMatrix( const nv::matrix4f* world )
+{
+    memmove( world_matrix._array, world->_array, sizeof( float ) * 16 );
+    PVT_SetMatrix( KE_MATRIX_WORLD, world );
+}
+
+void IKeThreadedRenderDevice::SetModelviewMatrix( const nv::matrix4f* modelview )
+{
+    memmove( modelview_matrix._array, modelview->_array, sizeof( float ) * 16 );
+    PVT_SetMatrix( KE_MATRIX_MODELVIEW, modelview );
+}
+
+void IKeThreadedRenderDevice::SetProjectionMatrix( const nv::matrix4f* projection )
+{
+    memmove( projection_matrix._array, projection->_array, sizeof( float ) * 16 );
+    PVT_SetMatrix( KE_MATRIX_PROJECTION, projection );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Get*Matrix
+ * Desc: Returns the last matrix set on this thread.
+ */
+void IKeThreadedRenderDevice::GetViewMatrix( nv::matrix4f* view )
+{
+    memmove( view->_array, view_matrix._array, sizeof( float ) * 16 );
+}
+
+void IKeThreadedRenderDevice::GetWorldMatrix( nv::matrix4f* world )
+{
+    memmove( world->_array, world_matrix._array, sizeof( float ) * 16 );
+}
+
+void IKeThreadedRenderDevice::GetModelviewMatrix( nv::matrix4f* modelview )
+{
+    memmove( modelview->_array, modelview_matrix._array, sizeof( float ) * 16 );
+}
+
+void IKeThreadedRenderDevice::GetProjectionMatrix( nv::matrix4f* projection )
+{
+    memmove( projection->_array, projection_matrix._array, sizeof( float ) * 16 );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetWorldMatrixBatch
+ * Desc: Recorded; the matrices are copied.
+ */
+bool IKeThreadedRenderDevice::SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count )
+{
+    if( !world || !count )
+        return false;
+    if( count > KE_MAX_BATCHED_WORLD_MATRICES )
+        DISPDBG_RB( KE_ERROR, "Too many world matrices in one batch (" << count << ", the limit is " << KE_MAX_BATCHED_WORLD_MATRICES << ")!" );
+
+    PVT_Command( KE_RCMD_SET_WORLD_MATRIX_BATCH );
+    PVT_Put( &count, sizeof( uint32_t ) );
+    PVT_PutData( world, sizeof( nv::matrix4f ) * count );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetDrawIndex
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetDrawIndex( uint32_t index )
+{
+    PVT_Command( KE_RCMD_SET_DRAW_INDEX );
+    PVT_Put( &index, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::BlockUntilVerticalBlank
+ * Desc: Stalls the calling thread; the wrapped implementation is thread safe.
+ */
+void IKeThreadedRenderDevice::BlockUntilVerticalBlank()
+{
+    device->BlockUntilVerticalBlank();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetSwapInterval
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::SetSwapInterval( int swap_interval )
+{
+    this->swap_interval = swap_interval;
+
+    PVT_Command( KE_RCMD_SET_SWAP_INTERVAL );
+    PVT_Put( &swap_interval, sizeof( int ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetSwapInterval
+ * Desc: Returns the last swap interval set.
+ */
+int IKeThreadedRenderDevice::GetSwapInterval()
+{
+    return swap_interval;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::BlockUntilIdle
+ * Desc: Waits until the render thread and the GPU have finished everything recorded so far.
+ */
+void IKeThreadedRenderDevice::BlockUntilIdle()
+{
+    if( !PVT_AcquireContext() )
+        return;
+
+    device->BlockUntilIdle();
+
+    PVT_ReleaseContext();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Kick
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::Kick()
+{
+    PVT_Command( KE_RCMD_KICK );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::CreateFence
+ * Desc: Returns a fence right away; it is created on the render thread.
+ */
+bool IKeThreadedRenderDevice::CreateFence( IKeFence** fence, uint32_t flags )
+{
+    IKeThreadedFence* f = new IKeThreadedFence;
+
+    f->device = this;
+    f->real = NULL;
+    f->inserted = f->executed = f->signalled = 0;
+
+    PVT_Command( KE_RCMD_CREATE_FENCE );
+    PVT_Put( &f, sizeof( f ) );
+    PVT_Put( &flags, sizeof( uint32_t ) );
+
+    *fence = f;
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::SetMaxFrameLatency
+ * Desc: Recorded.  This limits how far the GPU may fall behind the render thread; the pipeline
+ *       depth limits how far the render thread may fall behind the game thread.
+ */
+void IKeThreadedRenderDevice::SetMaxFrameLatency( int latency )
+{
+    if( latency < 1 )
+        latency = 1;
+    if( latency > KE_MAX_FRAMES_IN_FLIGHT )
+        latency = KE_MAX_FRAMES_IN_FLIGHT;
+
+    max_frame_latency = latency;
+
+    PVT_Command( KE_RCMD_SET_MAX_FRAME_LATENCY );
+    PVT_Put( &latency, sizeof( int ) );
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetMaxFrameLatency
+ * Desc: Returns the last frame latency set.
+ */
+int IKeThreadedRenderDevice::GetMaxFrameLatency()
+{
+    return max_frame_latency;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GetCompletedFrame
+ * Desc: Returns the last frame the GPU is known to have finished, as of the render thread's
+ *       last Swap.
+ */
+uint32_t IKeThreadedRenderDevice::GetCompletedFrame()
+{
+    lock.Enter();
+    uint32_t completed = completed_frame;
+    lock.Leave();
+
+    return completed;
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::DestroyDeferred
+ * Desc: Destroying any resource wrapper already defers to the wrapped device.
+ */
+void IKeThreadedRenderDevice::DestroyDeferred( IKeUnknown* resource )
+{
+    if( resource )
+        resource->Destroy();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::MakeCurrent
+ * Desc: With current set, waits for the render thread to go idle and lends the context to the
+ *       calling thread so that the API can be used directly; otherwise hands it back.  Device
+ *       calls made in between are recorded as usual and run once the context is handed back.
+ */
+bool IKeThreadedRenderDevice::MakeCurrent( int current )
+{
+    if( !current )
+    {
+        PVT_ReleaseContext();
+        return true;
+    }
+
+    return PVT_AcquireContext();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::GpuMemoryInfo
+ * Desc: Waits for the render thread to go idle.
+ */
+void IKeThreadedRenderDevice::GpuMemoryInfo( uint32_t* total_memory, uint32_t* free_memory )
+{
+    if( !PVT_AcquireContext() )
+        return;
+
+    device->GpuMemoryInfo( total_memory, free_memory );
+
+    PVT_ReleaseContext();
+}
+
+/*
+ * Name: IKeThreadedRenderDevice::Trim
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderDevice::Trim()
+{
+    PVT_Command( KE_RCMD_TRIM );
+}
+
+
+/* Records the destruction of a resource wrapper */
+static void KeThreadedDestroy( IKeThreadedRenderDevice* device, int type, IKeUnknown* resource )
+{
+    device->PVT_Command( KE_RCMD_DESTROY );
+    device->PVT_Put( &type, sizeof( int ) );
+    device->PVT_Put( &resource, sizeof( IKeUnknown* ) );
+}
+
+/* Records the unmapping of a resource wrapper */
+static void KeThreadedUnmap( IKeThreadedRenderDevice* device, int type, IKeUnknown* resource, void* ptr, int async )
+{
+    device->PVT_Command( KE_RCMD_UNMAP );
+    device->PVT_Put( &type, sizeof( int ) );
+    device->PVT_Put( &resource, sizeof( IKeUnknown* ) );
+    device->PVT_Put( &ptr, sizeof( void* ) );
+    device->PVT_Put( &async, sizeof( int ) );
+}
+
+
+/*
+ * Name: IKeThreadedGeometryBuffer::Destroy
+ * Desc: Destroys the geometry buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedGeometryBuffer::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_GEOMETRY_BUFFER, this );
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::MapData
+ * Desc: Waits for the render thread to go idle.  The pointer may be written from any thread
+ *       until UnmapData is called.
+ */
+void* IKeThreadedGeometryBuffer::MapData( uint32_t flags )
+{
+    void* ptr = NULL;
+
+    if( !device->PVT_AcquireContext() )
+        return NULL;
+
+    if( real )
+        ptr = real->MapData( flags );
+
+    device->PVT_ReleaseContext();
+
+    return ptr;
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::MapDataAsync
+ * Desc: Same as MapData.
+ */
+void* IKeThreadedGeometryBuffer::MapDataAsync( uint32_t flags )
+{
+    void* ptr = NULL;
+
+    if( !device->PVT_AcquireContext() )
+        return NULL;
+
+    if( real )
+        ptr = real->MapDataAsync( flags );
+
+    device->PVT_ReleaseContext();
+
+    return ptr;
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::UnmapData
+ * Desc: Recorded.
+ */
+void IKeThreadedGeometryBuffer::UnmapData( void* ptr )
+{
+    KeThreadedUnmap( device, KE_THREADED_GEOMETRY_BUFFER, this, ptr, No );
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::UnmapDataAsync
+ * Desc: Recorded.
+ */
+void IKeThreadedGeometryBuffer::UnmapDataAsync( void* ptr )
+{
+    KeThreadedUnmap( device, KE_THREADED_GEOMETRY_BUFFER, this, ptr, Yes );
+}
+
+/* Records a vertex or index data update */
+static void KeThreadedSetGeometryData( IKeThreadedGeometryBuffer* gb, int indices, uint32_t offset, uint32_t size, void* ptr )
+{
+    IKeGeometryBuffer* buffer = gb;
+
+    gb->device->PVT_Command( KE_RCMD_GEOMETRY_BUFFER_SET_DATA );
+    gb->device->PVT_Put( &buffer, sizeof( buffer ) );
+    gb->device->PVT_Put( &indices, sizeof( int ) );
+    gb->device->PVT_Put( &offset, sizeof( uint32_t ) );
+    gb->device->PVT_PutData( ptr, size );
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::SetVertexData
+ * Desc: Recorded; the data is copied.
+ */
+bool IKeThreadedGeometryBuffer::SetVertexData( uint32_t offset, uint32_t size, void* ptr )
+{
+    KeThreadedSetGeometryData( this, No, offset, size, ptr );
+    return true;
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::SetIndexData
+ * Desc: Recorded; the data is copied.
+ */
+bool IKeThreadedGeometryBuffer::SetIndexData( uint32_t offset, uint32_t size, void* ptr )
+{
+    KeThreadedSetGeometryData( this, Yes, offset, size, ptr );
+    return true;
+}
+
+/* Records a copy within the vertex or index buffer */
+static void KeThreadedCopyGeometryData( IKeThreadedGeometryBuffer* gb, int indices, uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+    IKeGeometryBuffer* buffer = gb;
+
+    gb->device->PVT_Command( KE_RCMD_GEOMETRY_BUFFER_COPY_DATA );
+    gb->device->PVT_Put( &buffer, sizeof( buffer ) );
+    gb->device->PVT_Put( &indices, sizeof( int ) );
+    gb->device->PVT_Put( &dst_offset, sizeof( uint32_t ) );
+    gb->device->PVT_Put( &src_offset, sizeof( uint32_t ) );
+    gb->device->PVT_Put( &size, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::CopyVertexData
+ * Desc: Recorded.
+ */
+bool IKeThreadedGeometryBuffer::CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+    KeThreadedCopyGeometryData( this, No, dst_offset, src_offset, size );
+    return true;
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::CopyIndexData
+ * Desc: Recorded.
+ */
+bool IKeThreadedGeometryBuffer::CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size )
+{
+    KeThreadedCopyGeometryData( this, Yes, dst_offset, src_offset, size );
+    return true;
+}
+
+/*
+ * Name: IKeThreadedGeometryBuffer::GetDesc
+ * Desc: Waits for the render thread to go idle.
+ */
+void IKeThreadedGeometryBuffer::GetDesc( KeGeometryBufferDesc* desc )
+{
+    ZeroMemory( desc, sizeof( KeGeometryBufferDesc ) );
+
+    if( !device->PVT_AcquireContext() )
+        return;
+
+    if( real )
+        real->GetDesc( desc );
+
+    device->PVT_ReleaseContext();
+}
+
+
+/*
+ * Name: IKeThreadedConstantBuffer::Destroy
+ * Desc: Destroys the constant buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedConstantBuffer::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_CONSTANT_BUFFER, this );
+}
+
+/*
+ * Name: IKeThreadedConstantBuffer::MapData
+ * Desc: Waits for the render thread to go idle.
+ */
+void* IKeThreadedConstantBuffer::MapData( uint32_t flags )
+{
+    void* ptr = NULL;
+
+    if( !device->PVT_AcquireContext() )
+        return NULL;
+
+    if( real )
+        ptr = real->MapData( flags );
+
+    device->PVT_ReleaseContext();
+
+    return ptr;
+}
+
+/*
+ * Name: IKeThreadedConstantBuffer::UnmapData
+ * Desc: Recorded.
+ */
+void IKeThreadedConstantBuffer::UnmapData( void* ptr )
+{
+    KeThreadedUnmap( device, KE_THREADED_CONSTANT_BUFFER, this, ptr, No );
+}
+
+/*
+ * Name: IKeThreadedConstantBuffer::SetConstantData
+ * Desc: Recorded; the data is copied.
+ */
+bool IKeThreadedConstantBuffer::SetConstantData( uint32_t offset, uint32_t size, void* ptr )
+{
+    IKeConstantBuffer* buffer = this;
+    int whole = No;
+
+    device->PVT_Command( KE_RCMD_SET_CONSTANT_BUFFER_DATA );
+    device->PVT_Put( &buffer, sizeof( buffer ) );
+    device->PVT_Put( &whole, sizeof( int ) );
+    device->PVT_Put( &offset, sizeof( uint32_t ) );
+    device->PVT_PutData( ptr, size );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedConstantBuffer::GetDesc
+ * Desc: Returns the description the buffer was created with.
+ */
+void IKeThreadedConstantBuffer::GetDesc( KeConstantBufferDesc* desc )
+{
+    memmove( desc, &this->desc, sizeof( KeConstantBufferDesc ) );
+}
+
+
+/*
+ * Name: IKeThreadedIndirectBuffer::Destroy
+ * Desc: Destroys the indirect buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedIndirectBuffer::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_INDIRECT_BUFFER, this );
+}
+
+/*
+ * Name: IKeThreadedIndirectBuffer::MapData
+ * Desc: Waits for the render thread to go idle.
+ */
+void* IKeThreadedIndirectBuffer::MapData( uint32_t flags )
+{
+    void* ptr = NULL;
+
+    if( !device->PVT_AcquireContext() )
+        return NULL;
+
+    if( real )
+        ptr = real->MapData( flags );
+
+    device->PVT_ReleaseContext();
+
+    return ptr;
+}
+
+/*
+ * Name: IKeThreadedIndirectBuffer::UnmapData
+ * Desc: Recorded.
+ */
+void IKeThreadedIndirectBuffer::UnmapData( void* ptr )
+{
+    KeThreadedUnmap( device, KE_THREADED_INDIRECT_BUFFER, this, ptr, No );
+}
+
+/*
+ * Name: IKeThreadedIndirectBuffer::SetCommands
+ * Desc: Recorded; the commands are copied.
+ */
+bool IKeThreadedIndirectBuffer::SetCommands( uint32_t first, uint32_t count, KeDrawIndexedIndirectCommand* commands )
+{
+    IKeIndirectBuffer* buffer = this;
+
+    if( first + count > command_count )
+        DISPDBG_RB( KE_ERROR, "Indirect buffer overflow!\nfirst: " << first << "\ncount: " << count << "\n" );
+
+    device->PVT_Command( KE_RCMD_SET_INDIRECT_COMMANDS );
+    device->PVT_Put( &buffer, sizeof( buffer ) );
+    device->PVT_Put( &first, sizeof( uint32_t ) );
+    device->PVT_Put( &count, sizeof( uint32_t ) );
+    device->PVT_PutData( commands, sizeof( KeDrawIndexedIndirectCommand ) * count );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedIndirectBuffer::GetCommandCount
+ * Desc: Returns the number of commands the buffer was created with.
+ */
+uint32_t IKeThreadedIndirectBuffer::GetCommandCount()
+{
+    return command_count;
+}
+
+
+/*
+ * Name: IKeThreadedGpuProgram::Destroy
+ * Desc: Destroys the program once the commands recorded before this call have executed.
+ */
+void IKeThreadedGpuProgram::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_GPU_PROGRAM, this );
+}
+
+/*
+ * Name: IKeThreadedGpuProgram::GetVertexAttributes
+ * Desc: Returns the vertex attributes the program was created with.
+ */
+void IKeThreadedGpuProgram::GetVertexAttributes( KeVertexAttribute* vertex_attributes )
+{
+    if( !va.empty() )
+        memmove( vertex_attributes, &va[0], sizeof( KeVertexAttribute ) * va.size() );
+}
+
+/*
+ * Name: IKeThreadedGpuProgram::IsReady
+ * Desc: Returns true once the render thread has seen the program finish linking.  Until then,
+ *       each call asks the render thread to check again.
+ */
+bool IKeThreadedGpuProgram::IsReady()
+{
+    IKeGpuProgram* program = this;
+
+    device->lock.Enter();
+    int is_ready = ready;
+    device->lock.Leave();
+
+    if( is_ready )
+        return true;
+
+    device->PVT_Command( KE_RCMD_POLL_PROGRAM );
+    device->PVT_Put( &program, sizeof( program ) );
+
+    return false;
+}
+
+
+/*
+ * Name: IKeThreadedTexture::Destroy
+ * Desc: Destroys the texture once the commands recorded before this call have executed.
+ */
+void IKeThreadedTexture::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_TEXTURE, this );
+}
+
+/*
+ * Name: IKeThreadedTexture::MapData
+ * Desc: Waits for the render thread to go idle.
+ */
+void* IKeThreadedTexture::MapData( uint32_t flags )
+{
+    void* ptr = NULL;
+
+    if( !device->PVT_AcquireContext() )
+        return NULL;
+
+    if( real )
+        ptr = real->MapData( flags );
+
+    device->PVT_ReleaseContext();
+
+    return ptr;
+}
+
+/*
+ * Name: IKeThreadedTexture::UnmapData
+ * Desc: Recorded.
+ */
+void IKeThreadedTexture::UnmapData( void* ptr )
+{
+    KeThreadedUnmap( device, KE_THREADED_TEXTURE, this, ptr, No );
+}
+
+/*
+ * Name: IKeThreadedTexture::SetTextureData
+ * Desc: Recorded; the pixels are copied.
+ */
+bool IKeThreadedTexture::SetTextureData( KeTextureDesc* texture_data, void* pixels )
+{
+    IKeTexture* t = this;
+    uint32_t depth = texture_data->depth ? texture_data->depth : 1;
+    uint32_t size = texel_size * texture_data->width * texture_data->height * depth;
+
+    if( !texel_size )
+        size = KeCompressedImageSize( format, texture_data->width, texture_data->height ) * depth;
+
+    device->PVT_Command( KE_RCMD_TEXTURE_SET_DATA );
+    device->PVT_Put( &t, sizeof( t ) );
+    device->PVT_Put( texture_data, sizeof( KeTextureDesc ) );
+    device->PVT_PutData( pixels, size );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedTexture::GetTextureDesc
+ * Desc: Waits for the render thread to go idle.
+ */
+bool IKeThreadedTexture::GetTextureDesc( KeTextureDesc* texture_desc )
+{
+    bool ret = false;
+
+    if( !device->PVT_AcquireContext() )
+        return false;
+
+    if( real )
+        ret = real->GetTextureDesc( texture_desc );
+
+    device->PVT_ReleaseContext();
+
+    return ret;
+}
+
+
+/*
+ * Name: IKeThreadedRenderTarget::Destroy
+ * Desc: Destroys the render target once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderTarget::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_RENDER_TARGET, this );
+}
+
+/*
+ * Name: IKeThreadedRenderTarget::MapData
+ * Desc: Waits for the render thread to go idle.
+ */
+void* IKeThreadedRenderTarget::MapData( uint32_t flags )
+{
+    void* ptr = NULL;
+
+    if( !device->PVT_AcquireContext() )
+        return NULL;
+
+    if( real )
+        ptr = real->MapData( flags );
+
+    device->PVT_ReleaseContext();
+
+    return ptr;
+}
+
+/*
+ * Name: IKeThreadedRenderTarget::UnmapData
+ * Desc: Recorded.
+ */
+void IKeThreadedRenderTarget::UnmapData( void* ptr )
+{
+    KeThreadedUnmap( device, KE_THREADED_RENDER_TARGET, this, ptr, No );
+}
+
+/*
+ * Name: IKeThreadedRenderTarget::GetTexture
+ * Desc: Returns the render target's texture.  It is owned by the render target.
+ */
+bool IKeThreadedRenderTarget::GetTexture( IKeTexture** texture )
+{
+    *texture = this->texture;
+    return true;
+}
+
+/*
+ * Name: IKeThreadedRenderTarget::GetTexture2
+ * Desc: Returns the render target's texture.  It is owned by the render target.
+ */
+IKeTexture* IKeThreadedRenderTarget::GetTexture2()
+{
+    return texture;
+}
+
+
+/*
+ * Name: IKeThreadedFence::Destroy
+ * Desc: Destroys the fence once the commands recorded before this call have executed.
+ */
+void IKeThreadedFence::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_FENCE, this );
+}
+
+/*
+ * Name: IKeThreadedFence::Insert
+ * Desc: Recorded; the fence is inserted once the render thread reaches this point.
+ */
+bool IKeThreadedFence::Insert()
+{
+    IKeThreadedFence* fence = this;
+    uint32_t serial = ++inserted;
+
+    device->PVT_Command( KE_RCMD_INSERT_FENCE );
+    device->PVT_Put( &fence, sizeof( fence ) );
+    device->PVT_Put( &serial, sizeof( uint32_t ) );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedFence::Test
+ * Desc: Returns true once the render thread has seen the last insert signalled.  Until then,
+ *       each call asks the render thread to check again.
+ */
+bool IKeThreadedFence::Test()
+{
+    IKeThreadedFence* fence = this;
+
+    device->lock.Enter();
+    bool passed = signalled == inserted;
+    device->lock.Leave();
+
+    if( passed )
+        return true;
+
+    device->PVT_Command( KE_RCMD_POLL_FENCE );
+    device->PVT_Put( &fence, sizeof( fence ) );
+
+    return false;
+}
+
+/*
+ * Name: IKeThreadedFence::Block
+ * Desc: Waits for the render thread to go idle, then for the GPU to reach the fence.
+ */
+void IKeThreadedFence::Block()
+{
+    if( !device->PVT_AcquireContext() )
+        return;
+
+    if( real )
+        real->Block();
+    signalled = inserted;
+
+    device->PVT_ReleaseContext();
+}
+
+/*
+ * Name: IKeThreadedFence::Valid
+ * Desc: Waits for the render thread to go idle.
+ */
+bool IKeThreadedFence::Valid()
+{
+    bool ret = false;
+
+    if( !device->PVT_AcquireContext() )
+        return false;
+
+    if( real )
+        ret = real->Valid();
+
+    device->PVT_ReleaseContext();
+
+    return ret;
+}
+
+
+/*
+ * Name: IKeThreadedRenderStateBuffer::Destroy
+ * Desc: Destroys the state buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedRenderStateBuffer::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_RENDER_STATE_BUFFER, this );
+}
+
+/*
+ * Name: IKeThreadedTextureSamplerBuffer::Destroy
+ * Desc: Destroys the sampler buffer once the commands recorded before this call have executed.
+ */
+void IKeThreadedTextureSamplerBuffer::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_TEXTURE_SAMPLER_BUFFER, this );
+}
+
+
+/*
+ * Name: IKeThreadedOcclusionQuery::Destroy
+ * Desc: Destroys the query once the commands recorded before this call have executed.
+ */
+void IKeThreadedOcclusionQuery::Destroy()
+{
+    KeThreadedDestroy( device, KE_THREADED_OCCLUSION_QUERY, this );
+}
+
+/*
+ * Name: IKeThreadedOcclusionQuery::Begin
+ * Desc: Recorded.
+ */
+bool IKeThreadedOcclusionQuery::Begin()
+{
+    IKeOcclusionQuery* q = this;
+
+    if( active )
+        DISPDBG_RB( KE_WARNING, "Occlusion query is already active!" );
+
+    active = Yes;
+
+    device->PVT_Command( KE_RCMD_BEGIN_QUERY );
+    device->PVT_Put( &q, sizeof( q ) );
+
+    return true;
+}
+
+/*
+ * Name: IKeThreadedOcclusionQuery::End
+ * Desc: Recorded.
+ */
+void IKeThreadedOcclusionQuery::End()
+{
+    IKeThreadedOcclusionQuery* q = this;
+
+    if( !active )
+        DISPDBG_R( KE_WARNING, "Occlusion query is not active!" );
+
+    active = No;
+    uint32_t serial = ++ended;
+
+    device->PVT_Command( KE_RCMD_END_QUERY );
+    device->PVT_Put( &q, sizeof( q ) );
+    device->PVT_Put( &serial, sizeof( uint32_t ) );
+}
+
+/*
+ * Name: IKeThreadedOcclusionQuery::GetResult
+ * Desc: Without wait, returns the result once the render thread has read it back (asking it to
+ *       check again otherwise), which normally takes one frame longer than without a render
+ *       thread.  With wait, drains the render thread and blocks on the GPU.
+ */
+bool IKeThreadedOcclusionQuery::GetResult( int wait, uint32_t* samples )
+{
+    IKeThreadedOcclusionQuery* q = this;
+
+    if( active )
+        DISPDBG_RB( KE_WARNING, "Occlusion query has not been ended!" );
+
+    if( !wait )
+    {
+        device->lock.Enter();
+        bool available = resolved == ended;
+        uint32_t value = result;
+        device->lock.Leave();
+
+        if( available )
+        {
+            if( samples )
+                *samples = value;
+            return true;
+        }
+
+        device->PVT_Command( KE_RCMD_POLL_QUERY );
+        device->PVT_Put( &q, sizeof( q ) );
+
+        return false;
+    }
+
+    if( !device->PVT_AcquireContext() )
+        return false;
+
+    uint32_t value = 0;
+    bool ret = real ? real->GetResult( Yes, &value ) : false;
+    if( ret )
+    {
+        result = value;
+        resolved = ended;
+    }
+
+    device->PVT_ReleaseContext();
+
+    if( ret && samples )
+        *samples = value;
+
+    return ret;
+}
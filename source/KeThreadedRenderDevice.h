@@ -0,0 +1,375 @@
+//
+//  KeThreadedRenderDevice.h
+//
+//  Created by Shogun3D on 10/19/26.
+//  Copyright (c) 2026 Shogun3D. All rights reserved.
+//
+
+#ifndef __KeThreadedRenderDevice__
+#define __KeThreadedRenderDevice__
+
+#include <vector>
+#include "KeRenderDevice.h"
+#include "KeThread.h"
+#include "KeMutex.h"
+
+
+/*
+ * Render thread pipeline depth (frames the game thread may record ahead of the render thread)
+ */
+#define KE_RENDER_THREAD_DEFAULT_DEPTH  1
+#define KE_RENDER_THREAD_MAX_DEPTH      3
+
+
+class IKeThreadedRenderDevice;
+
+/*
+ * Threaded resource wrappers.  These are handed to the game thread as soon as a resource is
+ * requested; real is filled in by the render thread once the creation command executes.
+ * Writes are recorded like any other command, anything that must read the resource back waits
+ * for the render thread to go idle (see IKeThreadedRenderDevice::PVT_AcquireContext).
+ */
+struct IKeThreadedGeometryBuffer : public IKeGeometryBuffer
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(void*) MapData( uint32_t flags );
+    _KEMETHOD(void*) MapDataAsync( uint32_t flags );
+    KEMETHOD UnmapData( void* );
+    KEMETHOD UnmapDataAsync( void* );
+
+    _KEMETHOD(bool) SetVertexData( uint32_t offset, uint32_t size, void* ptr );
+    _KEMETHOD(bool) SetIndexData( uint32_t offset, uint32_t size, void* ptr );
+    _KEMETHOD(bool) CopyVertexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size );
+    _KEMETHOD(bool) CopyIndexData( uint32_t dst_offset, uint32_t src_offset, uint32_t size );
+    KEMETHOD GetDesc( KeGeometryBufferDesc* desc );
+
+    IKeThreadedRenderDevice*    device;
+    IKeGeometryBuffer*          real;
+};
+
+struct IKeThreadedConstantBuffer : public IKeConstantBuffer
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(void*) MapData( uint32_t flags );
+    KEMETHOD UnmapData( void* );
+
+    _KEMETHOD(bool) SetConstantData( uint32_t offset, uint32_t size, void* ptr );
+    KEMETHOD GetDesc( KeConstantBufferDesc* desc );
+
+    IKeThreadedRenderDevice*    device;
+    IKeConstantBuffer*          real;
+    KeConstantBufferDesc        desc;   /* Copy of the creation parameters */
+};
+
+struct IKeThreadedIndirectBuffer : public IKeIndirectBuffer
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(void*) MapData( uint32_t flags );
+    KEMETHOD UnmapData( void* );
+
+    _KEMETHOD(bool) SetCommands( uint32_t first, uint32_t count, KeDrawIndexedIndirectCommand* commands );
+    _KEMETHOD(uint32_t) GetCommandCount();
+
+    IKeThreadedRenderDevice*    device;
+    IKeIndirectBuffer*          real;
+    uint32_t                    command_count;
+};
+
+struct IKeThreadedGpuProgram : public IKeGpuProgram
+{
+    KEMETHOD Destroy();
+	KEMETHOD GetVertexAttributes( KeVertexAttribute* vertex_attributes );
+    _KEMETHOD(bool) IsReady();
+
+    IKeThreadedRenderDevice*        device;
+    IKeGpuProgram*                  real;
+    std::vector<KeVertexAttribute>  va;     /* Including the -1 terminator */
+    int                             ready;  /* Set by the render thread once linked */
+};
+
+struct IKeThreadedTexture : public IKeTexture
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(void*) MapData( uint32_t flags );
+    KEMETHOD UnmapData( void* );
+
+    _KEMETHOD(bool) SetTextureData( KeTextureDesc* texture_data, void* pixels );
+	_KEMETHOD(bool) GetTextureDesc( KeTextureDesc* texture_desc );
+
+    IKeThreadedRenderDevice*    device;
+    IKeTexture*                 real;
+    uint32_t                    format;
+    uint32_t                    texel_size; /* 0 for compressed formats */
+};
+
+struct IKeThreadedRenderTarget : public IKeRenderTarget
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(void*) MapData( uint32_t flags );
+    KEMETHOD UnmapData( void* );
+
+	_KEMETHOD(bool) GetTexture( IKeTexture** texture );
+	virtual IKeTexture* GetTexture2();
+
+    IKeThreadedRenderDevice*    device;
+    IKeRenderTarget*            real;
+    IKeThreadedTexture*         texture;    /* Wraps the render target's own texture */
+};
+
+struct IKeThreadedFence : public IKeFence
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(bool) Insert();
+    _KEMETHOD(bool) Test();
+    KEMETHOD Block();
+    _KEMETHOD(bool) Valid();
+
+    IKeThreadedRenderDevice*    device;
+    IKeFence*                   real;
+    uint32_t                    inserted;   /* Inserts recorded by the game thread */
+    uint32_t                    executed;   /* Last insert executed by the render thread */
+    uint32_t                    signalled;  /* Last insert seen signalled by the render thread */
+};
+
+struct IKeThreadedRenderStateBuffer : public IKeRenderStateBuffer
+{
+    KEMETHOD Destroy();
+
+    IKeThreadedRenderDevice*    device;
+    IKeRenderStateBuffer*       real;
+};
+
+struct IKeThreadedTextureSamplerBuffer : public IKeTextureSamplerBuffer
+{
+    KEMETHOD Destroy();
+
+    IKeThreadedRenderDevice*    device;
+    IKeTextureSamplerBuffer*    real;
+};
+
+struct IKeThreadedOcclusionQuery : public IKeOcclusionQuery
+{
+    KEMETHOD Destroy();
+
+    _KEMETHOD(bool) Begin();
+    KEMETHOD End();
+    _KEMETHOD(bool) GetResult( int wait, uint32_t* samples );
+
+    IKeThreadedRenderDevice*    device;
+    IKeOcclusionQuery*          real;
+    int                         active;
+    uint32_t                    ended;      /* Queries ended by the game thread */
+    uint32_t                    executed;   /* Last query ended by the render thread */
+    uint32_t                    resolved;   /* Query the result below belongs to */
+    uint32_t                    result;
+};
+
+
+/*
+ * Asynchronous readback ticket
+ */
+struct KeThreadedReadback
+{
+    uint32_t    ticket;         /* Ticket handed to the game thread */
+    uint32_t    device_ticket;  /* Ticket from the wrapped device (render thread only) */
+    int         status;         /* KE_READBACK_* */
+    int         bpp;
+    void*       pixels;         /* Owned by the wrapped device until released */
+};
+
+
+/* Threaded render device.  Wraps another render device and moves all of its work onto a
+   render thread that owns the context.  While the render thread executes frame N-1, the game
+   thread records frame N into a command buffer; Swap hands the buffer over and only blocks if
+   the game thread gets more than depth frames ahead.
+   - Resources are created on the render thread; the game thread gets a wrapper right away.
+   - Data passed to recorded calls is copied, so the caller may reuse it immediately.
+   - Fences, occlusion queries, program readiness and framebuffer readbacks are polled without
+     stalling; their results arrive one or more frames later than they would without a render
+     thread.
+   - Mapping, reading back resource descriptions and other calls that need an answer right away
+     wait for the render thread to go idle and borrow the context. */
+class IKeThreadedRenderDevice : public IKeRenderDevice
+{
+public:
+    IKeThreadedRenderDevice( IKeRenderDevice* renderdevice, int pipeline_depth = KE_RENDER_THREAD_DEFAULT_DEPTH );
+    virtual ~IKeThreadedRenderDevice();
+
+public:
+    /* Misc */
+    _KEMETHOD(bool) ConfirmDevice();
+    KEMETHOD GetDeviceDesc( KeRenderDeviceDesc* device_desc );
+    KEMETHOD GetDeviceCaps( KeRenderDeviceCaps* device_caps );
+
+    /* General rendering stuff */
+    KEMETHOD SetClearColourFV( float* colour );
+    KEMETHOD SetClearColourUBV( uint8_t* colour );
+    KEMETHOD SetClearDepth( float depth );
+	KEMETHOD SetClearStencil( uint32_t stencil );
+    KEMETHOD ClearColourBuffer();
+    KEMETHOD ClearDepthBuffer();
+    KEMETHOD ClearStencilBuffer();
+	KEMETHOD Clear( uint32_t buffers );
+	KEMETHOD ClearState();
+    KEMETHOD Swap();
+	_KEMETHOD(bool) ResizeRenderTargetAndDepthStencil( int width, int height );
+
+    KEMETHOD SetIMCacheSize( uint32_t cache_size );
+    _KEMETHOD(bool) CreateGeometryBuffer( void* vertex_data, uint32_t vertex_data_size, void* index_data, uint32_t index_data_size, uint32_t index_data_type, uint32_t flags, KeVertexAttribute* va, IKeGeometryBuffer** geometry_buffer );
+    KEMETHOD DeleteGeometryBuffer( IKeGeometryBuffer* geometry_buffer );
+    KEMETHOD SetGeometryBuffer( IKeGeometryBuffer* geometry_buffer );
+	_KEMETHOD(bool) CreateCommandList( IKeCommandList** command_list );
+	_KEMETHOD(bool) BeginCommandList( IKeCommandList* command_list );
+	_KEMETHOD(bool) EndCommandList( IKeCommandList** command_list, int restore_state );
+	_KEMETHOD(bool) ExecuteCommandList( IKeCommandList* command_list, int restore_state );
+	KEMETHOD RestoreImmediateContext();
+    _KEMETHOD(bool) CreateProgram( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
+    _KEMETHOD(bool) CreateProgramAsync( const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
+    KEMETHOD DeleteProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetFallbackProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetProgramCachePath( const char* path );
+    KEMETHOD GetProgramCacheStats( KeProgramCacheStats* stats );
+    KEMETHOD SetProgram( IKeGpuProgram* gpu_program );
+    KEMETHOD SetProgramConstant1FV( const char* location, int count, float* value );
+    KEMETHOD SetProgramConstant2FV( const char* location, int count, float* value );
+    KEMETHOD SetProgramConstant3FV( const char* location, int count, float* value );
+    KEMETHOD SetProgramConstant4FV( const char* location, int count, float* value );
+    KEMETHOD SetProgramConstant1IV( const char* location, int count, int* value );
+    KEMETHOD SetProgramConstant2IV( const char* location, int count, int* value );
+    KEMETHOD SetProgramConstant3IV( const char* location, int count, int* value );
+    KEMETHOD SetProgramConstant4IV( const char* location, int count, int* value );
+    KEMETHOD GetProgramConstantFV( const char* location, float* value );
+    KEMETHOD GetProgramConstantIV( const char* location, int* value );
+	_KEMETHOD(bool) CreateConstantBuffer( KeConstantBufferDesc* desc, IKeConstantBuffer** constant_buffer, void* data = NULL );
+	KEMETHOD DeleteConstantBuffer( IKeConstantBuffer* constant_buffer );
+	_KEMETHOD(bool) SetConstantBufferData( void* data, IKeConstantBuffer* constant_buffer );
+	KEMETHOD SetConstantBuffer( int slot, int shader_type, IKeConstantBuffer* constant_buffer );
+	_KEMETHOD(bool) SetTransientConstants( int slot, void* data, uint32_t size );
+    _KEMETHOD(bool) CreateTexture1D( uint32_t target, int width, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
+    _KEMETHOD(bool) CreateTexture2D( uint32_t target, int width, int height, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
+    _KEMETHOD(bool) CreateTexture3D( uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels = NULL );
+    _KEMETHOD(bool) CreateCompressedTexture2D( uint32_t target, int width, int height, int mip_count, uint32_t format, void** mip_data, uint32_t* mip_sizes, IKeTexture** texture );
+    KEMETHOD DeleteTexture( IKeTexture* texture );
+    KEMETHOD SetTextureData1D( int offsetx, int width, int miplevel, void* pixels, IKeTexture* texture );
+    KEMETHOD SetTextureData2D( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture );
+    KEMETHOD SetTextureData3D( int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture );
+    _KEMETHOD(bool) SetTextureData2DAsync( int offsetx, int offsety, int width, int height, int miplevel, void* pixels, IKeTexture* texture );
+    KEMETHOD SetTextureMipRange( IKeTexture* texture, int base_level, int max_level );
+    _KEMETHOD(bool) CreateRenderTarget( int width, int height, int depth, uint32_t flags, IKeRenderTarget** rendertarget );
+    KEMETHOD DeleteRenderTarget( IKeRenderTarget* rendertarget );
+    KEMETHOD BindRenderTarget( IKeRenderTarget* rendertarget );
+    KEMETHOD SetTexture( int stage, IKeTexture* texture );
+    _KEMETHOD(bool) CreateRenderStateBuffer( KeState* state_params, int state_count, IKeRenderStateBuffer** state_buffer );
+	_KEMETHOD(bool) CreateTextureSamplerBuffer( KeState* state_params, int state_count, IKeTextureSamplerBuffer** state_buffer );
+    _KEMETHOD(bool) SetRenderStateBuffer( IKeRenderStateBuffer* state_buffer );
+	_KEMETHOD(bool) SetTextureSamplerBuffer( int stage, IKeTextureSamplerBuffer* state_buffer );
+    KEMETHOD SetRenderStates( KeState* states );
+    KEMETHOD SetSamplerStates( int stage, KeState* states );
+    KEMETHOD DrawVerticesIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int first, int count, void* vertex_data );
+    KEMETHOD DrawIndexedVerticesIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int count, void* vertex_data, void* index_data );
+    KEMETHOD DrawIndexedVerticesRangeIM( uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int start, int end, int count, void* vertex_data, void* index_data );
+    KEMETHOD DrawVertices( uint32_t primtype, uint32_t stride, int first, int count );
+    KEMETHOD DrawIndexedVertices( uint32_t primtype, uint32_t stride, int count );
+    KEMETHOD DrawIndexedVerticesRange( uint32_t primtype, uint32_t stride, int start, int end, int count );
+    KEMETHOD DrawIndexedVerticesBaseVertex( uint32_t primtype, uint32_t stride, int first_index, int count, int base_vertex );
+    _KEMETHOD(bool) CreateIndirectBuffer( KeDrawIndexedIndirectCommand* commands, uint32_t command_count, uint32_t flags, IKeIndirectBuffer** indirect_buffer );
+    KEMETHOD DeleteIndirectBuffer( IKeIndirectBuffer* indirect_buffer );
+    KEMETHOD DrawIndexedVerticesIndirect( uint32_t primtype, IKeIndirectBuffer* indirect_buffer, uint32_t first, uint32_t count );
+    _KEMETHOD(bool) CreateOcclusionQuery( uint32_t type, IKeOcclusionQuery** query );
+    KEMETHOD BeginConditionalRender( IKeOcclusionQuery* query, int wait );
+    KEMETHOD EndConditionalRender();
+
+    _KEMETHOD(bool) GetFramebufferRegion( int x, int y, int width, int height, uint32_t flags, int* bpp, void** pixels );
+    _KEMETHOD(uint32_t) RequestFramebufferRegion( int x, int y, int width, int height, uint32_t flags );
+    _KEMETHOD(int) ReadFramebufferRegion( uint32_t ticket, int wait, int* bpp, void** pixels );
+    KEMETHOD ReleaseFramebufferRegion( uint32_t ticket );
+
+    /* Matrix/viewport related */
+    KEMETHOD SetViewport( int x, int y, int width, int height );
+    KEMETHOD SetViewportV( int* viewport );
+    KEMETHOD GetViewport( int* x, int* y, int* width, int* height );
+    KEMETHOD GetViewportV( int* viewport );
+    KEMETHOD SetPerspectiveMatrix( float fov, float aspect, float near_z, float far_z );
+    KEMETHOD SetViewMatrix( const nv::matrix4f* view );
+    KEMETHOD SetWorldMatrix( const nv::matrix4f* world );
+    KEMETHOD SetModelviewMatrix( const nv::matrix4f* modelview );
+    KEMETHOD SetProjectionMatrix( const nv::matrix4f* projection );
+    KEMETHOD GetViewMatrix( nv::matrix4f* view );
+    KEMETHOD GetWorldMatrix( nv::matrix4f* world );
+    KEMETHOD GetModelviewMatrix( nv::matrix4f* modelview );
+    KEMETHOD GetProjectionMatrix( nv::matrix4f* projection );
+    _KEMETHOD(bool) SetWorldMatrixBatch( const nv::matrix4f* world, uint32_t count );
+    KEMETHOD SetDrawIndex( uint32_t index );
+
+    /* Synchronization */
+    KEMETHOD BlockUntilVerticalBlank();
+    KEMETHOD SetSwapInterval( int swap_interval );
+    virtual int GetSwapInterval();
+	KEMETHOD BlockUntilIdle();
+	KEMETHOD Kick();
+    _KEMETHOD(bool) CreateFence( IKeFence** fence, uint32_t flags );
+    KEMETHOD SetMaxFrameLatency( int latency );
+    _KEMETHOD(int) GetMaxFrameLatency();
+    _KEMETHOD(uint32_t) GetCompletedFrame();
+    KEMETHOD DestroyDeferred( IKeUnknown* resource );
+    _KEMETHOD(bool) MakeCurrent( int current );
+
+    /* Misc */
+    KEMETHOD GpuMemoryInfo( uint32_t* total_memory, uint32_t* free_memory );
+	KEMETHOD Trim();
+
+public:
+    /* Command recording (also used by the resource wrappers) */
+    void PVT_Command( uint32_t command );
+    void PVT_Put( const void* data, uint32_t size );
+    void PVT_PutData( const void* data, uint32_t size );
+    void PVT_PutString( const char* string );
+    void PVT_Submit();
+    bool PVT_AcquireContext();
+    void PVT_ReleaseContext();
+
+    /* Render thread */
+    void PVT_RenderThread();
+    void PVT_Execute( std::vector<uint8_t>* buffer );
+
+public:
+    KeMutex                             lock;           /* Guards everything shared with the render thread */
+
+protected:
+    void PVT_Drain();
+    bool PVT_CreateProgram( int async, const char* vertex_shader, const char* fragment_shader, const char* geometry_shader, const char* tesselation_shader, KeVertexAttribute* vertex_attributes, IKeGpuProgram** gpu_program );
+    void PVT_SetProgramConstant( uint32_t type, const char* location, int count, void* value, uint32_t size );
+    bool PVT_CreateTexture( int dimensions, uint32_t target, int width, int height, int depth, int mipmaps, uint32_t format, uint32_t data_type, IKeTexture** texture, void* pixels );
+    void PVT_SetTextureData( int type, int offsetx, int offsety, int offsetz, int width, int height, int depth, int miplevel, void* pixels, IKeTexture* texture );
+    void PVT_DrawIM( int type, uint32_t primtype, uint32_t stride, KeVertexAttribute* vertex_attributes, int first, int start, int end, int count, uint32_t vertex_count, void* vertex_data, void* index_data );
+    void PVT_Draw( int type, uint32_t primtype, uint32_t stride, int first, int end, int count, int base_vertex );
+    void PVT_SetMatrix( int type, const nv::matrix4f* m );
+
+protected:
+    IKeRenderDevice*                    device;         /* Wrapped device; owned by the render thread */
+    KeThread*                           thread;
+    pthread_cond_t                      submitted_cond; /* Signalled when a buffer is submitted */
+    pthread_cond_t                      executed_cond;  /* Signalled when a buffer has been executed */
+    std::vector<uint8_t>                buffers[KE_RENDER_THREAD_MAX_DEPTH+1];
+    std::vector<uint8_t>*               recording;      /* Buffer the game thread is recording into */
+    int                                 depth;
+    uint32_t                            submitted;      /* Buffers handed to the render thread */
+    uint32_t                            executed;       /* Buffers the render thread has finished */
+    int                                 quit;
+    int                                 context_acquired;   /* Nesting count while the game thread holds the context */
+    int                                 render_current;     /* Render thread only; Yes while it holds the context */
+    int                                 confirmed;
+    int                                 swap_interval;
+    int                                 max_frame_latency;
+    uint32_t                            completed_frame;
+    std::vector<KeThreadedReadback>     readbacks;
+    uint32_t                            next_ticket;
+};
+
+#endif /* defined(__KeThreadedRenderDevice__) */
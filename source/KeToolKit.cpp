@@ -17,6 +17,18 @@
 /* JoJpeg library for saving JPEGs */
 #include "jo_jpeg.h"
 
+/* Threads for downsampling large images */
+#include "KeThread.h"
+
+/* SIMD intrinsics */
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define KE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KE_NEON
+#include <arm_neon.h>
+#endif
+
 
 
 /*
@@ -207,6 +219,678 @@ void KeImageClose( KeImageData* image )
             delete [] (uint8_t*) image->pixels;
 }
 
+/*
+ * DDS/KTX container definitions
+ */
+#define KE_DDS_MAGIC            0x20534444  /* 'DDS ' */
+#define KE_DDS_FOURCC( a, b, c, d ) ( (uint32_t)(a) | ( (uint32_t)(b) << 8 ) | ( (uint32_t)(c) << 16 ) | ( (uint32_t)(d) << 24 ) )
+
+struct KeDDSPixelFormat
+{
+    uint32_t size, flags, fourcc, rgb_bit_count, r_mask, g_mask, b_mask, a_mask;
+};
+
+struct KeDDSHeader
+{
+    uint32_t size, flags, height, width, pitch_or_linear_size, depth, mip_map_count;
+    uint32_t reserved1[11];
+    KeDDSPixelFormat pixel_format;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct KeDDSHeaderDX10
+{
+    uint32_t dxgi_format, resource_dimension, misc_flag, array_size, misc_flags2;
+};
+
+struct KeKTXHeader
+{
+    uint8_t identifier[12];
+    uint32_t endianness, gl_type, gl_type_size, gl_format, gl_internal_format, gl_base_internal_format;
+    uint32_t pixel_width, pixel_height, pixel_depth, array_elements, faces, mipmap_levels, key_value_data_bytes;
+};
+
+static const uint8_t ktx_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+/* Returns the texture format for the given DDS four character code or DXGI format */
+static uint32_t KeDDSToTextureFormat( uint32_t fourcc, uint32_t dxgi_format )
+{
+    switch( fourcc )
+    {
+        case KE_DDS_FOURCC( 'D', 'X', 'T', '1' ): return KE_TEXTUREFORMAT_BC1;
+        case KE_DDS_FOURCC( 'D', 'X', 'T', '3' ): return KE_TEXTUREFORMAT_BC2;
+        case KE_DDS_FOURCC( 'D', 'X', 'T', '5' ): return KE_TEXTUREFORMAT_BC3;
+        case KE_DDS_FOURCC( 'A', 'T', 'I', '1' ):
+        case KE_DDS_FOURCC( 'B', 'C', '4', 'U' ): return KE_TEXTUREFORMAT_BC4;
+        case KE_DDS_FOURCC( 'A', 'T', 'I', '2' ):
+        case KE_DDS_FOURCC( 'B', 'C', '5', 'U' ): return KE_TEXTUREFORMAT_BC5;
+    }
+    
+    /* DXGI_FORMAT values */
+    switch( dxgi_format )
+    {
+        case 71: case 72: return KE_TEXTUREFORMAT_BC1;
+        case 74: case 75: return KE_TEXTUREFORMAT_BC2;
+        case 77: case 78: return KE_TEXTUREFORMAT_BC3;
+        case 80: return KE_TEXTUREFORMAT_BC4;
+        case 83: return KE_TEXTUREFORMAT_BC5;
+        case 95: return KE_TEXTUREFORMAT_BC6H;
+        case 98: case 99: return KE_TEXTUREFORMAT_BC7;
+    }
+    
+    return -1;
+}
+
+/* Returns the texture format for the given KTX (OpenGL) internal format */
+static uint32_t KeKTXToTextureFormat( uint32_t gl_internal_format )
+{
+    switch( gl_internal_format )
+    {
+        case 0x83F0: case 0x83F1: return KE_TEXTUREFORMAT_BC1;
+        case 0x83F2: return KE_TEXTUREFORMAT_BC2;
+        case 0x83F3: return KE_TEXTUREFORMAT_BC3;
+        case 0x8DBB: return KE_TEXTUREFORMAT_BC4;
+        case 0x8DBD: return KE_TEXTUREFORMAT_BC5;
+        case 0x8E8F: return KE_TEXTUREFORMAT_BC6H;
+        case 0x8E8C: return KE_TEXTUREFORMAT_BC7;
+        case 0x9274: return KE_TEXTUREFORMAT_ETC2_RGB8;
+        case 0x9278: return KE_TEXTUREFORMAT_ETC2_RGBA8;
+        case 0x9270: return KE_TEXTUREFORMAT_EAC_R11;
+        case 0x9272: return KE_TEXTUREFORMAT_EAC_RG11;
+        case 0x93B0: return KE_TEXTUREFORMAT_ASTC_4x4;
+        case 0x93B4: return KE_TEXTUREFORMAT_ASTC_6x6;
+        case 0x93B7: return KE_TEXTUREFORMAT_ASTC_8x8;
+    }
+    
+    return -1;
+}
+
+/* Returns the size in bytes of a single mip level of a block compressed image */
+uint32_t KeCompressedImageSize( uint32_t format, uint32_t width, uint32_t height )
+{
+    uint32_t block_width = 4, block_height = 4, block_size = 16;
+    
+    switch( format )
+    {
+        case KE_TEXTUREFORMAT_BC1:
+        case KE_TEXTUREFORMAT_BC4:
+        case KE_TEXTUREFORMAT_ETC2_RGB8:
+        case KE_TEXTUREFORMAT_EAC_R11:
+            block_size = 8;
+            break;
+            
+        case KE_TEXTUREFORMAT_ASTC_6x6:
+            block_width = block_height = 6;
+            break;
+            
+        case KE_TEXTUREFORMAT_ASTC_8x8:
+            block_width = block_height = 8;
+            break;
+    }
+    
+    return ( ( width + block_width - 1 ) / block_width ) * ( ( height + block_height - 1 ) / block_height ) * block_size;
+}
+
+/*
+ * Name: KeImageIsCompressed
+ * Desc: Returns true if the image file in memory is a DDS or KTX container.
+ */
+bool KeImageIsCompressed( void* image_file_ptr, uint32_t size )
+{
+    if( !image_file_ptr || size < 12 )
+        return false;
+    
+    if( *(uint32_t*) image_file_ptr == KE_DDS_MAGIC )
+        return true;
+    
+    return !memcmp( image_file_ptr, ktx_identifier, 12 );
+}
+
+/*
+ * Name: KeImageReadCompressedFromMemory
+ * Desc: Reads pre-compressed image data from a DDS or KTX file in memory.  The compressed blocks
+ *       are copied as is (no CPU decoding) so they can be handed straight to
+ *       IKeRenderDevice::CreateCompressedTexture2D.
+ * NOTE: Only 2D textures are supported (no cube maps, arrays or volumes).
+ */
+bool KeImageReadCompressedFromMemory( void* image_file_ptr, uint32_t size, KeCompressedImageData* image_out )
+{
+    uint8_t* ptr = (uint8_t*) image_file_ptr;
+    uint8_t* end = ptr + size;
+    uint32_t data_offset = 0;
+    bool ktx = false;
+    
+    ZeroMemory( image_out, sizeof( KeCompressedImageData ) );
+    
+    if( !KeImageIsCompressed( image_file_ptr, size ) )
+    {
+        DISPDBG( KE_ERROR, "Image is not a DDS or KTX file!" );
+        return false;
+    }
+    
+    if( *(uint32_t*) ptr == KE_DDS_MAGIC )
+    {
+        /* DDS: magic, header and (optionally) the DX10 extended header */
+        if( size < sizeof( uint32_t ) + sizeof( KeDDSHeader ) )
+        {
+            DISPDBG( KE_ERROR, "Truncated DDS header!" );
+            return false;
+        }
+        
+        KeDDSHeader* header = (KeDDSHeader*) ( ptr + sizeof( uint32_t ) );
+        uint32_t dxgi_format = 0;
+        data_offset = sizeof( uint32_t ) + sizeof( KeDDSHeader );
+        
+        if( header->pixel_format.fourcc == KE_DDS_FOURCC( 'D', 'X', '1', '0' ) )
+        {
+            if( size < data_offset + sizeof( KeDDSHeaderDX10 ) )
+            {
+                DISPDBG( KE_ERROR, "Truncated DDS header!" );
+                return false;
+            }
+            
+            dxgi_format = ( (KeDDSHeaderDX10*) ( ptr + data_offset ) )->dxgi_format;
+            data_offset += sizeof( KeDDSHeaderDX10 );
+        }
+        
+        image_out->width = header->width;
+        image_out->height = header->height;
+        image_out->mip_count = header->mip_map_count ? header->mip_map_count : 1;
+        image_out->format = KeDDSToTextureFormat( header->pixel_format.fourcc, dxgi_format );
+    }
+    else
+    {
+        /* KTX: header followed by key/value data */
+        if( size < sizeof( KeKTXHeader ) )
+        {
+            DISPDBG( KE_ERROR, "Truncated KTX header!" );
+            return false;
+        }
+        
+        KeKTXHeader* header = (KeKTXHeader*) ptr;
+        
+        if( header->endianness != 0x04030201 )
+        {
+            DISPDBG( KE_ERROR, "KTX files with swapped endianness are not supported!" );
+            return false;
+        }
+        
+        if( header->gl_type != 0 || header->faces > 1 || header->array_elements > 0 || header->pixel_depth > 1 )
+        {
+            DISPDBG( KE_ERROR, "Only compressed 2D KTX textures are supported!" );
+            return false;
+        }
+        
+        image_out->width = header->pixel_width;
+        image_out->height = header->pixel_height;
+        image_out->mip_count = header->mipmap_levels ? header->mipmap_levels : 1;
+        image_out->format = KeKTXToTextureFormat( header->gl_internal_format );
+        data_offset = sizeof( KeKTXHeader ) + header->key_value_data_bytes;
+        ktx = true;
+    }
+    
+    if( image_out->format == (uint32_t) -1 )
+    {
+        DISPDBG( KE_ERROR, "Unsupported compressed image format!" );
+        return false;
+    }
+    
+    if( image_out->mip_count > KE_MAX_IMAGE_MIP_LEVELS )
+        image_out->mip_count = KE_MAX_IMAGE_MIP_LEVELS;
+    
+    /* Copy the compressed blocks and locate each mip level */
+    if( data_offset >= size )
+    {
+        DISPDBG( KE_ERROR, "Image contains no data!" );
+        return false;
+    }
+    
+    image_out->data = new uint8_t[size - data_offset];
+    memmove( image_out->data, ptr + data_offset, size - data_offset );
+    
+    uint8_t* src = ptr + data_offset;
+    uint8_t* dst = (uint8_t*) image_out->data;
+    
+    for( uint32_t i = 0; i < image_out->mip_count; i++ )
+    {
+        uint32_t w = image_out->width >> i;
+        uint32_t h = image_out->height >> i;
+        uint32_t level_size = KeCompressedImageSize( image_out->format, w ? w : 1, h ? h : 1 );
+        
+        /* Each KTX mip level is preceded by its size and padded to 4 bytes */
+        if( ktx )
+        {
+            if( src + sizeof( uint32_t ) > end )
+                break;
+            
+            level_size = *(uint32_t*) src;
+            src += sizeof( uint32_t );
+        }
+        
+        if( src + level_size > end )
+            break;
+        
+        image_out->mip_data[i] = dst + ( src - ( ptr + data_offset ) );
+        image_out->mip_sizes[i] = level_size;
+        
+        src += ktx ? ( ( level_size + 3 ) & ~3 ) : level_size;
+    }
+    
+    /* Make sure that we got all of the mip levels we were promised */
+    for( uint32_t i = 0; i < image_out->mip_count; i++ )
+    {
+        if( !image_out->mip_data[i] )
+        {
+            if( !i )
+            {
+                KeImageCloseCompressed( image_out );
+                DISPDBG( KE_ERROR, "Truncated image data!" );
+                return false;
+            }
+            
+            DISPDBG( KE_WARNING, "Truncated image data; only " << i << " mip level(s) available." );
+            image_out->mip_count = i;
+            break;
+        }
+    }
+    
+    return true;
+}
+
+/*
+ * Name: KeImageCloseCompressed
+ * Desc: Closes a previously opened compressed image.
+ */
+void KeImageCloseCompressed( KeCompressedImageData* image )
+{
+    if( image )
+    {
+        if( image->data )
+            delete [] (uint8_t*) image->data;
+        
+        image->data = NULL;
+    }
+}
+
+/*
+ * Baked mip chain file definitions
+ */
+#define KE_MIP_CHAIN_MAGIC      0x31434D4B  /* 'KMC1' */
+#define KE_MIN_THREADED_PIXELS  (256*256)   /* Destination pixels below which we don't bother with threads */
+#define KE_MAX_DOWNSAMPLE_THREADS 8
+
+struct KeMipChainFileHeader
+{
+    uint32_t magic;
+    uint32_t width, height;
+    uint32_t format;
+    uint32_t components;
+    uint32_t level_count;
+};
+
+/* Work for a single downsampling thread */
+struct KeDownsampleJob
+{
+    const uint8_t* src;
+    uint8_t* dst;
+    int width, height;      /* Source dimensions */
+    int components;
+    int first_row, last_row;/* Destination rows [first_row, last_row) */
+};
+
+/* Downsamples the destination rows of a single job */
+static void KeDownsampleRows( KeDownsampleJob* job )
+{
+    int dst_width = job->width > 1 ? job->width / 2 : 1;
+    int src_pitch = job->width * job->components;
+    int dst_pitch = dst_width * job->components;
+    int c = job->components;
+    
+    for( int y = job->first_row; y < job->last_row; y++ )
+    {
+        /* Clamp to the last row/column for images only one texel tall/wide */
+        const uint8_t* row0 = job->src + ( y * 2 ) * src_pitch;
+        const uint8_t* row1 = ( y * 2 + 1 < job->height ) ? row0 + src_pitch : row0;
+        uint8_t* out = job->dst + y * dst_pitch;
+        int x = 0;
+        
+        if( job->width > 1 && c == 4 )
+        {
+#if defined(KE_SSE2)
+            __m128i zero = _mm_setzero_si128();
+            __m128i two = _mm_set1_epi16( 2 );
+            
+            /* 4 source pixels from each row become 2 destination pixels */
+            for( ; x + 2 <= dst_width; x += 2 )
+            {
+                __m128i a = _mm_loadu_si128( (const __m128i*) ( row0 + x * 8 ) );
+                __m128i b = _mm_loadu_si128( (const __m128i*) ( row1 + x * 8 ) );
+                
+                __m128i lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+                __m128i hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+                
+                lo = _mm_add_epi16( lo, _mm_srli_si128( lo, 8 ) );
+                hi = _mm_add_epi16( hi, _mm_srli_si128( hi, 8 ) );
+                
+                __m128i sum = _mm_srli_epi16( _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ), two ), 2 );
+                _mm_storel_epi64( (__m128i*) ( out + x * 4 ), _mm_packus_epi16( sum, zero ) );
+            }
+#elif defined(KE_NEON)
+            /* 4 source pixels from each row become 2 destination pixels */
+            for( ; x + 2 <= dst_width; x += 2 )
+            {
+                uint8x16_t a = vld1q_u8( row0 + x * 8 );
+                uint8x16_t b = vld1q_u8( row1 + x * 8 );
+                
+                uint16x8_t lo = vaddl_u8( vget_low_u8( a ), vget_low_u8( b ) );
+                uint16x8_t hi = vaddl_u8( vget_high_u8( a ), vget_high_u8( b ) );
+                
+                uint16x4_t p01 = vadd_u16( vget_low_u16( lo ), vget_high_u16( lo ) );
+                uint16x4_t p23 = vadd_u16( vget_low_u16( hi ), vget_high_u16( hi ) );
+                
+                vst1_u8( out + x * 4, vrshrn_n_u16( vcombine_u16( p01, p23 ), 2 ) );
+            }
+#endif
+        }
+        
+        /* Whatever is left (or everything, for images that aren't 4 component) */
+        for( ; x < dst_width; x++ )
+        {
+            int x0 = x * 2 * c;
+            int x1 = ( x * 2 + 1 < job->width ) ? x0 + c : x0;
+            
+            for( int i = 0; i < c; i++ )
+                out[x*c+i] = (uint8_t) ( ( row0[x0+i] + row0[x1+i] + row1[x0+i] + row1[x1+i] + 2 ) >> 2 );
+        }
+    }
+}
+
+/* Downsampling thread entry point */
+#ifdef _WIN32
+static uint32_t __stdcall KeDownsampleThreadProc( void* context )
+#else
+static void KeDownsampleThreadProc( void* context )
+#endif
+{
+    KeDownsampleRows( (KeDownsampleJob*) context );
+    
+#ifdef _WIN32
+    return 0;
+#endif
+}
+
+/*
+ * Name: KeImageFormatComponents
+ * Desc: Returns the number of 8-bit components per pixel for an uncompressed texture format.
+ */
+int KeImageFormatComponents( uint32_t format )
+{
+    switch( format )
+    {
+        case KE_TEXTUREFORMAT_RGBA:
+        case KE_TEXTUREFORMAT_BGRA: return 4;
+        case KE_TEXTUREFORMAT_R8:   return 1;
+        case KE_TEXTUREFORMAT_RGB:
+        case KE_TEXTUREFORMAT_BGR:  return 3;
+    }
+    
+    return 0;
+}
+
+/*
+ * Name: KeImageTexelSize
+ * Desc: Returns the size in bytes of a single texel of an uncompressed texture format stored
+ *       with the given KE_* data type (0 for compressed formats and packed data types).
+ */
+uint32_t KeImageTexelSize( uint32_t format, uint32_t data_type )
+{
+    static const uint32_t data_type_sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 2 };
+    
+    if( data_type >= sizeof( data_type_sizes ) / sizeof( data_type_sizes[0] ) )
+        return 0;
+    
+    return KeImageFormatComponents( format ) * data_type_sizes[data_type];
+}
+
+/*
+ * Name: KeImageCalculateMipLevelCount
+ * Desc: Returns the number of levels in a full mip chain for an image of the given size.
+ */
+int KeImageCalculateMipLevelCount( int width, int height )
+{
+    int levels = 1;
+    
+    while( width > 1 || height > 1 )
+    {
+        width >>= 1;
+        height >>= 1;
+        levels++;
+    }
+    
+    return levels;
+}
+
+/*
+ * Name: KeImageDownsample
+ * Desc: Halves an image with a 2x2 box filter.  The destination must be large enough to hold
+ *       max(1,width/2) x max(1,height/2) pixels.  Images with at least KE_MIN_THREADED_PIXELS
+ *       destination pixels are split into bands of rows, one per thread.
+ */
+void KeImageDownsample( const void* src, int width, int height, int components, void* dst, int thread_count )
+{
+    int dst_width = width > 1 ? width / 2 : 1;
+    int dst_height = height > 1 ? height / 2 : 1;
+    
+    if( thread_count <= 0 )
+        thread_count = ( dst_width * dst_height ) >= KE_MIN_THREADED_PIXELS ? 4 : 1;
+    if( thread_count > KE_MAX_DOWNSAMPLE_THREADS )
+        thread_count = KE_MAX_DOWNSAMPLE_THREADS;
+    if( thread_count > dst_height )
+        thread_count = dst_height;
+    
+    KeDownsampleJob jobs[KE_MAX_DOWNSAMPLE_THREADS];
+    KeThread* threads[KE_MAX_DOWNSAMPLE_THREADS];
+    int rows_per_job = ( dst_height + thread_count - 1 ) / thread_count;
+    
+    for( int i = 0; i < thread_count; i++ )
+    {
+        jobs[i].src = (const uint8_t*) src;
+        jobs[i].dst = (uint8_t*) dst;
+        jobs[i].width = width;
+        jobs[i].height = height;
+        jobs[i].components = components;
+        jobs[i].first_row = i * rows_per_job;
+        jobs[i].last_row = ( i + 1 ) * rows_per_job < dst_height ? ( i + 1 ) * rows_per_job : dst_height;
+    }
+    
+    /* The calling thread takes the first band */
+    for( int i = 1; i < thread_count; i++ )
+        threads[i] = new KeThread( KeDownsampleThreadProc, &jobs[i] );
+    
+    KeDownsampleRows( &jobs[0] );
+    
+    /* Wait for the worker threads to finish (the destructor joins POSIX threads) */
+    for( int i = 1; i < thread_count; i++ )
+    {
+#ifdef _WIN32
+        threads[i]->Wait( INFINITE );
+#endif
+        delete threads[i];
+    }
+}
+
+/* Allocates the storage for a mip chain and locates each level */
+bool KeImageAllocateMipChain( int width, int height, uint32_t format, int level_count, KeImageMipChain* chain_out )
+{
+    ZeroMemory( chain_out, sizeof( KeImageMipChain ) );
+    
+    int components = KeImageFormatComponents( format );
+    if( !components || width < 1 || height < 1 )
+    {
+        DISPDBG( KE_ERROR, "Invalid mip chain format or dimensions!" );
+        return false;
+    }
+    
+    int full_count = KeImageCalculateMipLevelCount( width, height );
+    if( level_count < 0 || level_count > full_count )
+        level_count = full_count;
+    if( level_count > KE_MAX_IMAGE_MIP_LEVELS )
+        level_count = KE_MAX_IMAGE_MIP_LEVELS;
+    if( level_count < 1 )
+        level_count = 1;
+    
+    chain_out->width = width;
+    chain_out->height = height;
+    chain_out->format = format;
+    chain_out->components = components;
+    chain_out->level_count = level_count;
+    
+    /* Calculate the size of each level and the total size */
+    uint32_t total_size = 0;
+    
+    for( int i = 0; i < level_count; i++ )
+    {
+        int w = width >> i;
+        int h = height >> i;
+        
+        chain_out->level_sizes[i] = ( w ? w : 1 ) * ( h ? h : 1 ) * components;
+        total_size += chain_out->level_sizes[i];
+    }
+    
+    chain_out->data = new uint8_t[total_size];
+    
+    uint8_t* ptr = (uint8_t*) chain_out->data;
+    for( int i = 0; i < level_count; i++ )
+    {
+        chain_out->levels[i] = ptr;
+        ptr += chain_out->level_sizes[i];
+    }
+    
+    return true;
+}
+
+/*
+ * Name: KeImageGenerateMipChain
+ * Desc: Generates a mip chain from an 8-bit per component image.  Level 0 is a copy of the
+ *       source image, and each following level is downsampled from the previous one.
+ */
+bool KeImageGenerateMipChain( const void* pixels, int width, int height, uint32_t format, int max_levels, KeImageMipChain* chain_out )
+{
+    if( !pixels )
+        return false;
+    
+    if( !KeImageAllocateMipChain( width, height, format, max_levels, chain_out ) )
+        return false;
+    
+    memmove( chain_out->levels[0], pixels, chain_out->level_sizes[0] );
+    
+    for( uint32_t i = 1; i < chain_out->level_count; i++ )
+    {
+        int w = width >> (i-1);
+        int h = height >> (i-1);
+        
+        KeImageDownsample( chain_out->levels[i-1], w ? w : 1, h ? h : 1, chain_out->components, chain_out->levels[i] );
+    }
+    
+    return true;
+}
+
+/*
+ * Name: KeImageIsMipChain
+ * Desc: Returns true if the file in memory is a baked mip chain (see KeImageSaveMipChain).
+ */
+bool KeImageIsMipChain( void* file_ptr, uint32_t size )
+{
+    if( !file_ptr || size < sizeof( KeMipChainFileHeader ) )
+        return false;
+    
+    return *(uint32_t*) file_ptr == KE_MIP_CHAIN_MAGIC;
+}
+
+/*
+ * Name: KeImageReadMipChainFromMemory
+ * Desc: Reads a baked mip chain from a file in memory.
+ */
+bool KeImageReadMipChainFromMemory( void* file_ptr, uint32_t size, KeImageMipChain* chain_out )
+{
+    if( !KeImageIsMipChain( file_ptr, size ) )
+    {
+        DISPDBG( KE_ERROR, "File is not a baked mip chain!" );
+        return false;
+    }
+    
+    KeMipChainFileHeader* header = (KeMipChainFileHeader*) file_ptr;
+    
+    if( !KeImageAllocateMipChain( header->width, header->height, header->format, header->level_count, chain_out ) )
+        return false;
+    
+    /* Make sure the file actually contains every level */
+    uint32_t total_size = 0;
+    for( uint32_t i = 0; i < chain_out->level_count; i++ )
+        total_size += chain_out->level_sizes[i];
+    
+    if( chain_out->level_count != header->level_count || size < sizeof( KeMipChainFileHeader ) + total_size )
+    {
+        KeImageCloseMipChain( chain_out );
+        DISPDBG( KE_ERROR, "Baked mip chain is truncated or corrupt!" );
+        return false;
+    }
+    
+    memmove( chain_out->data, header+1, total_size );
+    
+    return true;
+}
+
+/*
+ * Name: KeImageSaveMipChain
+ * Desc: Saves a mip chain to disk.  The resulting file can be added to a resource archive,
+ *       where KeResourceArchive::ReadTexture will upload it as is.
+ */
+bool KeImageSaveMipChain( KeImageMipChain* chain, char* path )
+{
+    FILE* file;
+    KeMipChainFileHeader header;
+    
+    if( !chain || !chain->data )
+        return false;
+    
+    if( ( file = fopen( path, "wb" ) ) == NULL )
+    {
+        DISPDBG( KE_WARNING, "Could not open file to save mip chain!" );
+        return false;
+    }
+    
+    header.magic = KE_MIP_CHAIN_MAGIC;
+    header.width = chain->width;
+    header.height = chain->height;
+    header.format = chain->format;
+    header.components = chain->components;
+    header.level_count = chain->level_count;
+    
+    fwrite( &header, sizeof( header ), 1, file );
+    for( uint32_t i = 0; i < chain->level_count; i++ )
+        fwrite( chain->levels[i], chain->level_sizes[i], 1, file );
+    
+    fclose( file );
+    
+    return true;
+}
+
+/*
+ * Name: KeImageCloseMipChain
+ * Desc: Releases a mip chain created by one of the above functions.
+ */
+void KeImageCloseMipChain( KeImageMipChain* chain )
+{
+    if( chain )
+    {
+        if( chain->data )
+            delete [] (uint8_t*) chain->data;
+        
+        chain->data = NULL;
+    }
+}
+
 bool KeImageSavePNG( int width, int height, void* pixels, char* image_path )
 {
     return false;   /* TODO */
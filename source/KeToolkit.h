@@ -21,6 +21,24 @@
 #define KE_TEXTUREFORMAT_RGB	3
 #define KE_TEXTUREFORMAT_BGR	4
 
+/*
+ * Compressed texture formats
+ */
+#define KE_TEXTUREFORMAT_BC1            5   /* DXT1 */
+#define KE_TEXTUREFORMAT_BC2            6   /* DXT3 */
+#define KE_TEXTUREFORMAT_BC3            7   /* DXT5 */
+#define KE_TEXTUREFORMAT_BC4            8   /* RGTC1 */
+#define KE_TEXTUREFORMAT_BC5            9   /* RGTC2 */
+#define KE_TEXTUREFORMAT_BC6H           10  /* BPTC (unsigned float) */
+#define KE_TEXTUREFORMAT_BC7            11  /* BPTC */
+#define KE_TEXTUREFORMAT_ETC2_RGB8      12
+#define KE_TEXTUREFORMAT_ETC2_RGBA8     13
+#define KE_TEXTUREFORMAT_EAC_R11        14
+#define KE_TEXTUREFORMAT_EAC_RG11       15
+#define KE_TEXTUREFORMAT_ASTC_4x4       16
+#define KE_TEXTUREFORMAT_ASTC_6x6       17
+#define KE_TEXTUREFORMAT_ASTC_8x8       18
+
 
 /*
  * Image palette entry (XRGB)
@@ -44,6 +62,39 @@ struct KeImageData
     KePaletteEntry palette[256];
 };
 
+/*
+ * Compressed image data structure (DDS/KTX)
+ */
+#define KE_MAX_IMAGE_MIP_LEVELS 16
+
+struct KeCompressedImageData
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;                                /* KE_TEXTUREFORMAT_BC1, etc. */
+    uint32_t mip_count;
+    
+    void* data;                                     /* Copy of the compressed blocks for all levels */
+    void* mip_data[KE_MAX_IMAGE_MIP_LEVELS];        /* Pointers into the above, one per mip level */
+    uint32_t mip_sizes[KE_MAX_IMAGE_MIP_LEVELS];    /* Size of each mip level in bytes */
+};
+
+/*
+ * Uncompressed mip chain (8-bit per component)
+ */
+struct KeImageMipChain
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;                                /* KE_TEXTUREFORMAT_RGBA, etc. */
+    uint32_t components;                            /* Bytes per pixel */
+    uint32_t level_count;
+    
+    void* data;                                     /* Pixels for all levels */
+    void* levels[KE_MAX_IMAGE_MIP_LEVELS];          /* Pointers into the above, one per mip level */
+    uint32_t level_sizes[KE_MAX_IMAGE_MIP_LEVELS];  /* Size of each mip level in bytes */
+};
+
 /*
  * Sound data structure
  */
@@ -86,6 +137,89 @@ bool KeImageReadFromMemory( void* image_file_ptr, uint32_t size, KeImageData* im
  */
 void KeImageClose( KeImageData* image );
 
+/*
+ * Name: KeImageIsCompressed
+ * Desc: Returns true if the image file in memory is a DDS or KTX container.
+ */
+bool KeImageIsCompressed( void* image_file_ptr, uint32_t size );
+
+/*
+ * Name: KeImageReadCompressedFromMemory
+ * Desc: Reads pre-compressed image data from a DDS or KTX file in memory without decoding it.
+ */
+bool KeImageReadCompressedFromMemory( void* image_file_ptr, uint32_t size, KeCompressedImageData* image_out );
+
+/*
+ * Name: KeImageCloseCompressed
+ * Desc: Closes a previously opened compressed image.
+ */
+void KeImageCloseCompressed( KeCompressedImageData* image );
+
+/*
+ * Name: KeImageFormatComponents
+ * Desc: Returns the number of 8-bit components per pixel for an uncompressed texture format.
+ */
+int KeImageFormatComponents( uint32_t format );
+
+/*
+ * Name: KeImageTexelSize
+ * Desc: Returns the size in bytes of a single texel of an uncompressed texture format stored
+ *       with the given KE_* data type (0 for compressed formats and packed data types).
+ */
+uint32_t KeImageTexelSize( uint32_t format, uint32_t data_type );
+
+/*
+ * Name: KeCompressedImageSize
+ * Desc: Returns the size in bytes of a single mip level of a block compressed image.
+ */
+uint32_t KeCompressedImageSize( uint32_t format, uint32_t width, uint32_t height );
+
+/*
+ * Name: KeImageCalculateMipLevelCount
+ * Desc: Returns the number of levels in a full mip chain for an image of the given size.
+ */
+int KeImageCalculateMipLevelCount( int width, int height );
+
+/*
+ * Name: KeImageDownsample
+ * Desc: Halves an image with a 2x2 box filter (SSE2/NEON accelerated for 4 component images).
+ *       Large images are split across several threads; pass 0 for thread_count to use a
+ *       default, or 1 to stay on the calling thread.
+ */
+void KeImageDownsample( const void* src, int width, int height, int components, void* dst, int thread_count = 0 );
+
+/*
+ * Name: KeImageGenerateMipChain
+ * Desc: Generates a mip chain from an 8-bit per component image.  Pass -1 for max_levels to
+ *       generate the full chain.
+ */
+bool KeImageGenerateMipChain( const void* pixels, int width, int height, uint32_t format, int max_levels, KeImageMipChain* chain_out );
+
+/*
+ * Name: KeImageIsMipChain
+ * Desc: Returns true if the file in memory is a baked mip chain (see KeImageSaveMipChain).
+ */
+bool KeImageIsMipChain( void* file_ptr, uint32_t size );
+
+/*
+ * Name: KeImageReadMipChainFromMemory
+ * Desc: Reads a baked mip chain from a file in memory.
+ */
+bool KeImageReadMipChainFromMemory( void* file_ptr, uint32_t size, KeImageMipChain* chain_out );
+
+/*
+ * Name: KeImageSaveMipChain
+ * Desc: Saves a mip chain to disk so that it can be stored in a resource archive and loaded
+ *       later without decoding or downsampling.
+ */
+bool KeImageSaveMipChain( KeImageMipChain* chain, char* path );
+
+/*
+ * Name: KeImageCloseMipChain
+ * Desc: Releases a mip chain created by one of the above functions.
+ */
+void KeImageCloseMipChain( KeImageMipChain* chain );
+
 /*
  * Name: KeImageSavePNG
  * Desc: Saves a pixel buffer as a .png file
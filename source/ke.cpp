@@ -199,6 +199,8 @@ bool KeInitializeEx( std::string settings_file, IKeRenderDevice** rd, IKeAudioDe
 						rddesc.buffer_count = atoi( valueval.c_str() );
 					else if( keyval == "RefreshRate" )
 						rddesc.refresh_rate = atoi( valueval.c_str() );
+					else if( keyval == "RenderThreadDepth" )
+						rddesc.render_thread_depth = atoi( valueval.c_str() );
 					else if( keyval == "DeviceType" )
 					{
 						if( valueval == "OpenGL3" )		rddesc.device_type = KE_RENDERDEVICE_OGL3;